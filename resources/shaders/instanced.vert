@@ -0,0 +1,39 @@
+#version 330 core
+
+// shader.vert with the model matrix and a tint read per instance, so one
+// draw call places every copy of a mesh.
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in vec3 color;
+layout (location = 3) in vec2 aTexCoords;
+
+layout (location = 6) in mat4 instanceTransform;
+layout (location = 10) in vec4 instanceTint;
+
+// meshes store positions relative to their bounds
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+layout (std140) uniform Frame {
+    mat4 projection;
+    mat4 view;
+    vec4 camera;
+};
+
+out vec4 fPosition;
+out vec4 fColor;
+out vec4 fLightPosition;
+out vec3 fNormal;
+
+void main(void)
+{
+    vec3 decoded = positionOffset + position * positionScale;
+    fPosition = view * instanceTransform * vec4(decoded,1.0);
+    fLightPosition = view * vec4(0.0,0.0,1.0,0.0);
+    fNormal = vec3(view * instanceTransform * vec4(normal,0.0));
+
+    fColor = vec4(color * instanceTint.rgb, 0.0);
+
+    gl_Position = projection * fPosition;
+}
@@ -5,7 +5,12 @@ in vec4 fColor;
 in vec4 fLightPosition;
 in vec3 fNormal;
 
-uniform vec3 camera;
+// the same per-frame block as the vertex shaders
+layout (std140) uniform Frame {
+    mat4 projection;
+    mat4 view;
+    vec4 camera;
+};
 
 // output
 out vec4 color;
@@ -27,7 +32,7 @@ void main(void)
 
     // Specular
     float specularStrength = 1.0;
-    vec3 viewDir = normalize(camera - fPosition.xyz);
+    vec3 viewDir = normalize(camera.xyz - fPosition.xyz);
 
     vec3 reflectDir = reflect(-lightDir, norm);
 
@@ -5,9 +5,18 @@ layout (location = 1) in vec3 normal;
 layout (location = 2) in vec3 color;
 layout (location = 3) in vec2 aTexCoords;
 
+// meshes store positions relative to their bounds, terrain passes 0 and 1
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
 uniform mat4 model;
-uniform mat4 projection;
-uniform mat4 view;
+
+// written once per frame, shared by every program
+layout (std140) uniform Frame {
+    mat4 projection;
+    mat4 view;
+    vec4 camera;
+};
 
 out vec4 fPosition;
 out vec4 fColor;
@@ -16,11 +25,12 @@ out vec3 fNormal;
 
 void main(void)
 {
-    fPosition = view * vec4(position,1.0);
+    vec3 decoded = positionOffset + position * positionScale;
+    fPosition = view * model * vec4(decoded,1.0);
     fLightPosition = view * vec4(0.0,0.0,1.0,0.0);
-    fNormal = vec3(view * vec4(normal,0.0));
+    fNormal = vec3(view * model * vec4(normal,0.0));
 
     fColor = vec4(color, 0.0);
     
-    gl_Position = projection * fPosition * model;
+    gl_Position = projection * fPosition;
 }
@@ -0,0 +1,91 @@
+#version 330 core
+
+// CDLOD terrain: a unit grid placed per quadtree node and displaced by the
+// heightmap. Vertices morph to the next coarser level near the end of the
+// node's LOD range so level switches do not pop.
+
+layout (location = 0) in vec2 gridPosition;
+
+// per-frame data, camera.w is unused
+layout (std140) uniform Frame {
+    mat4 projection;
+    mat4 view;
+    vec4 camera;
+};
+
+uniform sampler2D heightmap;
+uniform float gridDimension;
+uniform vec2 terrainOrigin;
+uniform float spacing;
+uniform float heightScale;
+
+uniform vec2 nodeOffset;
+uniform float nodeSize;
+uniform vec2 morphRange;
+
+out vec4 fPosition;
+out vec4 fColor;
+out vec4 fLightPosition;
+out vec3 fNormal;
+
+const vec4 lowColor = vec4(0.25, 0.45, 0.2, 1.0);
+const vec4 highColor = vec4(0.9, 0.9, 0.95, 1.0);
+
+// Bilinear so partially morphed vertices move smoothly between samples.
+float sampleHeight(vec2 cell)
+{
+    ivec2 size = textureSize(heightmap, 0);
+    vec2 base = floor(cell);
+    vec2 f = cell - base;
+    ivec2 t0 = clamp(ivec2(base), ivec2(0), size - 1);
+    ivec2 t1 = clamp(ivec2(base) + 1, ivec2(0), size - 1);
+    float h00 = texelFetch(heightmap, t0, 0).r;
+    float h10 = texelFetch(heightmap, ivec2(t1.x, t0.y), 0).r;
+    float h01 = texelFetch(heightmap, ivec2(t0.x, t1.y), 0).r;
+    float h11 = texelFetch(heightmap, t1, 0).r;
+    return mix(mix(h00, h10, f.x), mix(h01, h11, f.x), f.y);
+}
+
+vec3 worldPosition(vec2 cell)
+{
+    return vec3(terrainOrigin.x + cell.x * spacing,
+                sampleHeight(cell) * heightScale,
+                terrainOrigin.y + cell.y * spacing);
+}
+
+// Moves odd grid vertices onto the edge of the coarser level's cell.
+vec2 morphVertex(vec2 grid, vec2 cell, float morph)
+{
+    vec2 index = floor(grid * gridDimension + 0.5);
+    vec2 fracPart = mod(index, 2.0) / gridDimension;
+    return cell - fracPart * nodeSize * morph;
+}
+
+void main(void)
+{
+    vec2 cell = nodeOffset + gridPosition * nodeSize;
+
+    float dist = distance(camera.xyz, worldPosition(cell));
+    float morph = clamp((dist - morphRange.x) / (morphRange.y - morphRange.x),
+                        0.0, 1.0);
+    cell = morphVertex(gridPosition, cell, morph);
+
+    vec3 position = worldPosition(cell);
+
+    // central differences at the resolution of this node
+    float step = nodeSize / gridDimension;
+    float dx = (sampleHeight(cell + vec2(step, 0.0)) -
+                sampleHeight(cell - vec2(step, 0.0))) * heightScale;
+    float dz = (sampleHeight(cell + vec2(0.0, step)) -
+                sampleHeight(cell - vec2(0.0, step))) * heightScale;
+    vec3 normal = normalize(vec3(-dx, 2.0 * step * spacing, -dz));
+
+    float t = clamp(sampleHeight(cell) + 0.5, 0.0, 1.0);
+
+    fPosition = view * vec4(position, 1.0);
+    fLightPosition = view * vec4(0.0, 0.0, 1.0, 0.0);
+    fNormal = vec3(view * vec4(normal, 0.0));
+    fColor = mix(lowColor, highColor, t);
+
+    gl_Position = projection * fPosition;
+}
@@ -0,0 +1,30 @@
+#version 330 core
+
+// Water surface: tiles written in world space on the CPU, the alpha of the
+// color is the opacity.
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in vec4 color;
+
+// per-frame data, camera.w is unused
+layout (std140) uniform Frame {
+    mat4 projection;
+    mat4 view;
+    vec4 camera;
+};
+
+out vec4 fPosition;
+out vec4 fColor;
+out vec4 fLightPosition;
+out vec3 fNormal;
+
+void main(void)
+{
+    fPosition = view * vec4(position, 1.0);
+    fLightPosition = view * vec4(0.0, 0.0, 1.0, 0.0);
+    fNormal = vec3(view * vec4(normal, 0.0));
+    fColor = color;
+
+    gl_Position = projection * fPosition;
+}
@@ -41,3 +41,4 @@ const std::string Asset::RESOURCE_DIR = getExecutablePath() +  "/resources";
 const std::string Asset::SHADERS_DIR = Asset::RESOURCE_DIR + "/shaders";
 const std::string Asset::MODELS_DIR = Asset::RESOURCE_DIR + "/models";
 const std::string Asset::CONFIG_PATH = Asset::RESOURCE_DIR + "/config/config.json";
+const std::string Asset::CACHE_DIR = getExecutablePath() + "/cache";
\ No newline at end of file
@@ -1,51 +1,306 @@
-
 #include <ConfigReader.hpp>
 
+#include <chrono>
 #include <fstream>
+#include <sstream>
+#include <stdexcept>
 #include <nlohmann/json.hpp>
 
+#include <Logger.hpp>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
 using json = nlohmann::json;
 
 using namespace config;
 
-void CheckKey(json& data, std::string key) {
-  if (!data.contains(key)) {
-    throw new std::runtime_error{"The key does not exist: " + key};
+namespace {
+
+std::string ReadFile(const std::filesystem::path& path) {
+  std::ifstream f(path.string(), std::ios::binary);
+  if (!f) {
+    throw std::runtime_error{"Could not open the config file: " +
+                             path.string()};
+  }
+  std::stringstream contents;
+  contents << f.rdbuf();
+  return contents.str();
+}
+
+ConfigValue Convert(const json& value) {
+  if (value.is_boolean()) {
+    return value.get<bool>();
+  }
+  if (value.is_number_integer()) {
+    return value.get<int64_t>();
+  }
+  if (value.is_number()) {
+    return value.get<double>();
+  }
+  if (value.is_string()) {
+    return value.get<std::string>();
+  }
+  if (value.is_array()) {
+    std::vector<std::string> list;
+    for (auto& item : value) {
+      list.push_back(item.is_string() ? item.get<std::string>() : item.dump());
+    }
+    return list;
+  }
+  // objects and null are kept in their serialized form
+  return value.dump();
+}
+
+const char* TypeName(const ConfigValue& value) {
+  switch (value.index()) {
+    case 0:
+      return "boolean";
+    case 1:
+      return "integer";
+    case 2:
+      return "real";
+    case 3:
+      return "string";
+    default:
+      return "list";
+  }
+}
+
+template <typename T>
+const T& As(const ConfigValue& value, const std::string& key) {
+  const T* result = std::get_if<T>(&value);
+  if (!result) {
+    throw std::runtime_error{"The key " + key + " holds a " +
+                             TypeName(value) + " value"};
+  }
+  return *result;
+}
+}  // namespace
+
+ConfigSnapshot::ConfigSnapshot(const std::string& document, uint64_t version)
+    : version{version} {
+  json data = json::parse(document);
+  if (!data.is_object()) {
+    throw std::runtime_error{"The config document is not an object"};
+  }
+
+  for (auto it = data.begin(); it != data.end(); ++it) {
+    values.emplace(it.key(), Convert(it.value()));
+  }
+}
+
+const ConfigValue& ConfigSnapshot::Find(const std::string& key) const {
+  auto it = values.find(key);
+  if (it == values.end()) {
+    throw std::runtime_error{"The key does not exist: " + key};
   }
+  return it->second;
+}
+
+bool ConfigSnapshot::ContainsKey(const std::string& key) const {
+  return values.count(key) != 0;
 }
 
-ConfigReader::ConfigReader(std::filesystem::path path) : _path{path} {}
+bool ConfigSnapshot::Changed(const ConfigSnapshot& other,
+                             const std::string& key) const {
+  auto mine = values.find(key);
+  auto theirs = other.values.find(key);
+  if (mine == values.end() || theirs == other.values.end()) {
+    return (mine == values.end()) != (theirs == other.values.end());
+  }
+  return mine->second != theirs->second;
+}
+
+std::string ConfigSnapshot::ReadString(const std::string& key) const {
+  return As<std::string>(Find(key), key);
+}
+
+std::vector<std::string> ConfigSnapshot::ReadStringList(
+    const std::string& key) const {
+  return As<std::vector<std::string>>(Find(key), key);
+}
+
+int ConfigSnapshot::ReadInt(const std::string& key) const {
+  return static_cast<int>(As<int64_t>(Find(key), key));
+}
+
+bool ConfigSnapshot::ReadBool(const std::string& key) const {
+  return As<bool>(Find(key), key);
+}
+
+double ConfigSnapshot::ReadReal(const std::string& key) const {
+  const ConfigValue& value = Find(key);
+  // whole numbers are written without a fraction in JSON
+  if (auto integer = std::get_if<int64_t>(&value)) {
+    return static_cast<double>(*integer);
+  }
+  return As<double>(value, key);
+}
+
+ConfigReader::ConfigReader(std::filesystem::path path)
+    : _path{path},
+      document{ReadFile(path)} {
+  snapshot = std::make_shared<const ConfigSnapshot>(document, 0);
+}
+
+ConfigReader::~ConfigReader() {
+  StopWatching();
+}
+
+std::shared_ptr<const ConfigSnapshot> ConfigReader::Snapshot() const {
+  return std::atomic_load(&snapshot);
+}
+
+bool ConfigReader::Reload() {
+  std::lock_guard<std::mutex> lock(reloadMutex);
+
+  std::shared_ptr<const ConfigSnapshot> next;
+  std::string contents;
+  try {
+    contents = ReadFile(_path);
+    if (contents == document) {
+      return false;
+    }
+    next = std::make_shared<const ConfigSnapshot>(contents,
+                                                  Snapshot()->Version() + 1);
+  } catch (const std::exception& e) {
+    logging::Logger::LogError("Keeping the previous config, " +
+                              std::string(e.what()));
+    return false;
+  }
+
+  document = std::move(contents);
+  auto previous = Snapshot();
+  std::atomic_store(&snapshot, next);
+  LOG_INFO("Config reloaded from " + _path.string() + ", version " +
+           std::to_string(next->Version()));
+
+  std::vector<ConfigSubscriber> callbacks;
+  {
+    std::lock_guard<std::mutex> subscriberLock(subscriberMutex);
+    for (auto& entry : subscribers) {
+      callbacks.push_back(entry.second);
+    }
+  }
+  for (auto& callback : callbacks) {
+    callback(previous, next);
+  }
+  return true;
+}
+
+void ConfigReader::StartWatching() {
+  if (watching.exchange(true)) {
+    return;
+  }
+  watcher = std::thread([this]() { Watch(); });
+}
+
+void ConfigReader::StopWatching() {
+  if (!watching.exchange(false)) {
+    return;
+  }
+  watcher.join();
+}
+
+void ConfigReader::Watch() {
+  // how long a burst of writes may take, editors often save in several steps
+  const auto settle = std::chrono::milliseconds(50);
+
+#if defined(__linux__)
+  // watch the directory, editors commonly replace the file through a rename
+  const std::filesystem::path directory =
+      _path.has_parent_path() ? _path.parent_path() : ".";
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0 ||
+      inotify_add_watch(fd, directory.string().c_str(),
+                        IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+    logging::Logger::LogError("Could not watch the config file " +
+                              _path.string());
+    if (fd >= 0) {
+      close(fd);
+    }
+    return;
+  }
+
+  const std::string fileName = _path.filename().string();
+  alignas(inotify_event) char buffer[4096];
+  while (watching) {
+    pollfd request{fd, POLLIN, 0};
+    if (poll(&request, 1, 200) <= 0) {
+      continue;
+    }
+
+    bool changed = false;
+    ssize_t length;
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+      for (ssize_t offset = 0; offset < length;) {
+        auto event = reinterpret_cast<const inotify_event*>(buffer + offset);
+        if (event->len && fileName == event->name) {
+          changed = true;
+        }
+        offset += sizeof(inotify_event) + event->len;
+      }
+    }
+
+    if (changed) {
+      std::this_thread::sleep_for(settle);
+      while (read(fd, buffer, sizeof(buffer)) > 0) {
+      }
+      Reload();
+    }
+  }
+  close(fd);
+#else
+  std::error_code error;
+  auto lastWrite = std::filesystem::last_write_time(_path, error);
+  while (watching) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    auto write = std::filesystem::last_write_time(_path, error);
+    if (!error && write != lastWrite) {
+      lastWrite = write;
+      std::this_thread::sleep_for(settle);
+      Reload();
+    }
+  }
+#endif
+}
+
+int ConfigReader::Subscribe(ConfigSubscriber subscriber) {
+  std::lock_guard<std::mutex> lock(subscriberMutex);
+  int id = nextSubscriber++;
+  subscribers.emplace(id, std::move(subscriber));
+  return id;
+}
+
+void ConfigReader::Unsubscribe(int id) {
+  std::lock_guard<std::mutex> lock(subscriberMutex);
+  subscribers.erase(id);
+}
 
 std::string ConfigReader::ReadString(std::string key) {
-  std::ifstream f(this->_path.string());
-  json data = json::parse(f);
-  CheckKey(data, key);
-  return data[key];
+  return Snapshot()->ReadString(key);
+}
+
+std::vector<std::string> ConfigReader::ReadStringList(std::string key) {
+  return Snapshot()->ReadStringList(key);
 }
 
 int ConfigReader::ReadInt(std::string key) {
-  std::ifstream f(this->_path.string());
-  json data = json::parse(f);
-  CheckKey(data, key);
-  return data[key];
+  return Snapshot()->ReadInt(key);
 }
 
 bool ConfigReader::ReadBool(std::string key) {
-  std::ifstream f(this->_path.string());
-  json data = json::parse(f);
-  CheckKey(data, key);
-  return data[key];
+  return Snapshot()->ReadBool(key);
 }
 
 double ConfigReader::ReadReal(std::string key) {
-  std::ifstream f(this->_path.string());
-  json data = json::parse(f);
-  CheckKey(data, key);
-  return data[key];
+  return Snapshot()->ReadReal(key);
 }
 
 bool ConfigReader::ContainsKey(std::string key) {
-  std::ifstream f(this->_path.string());
-  json data = json::parse(f);
-  return data.contains(key);
+  return Snapshot()->ContainsKey(key);
 }
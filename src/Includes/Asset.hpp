@@ -22,5 +22,6 @@ class Asset {
         static const std::string SHADERS_DIR;
         static const std::string MODELS_DIR;
         static const std::string CONFIG_PATH;
+        static const std::string CACHE_DIR;
 };
 } // namespace asset
\ No newline at end of file
@@ -1,5 +1,28 @@
 #pragma once
 
+#include <glm/glm.hpp>
+
+#include <array>
+
 namespace camera {
 
-}
\ No newline at end of file
+/// @brief View frustum as six inward facing planes (a, b, c, d) with
+/// a*x + b*y + c*z + d >= 0 for points inside.
+class Frustum {
+ private:
+  std::array<glm::vec4, 6> planes;
+
+ public:
+  Frustum() = default;
+
+  /// @brief Extract the planes from a combined projection * view matrix.
+  /// @param viewProjection The matrix, planes end up in world space.
+  explicit Frustum(const glm::mat4& viewProjection);
+
+  const std::array<glm::vec4, 6>& Planes() const { return this->planes; }
+
+  /// @brief Test an axis aligned box against the frustum.
+  /// @return False only if the box is entirely outside one plane.
+  bool IntersectsAabb(const glm::vec3& min, const glm::vec3& max) const;
+};
+}  // namespace camera
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <Camera.hpp>
+#include <Heightfield.hpp>
+#include <Shader.hpp>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace terrain {
+
+struct CdlodSettings {
+  // Grid cells along each side of a node, shared by every LOD level.
+  int leafSize = 32;
+
+  // Number of LOD levels, the root covers leafSize << (lodCount - 1) cells.
+  int lodCount = 6;
+
+  // Screen-space size in pixels a grid cell may reach before the next finer
+  // level is selected.
+  float maxScreenSpaceError = 8.0f;
+
+  // Fraction of a level's range where morphing towards the coarser level
+  // starts.
+  float morphStartRatio = 0.66f;
+};
+
+struct CdlodSelectedNode {
+  // Node origin and size in heightfield cells.
+  int x;
+  int z;
+  int size;
+  int level;
+
+  // Bit i set when quadrant i (x-major, then z) is drawn at this level. A
+  // full node has all four bits set.
+  uint8_t quadrants;
+};
+
+/// @brief Continuous distance-dependent LOD quadtree over a heightfield.
+///
+/// Each node stores its height bounds. Selection walks the tree from the root
+/// and keeps a node at the coarsest level whose range still contains it, so
+/// the grid cells of every selected node stay under the screen-space error.
+/// Vertices morph towards the next coarser level near the end of each range,
+/// which removes popping when a node switches level.
+class CdlodQuadtree {
+ private:
+  CdlodSettings settings;
+  const Heightfield* field;
+  float originX;
+  float originZ;
+  float spacing;
+  float heightScale;
+
+  // per level, nodes stored row-major as (min, max) height
+  std::vector<std::vector<glm::vec2>> bounds;
+  std::vector<int> nodesPerSide;
+  std::vector<float> ranges;
+
+  bool SelectNode(int x,
+                  int z,
+                  int level,
+                  const glm::vec3& cameraPos,
+                  const camera::Frustum& frustum,
+                  std::vector<CdlodSelectedNode>& selection) const;
+  void NodeBounds(int x,
+                  int z,
+                  int level,
+                  glm::vec3& min,
+                  glm::vec3& max) const;
+
+ public:
+  /// @brief Build the height bounds for every node.
+  /// @param field The heightfield, must outlive the quadtree.
+  /// @param originX World x of sample zero.
+  /// @param originZ World z of sample zero.
+  /// @param spacing World distance between samples.
+  /// @param heightScale Multiplier applied to the stored heights.
+  CdlodQuadtree(const Heightfield& field,
+                float originX,
+                float originZ,
+                float spacing,
+                float heightScale,
+                CdlodSettings settings = {});
+
+  const CdlodSettings& Settings() const { return this->settings; }
+
+  /// @brief Recompute the LOD ranges from the projection.
+  /// @param fovRadians Vertical field of view.
+  /// @param viewportHeight Viewport height in pixels.
+  /// @param zfar Far plane, the coarsest level always reaches it.
+  void UpdateRanges(float fovRadians, float viewportHeight, float zfar);
+
+  /// @brief World distance at which a level hands over to the next one.
+  float Range(int level) const { return ranges[level]; }
+  float MorphStart(int level) const {
+    return ranges[level] * settings.morphStartRatio;
+  }
+
+  /// @brief Select the nodes to draw this frame.
+  /// @param cameraPos The camera position.
+  /// @param frustum Nodes fully outside are skipped.
+  /// @param selection Output, cleared first.
+  void Select(const glm::vec3& cameraPos,
+              const camera::Frustum& frustum,
+              std::vector<CdlodSelectedNode>& selection) const;
+
+  /// @brief Triangles needed to draw a selection.
+  size_t TriangleCount(const std::vector<CdlodSelectedNode>& selection) const;
+};
+
+/// @brief GPU side of CDLOD: one small grid mesh with shared index ranges for
+/// a full node and each quadrant, and the heightfield as a float texture the
+/// vertex shader displaces the grid with.
+class CdlodRenderer {
+ private:
+  int gridSize;
+  GLuint vao = 0;
+  GLuint vbo = 0;
+  GLuint ibo = 0;
+  GLuint heightmap = 0;
+
+  // index ranges: full node, then one per quadrant
+  GLsizei fullCount = 0;
+  GLsizei quadrantCount = 0;
+
+ public:
+  CdlodRenderer(const Heightfield& field, int gridSize);
+  ~CdlodRenderer();
+
+  CdlodRenderer(const CdlodRenderer&) = delete;
+  CdlodRenderer& operator=(const CdlodRenderer&) = delete;
+
+  /// @brief Draw a selection. The program must already be in use with the
+  /// camera uniforms set.
+  void Draw(ShaderProgram& shader,
+            const CdlodQuadtree& tree,
+            const std::vector<CdlodSelectedNode>& selection,
+            float originX,
+            float originZ,
+            float spacing,
+            float heightScale) const;
+};
+
+struct CdlodFrameReport {
+  size_t nodes;
+  size_t triangles;
+};
+
+/// @brief Reproducible CPU-only selection over a fixed camera path.
+/// @param tree The quadtree, ranges already updated.
+/// @param positions Camera position per frame.
+/// @param fronts Camera direction per frame.
+/// @param fovRadians Vertical field of view.
+/// @param aspect Viewport aspect ratio.
+/// @param znear Near plane.
+/// @param zfar Far plane.
+/// @return Node and triangle count for each frame.
+std::vector<CdlodFrameReport> TraceCameraPath(
+    const CdlodQuadtree& tree,
+    const std::vector<glm::vec3>& positions,
+    const std::vector<glm::vec3>& fronts,
+    float fovRadians,
+    float aspect,
+    float znear,
+    float zfar);
+
+/// @brief Select over a generated field along a fly-over, with and without
+/// culling, for several level counts. Checks that the drawn quadrants cover
+/// every cell in range exactly once, that neighbouring cells differ by at
+/// most one level, and that the triangles of each level match the area it
+/// covers.
+/// @return True when every frame passed.
+bool CheckLod();
+}  // namespace terrain
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <Logger.hpp>
+
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace checks {
+
+/// @brief Collects the outcome of a headless --check-* run. Every failed
+/// expectation is logged as an error with the name of the check, and the
+/// run keeps going so one pass reports all of them. Safe to share between
+/// threads.
+class Checker {
+ private:
+  std::string name;
+  mutable std::mutex mutex;
+  bool passed = true;
+
+ public:
+  /// @param name Starts every failure message, e.g. "Registry".
+  explicit Checker(std::string name) : name{std::move(name)} {}
+
+  void Expect(bool condition, const std::string& what) {
+    if (!condition) {
+      std::lock_guard<std::mutex> lock(mutex);
+      logging::Logger::LogError(name + " check failed: " + what);
+      passed = false;
+    }
+  }
+
+  bool Passed() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return passed;
+  }
+};
+}  // namespace checks
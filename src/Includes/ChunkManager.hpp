@@ -0,0 +1,181 @@
+#pragma once
+
+#include <Culling.hpp>
+#include <Heightfield.hpp>
+#include <JobSystem.hpp>
+#include <Noise.hpp>
+#include <TerrainMesh.hpp>
+#include <TileStore.hpp>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace terrain {
+
+struct ChunkCoord {
+  int x;
+  int z;
+
+  bool operator==(const ChunkCoord& other) const {
+    return x == other.x && z == other.z;
+  }
+  bool operator!=(const ChunkCoord& other) const { return !(*this == other); }
+};
+
+struct ChunkCoordHash {
+  size_t operator()(const ChunkCoord& coord) const {
+    return std::hash<int64_t>{}((static_cast<int64_t>(coord.x) << 32) ^
+                                static_cast<uint32_t>(coord.z));
+  }
+};
+
+struct ChunkSettings {
+  // Vertices along each side of a chunk, neighbours share their edge row.
+  int resolution = 129;
+  float spacing = 0.25f;
+  float heightScale = 40.0f;
+
+  // Chunks drawn around the camera, as a Chebyshev radius.
+  int viewRadius = 5;
+
+  // Chunks requested around the predicted camera position.
+  int prefetchRadius = 2;
+
+  // How many frames ahead the camera position is predicted.
+  float prefetchFrames = 120.0f;
+
+  // Resident chunk cap, 0 sizes it from the view radius.
+  size_t maxResident = 0;
+
+  // GL uploads performed per frame, keeps the frame loop from stalling.
+  int maxUploadsPerFrame = 4;
+
+  // Chunk builds running on the job system at once, 0 uses the worker count.
+  unsigned int maxConcurrentBuilds = 0;
+};
+
+struct ChunkStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t prefetches = 0;
+  uint64_t evictions = 0;
+  uint64_t generated = 0;
+  uint64_t loaded = 0;
+  uint64_t cancelled = 0;
+  size_t resident = 0;
+  size_t pending = 0;
+  // chunks within the view radius, and those of them the last Draw kept
+  size_t inRange = 0;
+  size_t visible = 0;
+};
+
+/// @brief Streams terrain chunks around the camera.
+///
+/// Chunks are keyed on integer coordinates derived from the camera position.
+/// Missing chunks are generated and meshed on the job system, and the
+/// frame loop only picks up finished results and uploads a bounded number of
+/// them per frame. Chunks in the direction of travel are prefetched and the
+/// least recently used chunks are evicted once the resident cap is reached.
+/// With a tile store, heights are mapped from disk when present and written
+/// back after generation otherwise.
+class ChunkManager {
+ private:
+  struct Chunk {
+    ChunkCoord coord;
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    uint64_t lastUsedFrame = 0;
+    camera::Aabb bounds;
+  };
+
+  struct ChunkBuild {
+    ChunkCoord coord;
+    std::vector<TerrainVertex> vertices;
+    bool loaded = false;
+  };
+
+  ChunkSettings settings;
+
+  // samples the noise in grid units so chunk edges line up exactly
+  NoiseGenerator noise;
+
+  // generated tiles are written back so revisited chunks skip the noise
+  std::shared_ptr<TileStore> store;
+
+  std::unordered_map<ChunkCoord, Chunk, ChunkCoordHash> resident;
+  ChunkStats stats;
+  ChunkCoord center{0, 0};
+  uint64_t frame = 0;
+
+  // shared by every chunk, all chunks have the same grid topology
+  GLuint ibo = 0;
+  GLsizei indexCount = 0;
+
+  // work waiting for a build job, closest to the focus is built first
+  std::mutex requestMutex;
+  std::vector<ChunkCoord> requests;
+  std::unordered_set<ChunkCoord, ChunkCoordHash> inFlight;
+  ChunkCoord focus{0, 0};
+  std::atomic<bool> stopping{false};
+
+  // finished builds waiting for the GL thread
+  std::mutex completedMutex;
+  std::vector<std::unique_ptr<ChunkBuild>> completed;
+
+  std::vector<jobs::JobHandle> builds;
+
+  // chunks within the view radius, rebuilt when residency or the center
+  // chunk changes
+  camera::BoundingVolumeHierarchy hierarchy;
+  std::vector<ChunkCoord> hierarchyCoords;
+  bool hierarchyDirty = true;
+  std::vector<uint32_t> visible;
+
+  void BuildNext();
+  std::unique_ptr<ChunkBuild> Build(ChunkCoord coord) const;
+  void Upload(ChunkBuild& build);
+  void Evict();
+
+ public:
+  /// @param store Optional tile store, its resolution must be the chunk
+  /// resolution plus a one sample apron on each side.
+  ChunkManager(ChunkSettings settings,
+               NoiseParameters parameters,
+               std::shared_ptr<TileStore> store = nullptr);
+  ~ChunkManager();
+
+  ChunkManager(const ChunkManager&) = delete;
+  ChunkManager& operator=(const ChunkManager&) = delete;
+
+  /// @brief World size of a chunk along each side.
+  float ChunkSize() const;
+
+  /// @brief The chunk containing a world position.
+  ChunkCoord ChunkAt(const glm::vec3& position) const;
+
+  /// @brief Update residency for this frame. Must be called from the GL
+  /// thread, it never waits on the workers.
+  /// @param cameraPos The camera position.
+  /// @param cameraFront The camera direction of travel.
+  /// @param speed Distance the camera moves per frame.
+  void Update(const glm::vec3& cameraPos,
+              const glm::vec3& cameraFront,
+              float speed);
+
+  /// @brief Draw every resident chunk within the view radius.
+  /// @param frustum When set, only chunks intersecting it are drawn.
+  void Draw(const camera::Frustum* frustum = nullptr);
+
+  /// @brief Counters for sizing the resident ring.
+  ChunkStats Stats();
+};
+}  // namespace terrain
@@ -1,20 +1,118 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <variant>
+#include <vector>
 
 namespace config {
+
+using ConfigValue = std::variant<bool,
+                                 int64_t,
+                                 double,
+                                 std::string,
+                                 std::vector<std::string>>;
+
+/// @brief An immutable, fully parsed view of the configuration file. Values
+/// are converted once when the snapshot is built, lookups are a single hash.
+class ConfigSnapshot {
+ private:
+  std::unordered_map<std::string, ConfigValue> values;
+  uint64_t version;
+
+  const ConfigValue& Find(const std::string& key) const;
+
+ public:
+  /// @brief Parse a JSON document.
+  /// @throws std::runtime_error when the document is not a JSON object.
+  ConfigSnapshot(const std::string& document, uint64_t version);
+
+  /// @brief Increases by one every time the file is reloaded.
+  uint64_t Version() const { return this->version; }
+
+  bool ContainsKey(const std::string& key) const;
+
+  /// @brief True when the key was added, removed or changed its value.
+  bool Changed(const ConfigSnapshot& other, const std::string& key) const;
+
+  std::string ReadString(const std::string& key) const;
+  std::vector<std::string> ReadStringList(const std::string& key) const;
+  int ReadInt(const std::string& key) const;
+  bool ReadBool(const std::string& key) const;
+  double ReadReal(const std::string& key) const;
+};
+
+using ConfigSubscriber =
+    std::function<void(std::shared_ptr<const ConfigSnapshot> previous,
+                       std::shared_ptr<const ConfigSnapshot> current)>;
+
 class ConfigReader {
-    private:
-    std::filesystem::path _path;
+ private:
+  std::filesystem::path _path;
+
+  // replaced as a whole, readers keep the snapshot they loaded alive
+  std::shared_ptr<const ConfigSnapshot> snapshot;
+
+  // the text of the current snapshot, a reload with identical text is a no-op
+  std::mutex reloadMutex;
+  std::string document;
+
+  std::mutex subscriberMutex;
+  std::unordered_map<int, ConfigSubscriber> subscribers;
+  int nextSubscriber = 0;
+
+  std::thread watcher;
+  std::atomic<bool> watching{false};
+
+  void Watch();
+
  public:
   /// @brief Loads the config from the file.
   ConfigReader(std::filesystem::path path);
+  ~ConfigReader();
+
+  ConfigReader(const ConfigReader&) = delete;
+  ConfigReader& operator=(const ConfigReader&) = delete;
+
+  /// @brief The current snapshot. Keep it for a consistent view across
+  /// several reads.
+  std::shared_ptr<const ConfigSnapshot> Snapshot() const;
+
+  /// @brief Read the file again and publish a new snapshot if its contents
+  /// changed. Subscribers are called on the calling thread. A document that
+  /// fails to parse is logged and the previous snapshot is kept.
+  /// @return True when a new snapshot was published.
+  bool Reload();
+
+  /// @brief Watch the file and reload it whenever it changes. Uses inotify
+  /// on Linux and polls the modification time elsewhere.
+  void StartWatching();
+  void StopWatching();
+
+  /// @brief Call a function with the previous and the new snapshot after
+  /// every reload. It runs on the reloading thread, which is the watcher
+  /// thread for file changes.
+  /// @return An id for Unsubscribe.
+  int Subscribe(ConfigSubscriber subscriber);
+  void Unsubscribe(int id);
 
   /// @brief Read a string value from config.
   /// @param key The configuration key.
   /// @return The configuration value if exists, exception otherwise.
   std::string ReadString(std::string key);
 
+  /// @brief Read a list of strings from config.
+  /// @param key The configuration key.
+  /// @return The configuration value if exists, exception otherwise.
+  std::vector<std::string> ReadStringList(std::string key);
+
   /// @brief Read an integer value from config.
   /// @param key The configuration key.
   /// @return The configuration value if exists, exception otherwise.
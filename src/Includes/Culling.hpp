@@ -0,0 +1,119 @@
+#pragma once
+
+#include <Camera.hpp>
+
+#include <glm/glm.hpp>
+
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace camera {
+
+/// @brief Axis aligned bounding box. The default box is empty, it contains
+/// nothing and is outside every frustum.
+struct Aabb {
+  glm::vec3 min = glm::vec3(FLT_MAX);
+  glm::vec3 max = glm::vec3(-FLT_MAX);
+
+  void Expand(const glm::vec3& point);
+  void Expand(const Aabb& box);
+
+  bool Empty() const { return min.x > max.x; }
+  glm::vec3 Center() const { return 0.5f * (min + max); }
+
+  /// @brief The box around this one after an affine transform (Arvo).
+  Aabb Transformed(const glm::mat4& transform) const;
+};
+
+/// @brief Bounding volume hierarchy of boxes for frustum culling.
+///
+/// Every node has up to kWidth children stored as structure of arrays, so one
+/// node is tested against a plane with a single 8 wide (AVX2) or two 4 wide
+/// (SSE4.1) instructions per step. Subtrees outside a plane are skipped, and
+/// subtrees inside every plane are accepted without testing their children.
+class BoundingVolumeHierarchy {
+ public:
+  static constexpr int kWidth = 8;
+
+ private:
+  struct alignas(32) Node {
+    float minX[kWidth];
+    float minY[kWidth];
+    float minZ[kWidth];
+    float maxX[kWidth];
+    float maxY[kWidth];
+    float maxZ[kWidth];
+    // index of the child node, -1 for a single object
+    int32_t child[kWidth];
+    // the objects below each child, a range of the ids array
+    uint32_t first[kWidth];
+    uint32_t count[kWidth];
+  };
+
+  std::vector<Node> nodes;
+
+  // object ids ordered so every subtree is contiguous
+  std::vector<uint32_t> ids;
+
+  int32_t BuildNode(const std::vector<Aabb>& boxes,
+                    const std::vector<glm::vec3>& centers,
+                    uint32_t begin,
+                    uint32_t end);
+
+ public:
+  /// @brief Build the hierarchy over a set of boxes, object ids are the
+  /// indices into boxes. Empty boxes are left out.
+  void Build(const std::vector<Aabb>& boxes);
+
+  /// @brief Collect every object whose box intersects the frustum, in no
+  /// particular order. Gives the same set as CullBruteForce.
+  /// @param frustum The view frustum.
+  /// @param visible Output, cleared first.
+  void Cull(const Frustum& frustum, std::vector<uint32_t>& visible) const;
+
+  /// @brief Number of objects in the hierarchy.
+  size_t Size() const { return this->ids.size(); }
+  size_t NodeCount() const { return this->nodes.size(); }
+
+  /// @brief The instruction set the node tests were compiled for.
+  static const char* SimdPath();
+};
+
+/// @brief Reference culling: every box is tested on its own with
+/// Frustum::IntersectsAabb.
+/// @param visible Output in ascending order, cleared first.
+void CullBruteForce(const std::vector<Aabb>& boxes,
+                    const Frustum& frustum,
+                    std::vector<uint32_t>& visible);
+
+/// @brief CPU cost of culling a set of boxes, both ways.
+struct CullingBenchmark {
+  size_t objects = 0;
+  size_t visible = 0;
+  double buildMs = 0.0;
+  double bruteForceMs = 0.0;
+  double hierarchyMs = 0.0;
+  // both ways found the same set of objects
+  bool matches = false;
+};
+
+/// @brief Build a hierarchy over the boxes, then time culling it against
+/// the brute force reference and compare their results.
+/// @param repeats Number of culls timed for each, the average is reported.
+CullingBenchmark BenchmarkCulling(const std::vector<Aabb>& boxes,
+                                  const Frustum& frustum,
+                                  int repeats = 10);
+
+/// @brief Run BenchmarkCulling and log its timings.
+/// @return True when the hierarchy and the reference found the same objects.
+bool ReportCullingBenchmark(const std::vector<Aabb>& boxes,
+                            const Frustum& frustum);
+
+/// @brief Cull up to a million scattered boxes, some flat or empty, against
+/// views from inside, outside and away from them, and log the timings of
+/// each size. Needs no window.
+/// @return True when the hierarchy found the brute force set for every view.
+bool CheckCulling();
+}  // namespace camera
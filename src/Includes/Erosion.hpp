@@ -0,0 +1,104 @@
+#pragma once
+
+#include <Heightfield.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace jobs {
+class JobSystem;
+}
+
+namespace terrain {
+
+struct ErosionSettings {
+  uint32_t seed = 1337;
+  // per field of the same number of samples, tiles simulate their overlap
+  // too so a few more run in total
+  int droplets = 1 << 18;
+  // droplets of a tile never leave it, tiles blend over the overlap
+  int tileSize = 128;
+  int tileOverlap = 16;
+  int maxLifetime = 48;
+  // cells around a droplet that it erodes, in cells
+  int radius = 3;
+  // how much of its direction a droplet keeps instead of following the slope
+  float inertia = 0.05f;
+  float capacity = 4.0f;
+  float minCapacity = 0.01f;
+  float erodeSpeed = 0.3f;
+  float depositSpeed = 0.3f;
+  float evaporateSpeed = 0.02f;
+  float gravity = 4.0f;
+  // the droplets run on heights measured in cells: world height of one
+  // heightfield unit over the sample spacing
+  float verticalScale = 1.0f;
+};
+
+/// @brief Particle based hydraulic erosion.
+///
+/// Droplets are spawned at random, run downhill picking up sediment while
+/// they speed up and dropping it where they slow down or fill up. The field
+/// is split into tiles that are eroded independently, each from the
+/// original heights, and blended over their overlap, so the result depends
+/// only on the settings and never on how tiles were scheduled.
+///
+/// Within a tile droplets run 8 at a time in lock step, sampling height and
+/// gradient for all of them with AVX2 gathers or SSE4.1. The scalar path
+/// performs the same floating point operations in the same order.
+class HydraulicErosion {
+ public:
+  struct BrushTap {
+    int dx;
+    int dz;
+    float weight;
+  };
+
+ private:
+  ErosionSettings settings;
+  std::vector<BrushTap> brush;
+
+  void Run(Heightfield& field, jobs::JobSystem* jobs, bool simd) const;
+  void ErodeTile(std::vector<float>& grid,
+                 int width,
+                 int depth,
+                 int droplets,
+                 uint32_t tile,
+                 bool simd) const;
+
+ public:
+  HydraulicErosion(ErosionSettings settings);
+
+  const ErosionSettings& Settings() const { return this->settings; }
+
+  /// @brief Erode the field, spreading tiles over a job system.
+  void Erode(Heightfield& field, jobs::JobSystem& jobs) const;
+
+  /// @brief Erode the field on the calling thread only, with the same
+  /// result as Erode.
+  void Erode(Heightfield& field) const;
+
+  /// @brief Single threaded scalar reference for Erode.
+  void ErodeReference(Heightfield& field) const;
+
+  /// @brief Droplets a field of this size simulates, overlap included.
+  size_t DropletCount(int width, int depth) const;
+
+  /// @brief The instruction set the sampling was compiled for.
+  static const char* SimdPath();
+};
+
+struct ErosionBenchmark {
+  unsigned threads = 0;
+  double milliseconds = 0.0;
+  double dropletsPerSecond = 0.0;
+  // same heights as the single threaded run
+  bool matches = false;
+};
+
+/// @brief Erode copies of a field on 1, 2, 4... up to the hardware
+/// concurrency threads, each count with its own job system, and check every
+/// run produced the same heights as the scalar reference.
+std::vector<ErosionBenchmark> BenchmarkErosion(const Heightfield& field,
+                                               const ErosionSettings& settings);
+}  // namespace terrain
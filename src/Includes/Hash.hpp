@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace hashing {
+
+/// @brief The 64 bit FNV-1a offset basis, the hash of no bytes.
+constexpr uint64_t kFnv1aBasis = 0xCBF29CE484222325ull;
+
+/// @brief 64 bit FNV-1a over a range of bytes. The result only depends on
+/// the bytes, so it is safe to store on disk as a cache key.
+/// @param hash The hash of the bytes before these, to hash in pieces.
+inline uint64_t Fnv1a(const void* data,
+                      size_t size,
+                      uint64_t hash = kFnv1aBasis) {
+  const auto* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001B3ull;
+  }
+  return hash;
+}
+}  // namespace hashing
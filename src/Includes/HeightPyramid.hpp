@@ -0,0 +1,151 @@
+#pragma once
+
+#include <Heightfield.hpp>
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace terrain {
+
+struct RayHit {
+  // along the normalised ray direction, in world units
+  float distance = 0.0f;
+  glm::vec3 position = glm::vec3(0.0f);
+};
+
+/// @brief World space heights of a heightfield with a min/max pyramid over
+/// its cells, for height queries and ray casts.
+///
+/// The surface between four samples is their bilinear interpolation.
+/// Level 0 of the pyramid keeps the lowest and highest corner of every
+/// cell, each further level the extremes of 2x2 nodes of the one below,
+/// up to a single node. A ray walks the pyramid front to back and skips
+/// every node whose height range it passes above or below, so only the
+/// cells next to the surface are intersected exactly.
+///
+/// Batched height queries run 8 points at a time with AVX2 gathers or 4
+/// with SSE4.1. The scalar path performs the same operations in the same
+/// order.
+class HeightPyramid {
+ private:
+  int width;
+  int depth;
+  float spacing;
+  float originX;
+  float originZ;
+  // samples in world units, row-major like the heightfield
+  std::vector<float> heights;
+  // per level, row-major over its nodes
+  std::vector<std::vector<float>> minHeights;
+  std::vector<std::vector<float>> maxHeights;
+  std::vector<int> levelWidths;
+  std::vector<int> levelDepths;
+
+  bool IntersectCell(int x,
+                     int z,
+                     const glm::vec3& origin,
+                     const glm::vec3& direction,
+                     float enter,
+                     float exit,
+                     float& distance) const;
+
+ public:
+  /// @param heightScale Multiplier applied to the stored heights.
+  /// @param spacing World distance between neighbouring samples.
+  /// @param originX World x of column zero.
+  /// @param originZ World z of row zero.
+  HeightPyramid(const Heightfield& field,
+                float heightScale,
+                float spacing,
+                float originX,
+                float originZ);
+
+  int Width() const { return this->width; }
+  int Depth() const { return this->depth; }
+  float Spacing() const { return this->spacing; }
+  float OriginX() const { return this->originX; }
+  float OriginZ() const { return this->originZ; }
+  int Levels() const { return static_cast<int>(this->minHeights.size()); }
+  float MinHeight() const { return this->minHeights.back()[0]; }
+  float MaxHeight() const { return this->maxHeights.back()[0]; }
+
+  /// @brief Whether a world position lies over the grid.
+  bool Contains(float x, float z) const {
+    return x >= originX && x <= originX + spacing * (width - 1) &&
+           z >= originZ && z <= originZ + spacing * (depth - 1);
+  }
+
+  /// @brief Surface height at a world position, points outside the grid
+  /// take the height of the nearest edge.
+  float Height(float x, float z) const;
+
+  /// @brief Unit surface normal at a world position, from the slope of the
+  /// same bilinear patch Height samples.
+  glm::vec3 Normal(float x, float z) const;
+
+  /// @brief Height for count points at once, with the same results as
+  /// Height.
+  /// @param simd False takes the scalar path.
+  void Heights(const float* xs,
+               const float* zs,
+               float* out,
+               size_t count,
+               bool simd = true) const;
+
+  /// @brief First point where a ray meets the surface. A ray starting
+  /// below the surface hits at its origin; nothing is hit outside the grid.
+  /// @param direction Need not be normalised.
+  /// @return False when the surface is not within maxDistance.
+  bool Raycast(const glm::vec3& origin,
+               const glm::vec3& direction,
+               float maxDistance,
+               RayHit& hit) const;
+
+  /// @brief Raycast by fixed steps followed by bisection, the naive
+  /// reference. Features thinner than a step can be missed.
+  bool RaycastMarching(const glm::vec3& origin,
+                       const glm::vec3& direction,
+                       float maxDistance,
+                       float step,
+                       RayHit& hit) const;
+
+  /// @brief The instruction set the batched queries were compiled for.
+  static const char* SimdPath();
+};
+
+struct RaycastBenchmark {
+  size_t rays = 0;
+  size_t hits = 0;
+  double pyramidRaysPerSecond = 0.0;
+  double marchingRaysPerSecond = 0.0;
+  // rays both found at the same distance, within one marching step, or
+  // both missed
+  double agreement = 0.0;
+  // rays where the pyramid misses a hit marching found, hits more than a
+  // step later, or hits off the surface. Earlier hits on the surface are
+  // features marching stepped over and do not count.
+  size_t mismatches = 0;
+  size_t queries = 0;
+  double scalarQueriesPerSecond = 0.0;
+  double simdQueriesPerSecond = 0.0;
+  // same heights on both paths
+  bool queriesMatch = false;
+};
+
+/// @brief Cast random rays from above the surface, looking mostly down,
+/// through the pyramid and by marching half a sample apart, then time
+/// batched height queries on both paths.
+RaycastBenchmark BenchmarkRaycasts(const HeightPyramid& pyramid,
+                                   size_t rays,
+                                   uint32_t seed);
+
+/// @brief Run BenchmarkRaycasts and log its rates and any mismatch.
+/// @return True when no pyramid hit was a mismatch and both height query
+/// paths agreed.
+bool ReportRaycastBenchmark(const HeightPyramid& pyramid,
+                            size_t rays,
+                            uint32_t seed);
+}  // namespace terrain
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace terrain {
+
+/// @brief A dense, row-major grid of height samples. Rows run along +z and
+/// columns along +x.
+class Heightfield {
+ private:
+  int width;
+  int depth;
+  std::vector<float> heights;
+
+ public:
+  Heightfield(int width, int depth)
+      : width{width},
+        depth{depth},
+        heights(static_cast<size_t>(width) * depth, 0.0f) {}
+
+  int Width() const { return this->width; }
+  int Depth() const { return this->depth; }
+  size_t Size() const { return this->heights.size(); }
+
+  float* Data() { return this->heights.data(); }
+  const float* Data() const { return this->heights.data(); }
+
+  float* Row(int z) { return &this->heights[static_cast<size_t>(z) * width]; }
+  const float* Row(int z) const {
+    return &this->heights[static_cast<size_t>(z) * width];
+  }
+
+  float At(int x, int z) const {
+    return this->heights[static_cast<size_t>(z) * width + x];
+  }
+  void Set(int x, int z, float value) {
+    this->heights[static_cast<size_t>(z) * width + x] = value;
+  }
+};
+
+/// @brief Read-only view over height samples owned elsewhere, e.g. a
+/// Heightfield or a memory mapped tile. Samples are either floats or 16-bit
+/// values normalised to [minHeight, maxHeight].
+class HeightfieldView {
+ private:
+  const float* floats = nullptr;
+  const uint16_t* quantized = nullptr;
+  float offset = 0.0f;
+  float scale = 1.0f;
+  int width = 0;
+  int depth = 0;
+
+ public:
+  HeightfieldView(const Heightfield& field)
+      : floats{field.Data()}, width{field.Width()}, depth{field.Depth()} {}
+  HeightfieldView(const float* data, int width, int depth)
+      : floats{data}, width{width}, depth{depth} {}
+  HeightfieldView(const uint16_t* data,
+                  int width,
+                  int depth,
+                  float minHeight,
+                  float maxHeight)
+      : quantized{data},
+        offset{minHeight},
+        scale{(maxHeight - minHeight) / 65535.0f},
+        width{width},
+        depth{depth} {}
+
+  int Width() const { return this->width; }
+  int Depth() const { return this->depth; }
+
+  /// @brief The samples when they are floats, nullptr when quantized.
+  const float* Floats() const { return this->floats; }
+
+  float At(int x, int z) const {
+    size_t i = static_cast<size_t>(z) * width + x;
+    return floats ? floats[i] : offset + quantized[i] * scale;
+  }
+};
+}  // namespace terrain
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace jobs {
+
+class JobSystem;
+
+/// @brief A unit of work. Jobs run once all of their dependencies finished.
+/// A job that throws still finishes, the exception is kept and passed on to
+/// the jobs depending on it, which are skipped.
+class Job {
+  friend class JobSystem;
+
+ private:
+  std::function<void()> work;
+  bool mainThread = false;
+
+  // starts at one so the job cannot run while dependencies are attached
+  std::atomic<int> unfinishedDependencies{1};
+  std::atomic<bool> finished{false};
+  // set before finished, by the job itself or by a failed dependency
+  std::exception_ptr error;
+
+  std::mutex continuationMutex;
+  std::vector<std::shared_ptr<Job>> continuations;
+
+ public:
+  bool IsFinished() const { return finished.load(std::memory_order_acquire); }
+};
+
+using JobHandle = std::shared_ptr<Job>;
+
+struct WorkerStats {
+  uint64_t jobs = 0;
+  uint64_t steals = 0;
+  double busySeconds = 0.0;
+  double utilization = 0.0;
+};
+
+/// @brief Work-stealing task scheduler shared by every CPU heavy subsystem.
+///
+/// Each worker owns a deque: it pushes and pops work at the back and idle
+/// workers steal from the front of the others. Jobs submitted from threads
+/// that are not workers go into a shared injection queue. Jobs flagged for the
+/// main thread are held until the GL thread calls RunMainThreadJobs.
+class JobSystem {
+ private:
+  class WorkQueue {
+   private:
+    std::mutex mutex;
+    std::deque<JobHandle> jobs;
+
+   public:
+    void Push(JobHandle job);
+    JobHandle Pop();
+    JobHandle Steal();
+  };
+
+  struct WorkerCounters {
+    std::atomic<uint64_t> jobs{0};
+    std::atomic<uint64_t> steals{0};
+    std::atomic<uint64_t> busyNanoseconds{0};
+  };
+
+  // one queue per worker, followed by the injection queue
+  std::vector<std::unique_ptr<WorkQueue>> queues;
+  std::vector<std::unique_ptr<WorkerCounters>> counters;
+  std::vector<std::thread> threads;
+
+  std::atomic<size_t> queued{0};
+  std::atomic<bool> stopping{false};
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+
+  std::mutex mainMutex;
+  std::deque<JobHandle> mainJobs;
+  std::thread::id mainThread;
+
+  std::chrono::steady_clock::time_point statsStart;
+
+  size_t InjectionQueue() const { return queues.size() - 1; }
+  size_t CurrentQueue() const;
+
+  void WorkerLoop(size_t index);
+  JobHandle Find(size_t index);
+  void Execute(const JobHandle& job, size_t index);
+  void Schedule(const JobHandle& job);
+  JobHandle Create(std::function<void()> work,
+                   const std::vector<JobHandle>& dependencies,
+                   bool mainThread);
+  bool RunMainThreadJob();
+  bool RunMainThreadJob(const JobHandle& job);
+
+ public:
+  /// @brief Start the scheduler.
+  /// @param workerCount Worker threads, 0 uses one less than the hardware
+  /// concurrency since the calling thread also helps while waiting.
+  JobSystem(unsigned int workerCount = 0);
+  ~JobSystem();
+
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+
+  /// @brief The shared scheduler. The first call records the calling thread
+  /// as the main (GL) thread.
+  static JobSystem& GetInstance();
+
+  unsigned int WorkerCount() const {
+    return static_cast<unsigned int>(threads.size());
+  }
+
+  /// @brief Submit a job to the workers.
+  /// @param work The function to run.
+  /// @param dependencies Jobs that must finish before this one starts.
+  /// @return A handle that can be waited on or used as a dependency.
+  JobHandle Submit(std::function<void()> work,
+                   const std::vector<JobHandle>& dependencies = {});
+
+  /// @brief Submit a job that may only run on the main (GL) thread.
+  /// @param work The function to run.
+  /// @param dependencies Jobs that must finish before this one starts.
+  /// @return A handle that can be waited on or used as a dependency.
+  JobHandle SubmitMainThread(std::function<void()> work,
+                             const std::vector<JobHandle>& dependencies = {});
+
+  /// @brief Block until the job finished, executing other work meanwhile.
+  /// Queued main thread jobs are not run here, they could re-enter the
+  /// caller; only a main thread job waited for on the main thread runs.
+  /// @throws The exception the job, or a job it depends on, threw.
+  void Wait(const JobHandle& job);
+
+  /// @brief Split [begin, end) into ranges of at most grain elements and run
+  /// body(first, last) on each range in parallel.
+  /// @return A handle that finishes once every range finished.
+  JobHandle ParallelForAsync(int begin,
+                             int end,
+                             int grain,
+                             std::function<void(int, int)> body,
+                             const std::vector<JobHandle>& dependencies = {});
+
+  /// @brief Blocking version of ParallelForAsync, the caller helps.
+  void ParallelFor(int begin,
+                   int end,
+                   int grain,
+                   std::function<void(int, int)> body);
+
+  /// @brief Run queued main thread jobs. Must be called from the GL thread.
+  /// @param budgetMilliseconds Stop once this much time was spent; at least
+  /// one job runs when any are queued.
+  /// @return The number of jobs run.
+  size_t RunMainThreadJobs(double budgetMilliseconds);
+
+  /// @brief Per-worker counters since the last reset.
+  std::vector<WorkerStats> Stats() const;
+  void ResetStats();
+
+  /// @brief Log per-worker utilization and reset the counters.
+  void LogStats();
+};
+}  // namespace jobs
@@ -1,6 +1,31 @@
+#pragma once
 
-#include <map>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
+
+/// @brief Log a message when its level is enabled. The message expression is
+/// not evaluated otherwise, so building the string costs nothing for a
+/// disabled level.
+#define LOG_AT(level, message)                              \
+  do {                                                      \
+    if (logging::Logger::GetInstance().IsEnabled(level)) {  \
+      logging::Logger::GetInstance().Log(level, (message)); \
+    }                                                       \
+  } while (0)
+
+#define LOG_DEBUG(message) LOG_AT(logging::DBG, message)
+#define LOG_INFO(message) LOG_AT(logging::INF, message)
+#define LOG_WARN(message) LOG_AT(logging::WRN, message)
+#define LOG_ERROR(message) LOG_AT(logging::ERR, message)
+
 namespace logging {
 
 enum LogLevel {
@@ -10,30 +35,102 @@ enum LogLevel {
   ERR,
 };
 
+/// @brief One queued message.
+struct LogRecord {
+  LogLevel level = INF;
+  uint32_t thread = 0;
+  // nanoseconds since the logger was created
+  int64_t time = 0;
+  std::string message;
+};
+
+/// @brief Single producer, single consumer queue of records. Every thread
+/// that logs owns one, the sink thread is the only consumer.
+class LogBuffer {
+ public:
+  static constexpr size_t kCapacity = 1024;
+
+ private:
+  LogRecord records[kCapacity];
+  // written by the producer, read by the sink
+  alignas(64) std::atomic<size_t> head{0};
+  // written by the sink, read by the producer
+  alignas(64) std::atomic<size_t> tail{0};
+
+ public:
+  const uint32_t thread;
+  std::atomic<uint64_t> dropped{0};
+  // set once the owning thread exits, the sink frees the buffer when empty
+  std::atomic<bool> retired{false};
+
+  explicit LogBuffer(uint32_t thread) : thread{thread} {}
+
+  /// @brief Queue a record without blocking.
+  /// @return False when the buffer is full and the record was dropped.
+  bool Push(LogRecord&& record);
+
+  /// @brief Move every queued record to the end of out.
+  /// @return The number of records taken.
+  size_t Drain(std::vector<LogRecord>& out);
+
+  bool Empty() const;
+};
+
+/// @brief Asynchronous logger. Log takes no lock and does no I/O, the message
+/// is moved into the calling thread's buffer and a background sink thread
+/// writes it to the console and, optionally, to a binary log file. When a
+/// buffer is full the record is dropped and counted, logging never stalls
+/// the caller.
 class Logger {
   static Logger globalInstance;
 
  private:
-  std::map<LogLevel, bool> enabled = {
-      {DBG, true},
-      {INF, true},
-      {WRN, true},
-      {ERR, true},
-  };
-
-  std::map<LogLevel, std::string> stringMapping = {
-      {DBG, "DEBUG"},
-      {INF, "INFO"},
-      {WRN, "WARN"},
-      {ERR, "ERROR"},
-  };
-
-  Logger() {}
+  std::atomic<bool> enabled[4] = {{true}, {true}, {true}, {true}};
+
+  const std::chrono::steady_clock::time_point start;
+
+  // every live buffer, only locked when a thread logs for the first time and
+  // by the sink
+  std::mutex buffersMutex;
+  std::vector<std::shared_ptr<LogBuffer>> buffers;
+  std::atomic<uint32_t> nextThread{0};
+
+  std::mutex sinkMutex;
+  std::condition_variable wake;
+  std::condition_variable flushed;
+  std::thread sink;
+  std::once_flag sinkStarted;
+  // set once the sink thread exists
+  std::atomic<bool> running{false};
+  // set once the sink thread has exited
+  std::atomic<bool> stopped{false};
+  bool shutdown = false;
+  uint64_t flushRequests = 0;
+  uint64_t flushesDone = 0;
+
+  std::mutex fileMutex;
+  std::ofstream binaryLog;
+
+  Logger();
+  ~Logger();
+
+  LogBuffer& ThreadBuffer();
+  void StartSink();
+  void RunSink();
+  void DrainAll(std::vector<LogRecord>& batch);
+  void Write(const std::vector<LogRecord>& batch);
 
  public:
   static Logger& GetInstance() { return globalInstance; }
 
-  void Log(LogLevel level, std::string msg) const;
+  Logger(const Logger&) = delete;
+  Logger& operator=(const Logger&) = delete;
+
+  bool IsEnabled(LogLevel level) const {
+    return enabled[level].load(std::memory_order_relaxed);
+  }
+
+  void Log(LogLevel level, std::string msg);
 
   static void LogDebug(std::string msg);
   static void LogInfo(std::string msg);
@@ -42,5 +139,14 @@ class Logger {
 
   void SetEnabled(LogLevel level, bool value);
   bool GetEnabled(LogLevel level) const;
+
+  /// @brief Also write every record to a binary file: an 8 byte magic
+  /// followed by records of time, thread, level and message length, then the
+  /// message bytes.
+  /// @throws std::runtime_error when the file cannot be created.
+  void OpenBinaryLog(const std::string& path);
+
+  /// @brief Block until everything logged before the call has been written.
+  void Flush();
 };
 }  // namespace logging
\ No newline at end of file
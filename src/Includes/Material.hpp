@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <Shader.hpp>
+#include <Texture.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace models {
+
+/// @brief A texture and the unit it is bound to.
+struct TextureBinding {
+  GLuint unit;
+  GLuint texture;
+};
+
+/// @brief The textures a mesh is drawn with. Every sampler name has a fixed
+/// texture unit, so a program sets its sampler uniforms once and binding a
+/// material only binds textures. Meshes with the same textures share one
+/// material, and with it one id for sorting.
+class Material {
+ public:
+  // texture_diffuse1 .. texture_diffuse4 use units 0 to 3, then specular,
+  // normal and height maps
+  static constexpr unsigned int kSamplersPerType = 4;
+
+ private:
+  uint32_t id;
+  std::vector<TextureBinding> bindings;
+  // marked used whenever the material is bound, for the residency cache
+  std::vector<std::shared_ptr<Texture>> textures;
+
+  Material(uint32_t id,
+           std::vector<TextureBinding> bindings,
+           std::vector<std::shared_ptr<Texture>> textures);
+
+ public:
+  /// @brief The shared material of a set of textures, created on first use.
+  /// Must be called on the GL thread.
+  static std::shared_ptr<const Material> Get(
+      const std::vector<std::shared_ptr<Texture>>& textures);
+
+  /// @brief Point the sampler uniforms of a program at their fixed units.
+  /// Called once per program, the assignment is program state.
+  static void BindSamplerUnits(ShaderProgram& shader);
+
+  /// @brief Small, stable and unique while the material is alive.
+  uint32_t Id() const { return this->id; }
+
+  const std::vector<TextureBinding>& Bindings() const {
+    return this->bindings;
+  }
+
+  /// @brief Bind every texture to its unit and mark it used this frame.
+  void Bind() const;
+};
+}  // namespace models
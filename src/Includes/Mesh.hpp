@@ -1,13 +1,19 @@
 
 #pragma once
 
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
 #include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
 
 #include <assimp/scene.h>
 
+#include <Culling.hpp>
+#include <Material.hpp>
 #include <Shader.hpp>
 #include <Texture.hpp>
 
+#include <atomic>
 #include <memory>
 #include <optional>
 #include <vector>
@@ -26,15 +32,47 @@ struct VertexType {
   glm::vec3 Tangent;
 };
 
+/// @brief Per-instance data of an instanced draw, read by instanced.vert.
+struct MeshInstance {
+  glm::mat4 transform;
+  glm::vec4 tint;
+};
+
+/// @brief A texture a mesh uses, resolved relative to the model file.
+struct TextureReference {
+  std::string path;
+  std::string type;
+};
+
 class Mesh {
  private:
   std::vector<VertexType> vertices;
   std::vector<unsigned int> indices;
   std::vector<std::shared_ptr<models::Texture>> textures;
+  std::vector<TextureReference> textureReferences;
+  // resolved from the textures once the mesh is on the GPU
+  std::shared_ptr<const Material> material;
+  glm::vec4 color = glm::vec4(1.0f);
+  GLsizei indexCount = 0;
+  GLenum indexType = GL_UNSIGNED_INT;
+
+  // the GPU copy is packed, positions are relative to the mesh bounds
+  glm::vec3 positionOffset = glm::vec3(0.0f);
+  glm::vec3 positionScale = glm::vec3(1.0f);
+  size_t vertexBytes = 0;
+  camera::Aabb bounds;
 
   unsigned int VAO, VBO, EBO;
 
-  void Setup();
+  // vertex and index buffers generated by every mesh so far
+  static inline std::atomic<size_t> buffersCreated{0};
+
+  void Bind(ShaderProgram& shader) const;
+
+  void Setup(const VertexType* vertexData,
+             size_t vertexCount,
+             const unsigned int* indexData,
+             size_t indexCount);
 
  public:
   /// @brief Loads the mesh data from the scene and assimp mesh object.
@@ -42,8 +80,89 @@ class Mesh {
   /// @param mesh The assimp mesh object.
   void Load(const aiScene* scene, const aiMesh* mesh, std::optional<std::string> relativePath = std::nullopt);
 
+  /// @brief Converts the assimp mesh without touching GL, so it can run on a
+  /// worker thread. Vertices are welded and both buffers reordered for the
+  /// GPU caches. Textures are only collected as references.
+  /// @param scene The assimp scene object.
+  /// @param mesh The assimp mesh object.
+  void Import(const aiScene* scene,
+              const aiMesh* mesh,
+              std::optional<std::string> relativePath = std::nullopt);
+
+  /// @brief Creates the GL buffers for imported data. Must be called on the
+  /// GL thread.
+  /// @param textures The loaded textures, in reference order.
+  void Upload(std::vector<std::shared_ptr<models::Texture>> textures);
+
+  /// @brief Uploads already processed mesh data, e.g. from the model cache.
+  /// Nothing is kept on the CPU side.
+  /// @param vertices The vertex data.
+  /// @param vertexCount Number of vertices.
+  /// @param indices The triangle indices.
+  /// @param indexCount Number of indices.
+  /// @param color The material color.
+  /// @param textures Textures bound when drawing.
+  void Load(const VertexType* vertices,
+            size_t vertexCount,
+            const unsigned int* indices,
+            size_t indexCount,
+            glm::vec4 color,
+            std::vector<std::shared_ptr<models::Texture>> textures);
+
+  const std::vector<VertexType>& Vertices() const { return this->vertices; }
+  const std::vector<unsigned int>& Indices() const { return this->indices; }
+  const std::vector<std::shared_ptr<models::Texture>>& Textures() const {
+    return this->textures;
+  }
+  const std::vector<TextureReference>& TextureReferences() const {
+    return this->textureReferences;
+  }
+  glm::vec4 Color() const { return this->color; }
+
+  /// @brief Size of the packed vertex buffer on the GPU.
+  size_t VertexBytes() const { return this->vertexBytes; }
+
+  /// @brief Bounds of the uploaded vertices, in model space.
+  const camera::Aabb& Bounds() const { return this->bounds; }
+
+  const Material& GetMaterial() const { return *this->material; }
+  GLuint Vao() const { return this->VAO; }
+
+  /// @brief Number of vertex and index buffers every mesh has created so
+  /// far, two per upload.
+  static size_t BuffersCreated() { return buffersCreated.load(); }
+
+  /// @brief Bind the vertex array and set the uniforms decoding its
+  /// positions. The textures are bound separately, by the material.
+  void BindVertices(ShaderProgram& shader) const;
+
+  /// @brief Draw the bound mesh once.
+  void DrawElements() const;
+
+  /// @brief Draw the bound mesh once per MeshInstance in a buffer.
+  /// @param instanceBuffer Buffer of MeshInstance records.
+  /// @param count Number of records.
+  void DrawElementsInstanced(GLuint instanceBuffer, GLsizei count) const;
+
   /// @brief Draw the mesh to the screen.
   /// @param shader The shader we want to use when drawing.
   void Draw(ShaderProgram& shader) const;
+
+  /// @brief Draw every placement of the mesh, binding it once.
+  /// @param shader The shader we want to use when drawing.
+  /// @param transform Applied to all placements.
+  /// @param instances World transform of each placement.
+  void Draw(ShaderProgram& shader,
+            const glm::mat4& transform,
+            const std::vector<glm::mat4>& instances) const;
+
+  /// @brief Draw the mesh once per MeshInstance in a buffer, in a single
+  /// call.
+  /// @param shader A shader reading the instance attributes.
+  /// @param instanceBuffer Buffer of MeshInstance records.
+  /// @param count Number of records.
+  void DrawInstanced(ShaderProgram& shader,
+                     GLuint instanceBuffer,
+                     GLsizei count) const;
 };
 }  // namespace models
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <Mesh.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace models {
+
+/// @brief How well an index buffer uses the post-transform vertex cache.
+struct VertexCacheStats {
+  // average cache miss ratio, transformed vertices per triangle: 0.5 is the
+  // ideal for a large regular grid, 3 means nothing is reused
+  float acmr = 0.0f;
+  // average transform to vertex ratio, 1 means every vertex is transformed
+  // exactly once
+  float atvr = 0.0f;
+};
+
+/// @brief What OptimizeMesh did to a mesh.
+struct MeshOptimizationReport {
+  size_t verticesBefore = 0;
+  size_t verticesAfter = 0;
+  VertexCacheStats before;
+  VertexCacheStats after;
+};
+
+/// @brief Simulate a FIFO post-transform cache.
+/// @param indices Triangle list.
+/// @param vertexCount Number of vertices the indices refer to.
+/// @param cacheSize Entries in the simulated cache.
+VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int>& indices,
+                                    size_t vertexCount,
+                                    size_t cacheSize = 16);
+
+/// @brief Merge bitwise identical vertices and remap the indices.
+/// @return The number of vertices removed.
+size_t WeldVertices(std::vector<VertexType>& vertices,
+                    std::vector<unsigned int>& indices);
+
+/// @brief Reorder triangles for post-transform cache locality using
+/// Tipsify (Sander, Nehab and Barczak, 2007). Runs in linear time.
+/// @param indices Triangle list, reordered in place. Left alone when its
+/// size is not a multiple of 3.
+/// @param vertexCount Number of vertices the indices refer to.
+/// @param cacheSize Entries of the cache to optimize for.
+void OptimizeVertexCache(std::vector<unsigned int>& indices,
+                         size_t vertexCount,
+                         size_t cacheSize = 16);
+
+/// @brief Reorder vertices in the order the indices first use them, so the
+/// vertex fetch walks memory forward. Unreferenced vertices are dropped.
+void OptimizeVertexFetch(std::vector<VertexType>& vertices,
+                         std::vector<unsigned int>& indices);
+
+/// @brief Weld, reorder for the vertex cache, then reorder for fetch.
+/// Indices that are not a triangle list pass through unchanged, with the
+/// cache stats of the report left at zero.
+MeshOptimizationReport OptimizeMesh(std::vector<VertexType>& vertices,
+                                    std::vector<unsigned int>& indices);
+}  // namespace models
@@ -4,29 +4,144 @@
 #include <assimp/scene.h>
 #include <assimp/Importer.hpp>
 
+#include <JobSystem.hpp>
 #include <Mesh.hpp>
+#include <ModelCache.hpp>
+#include <RenderQueue.hpp>
+#include <SceneGraph.hpp>
 #include <Shader.hpp>
+#include <Texture.hpp>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
 #include <vector>
 
 namespace models {
 
+/// @brief CPU side of a model load. Filled on a worker thread and consumed on
+/// the GL thread by Model::Upload.
+struct ModelImport {
+  std::string path;
+
+  // set on a cache hit, the cached meshes point into the mapping
+  std::unique_ptr<ModelCache> cache;
+
+  // set on a miss, imported but not uploaded yet
+  std::vector<Mesh> meshes;
+
+  // the node hierarchy, meshes are referenced by index
+  SceneGraph graph;
+
+  // every referenced texture decoded once, keyed on path
+  std::map<std::string, TextureImage> images;
+
+  // first failure, raised again on the GL thread
+  std::string error;
+};
+
 class Model {
  private:
   std::string path;
 
+  // one per unique mesh of the file, the graph places them
   std::vector<models::Mesh> meshes;
+  SceneGraph graph;
+  // every mesh placement, in model space
+  camera::Aabb bounds;
   std::vector<Texture>
       textures_loaded;  // Unsure a texture is only loaded once.
 
-  void ProcessNode(aiNode* node, const aiScene* scene);
+  std::atomic<bool> ready{false};
+  jobs::JobHandle loadJob;
+
+  static void ProcessNode(const aiNode* node, int parent, SceneGraph& graph);
+
+  /// @brief Convert a scene read by assimp into the import's graph and
+  /// meshes.
+  /// @throws std::runtime_error when the scene is missing or incomplete.
+  static void ImportScene(const aiScene* scene,
+                          const std::optional<std::string>& fileName,
+                          ModelImport& import);
+
+  /// @brief Decode every texture the imported meshes reference.
+  /// @throws std::runtime_error when a texture fails to decode.
+  static void DecodeTextures(ModelImport& import);
 
  public:
-  /// @brief Load the model from the provided file.
+  /// @brief Load the model from the provided file, blocking until it is on
+  /// the GPU. Processed imports are cached, a cache hit skips assimp
+  /// entirely.
   /// @param fileName The path to the file.
   void Load(std::string fileName);
 
-  /// @brief Draw using a shader.
+  /// @brief Import and decode the model on the workers, then upload it on
+  /// the GL thread. The model draws a placeholder until it is ready.
+  /// @param model The model to fill.
+  /// @param fileName The path to the file.
+  /// @return The upload job, finished once the model is ready.
+  static jobs::JobHandle LoadAsync(std::shared_ptr<Model> model,
+                                   std::string fileName);
+
+  /// @brief Read, process and decode everything a model needs without
+  /// touching GL. Safe to call from any thread.
+  /// @param fileName The path to the file.
+  /// @param import Output.
+  static void Import(std::string fileName, ModelImport& import);
+
+  /// @brief Import a model held in memory, e.g. by a headless check. The
+  /// result is not cached.
+  /// @param data The file contents.
+  /// @param hint The file extension naming the format, e.g. "dae".
+  /// @param import Output.
+  static void ImportMemory(const std::string& data,
+                           const std::string& hint,
+                           ModelImport& import);
+
+  /// @brief Create the GL objects of an import. Must be called on the GL
+  /// thread.
+  /// @throws std::runtime_error when the import failed.
+  void Upload(ModelImport& import);
+
+  bool IsReady() const { return ready.load(std::memory_order_acquire); }
+
+  /// @brief The pending upload of an asynchronous load, null otherwise.
+  const jobs::JobHandle& LoadJob() const { return this->loadJob; }
+
+  /// @brief Draw using a shader. Each mesh is bound once and drawn at every
+  /// node that uses it.
   /// @param shader The shader to bind to the model.
-  void Draw(ShaderProgram& shader) const;
+  /// @param transform Placement of the whole model.
+  void Draw(ShaderProgram& shader,
+            const glm::mat4& transform = glm::mat4(1.0f)) const;
+
+  /// @brief Record a draw of every mesh placement, or of the placeholder
+  /// while loading.
+  /// @param queue The frame's queue.
+  /// @param shader The shader to draw with.
+  /// @param transform Placement of the whole model.
+  void Record(rendering::RenderQueue& queue,
+              ShaderProgram& shader,
+              const glm::mat4& transform = glm::mat4(1.0f)) const;
+
+  const std::vector<models::Mesh>& Meshes() const { return this->meshes; }
+  const SceneGraph& Graph() const { return this->graph; }
+
+  /// @brief Bounds of every mesh placement, empty until the model is ready.
+  const camera::Aabb& Bounds() const { return this->bounds; }
+
+  /// @brief Number of unique meshes, each owns one set of GPU buffers.
+  size_t MeshCount() const { return this->meshes.size(); }
+
+  /// @brief Number of mesh placements over all nodes.
+  size_t InstanceCount() const { return this->graph.InstanceCount(); }
 };
-}  // namespace models
\ No newline at end of file
+
+/// @brief Import a scene whose nodes share meshes, upload it to a hidden GL
+/// context and compare the buffers the meshes created with MeshCount().
+/// @return True when every mesh was uploaded once, however many nodes use
+/// it.
+bool CheckModelInstancing();
+}  // namespace models
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <Mesh.hpp>
+#include <SceneGraph.hpp>
+
+#include <glm/vec4.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace models {
+
+/// @brief One mesh as stored in the cache. The arrays point into the mapped
+/// file and are valid for the lifetime of the ModelCache.
+struct CachedMesh {
+  const VertexType* vertices;
+  size_t vertexCount;
+  const unsigned int* indices;
+  size_t indexCount;
+  glm::vec4 color;
+  std::vector<TextureReference> textures;
+};
+
+/// @brief Binary cache of processed model imports.
+///
+/// Entries are keyed on a hash of the source file contents and the import
+/// flags, so an edited model or a change to the import pipeline never hits a
+/// stale entry. A hit maps the file read-only and hands out pointers into it,
+/// so the mesh data goes straight from the page cache to the GL buffers.
+class ModelCache {
+ private:
+  void* mapping = nullptr;
+  size_t mappingSize = 0;
+
+  // used when the platform has no mmap
+  std::vector<uint8_t> buffer;
+
+  std::vector<CachedMesh> meshes;
+  SceneGraph graph;
+
+  bool Parse(const uint8_t* data, size_t size, uint64_t key);
+
+ public:
+  ModelCache() = default;
+  ~ModelCache();
+
+  ModelCache(const ModelCache&) = delete;
+  ModelCache& operator=(const ModelCache&) = delete;
+
+  /// @brief Hash the source file together with the import flags.
+  /// @throws std::runtime_error when the file cannot be read.
+  static uint64_t Key(const std::string& fileName, unsigned int flags);
+
+  /// @brief Where the entry for a key lives.
+  static std::string PathFor(uint64_t key);
+
+  /// @brief Map a cache entry.
+  /// @return The entry, or nullptr when it is missing or invalid.
+  static std::unique_ptr<ModelCache> Open(uint64_t key);
+
+  /// @brief Write the processed meshes and the node hierarchy of a model.
+  /// The file is written under a temporary name and renamed, readers never
+  /// see a partial entry.
+  /// @throws std::runtime_error when the entry cannot be written.
+  static void Write(uint64_t key,
+                    const std::vector<Mesh>& meshes,
+                    const SceneGraph& graph);
+
+  const std::vector<CachedMesh>& Meshes() const { return this->meshes; }
+  const SceneGraph& Graph() const { return this->graph; }
+};
+}  // namespace models
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+
+#include <Culling.hpp>
+#include <Mesh.hpp>
+#include <Model.hpp>
+#include <RenderQueue.hpp>
+#include <Shader.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace models {
+
+/// @brief Many placements of one model, drawn with one instanced call per
+/// mesh. The transforms and tints live in a GPU buffer per mesh that is only
+/// rebuilt when the placements change, or with culling, when the set of
+/// visible placements does.
+class ModelInstances {
+ private:
+  std::shared_ptr<Model> model;
+  std::vector<MeshInstance> instances;
+
+  // per mesh, the uploaded instances combined with every node placement of
+  // the mesh
+  std::vector<GLuint> buffers;
+  std::vector<GLsizei> counts;
+  bool dirty = true;
+
+  // the instances in the buffers when they are not all of them
+  bool uploadedAll = false;
+  std::vector<uint32_t> uploaded;
+
+  // world bounds of every instance, built once the model is ready
+  camera::BoundingVolumeHierarchy hierarchy;
+  bool hierarchyDirty = true;
+  std::vector<uint32_t> visible;
+
+  void Upload(const std::vector<uint32_t>* selection);
+  void Cull(const camera::Frustum& frustum);
+
+  /// @brief Cull and refresh the buffers for an instanced draw.
+  /// @return False when there is nothing to draw.
+  bool Prepare(const camera::Frustum* frustum);
+
+ public:
+  explicit ModelInstances(std::shared_ptr<Model> model);
+  ~ModelInstances();
+
+  ModelInstances(const ModelInstances&) = delete;
+  ModelInstances& operator=(const ModelInstances&) = delete;
+
+  /// @brief Replace every placement.
+  void Set(std::vector<MeshInstance> instances);
+
+  void Add(const glm::mat4& transform,
+           const glm::vec4& tint = glm::vec4(1.0f));
+
+  void Clear();
+
+  size_t Size() const { return this->instances.size(); }
+
+  const std::shared_ptr<Model>& GetModel() const { return this->model; }
+
+  /// @brief Instances that passed the last culled draw.
+  size_t VisibleCount() const { return this->visible.size(); }
+
+  /// @brief One glDrawElementsInstanced per mesh. Nothing is drawn until the
+  /// model is ready.
+  /// @param shader A shader reading the instance attributes, such as
+  /// instanced.vert.
+  /// @param frustum When set, only instances intersecting it are drawn.
+  void Draw(ShaderProgram& shader, const camera::Frustum* frustum = nullptr);
+
+  /// @brief Record the instanced draws instead of issuing them. The
+  /// buffers stay untouched until the next Draw or Record.
+  void Record(rendering::RenderQueue& queue,
+              ShaderProgram& shader,
+              const camera::Frustum* frustum = nullptr);
+
+  /// @brief Record one Model::Record per placement.
+  void RecordEach(rendering::RenderQueue& queue,
+                  ShaderProgram& shader,
+                  const camera::Frustum* frustum = nullptr);
+
+  /// @brief The per-object path: one Model::Draw per placement, with the
+  /// transform sent as a uniform. Tints are ignored.
+  /// @param shader The regular model shader.
+  /// @param frustum When set, only instances intersecting it are drawn.
+  void DrawEach(ShaderProgram& shader,
+                const camera::Frustum* frustum = nullptr);
+};
+}  // namespace models
@@ -0,0 +1,274 @@
+#pragma once
+
+#include <HeightPyramid.hpp>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace jobs {
+class JobSystem;
+}
+
+namespace physics {
+
+enum class ShapeType : uint8_t { Sphere, Capsule, Box };
+
+/// @brief A collision shape centred on the position of its body.
+struct Shape {
+  ShapeType type = ShapeType::Sphere;
+  // spheres and capsules
+  float radius = 0.5f;
+  // capsules: half the distance between the cap centres, along local y
+  float halfHeight = 0.5f;
+  // boxes
+  glm::vec3 halfExtents = glm::vec3(0.5f);
+
+  static Shape Sphere(float radius);
+  static Shape Capsule(float radius, float halfHeight);
+  static Shape Box(const glm::vec3& halfExtents);
+};
+
+struct BodyDesc {
+  Shape shape;
+  glm::vec3 position = glm::vec3(0.0f);
+  glm::quat orientation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+  glm::vec3 velocity = glm::vec3(0.0f);
+  glm::vec3 angularVelocity = glm::vec3(0.0f);
+  // zero makes the body static
+  float mass = 1.0f;
+  float friction = 0.6f;
+  float restitution = 0.1f;
+};
+
+/// @brief A shape placed in the world, what the narrowphase works on.
+struct Collider {
+  Shape shape;
+  glm::vec3 position;
+  // columns are the local axes
+  glm::mat3 rotation;
+};
+
+struct Contact {
+  // midway between the two surfaces
+  glm::vec3 point;
+  // unit length, from the second collider towards the first
+  glm::vec3 normal;
+  float depth;
+};
+
+constexpr int kMaxContacts = 8;
+
+/// @brief Contacts between two colliders.
+/// @param contacts Room for kMaxContacts.
+/// @return The number of contacts written, 0 when they do not touch.
+int Collide(const Collider& a, const Collider& b, Contact* contacts);
+
+/// @brief Contacts between a collider and the terrain surface, with normals
+/// pointing out of the ground. Nothing collides outside the heightfield.
+/// @param contacts Room for kMaxContacts.
+int CollideTerrain(const Collider& a,
+                   const terrain::HeightPyramid& ground,
+                   Contact* contacts);
+
+struct PhysicsSettings {
+  // fixed simulation steps per second, whatever the frame rate
+  float stepsPerSecond = 60.0f;
+  // steps one Advance runs at most, the rest of a long frame is dropped
+  int maxSteps = 4;
+  glm::vec3 gravity = glm::vec3(0.0f, -9.81f, 0.0f);
+  // velocity passes over every contact per step
+  int iterations = 8;
+  // fraction of the penetration pushed out per step
+  float baumgarte = 0.2f;
+  // penetration left alone so resting contacts stay in touch
+  float slop = 0.01f;
+  // cap on the separating speed penetration recovery may add
+  float maxPushSpeed = 4.0f;
+  // broadphase bounds are grown by this much
+  float margin = 0.05f;
+  float linearDamping = 0.05f;
+  float angularDamping = 0.1f;
+  // bodies, pairs or contact manifolds handed to a job at once
+  int grain = 256;
+};
+
+struct PhysicsStats {
+  size_t pairs = 0;
+  size_t manifolds = 0;
+  size_t contacts = 0;
+  // contact batches solved in parallel, bodies in more than 64 manifolds
+  // spill into a last batch solved in order
+  int colors = 0;
+  double broadphaseMilliseconds = 0.0;
+  double narrowphaseMilliseconds = 0.0;
+  double solverMilliseconds = 0.0;
+  double stepMilliseconds = 0.0;
+};
+
+/// @brief Rigid bodies falling onto the terrain and each other.
+///
+/// Bodies are stored as structure of arrays, one array per attribute. A
+/// step applies gravity, finds overlapping bounds with sweep and prune
+/// along x, builds contact manifolds, then solves them with sequential
+/// impulses: contact, friction and restitution, with Baumgarte
+/// stabilisation. Manifolds are coloured so no two of a color share a
+/// moving body; a color is solved on the workers, colors one after the
+/// other.
+///
+/// Every parallel pass splits its work into ranges of a fixed size and
+/// writes only to its own range or bodies, so a step gives the same result
+/// on any number of threads.
+class PhysicsWorld {
+ public:
+  // the body index standing for the terrain in a manifold
+  static constexpr uint32_t kGround = UINT32_MAX;
+
+ private:
+  struct Pair {
+    uint32_t a;
+    uint32_t b;
+  };
+
+  struct Manifold {
+    uint32_t a;
+    // kGround for terrain contacts
+    uint32_t b;
+    uint32_t first;
+    uint32_t count;
+    float friction;
+    float restitution;
+  };
+
+  // Everything the solver needs along the normal (0) and the two friction
+  // directions, so an iteration is dot products and additions only.
+  struct ContactPoint {
+    glm::vec3 directions[3];
+    // lever arm cross direction, for each body
+    glm::vec3 armsA[3];
+    glm::vec3 armsB[3];
+    // change in spin per unit impulse, for each body
+    glm::vec3 spinsA[3];
+    glm::vec3 spinsB[3];
+    float masses[3];
+    float impulses[3];
+    // separating speed the normal impulse aims for
+    float bias;
+  };
+
+  PhysicsSettings settings;
+  const terrain::HeightPyramid* ground = nullptr;
+  double pending = 0.0;
+  size_t steps = 0;
+  PhysicsStats stats;
+
+  // bodies
+  std::vector<Shape> shapes;
+  std::vector<glm::vec3> positions;
+  std::vector<glm::quat> orientations;
+  std::vector<glm::vec3> velocities;
+  std::vector<glm::vec3> angularVelocities;
+  std::vector<float> inverseMasses;
+  // diagonal, in body space
+  std::vector<glm::vec3> inverseInertias;
+  std::vector<float> frictions;
+  std::vector<float> restitutions;
+
+  // refreshed at the start of every step
+  std::vector<glm::mat3> rotations;
+  std::vector<glm::mat3> worldInverseInertias;
+  std::vector<glm::vec3> boundsMin;
+  std::vector<glm::vec3> boundsMax;
+
+  // bodies by the low x of their bounds, nearly sorted from the last step
+  std::vector<uint32_t> sweep;
+  bool sweepSorted = false;
+  std::vector<Pair> pairs;
+  std::vector<std::vector<Pair>> rangePairs;
+
+  std::vector<Manifold> manifolds;
+  std::vector<Contact> contacts;
+  std::vector<ContactPoint> points;
+  std::vector<std::vector<Manifold>> rangeManifolds;
+  std::vector<std::vector<Contact>> rangeContacts;
+
+  // manifold indices grouped by color, color c in [starts[c], starts[c+1])
+  std::vector<uint32_t> colorOrder;
+  std::vector<uint32_t> colorStarts;
+
+  Collider MakeCollider(uint32_t body) const;
+  void UpdateBodies(jobs::JobSystem* jobs, float dt);
+  void FindPairs(jobs::JobSystem* jobs);
+  void FindContacts(jobs::JobSystem* jobs);
+  void ColorManifolds();
+  void PrepareContacts(jobs::JobSystem* jobs, float dt);
+  void SolveManifold(const Manifold& manifold);
+  void Solve(jobs::JobSystem* jobs);
+  void Integrate(jobs::JobSystem* jobs, float dt);
+
+ public:
+  PhysicsWorld(PhysicsSettings settings = PhysicsSettings());
+
+  const PhysicsSettings& Settings() const { return this->settings; }
+
+  /// @brief Collide with this terrain, nullptr for none. The pyramid must
+  /// outlive the world or be replaced first.
+  void SetGround(const terrain::HeightPyramid* ground);
+
+  /// @return The index of the new body. Indices stay valid until Clear.
+  uint32_t AddBody(const BodyDesc& desc);
+  void Clear();
+
+  size_t BodyCount() const { return this->positions.size(); }
+  const glm::vec3& Position(uint32_t body) const {
+    return this->positions[body];
+  }
+  const glm::quat& Orientation(uint32_t body) const {
+    return this->orientations[body];
+  }
+  const glm::vec3& Velocity(uint32_t body) const {
+    return this->velocities[body];
+  }
+
+  /// @brief Body to world transform.
+  glm::mat4 Transform(uint32_t body) const;
+
+  /// @brief Run one fixed step of 1 / stepsPerSecond seconds.
+  /// @param jobs Spread the work over these workers, nullptr runs it here.
+  void Step(jobs::JobSystem* jobs);
+
+  /// @brief Run as many fixed steps as the elapsed time holds, carrying the
+  /// remainder to the next call.
+  /// @return The number of steps run.
+  int Advance(double seconds, jobs::JobSystem* jobs);
+
+  size_t Steps() const { return this->steps; }
+
+  /// @brief Counters and timings of the last step.
+  const PhysicsStats& Stats() const { return this->stats; }
+};
+
+struct PhysicsBenchmark {
+  size_t bodies = 0;
+  unsigned threads = 0;
+  // mean step time on the calling thread alone and on the workers
+  double serialMilliseconds = 0.0;
+  double parallelMilliseconds = 0.0;
+  // in the last step
+  size_t pairs = 0;
+  size_t contacts = 0;
+  // same positions and orientations after the last step on both
+  bool matches = false;
+};
+
+/// @brief Drop each number of spheres, capsules and boxes in layers onto
+/// the terrain and time a fixed number of steps, on the calling thread and
+/// on a job system with one worker per remaining hardware thread.
+std::vector<PhysicsBenchmark> BenchmarkPhysics(
+    const terrain::HeightPyramid& ground,
+    const std::vector<size_t>& bodyCounts,
+    int steps);
+}  // namespace physics
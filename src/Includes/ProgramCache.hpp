@@ -0,0 +1,55 @@
+#pragma once
+
+#include <Shader.hpp>
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace rendering {
+
+/// @brief Disk cache of linked program binaries.
+///
+/// Entries are keyed on a hash of the shader sources together with the
+/// vendor, renderer and version strings of the driver, so an edited shader or
+/// a driver update never loads a stale binary. A driver may still reject a
+/// binary it wrote itself, the program is then compiled as if it missed.
+class ProgramCache {
+ private:
+  std::string directory;
+  std::string driver;
+  bool enabled = false;
+  size_t hits = 0;
+  size_t misses = 0;
+
+ public:
+  /// @brief Needs a current context: queries the driver and, when the driver
+  /// supports KHR_parallel_shader_compile, lets it compile on all its threads.
+  /// @param directory Where the binaries are written.
+  explicit ProgramCache(std::string directory);
+
+  /// @brief Hash the sources of the shaders of a program with the driver.
+  uint64_t Key(const std::vector<Shader>& shaders) const;
+
+  /// @brief Where the entry for a key lives.
+  std::string PathFor(uint64_t key) const;
+
+  /// @brief Load a cached binary into a program.
+  /// @return True when the program is linked and ready, false on a miss or
+  /// when the cache is disabled.
+  bool Load(uint64_t key, GLuint program);
+
+  /// @brief Write the binary of a linked program. Failures are logged, the
+  /// program is simply compiled again next time. Does nothing when disabled.
+  void Store(uint64_t key, GLuint program);
+
+  /// @brief The driver can retrieve program binaries.
+  bool Enabled() const { return this->enabled; }
+
+  size_t Hits() const { return this->hits; }
+  size_t Misses() const { return this->misses; }
+};
+}  // namespace rendering
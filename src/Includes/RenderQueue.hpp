@@ -0,0 +1,116 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <Mesh.hpp>
+#include <Shader.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace rendering {
+
+/// @brief A sort key and the command it belongs to.
+struct SortEntry {
+  uint64_t key;
+  uint32_t index;
+};
+
+/// @brief Stable least significant digit radix sort on the keys, one byte
+/// per pass. Passes where every key has the same byte are skipped.
+/// @param entries Sorted in place.
+/// @param scratch Working storage, reused between calls.
+void RadixSort(std::vector<SortEntry>& entries,
+               std::vector<SortEntry>& scratch);
+
+/// @brief One recorded draw of a mesh.
+struct DrawCommand {
+  ShaderProgram* program = nullptr;
+  const models::Mesh* mesh = nullptr;
+  glm::mat4 transform = glm::mat4(1.0f);
+  // instanced draws read their transforms from this buffer instead
+  GLuint instanceBuffer = 0;
+  GLsizei instanceCount = 0;
+};
+
+/// @brief What the last Flush did.
+struct RenderQueueStats {
+  size_t commands = 0;
+  size_t programChanges = 0;
+  size_t materialChanges = 0;
+  size_t meshChanges = 0;
+  // the changes the same commands need when submitted in recording order
+  size_t unsortedChanges = 0;
+  double sortMs = 0.0;
+  double submitMs = 0.0;
+
+  size_t StateChanges() const {
+    return programChanges + materialChanges + meshChanges;
+  }
+
+  /// @brief Binds the sort avoided.
+  size_t Saved() const {
+    return unsortedChanges > StateChanges() ? unsortedChanges - StateChanges()
+                                            : 0;
+  }
+};
+
+/// @brief Draws recorded during a frame, sorted so commands sharing a
+/// program, then a material, then a vertex array run back to back, and
+/// submitted binding each only when it changes. Within a vertex array opaque
+/// draws go front to back.
+///
+/// The 64 bit key holds, from the most significant bit: the program slot
+/// (8 bits), the material id (16 bits), the vertex array name (20 bits) and
+/// the quantized view distance (20 bits). Truncated fields only cost
+/// batching, the submission compares the actual objects.
+class RenderQueue {
+ private:
+  std::vector<DrawCommand> commands;
+  std::vector<SortEntry> entries;
+  std::vector<SortEntry> scratch;
+
+  // programs seen so far, the index is the slot in the key
+  std::vector<const ShaderProgram*> programs;
+
+  glm::vec3 eye = glm::vec3(0.0f);
+  float farPlane = 1.0f;
+
+  RenderQueueStats stats;
+
+  uint64_t Key(const ShaderProgram& program,
+               const models::Mesh& mesh,
+               float distance);
+  void Record(const DrawCommand& command, float distance);
+
+ public:
+  /// @brief Drop the commands of the previous frame.
+  /// @param camera Position the depth of each draw is measured from.
+  /// @param zfar Distance mapped to the furthest depth.
+  void Begin(const glm::vec3& camera, float zfar);
+
+  /// @brief Record a draw of the mesh at a world transform. The program's
+  /// frame uniforms must be set before Flush.
+  void Submit(ShaderProgram& program,
+              const models::Mesh& mesh,
+              const glm::mat4& transform);
+
+  /// @brief Record an instanced draw. The buffer must stay unchanged until
+  /// Flush.
+  /// @param instanceBuffer Buffer of MeshInstance records.
+  /// @param count Number of records.
+  void SubmitInstanced(ShaderProgram& program,
+                       const models::Mesh& mesh,
+                       GLuint instanceBuffer,
+                       GLsizei count);
+
+  /// @brief Sort and submit everything recorded since Begin.
+  void Flush();
+
+  size_t Size() const { return this->commands.size(); }
+
+  const RenderQueueStats& Stats() const { return this->stats; }
+};
+}  // namespace rendering
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace resources {
+
+/// @brief Where a ResidencyCache stands.
+struct ResidencyStats {
+  size_t entries = 0;
+  size_t budgetBytes = 0;
+  size_t residentBytes = 0;
+  // highest residentBytes seen since the cache was created
+  size_t peakBytes = 0;
+  size_t evictions = 0;
+  size_t upgrades = 0;
+  // entries holding levels that are not resident yet
+  size_t pendingUpgrades = 0;
+};
+
+/// @brief Byte budgeted set of GPU resources keyed on path.
+///
+/// The cache holds one reference to every resource. Resources nobody else
+/// references are evicted least recently used first whenever the resident
+/// bytes exceed the budget; referenced ones are never released, so the
+/// budget can be exceeded by what is actually in use. Resources start with
+/// part of their data resident, the referenced ones are upgraded a step at a
+/// time, most recently used first, while the budget allows.
+///
+/// Resource must provide:
+///   size_t Bytes() const             bytes currently resident
+///   uint64_t LastUsedFrame() const   frame it was last used in
+///   bool CanUpgrade() const          more data is waiting
+///   size_t UpgradeBytes() const      bytes the next step adds
+///   void Upgrade()                   make the next step resident
+template <typename Resource>
+class ResidencyCache {
+ private:
+  struct Entry {
+    std::shared_ptr<Resource> resource;
+    // insertion order, breaks ties between resources used in the same frame
+    uint64_t order;
+  };
+
+  std::map<std::string, Entry> entries;
+  uint64_t nextOrder = 0;
+  ResidencyStats stats;
+  std::function<void(const std::string&)> onEvict;
+
+  void Track() {
+    stats.peakBytes = std::max(stats.peakBytes, stats.residentBytes);
+  }
+
+  // the least recently used entry only the cache references
+  typename std::map<std::string, Entry>::iterator LeastRecentlyUsed() {
+    auto best = entries.end();
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+      if (it->second.resource.use_count() > 1) {
+        continue;
+      }
+      if (best == entries.end() ||
+          it->second.resource->LastUsedFrame() <
+              best->second.resource->LastUsedFrame() ||
+          (it->second.resource->LastUsedFrame() ==
+               best->second.resource->LastUsedFrame() &&
+           it->second.order < best->second.order)) {
+        best = it;
+      }
+    }
+    return best;
+  }
+
+  // evict until bytes more fit in the budget, false when they cannot
+  bool MakeRoom(size_t bytes) {
+    while (stats.residentBytes + bytes > stats.budgetBytes) {
+      auto victim = LeastRecentlyUsed();
+      if (victim == entries.end()) {
+        return false;
+      }
+      stats.residentBytes -= victim->second.resource->Bytes();
+      stats.evictions++;
+      const std::string key = victim->first;
+      entries.erase(victim);
+      if (onEvict) {
+        onEvict(key);
+      }
+    }
+    return true;
+  }
+
+ public:
+  explicit ResidencyCache(size_t budgetBytes) {
+    stats.budgetBytes = budgetBytes;
+  }
+
+  /// @brief Change the budget, the excess is evicted on the next Update.
+  void SetBudget(size_t bytes) { stats.budgetBytes = bytes; }
+
+  /// @brief Called with the key of every evicted resource.
+  void OnEvict(std::function<void(const std::string&)> callback) {
+    onEvict = std::move(callback);
+  }
+
+  /// @brief The resource stored under a key, or nullptr.
+  std::shared_ptr<Resource> Find(const std::string& key) const {
+    auto it = entries.find(key);
+    return it == entries.end() ? nullptr : it->second.resource;
+  }
+
+  /// @brief Take a new resource, evicting unreferenced ones to fit it.
+  void Add(const std::string& key, std::shared_ptr<Resource> resource) {
+    MakeRoom(resource->Bytes());
+    stats.residentBytes += resource->Bytes();
+    auto& entry = entries[key];
+    if (entry.resource) {
+      stats.residentBytes -= entry.resource->Bytes();
+    }
+    entry = Entry{std::move(resource), nextOrder++};
+    Track();
+  }
+
+  /// @brief Evict down to the budget, then upgrade the most recently used
+  /// resources while the budget and the upload allowance last.
+  /// @param uploadBytes Bytes that may be uploaded in this call.
+  void Update(size_t uploadBytes) {
+    MakeRoom(0);
+
+    // only resources in use are worth the upload, evicting makes room for
+    // them and never removes them since they are referenced
+    std::vector<Entry*> waiting;
+    for (auto& [key, entry] : entries) {
+      if (entry.resource.use_count() > 1 && entry.resource->CanUpgrade()) {
+        waiting.push_back(&entry);
+      }
+    }
+    std::sort(waiting.begin(), waiting.end(), [](Entry* a, Entry* b) {
+      if (a->resource->LastUsedFrame() != b->resource->LastUsedFrame()) {
+        return a->resource->LastUsedFrame() > b->resource->LastUsedFrame();
+      }
+      return a->order < b->order;
+    });
+
+    for (Entry* entry : waiting) {
+      Resource& resource = *entry->resource;
+      while (resource.CanUpgrade()) {
+        const size_t step = resource.UpgradeBytes();
+        if (step > uploadBytes || !MakeRoom(step)) {
+          break;
+        }
+        const size_t before = resource.Bytes();
+        resource.Upgrade();
+        stats.residentBytes += resource.Bytes() - before;
+        stats.upgrades++;
+        uploadBytes -= step;
+        Track();
+      }
+    }
+  }
+
+  ResidencyStats Stats() const {
+    ResidencyStats result = stats;
+    result.entries = entries.size();
+    for (auto& [key, entry] : entries) {
+      result.pendingUpgrades += entry.resource->CanUpgrade() ? 1 : 0;
+    }
+    return result;
+  }
+};
+
+/// @brief Headless check of ResidencyCache: loads more resources than the
+/// budget holds and verifies the eviction order, that referenced resources
+/// survive, that upgrades respect the budget and the peak usage.
+/// @return True when every check passed, failures are logged.
+bool CheckResidencyCache();
+}  // namespace resources
@@ -6,27 +6,90 @@
 #include <memory>
 
 #include <Model.hpp>
+#include <ResidencyCache.hpp>
+#include <ResourceRegistry.hpp>
 #include <Texture.hpp>
 
-#include <map>
+#include <mutex>
 #include <optional>
 #include <vector>
 
 namespace resources {
+using ModelHandle = Handle<models::Model>;
+
+/// @brief Owns every texture and model, shared by path. Safe to call from
+/// any thread, though textures are only created on the GL thread.
 class ResourceManager {
+ public:
+  static constexpr size_t kDefaultTextureBudget = 512ull << 20;
+  // texture levels uploaded per frame at most, upgrades wait for later frames
+  static constexpr size_t kTextureUploadPerFrame = 8ull << 20;
+
  private:
-  std::map<std::string, std::shared_ptr<models::Texture>> textures_loaded;
-  std::map<std::string, std::shared_ptr<models::Model>> models_loaded;
+  // the residency cache is not thread safe, and holding the lock while a
+  // texture uploads keeps two callers from loading the same path
+  mutable std::mutex texturesMutex;
+  ResidencyCache<models::Texture> textures_loaded{kDefaultTextureBudget};
+  ResourceRegistry<models::Model> models_loaded;
 
  public:
+  ResourceManager() = default;
+  // one per process, a copy would fill its own caches and lose them
+  ResourceManager(const ResourceManager&) = delete;
+  ResourceManager& operator=(const ResourceManager&) = delete;
+
   static ResourceManager& GetManager();
 
+  /// @brief Bytes of GPU memory the textures should stay within. Textures in
+  /// use are kept even when they exceed it.
+  void SetTextureBudget(size_t bytes);
+
+  /// @brief Per frame texture upkeep, on the GL thread before drawing:
+  /// evicts unused textures over budget and uploads larger levels of the
+  /// ones in use.
+  void BeginFrame();
+
+  ResidencyStats TextureStats() const;
+
   std::vector<std::shared_ptr<models::Texture>> LoadTextures(
       aiMaterial* mat,
       aiTextureType type,
       std::string typeName,
       std::optional<std::string> relativePath = std::nullopt);
 
+  /// @brief Paths of the textures of one type a material uses.
+  static std::vector<std::string> TexturePaths(
+      aiMaterial* mat,
+      aiTextureType type,
+      std::optional<std::string> relativePath = std::nullopt);
+
+  /// @brief Load a texture once, later calls with the same path share it.
+  std::shared_ptr<models::Texture> LoadTexture(std::string path,
+                                               std::string typeName);
+
+  /// @brief Load a texture decoded earlier, unless the path is already
+  /// loaded. Must be called on the GL thread.
+  std::shared_ptr<models::Texture> LoadTexture(std::string path,
+                                               std::string typeName,
+                                               models::TextureImage image);
+
+  /// @brief Load a model, blocking until it is on the GPU.
   std::shared_ptr<models::Model> LoadModel(std::string path);
+
+  /// @brief Start loading a model on the workers and return at once. The
+  /// model draws a placeholder until its upload ran on the GL thread, see
+  /// Model::IsReady and Model::LoadJob.
+  std::shared_ptr<models::Model> LoadModelAsync(std::string path);
+
+  /// @brief The handle of a loaded or loading model, invalid if there is
+  /// none.
+  ModelHandle FindModel(const std::string& path);
+
+  /// @return nullptr once the handle was released.
+  std::shared_ptr<models::Model> GetModel(ModelHandle handle);
+
+  /// @brief Forget a model, the next load of its path reads it again.
+  /// Whoever holds the model keeps it.
+  bool ReleaseModel(ModelHandle handle);
 };
 }  // namespace resources
\ No newline at end of file
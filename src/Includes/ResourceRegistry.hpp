@@ -0,0 +1,245 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace resources {
+
+/// @brief A path stored once for the whole process. Interned paths compare
+/// and hash by address, so registries never hash or copy the string again.
+class InternedPath {
+ private:
+  const std::string* value = nullptr;
+  size_t hash = 0;
+
+  InternedPath(const std::string* value, size_t hash)
+      : value(value), hash(hash) {}
+
+  friend InternedPath Intern(const std::string& path);
+
+ public:
+  InternedPath() = default;
+
+  const std::string& Str() const { return *value; }
+  size_t Hash() const { return hash; }
+  bool Empty() const { return value == nullptr; }
+
+  bool operator==(const InternedPath& other) const {
+    return value == other.value;
+  }
+  bool operator!=(const InternedPath& other) const {
+    return value != other.value;
+  }
+};
+
+/// @brief The interned copy of a path. Safe to call from any thread, the
+/// strings live until the process exits.
+InternedPath Intern(const std::string& path);
+
+/// @brief Names a resource in a ResourceRegistry. The generation changes
+/// whenever a slot is reused, so a handle to a released resource never
+/// resolves to whatever took its place.
+template <typename Resource>
+struct Handle {
+  // slot within the shard in the high bits, the shard in the low ones
+  uint32_t index = 0;
+  // zero for a handle that names nothing
+  uint32_t generation = 0;
+
+  bool Valid() const { return generation != 0; }
+
+  bool operator==(const Handle& other) const {
+    return index == other.index && generation == other.generation;
+  }
+  bool operator!=(const Handle& other) const { return !(*this == other); }
+};
+
+/// @brief Resources keyed on path and named by generational handles, safe
+/// for any number of threads at once.
+///
+/// Paths are spread over shards that lock independently, so loads of
+/// different paths rarely wait on each other. The first caller for a path
+/// runs the loader outside the lock; callers arriving meanwhile get the
+/// same handle and wait for that load instead of starting their own.
+template <typename Resource>
+class ResourceRegistry {
+ public:
+  using Loader = std::function<std::shared_ptr<Resource>()>;
+
+  static constexpr uint32_t kShardBits = 4;
+  static constexpr uint32_t kShards = 1u << kShardBits;
+
+ private:
+  struct Slot {
+    InternedPath path;
+    uint32_t generation = 1;
+    bool used = false;
+    std::shared_future<std::shared_ptr<Resource>> value;
+  };
+
+  struct InternedPathHash {
+    size_t operator()(const InternedPath& path) const { return path.Hash(); }
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<InternedPath, uint32_t, InternedPathHash> byPath;
+    std::vector<Slot> slots;
+    std::vector<uint32_t> free;
+  };
+
+  std::array<Shard, kShards> shards;
+
+  static uint32_t ShardOf(const InternedPath& path) {
+    return static_cast<uint32_t>(path.Hash() >> 7) & (kShards - 1);
+  }
+
+  // the slot a handle names, nullptr when it was released. Shard locked.
+  Slot* Resolve(Shard& shard, Handle<Resource> handle) {
+    const uint32_t slot = handle.index >> kShardBits;
+    if (!handle.Valid() || slot >= shard.slots.size() ||
+        !shard.slots[slot].used ||
+        shard.slots[slot].generation != handle.generation) {
+      return nullptr;
+    }
+    return &shard.slots[slot];
+  }
+
+  // drop a slot and its path, later handles to it stop resolving. Shard
+  // locked.
+  void Free(Shard& shard, uint32_t slot) {
+    Slot& entry = shard.slots[slot];
+    shard.byPath.erase(entry.path);
+    entry.used = false;
+    entry.value = {};
+    // zero is reserved for invalid handles
+    entry.generation = entry.generation + 1 == 0 ? 1 : entry.generation + 1;
+    shard.free.push_back(slot);
+  }
+
+ public:
+  /// @brief The handle of a path, loading it first if nobody has. Concurrent
+  /// calls for one path run the loader once.
+  /// @param path The key.
+  /// @param loader Runs on the calling thread, without any lock held.
+  /// @throws Whatever the loader throws. The path is forgotten so a later
+  /// call can try again.
+  Handle<Resource> Acquire(const std::string& path, const Loader& loader) {
+    const InternedPath key = Intern(path);
+    const uint32_t shardIndex = ShardOf(key);
+    Shard& shard = shards[shardIndex];
+
+    std::promise<std::shared_ptr<Resource>> promise;
+    Handle<Resource> handle;
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      auto it = shard.byPath.find(key);
+      if (it != shard.byPath.end()) {
+        return Handle<Resource>{it->second << kShardBits | shardIndex,
+                                shard.slots[it->second].generation};
+      }
+
+      uint32_t slot;
+      if (!shard.free.empty()) {
+        slot = shard.free.back();
+        shard.free.pop_back();
+      } else {
+        slot = static_cast<uint32_t>(shard.slots.size());
+        shard.slots.emplace_back();
+      }
+      Slot& entry = shard.slots[slot];
+      entry.path = key;
+      entry.used = true;
+      entry.value = promise.get_future().share();
+      shard.byPath[key] = slot;
+      handle = Handle<Resource>{slot << kShardBits | shardIndex,
+                                entry.generation};
+    }
+
+    try {
+      promise.set_value(loader());
+    } catch (...) {
+      promise.set_exception(std::current_exception());
+      Release(handle);
+      throw;
+    }
+    return handle;
+  }
+
+  /// @brief The resource a handle names, waiting if it is still loading.
+  /// @return nullptr once the handle was released.
+  /// @throws What the loader threw, when the load failed.
+  std::shared_ptr<Resource> Get(Handle<Resource> handle) {
+    std::shared_future<std::shared_ptr<Resource>> value;
+    {
+      Shard& shard = shards[handle.index & (kShards - 1)];
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      Slot* slot = Resolve(shard, handle);
+      if (!slot) {
+        return nullptr;
+      }
+      value = slot->value;
+    }
+    return value.get();
+  }
+
+  /// @brief Acquire and Get in one call.
+  std::shared_ptr<Resource> Load(const std::string& path,
+                                 const Loader& loader) {
+    return Get(Acquire(path, loader));
+  }
+
+  /// @brief The handle of a loaded or loading path, invalid if there is none.
+  Handle<Resource> Find(const std::string& path) {
+    const InternedPath key = Intern(path);
+    const uint32_t shardIndex = ShardOf(key);
+    Shard& shard = shards[shardIndex];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.byPath.find(key);
+    if (it == shard.byPath.end()) {
+      return {};
+    }
+    return Handle<Resource>{it->second << kShardBits | shardIndex,
+                            shard.slots[it->second].generation};
+  }
+
+  /// @brief Forget a resource. Whoever still holds the shared_ptr keeps it,
+  /// the next Acquire of the path loads it again.
+  /// @return False when the handle was already released.
+  bool Release(Handle<Resource> handle) {
+    Shard& shard = shards[handle.index & (kShards - 1)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (!Resolve(shard, handle)) {
+      return false;
+    }
+    Free(shard, handle.index >> kShardBits);
+    return true;
+  }
+
+  /// @brief Resources loaded or loading.
+  size_t Size() {
+    size_t result = 0;
+    for (auto& shard : shards) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      result += shard.byPath.size();
+    }
+    return result;
+  }
+};
+
+/// @brief Headless stress test of ResourceRegistry: many threads acquire,
+/// get and release overlapping paths at once. Checks every path loads once
+/// while it is held, handles stay stable and released handles go stale.
+/// Meant to also run under ThreadSanitizer.
+/// @return True when every check passed, failures are logged.
+bool CheckResourceRegistry();
+}  // namespace resources
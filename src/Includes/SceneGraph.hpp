@@ -0,0 +1,53 @@
+#pragma once
+
+#include <glm/mat4x4.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace models {
+
+/// @brief A node of a model file. Nodes reference meshes by index, so a mesh
+/// used by several nodes is stored and uploaded once.
+struct SceneNode {
+  // index of the parent node, -1 for the root; parents precede children
+  int parent = -1;
+  // relative to the parent
+  glm::mat4 transform = glm::mat4(1.0f);
+  std::vector<unsigned int> meshes;
+};
+
+/// @brief The node hierarchy of a model, flattened into instances grouped by
+/// mesh so each mesh binds its buffers once and draws every placement.
+class SceneGraph {
+ private:
+  std::vector<SceneNode> nodes;
+
+  // world transforms of every placement, indexed by mesh
+  std::vector<std::vector<glm::mat4>> instances;
+
+ public:
+  /// @brief Append a node.
+  /// @param parent An already added node, or -1 for a root.
+  /// @return The index of the node.
+  /// @throws std::runtime_error when the parent does not exist yet.
+  int AddNode(int parent,
+              const glm::mat4& transform,
+              std::vector<unsigned int> meshes);
+
+  /// @brief Recompute the world transforms and regroup them by mesh.
+  /// @param meshCount Number of meshes the nodes refer to.
+  /// @throws std::runtime_error when a node refers to a missing mesh.
+  void Update(size_t meshCount);
+
+  const std::vector<SceneNode>& Nodes() const { return this->nodes; }
+
+  /// @brief World transforms of every placement of a mesh.
+  const std::vector<glm::mat4>& Instances(unsigned int mesh) const {
+    return this->instances[mesh];
+  }
+
+  /// @brief Total number of placements over all meshes.
+  size_t InstanceCount() const;
+};
+}  // namespace models
@@ -14,27 +14,106 @@
 #define GLM_FORCE_RADIANS
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
 #include <initializer_list>
 #include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
 class Shader;
 class ShaderProgram;
 
-// Loads a shader from a file into OpenGL.
+namespace rendering {
+class ProgramCache;
+}
+
+// FNV-1a, usable in constant expressions so literal names hash at compile
+// time.
+constexpr uint32_t hashUniformName(const char* name, size_t length) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= static_cast<uint8_t>(name[i]);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// A uniform name and its hash. Built from a string literal the hash is a
+// constant, so looking a uniform up allocates nothing. The name is only kept
+// for error messages and must outlive the call it is passed to.
+class UniformId {
+ public:
+  template <size_t N>
+  constexpr UniformId(const char (&name)[N])
+      : hash(hashUniformName(name, N - 1)), name(name) {}
+  UniformId(const std::string& name)
+      : hash(hashUniformName(name.data(), name.size())), name(name.c_str()) {}
+
+  constexpr uint32_t getHash() const { return hash; }
+  constexpr const char* getName() const { return name; }
+
+ private:
+  uint32_t hash;
+  const char* name;
+};
+
+// The location of a uniform in one program, resolved once. Setting a uniform
+// through a handle is a plain GL call.
+enum class UniformHandle : GLint {};
+
+// Binding points of the uniform blocks programs share. A program binds every
+// block it declares with one of these names at link time.
+enum UniformBlockBinding : GLuint {
+  // per-frame data: projection, view and camera position
+  kFrameBlockBinding = 0,
+};
+
+// One active uniform found when the program was linked.
+struct UniformInfo {
+  uint32_t hash;
+  GLint location;
+  GLenum type;
+  GLint size;
+  std::string name;
+};
+
+// Loads a shader from a file into OpenGL. The source is read up front and
+// compiled the first time a program needs it, so a program loaded from the
+// binary cache never compiles its shaders.
 class Shader {
  public:
   // Load Shader from a file
   Shader(const std::string& filename, GLenum type);
 
-  // provide opengl shader identifiant.
+  // start the compilation without waiting for it. Copies share it, so a
+  // shader used by several programs is compiled once
+  void compile() const;
+
+  // wait for the compilation and report its errors
+  void checkCompile() const;
+
+  // provide opengl shader identifiant, 0 before compile()
   GLuint getHandle() const;
 
+  GLenum getType() const;
+  const std::string& getSource() const;
+
   ~Shader();
 
  private:
-  // opengl program identifiant
-  GLuint handle;
+  struct State {
+    std::string filename;
+    GLenum type;
+    std::string source;
+    // opengl shader identifiant
+    GLuint handle = 0;
+    bool checked = false;
+
+    ~State();
+  };
+  std::shared_ptr<State> state;
 
   friend class ShaderProgram;
 };
@@ -46,9 +125,22 @@ class Shader {
 // using GLM objects.
 class ShaderProgram {
  public:
-  // constructor
+  // compile and link, waiting for the result
   ShaderProgram(std::initializer_list<Shader> shaderList);
 
+  // load the program from the binary cache, or compile and start linking it.
+  // The link completes in finish(), so programs created one after the other
+  // build at the same time
+  ShaderProgram(std::initializer_list<Shader> shaderList,
+                rendering::ProgramCache& cache);
+
+  // wait for the link, report errors, reflect the uniforms and store the
+  // binary in the cache. Does nothing once finished
+  void finish();
+
+  // the program came out of the binary cache
+  bool fromCache() const;
+
   // bind the program
   void use() const;
   void unuse() const;
@@ -65,33 +157,60 @@ class ShaderProgram {
   void setAttribute(const std::string& name, GLint size, GLsizei stride, GLuint offset);
   // clang-format on
 
-  // provide uniform location
-  GLint uniform(const std::string& name);
+  // provide uniform location, from the table built at link time
+  GLint uniform(UniformId name);
+
+  // provide a handle to set a uniform without any lookup
+  UniformHandle uniformHandle(UniformId name);
+
+  // every active uniform outside a block, sorted by hash
+  const std::vector<UniformInfo>& activeUniforms() const;
 
   // affect uniform
-  void setUniform(const std::string& name, float x, float y, float z);
-  void setUniform(const std::string& name, const glm::vec3& v);
-  void setUniform(const std::string& name, const glm::dvec3& v);
-  void setUniform(const std::string& name, const glm::vec4& v);
-  void setUniform(const std::string& name, const glm::dvec4& v);
-  void setUniform(const std::string& name, const glm::dmat4& m);
-  void setUniform(const std::string& name, const glm::mat4& m);
-  void setUniform(const std::string& name, const glm::mat3& m);
-  void setUniform(const std::string& name, float val);
-  void setUniform(const std::string& name, int val);
+  void setUniform(UniformId name, float x, float y, float z);
+  void setUniform(UniformId name, const glm::vec2& v);
+  void setUniform(UniformId name, const glm::vec3& v);
+  void setUniform(UniformId name, const glm::dvec3& v);
+  void setUniform(UniformId name, const glm::vec4& v);
+  void setUniform(UniformId name, const glm::dvec4& v);
+  void setUniform(UniformId name, const glm::dmat4& m);
+  void setUniform(UniformId name, const glm::mat4& m);
+  void setUniform(UniformId name, const glm::mat3& m);
+  void setUniform(UniformId name, float val);
+  void setUniform(UniformId name, int val);
+
+  // affect uniform through a handle
+  void setUniform(UniformHandle handle, const glm::vec2& v);
+  void setUniform(UniformHandle handle, const glm::vec3& v);
+  void setUniform(UniformHandle handle, const glm::vec4& v);
+  void setUniform(UniformHandle handle, const glm::mat4& m);
+  void setUniform(UniformHandle handle, const glm::mat3& m);
+  void setUniform(UniformHandle handle, float val);
+  void setUniform(UniformHandle handle, int val);
 
   ~ShaderProgram();
 
  private:
   ShaderProgram();
 
-  std::map<std::string, GLint> uniforms;
+  // reflected at link time, sorted by hash
+  std::vector<UniformInfo> uniforms;
+  // hashes of names asked for but not found, reported once each
+  std::vector<uint32_t> missingUniforms;
   std::map<std::string, GLint> attributes;
 
   // opengl id
   GLuint handle;
 
+  // the shaders of a link that has not been finished
+  std::vector<Shader> shaders;
+  rendering::ProgramCache* cache = nullptr;
+  uint64_t cacheKey = 0;
+  bool linking = false;
+  bool cached = false;
+
   void link();
+  void reflect();
 };
 
 #endif  // OPENGL_CMAKE_SKELETON_SHADER_HPP
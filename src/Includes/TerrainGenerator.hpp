@@ -13,15 +13,30 @@
 
 #include <OGLApplication.hpp>
 
+#include <Cdlod.hpp>
+#include <ChunkManager.hpp>
+#include <Culling.hpp>
+#include <Erosion.hpp>
+#include <HeightPyramid.hpp>
+#include <Heightfield.hpp>
 #include <Model.hpp>
+#include <ModelInstances.hpp>
+#include <Noise.hpp>
+#include <Physics.hpp>
+#include <RenderQueue.hpp>
 #include <Shader.hpp>
+#include <TileStore.hpp>
+#include <UniformBuffer.hpp>
+#include <Water.hpp>
 
+#include <chrono>
 #include <memory>
 #include <ConfigReader.hpp>
 
 class TerrainGenerator : public OGLApplication {
  public:
   TerrainGenerator(config::ConfigReader& configReader);
+  ~TerrainGenerator();
   glm::vec3 cameraPos;
   glm::vec3 cameraFront;
   glm::vec3 cameraUp;
@@ -38,6 +53,17 @@ class TerrainGenerator : public OGLApplication {
   float znear = 0.01f;
   float zfar = 150.0f;
 
+  /// @brief Run one of the GL benchmarks of the keys on this window's
+  /// context and assets instead of the frame loop, so scripts can run it.
+  /// @param name "instancing" or "uniforms".
+  /// @return False when the benchmark is unknown or could not run.
+  bool RunBenchmark(const std::string& name);
+
+  /// @brief Speed and PSNR of the texture encoders on an image generated
+  /// from the noise. Needs no window.
+  static void BenchmarkTextureCompression(
+      const terrain::NoiseParameters& noiseParameters);
+
  protected:
   virtual void render();
   virtual void mouseMoved(GLFWwindow*, double, double);
@@ -45,23 +71,145 @@ class TerrainGenerator : public OGLApplication {
 
  private:
   void Init();
+  void ReadTerrainConfig(const config::ConfigSnapshot& config);
+
+  config::ConfigReader& configReader;
+  int configSubscription = -1;
   const int size = 1024;
   size_t num_vertices;
   size_t num_indexes;
 
+  // Terrain
+  terrain::NoiseParameters noiseParameters;
+  std::unique_ptr<terrain::Heightfield> heightfield;
+  float terrainSpacing = 0.25f;
+  float terrainHeightScale = 40.0f;
+
+  // The heightfield is centred on the origin, on the grid of the streamed
+  // chunks: column zero is sample GridFirst() in both.
+  int GridFirst() const { return -(size / 2); }
+  float GridOrigin() const { return terrainSpacing * GridFirst(); }
+
+  // Ground height and ray queries over the fixed heightfield
+  std::unique_ptr<terrain::HeightPyramid> heightPyramid;
+  void BenchmarkRaycasts();
+
+  // Droplet erosion of the fixed heightfield, streamed chunks are not
+  // eroded
+  terrain::ErosionSettings erosionSettings;
+  void BenchmarkErosion();
+
+  // Shallow water over the fixed heightfield. Steps run on the workers at
+  // their own rate, one batch at a time; the GL thread only touches the
+  // simulation between batches.
+  bool waterSimulation = true;
+  terrain::WaterSettings waterSettings;
+  std::unique_ptr<terrain::ShallowWater> water;
+  std::unique_ptr<terrain::WaterRenderer> waterRenderer;
+  jobs::JobHandle waterJob;
+  std::chrono::steady_clock::time_point waterClock;
+  // the spring R places under the camera, applied between batches
+  bool waterSpring = false;
+  terrain::WaterSource waterSource;
+  void UpdateWater(const camera::Frustum* frustum);
+  void StopWater();
+
+  // Bodies K drops onto the fixed heightfield, drawn as copies of the first
+  // model. Like the water, steps run on the workers one batch at a time.
+  physics::PhysicsSettings physicsSettings;
+  std::unique_ptr<physics::PhysicsWorld> physicsWorld;
+  std::unique_ptr<models::ModelInstances> droppedModels;
+  jobs::JobHandle physicsJob;
+  std::chrono::steady_clock::time_point physicsClock;
+  // model space to body space, fitting the model into its box
+  glm::mat4 droppedModelOffset = glm::mat4(1.0f);
+  void UpdatePhysics();
+  void StopPhysics();
+  void DropBodies();
+
+  // Streams chunks around the camera instead of drawing the fixed grid
+  bool terrainStreaming = true;
+  terrain::ChunkSettings chunkSettings;
+  std::unique_ptr<terrain::ChunkManager> chunkManager;
+
+  // Streamed chunks are kept on disk, empty disables the store
+  std::string terrainTilePath;
+  terrain::TileFormat terrainTileFormat = terrain::TileFormat::Float32;
+  std::shared_ptr<terrain::TileStore> tileStore;
+
+  // CDLOD over the fixed heightfield when not streaming, the full
+  // resolution mesh in vao/vbo/ibo otherwise
+  bool terrainLod = true;
+  bool lodSelectionReport = false;
+  terrain::CdlodSettings cdlodSettings;
+  std::unique_ptr<terrain::CdlodQuadtree> cdlodTree;
+  std::unique_ptr<terrain::CdlodRenderer> cdlodRenderer;
+  std::vector<terrain::CdlodSelectedNode> cdlodSelection;
+
+  void GenerateTerrain();
+  void RegenerateTerrain();
+  void LogChunkStats();
+  void LogMemoryUsage(const std::string& context);
+  void ReportLodSelection();
+
   // Movement speed
   const float running_speed = 0.5f;
   const float walking_speed = 0.01f;
   float speed = walking_speed;
 
-  // Model
-  std::string modelPath;
+  // Walk on the ground inside the heightfield instead of flying
+  bool cameraFollowTerrain = true;
+  float cameraEyeHeight = 2.0f;
+
+  // Models
+  std::vector<std::string> modelPaths;
+
+  // copies of the first model scattered over the terrain
+  int modelInstanceCount = 0;
+  bool instancedRendering = true;
+  std::unique_ptr<models::ModelInstances> scatteredModels;
+
+  std::vector<models::MeshInstance> ScatterInstances(size_t count,
+                                                     uint32_t seed) const;
+  bool BenchmarkInstancing();
+
+  // Culling: chunks, model meshes and scattered copies outside the view
+  // frustum are skipped
+  bool frustumCulling = true;
+
+  // one per mesh placement of every loaded model, grouped by model and mesh
+  struct MeshPlacement {
+    size_t model;
+    unsigned int mesh;
+    glm::mat4 transform;
+  };
+  std::vector<MeshPlacement> placements;
+  camera::BoundingVolumeHierarchy placementHierarchy;
+  size_t placedModels = 0;
+  std::vector<uint32_t> visiblePlacements;
+
+  void RecordModels(const camera::Frustum* frustum);
+  void BenchmarkCulling();
+
+  // model draws are recorded during the frame and submitted sorted
+  rendering::RenderQueue renderQueue;
+  void LogRenderStats();
 
   // shader
   std::unique_ptr<ShaderProgram> shaderProgram;
+  std::unique_ptr<ShaderProgram> terrainShaderProgram;
+  std::unique_ptr<ShaderProgram> instancedShaderProgram;
+  std::unique_ptr<ShaderProgram> waterShaderProgram;
+
+  // projection, view and camera, read by every program's Frame block
+  std::unique_ptr<rendering::UniformBuffer> frameUniforms;
+  bool BenchmarkUniforms();
 
   std::string vertexShaderPath;
   std::string fragmentShaderPath;
+  std::string terrainVertexShaderPath;
+  std::string instancedVertexShaderPath;
+  std::string waterVertexShaderPath;
 
   // shader matrix uniforms, start with identity
   glm::mat4 model = glm::mat4(1.0);
@@ -69,7 +217,7 @@ class TerrainGenerator : public OGLApplication {
   glm::mat4 view = glm::mat4(1.0);
 
   // VBO/VAO/ibo
-  GLuint vao, vbo, ibo;
+  GLuint vao = 0, vbo = 0, ibo = 0;
 
   // polygon representation
   GLenum polygonModes[2] = {GL_FILL, GL_LINE};
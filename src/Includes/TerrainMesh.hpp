@@ -0,0 +1,85 @@
+#pragma once
+
+#include <Heightfield.hpp>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace terrain {
+
+struct TerrainVertex {
+  glm::vec3 position;
+  glm::vec3 normal;
+  glm::vec4 color;
+  // unit surface direction along +x, the bitangent is cross(tangent, normal)
+  glm::vec3 tangent;
+};
+
+/// @brief Heightfield samples [x0, x1) by [z0, z1).
+struct SampleRect {
+  int x0 = 0;
+  int z0 = 0;
+  int x1 = 0;
+  int z1 = 0;
+};
+
+/// @brief Build vertices for the interior of a heightfield.
+///
+/// Normals and tangents come from central differences, one sided at the
+/// edges of the field. They are computed a row at a time, 8 samples at once
+/// with AVX2 or 4 with SSE4.1; the scalar path performs the same operations
+/// in the same order.
+/// @param field The heightfield, including an apron of border samples.
+/// @param border Width of the apron used only for normals; no vertices are
+/// emitted for it.
+/// @param originX Grid x of the first interior sample, in samples. World
+/// positions are computed as (origin + index) * spacing so neighbouring
+/// chunks produce bit identical edge vertices.
+/// @param originZ Grid z of the first interior sample, in samples.
+/// @param spacing World distance between neighbouring samples.
+/// @param heightScale Multiplier applied to the stored heights.
+/// @param vertices Output vertices, row-major over the interior.
+/// @param simd False takes the scalar path.
+void BuildTerrainVertices(const HeightfieldView& field,
+                          int border,
+                          float originX,
+                          float originZ,
+                          float spacing,
+                          float heightScale,
+                          std::vector<TerrainVertex>& vertices,
+                          bool simd = true);
+
+/// @brief Refresh vertices built by BuildTerrainVertices after the heights
+/// of some samples changed. The normals one sample around the change read
+/// the new heights as well, so they are recomputed with it; nothing else
+/// is touched.
+/// @param field The edited heightfield, laid out as when it was built.
+/// @param changed The samples whose heights changed, clamped to the field.
+void UpdateTerrainVertices(const HeightfieldView& field,
+                           int border,
+                           float spacing,
+                           float heightScale,
+                           const SampleRect& changed,
+                           std::vector<TerrainVertex>& vertices,
+                           bool simd = true);
+
+/// @brief Build triangle indices for a square grid of vertices.
+/// @param resolution The number of vertices along each side.
+/// @return Two triangles per grid cell.
+std::vector<unsigned int> BuildGridIndices(int resolution);
+
+/// @brief Bind the TerrainVertex attributes for the currently bound VAO/VBO.
+void SetupTerrainVertexAttributes();
+
+/// @brief The instruction set the normal kernel was compiled for.
+const char* TerrainMeshSimdPath();
+
+/// @brief Headless check of the vertex builder: compares the vector and
+/// scalar paths bit for bit on float and quantized fields, with and without
+/// an apron, checks the normals against the plain glm formula, and that
+/// updating an edited rectangle matches a full rebuild. Logs the build time
+/// of a 1024x1024 grid on both paths.
+/// @return True when every check passed, failures are logged.
+bool CheckTerrainVertices();
+}  // namespace terrain
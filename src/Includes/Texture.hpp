@@ -1,19 +1,90 @@
 #pragma once
 
+#include <TextureCompression.hpp>
+
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <vector>
 
 namespace models {
+
+/// @brief A processed mip chain waiting for upload, level 0 first down to
+/// 1x1.
+struct TextureImage {
+  int width = 0;
+  int height = 0;
+  TextureFormat format = TextureFormat::kRgba8;
+  std::vector<TextureLevel> levels;
+};
+
+/// @brief A texture on the GPU. It starts with the levels up to
+/// kStreamingSize resident and is upgraded one level at a time, see
+/// ResidencyCache, until the full chain is uploaded.
 class Texture {
+ public:
+  // largest side of the levels uploaded when the texture is created
+  static constexpr int kStreamingSize = 128;
+
  private:
   std::string type;
   unsigned int id;
   std::string path;
 
+  TextureFormat format = TextureFormat::kRgba8;
+  // the largest level on the GPU, every smaller one is resident too
+  int baseLevel = 0;
+  size_t bytes = 0;
+  // the levels above baseLevel, released once uploaded
+  std::vector<TextureLevel> pending;
+  uint64_t lastUsedFrame = 0;
+
+  static uint64_t currentFrame;
+
+  void Upload(TextureImage image);
+  void UploadLevel(int level, const TextureLevel& data);
+
  public:
   std::string Type() const { return this->type; }
   unsigned int Id() const { return this->id; }
   std::string Path() const { return this->path; }
 
+  /// @brief Decode and upload the image at path.
   Texture(std::string path, std::string typeName);
+
+  /// @brief Upload an image decoded earlier. Must be called on the GL thread.
+  Texture(std::string path, std::string typeName, TextureImage image);
+
+  ~Texture();
+
+  Texture(const Texture&) = delete;
+  Texture& operator=(const Texture&) = delete;
+
+  /// @brief Load the processed mip chain of an image file from the texture
+  /// cache. On a miss the file is decoded, its mips are built and compressed
+  /// for the usage of the type, and the result is cached. Safe to call from
+  /// any thread.
+  /// @throws std::runtime_error when the file cannot be decoded.
+  static TextureImage Decode(const std::string& path,
+                             const std::string& typeName);
+
+  /// @brief Start a new frame for LastUsedFrame.
+  static void AdvanceFrame() { currentFrame++; }
+
+  /// @brief Record that the texture is used in the current frame.
+  void MarkUsed() { this->lastUsedFrame = currentFrame; }
+  uint64_t LastUsedFrame() const { return this->lastUsedFrame; }
+
+  /// @brief GPU memory of the resident levels.
+  size_t Bytes() const { return this->bytes; }
+
+  /// @brief Levels are still waiting for upload.
+  bool CanUpgrade() const { return !this->pending.empty(); }
+
+  /// @brief GPU memory the next Upgrade adds.
+  size_t UpgradeBytes() const;
+
+  /// @brief Upload the next larger level. Must be called on the GL thread.
+  void Upgrade();
 };
-}  // namespace models
\ No newline at end of file
+}  // namespace models
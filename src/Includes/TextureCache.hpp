@@ -0,0 +1,39 @@
+#pragma once
+
+#include <Texture.hpp>
+#include <TextureCompression.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace models {
+
+/// @brief Disk cache of processed textures: the mip chain, compressed.
+///
+/// The layout follows KTX2: an identifier, a header, then an index holding
+/// the offset and size of every level, with the levels stored smallest first
+/// so a streaming reader can show the low mips before the rest arrived. It
+/// is not a conforming KTX2 file, there is no data format descriptor and the
+/// format is a TextureFormat instead of a Vulkan format.
+///
+/// Entries are keyed on a hash of the source file contents and its usage,
+/// an edited image or a change to the encoders never hits a stale entry.
+class TextureCache {
+ public:
+  /// @brief Hash the encoded source file together with the usage.
+  static uint64_t Key(const uint8_t* file, size_t size, TextureUsage usage);
+
+  /// @brief Where the entry for a key lives.
+  static std::string PathFor(uint64_t key);
+
+  /// @brief Read an entry.
+  /// @return False when it is missing or invalid.
+  static bool Read(uint64_t key, TextureImage& image);
+
+  /// @brief Write the levels of a processed image. The file is written under
+  /// a temporary name and renamed, readers never see a partial entry.
+  /// @throws std::runtime_error when the entry cannot be written.
+  static void Write(uint64_t key, const TextureImage& image);
+};
+}  // namespace models
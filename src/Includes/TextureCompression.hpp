@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace models {
+
+/// @brief How the levels of a texture are stored. The block formats encode
+/// 4x4 pixels per block, RGBA8 is the uncompressed fallback.
+enum class TextureFormat : uint32_t {
+  kRgba8 = 0,
+  // RGB at 4 bits per pixel, for opaque color
+  kBc1 = 1,
+  // BC1 color and an interpolated alpha block, 8 bits per pixel
+  kBc3 = 3,
+  // two interpolated channels, for normal maps (z is reconstructed)
+  kBc5 = 5,
+  // RGBA at 8 bits per pixel, only mode 6 is produced
+  kBc7 = 7,
+};
+
+/// @brief Bytes per 4x4 block, or per pixel for kRgba8.
+size_t TextureFormatBlockSize(TextureFormat format);
+
+/// @brief Bytes of one level of the given size.
+size_t TextureLevelSize(TextureFormat format, int width, int height);
+
+const char* TextureFormatName(TextureFormat format);
+
+/// @brief One mip level, tightly packed rows of pixels or of blocks.
+struct TextureLevel {
+  int width = 0;
+  int height = 0;
+  std::vector<uint8_t> data;
+};
+
+/// @brief What the texture holds, it decides the format and whether mips
+/// are averaged in linear light.
+enum class TextureUsage {
+  // sRGB encoded color, mips are filtered after decoding to linear
+  kColor,
+  // linear data such as specular or height maps
+  kData,
+  // tangent space normals, only x and y are kept
+  kNormal,
+};
+
+/// @brief The usage of an assimp texture type name such as texture_normal.
+TextureUsage TextureUsageFor(const std::string& typeName);
+
+/// @brief Build the full mip chain of an RGBA8 image down to 1x1. Each level
+/// is a 2x2 box filter of the previous one, in linear light for kColor.
+/// @param base Level 0, its data is moved into the result.
+std::vector<TextureLevel> BuildMipChain(TextureLevel base, TextureUsage usage);
+
+/// @brief Pick the block format for a mip chain: BC5 for normals, BC1 when
+/// every pixel is opaque, BC7 otherwise.
+TextureFormat ChooseTextureFormat(const TextureLevel& base,
+                                  TextureUsage usage);
+
+/// @brief Compress RGBA8 levels to a block format. The blocks of all levels
+/// are spread over the job system.
+/// @param threaded False encodes on the calling thread only.
+std::vector<TextureLevel> CompressLevels(const std::vector<TextureLevel>& rgba,
+                                         TextureFormat format,
+                                         bool threaded = true);
+
+/// @brief Decode compressed levels back to RGBA8. Used when the driver lacks
+/// the format and to measure the encoders.
+std::vector<TextureLevel> DecompressLevels(
+    const std::vector<TextureLevel>& blocks,
+    TextureFormat format);
+
+/// @brief Peak signal to noise ratio between two RGBA8 images of the same
+/// size, over the channels the format keeps.
+/// @return The PSNR in dB, infinity when the images are identical.
+double TexturePsnr(const TextureLevel& reference,
+                   const TextureLevel& decoded,
+                   TextureFormat format);
+
+/// @brief Speed and quality of one encoder on one image.
+struct TextureEncoderBenchmark {
+  TextureFormat format = TextureFormat::kRgba8;
+  double singleThreadMs = 0.0;
+  double threadedMs = 0.0;
+  // megapixels per second with the job system
+  double megapixelsPerSecond = 0.0;
+  // of level 0
+  double psnr = 0.0;
+  // RGBA8 bytes over compressed bytes, for the whole chain
+  double ratio = 0.0;
+};
+
+/// @brief Encode the mip chain of an image with BC1, BC3, BC5 and BC7, on
+/// one thread and on the job system, and measure what each lost.
+std::vector<TextureEncoderBenchmark> BenchmarkTextureEncoders(
+    const TextureLevel& image);
+}  // namespace models
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <Heightfield.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+
+namespace terrain {
+
+enum class TileFormat : uint32_t {
+  Float32 = 0,
+  // heights quantised to [minHeight, maxHeight]
+  Unorm16 = 1,
+};
+
+struct TileStoreSettings {
+  // Samples along each side of the finest level.
+  int resolution = 131;
+
+  // Levels per tile including the finest one, each halves the resolution.
+  int mipCount = 4;
+
+  TileFormat format = TileFormat::Float32;
+  float minHeight = -1.0f;
+  float maxHeight = 1.0f;
+
+  // Index slots, a power of two. Writes stop once the index is 3/4 full.
+  uint32_t capacity = 1 << 16;
+
+  // Identifies the generator that produced the tiles, a file written with a
+  // different key is discarded.
+  uint64_t key = 0;
+};
+
+struct TileStoreStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t written = 0;
+  uint64_t tiles = 0;
+  uint64_t fileBytes = 0;
+  uint64_t mappedBytes = 0;
+};
+
+/// @brief Process wide memory counters, for comparing the tile store against
+/// in-memory generation.
+struct MemoryUsage {
+  uint64_t residentBytes = 0;
+  uint64_t peakResidentBytes = 0;
+  uint64_t minorFaults = 0;
+  uint64_t majorFaults = 0;
+};
+
+/// @brief One tile mapped read-only from the store. The samples stay valid
+/// for the lifetime of the view.
+class TileView {
+ private:
+  void* mapping = nullptr;
+  size_t mappingSize = 0;
+  const uint8_t* data = nullptr;
+  TileStoreSettings settings;
+
+ public:
+  TileView(void* mapping,
+           size_t mappingSize,
+           const uint8_t* data,
+           const TileStoreSettings& settings);
+  ~TileView();
+
+  TileView(const TileView&) = delete;
+  TileView& operator=(const TileView&) = delete;
+
+  int Levels() const { return settings.mipCount; }
+
+  /// @brief The samples of one mip level, zero-copy.
+  HeightfieldView Level(int level) const;
+};
+
+/// @brief Out-of-core store for heightfield tiles keyed on chunk coordinates.
+///
+/// The file starts with a fixed header and an open addressing index of tile
+/// offsets, both mapped writable. Tiles are appended page aligned behind it,
+/// each holding every mip level, and are mapped read-only on demand so the
+/// kernel only faults in the pages that are actually read. Reads and writes
+/// may come from any thread.
+class TileStore {
+ private:
+  std::string path;
+  TileStoreSettings settings;
+  int fd = -1;
+
+  // header followed by the index
+  void* header = nullptr;
+  size_t headerSize = 0;
+
+  size_t tileBytes = 0;
+
+  std::shared_mutex indexMutex;
+  std::mutex appendMutex;
+
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> misses{0};
+  std::atomic<uint64_t> written{0};
+  std::atomic<uint64_t> mappedBytes{0};
+
+  bool OpenExisting();
+  void Create();
+  int64_t Find(int x, int z) const;
+
+ public:
+  /// @brief Open the store at path, creating it when it is missing or was
+  /// written with different settings.
+  /// @throws std::runtime_error when the file cannot be opened or mapped.
+  TileStore(std::string path, TileStoreSettings settings);
+  ~TileStore();
+
+  TileStore(const TileStore&) = delete;
+  TileStore& operator=(const TileStore&) = delete;
+
+  const TileStoreSettings& Settings() const { return this->settings; }
+
+  /// @brief Map a tile.
+  /// @return The tile, or nullptr when it has not been written.
+  std::unique_ptr<TileView> Read(int x, int z);
+
+  /// @brief Build the mip levels of a tile and append it. Tiles already in
+  /// the store are left alone.
+  /// @param field The finest level, resolution samples on each side.
+  /// @return False when the index is full.
+  bool Write(int x, int z, const Heightfield& field);
+
+  TileStoreStats Stats();
+
+  /// @brief Resident set size and page fault counts of this process.
+  static MemoryUsage ProcessMemory();
+};
+}  // namespace terrain
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <Shader.hpp>
+
+#include <cstddef>
+#include <type_traits>
+
+namespace rendering {
+
+/// @brief The Frame uniform block, std140: every member is 16 byte aligned.
+struct FrameUniforms {
+  glm::mat4 projection;
+  glm::mat4 view;
+  // xyz is the camera position, w is unused
+  glm::vec4 camera;
+};
+
+static_assert(sizeof(FrameUniforms) == 144,
+              "FrameUniforms must match the std140 layout of Frame");
+
+/// @brief A uniform buffer bound to a fixed binding point. Every program
+/// declaring the matching block reads it, so it is written once per frame
+/// instead of once per program.
+class UniformBuffer {
+ private:
+  GLuint buffer = 0;
+  GLuint binding;
+  size_t size;
+
+ public:
+  /// @param binding The binding point, see UniformBlockBinding.
+  /// @param size Size of the block in bytes.
+  UniformBuffer(GLuint binding, size_t size);
+  ~UniformBuffer();
+
+  UniformBuffer(const UniformBuffer&) = delete;
+  UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+  /// @brief Replace the whole block.
+  void Update(const void* data);
+
+  template <typename Block>
+  void Update(const Block& block) {
+    static_assert(std::is_trivially_copyable<Block>::value,
+                  "uniform blocks are copied bytewise");
+    Update(static_cast<const void*>(&block));
+  }
+
+  GLuint Binding() const { return this->binding; }
+};
+}  // namespace rendering
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <Mesh.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace models {
+
+/// @brief Bounds of a mesh, quantized positions are stored relative to them.
+/// The vertex shader decodes offset + position * scale.
+struct VertexQuantization {
+  glm::vec3 offset = glm::vec3(0.0f);
+  glm::vec3 scale = glm::vec3(1.0f);
+
+  /// @brief The bounding box of the vertices, degenerate axes get a unit
+  /// scale so they still decode exactly.
+  static VertexQuantization FromBounds(const VertexType* vertices,
+                                       size_t count);
+};
+
+/// @brief Optional attributes, the ones a mesh does not use are left out of
+/// its layout.
+enum VertexAttributes : unsigned int {
+  kVertexTexCoords = 1 << 0,
+  kVertexTangents = 1 << 1,
+};
+
+/// @brief Find the optional attributes holding anything but zeros.
+unsigned int DetectVertexAttributes(const VertexType* vertices, size_t count);
+
+namespace packing {
+
+uint16_t FloatToHalf(float value);
+float HalfToFloat(uint16_t value);
+
+uint16_t PackUnorm16(float value);
+float UnpackUnorm16(uint16_t value);
+
+/// @brief Signed normalized 10:10:10:2, the layout of GL_INT_2_10_10_10_REV.
+uint32_t PackSnorm1010102(glm::vec3 value);
+glm::vec3 UnpackSnorm1010102(uint32_t value);
+
+uint32_t PackUnorm4x8(glm::vec4 value);
+glm::vec4 UnpackUnorm4x8(uint32_t value);
+}  // namespace packing
+
+/// @brief The attributes a layout is built from. Each one knows its shader
+/// location, its packed size and GL format, and how to convert a VertexType
+/// field in both directions.
+namespace attributes {
+
+/// @brief Three unorm16 relative to the mesh bounds, padded to 8 bytes.
+struct Position {
+  static constexpr GLuint kLocation = 0;
+  static constexpr size_t kSize = 8;
+  static constexpr GLint kComponents = 3;
+  static constexpr GLenum kType = GL_UNSIGNED_SHORT;
+  static constexpr GLboolean kNormalized = GL_TRUE;
+
+  static void Pack(const VertexType& vertex,
+                   const VertexQuantization& quantization,
+                   uint8_t* out);
+  static void Unpack(const uint8_t* in,
+                     const VertexQuantization& quantization,
+                     VertexType& vertex);
+};
+
+struct Normal {
+  static constexpr GLuint kLocation = 1;
+  static constexpr size_t kSize = 4;
+  static constexpr GLint kComponents = 4;
+  static constexpr GLenum kType = GL_INT_2_10_10_10_REV;
+  static constexpr GLboolean kNormalized = GL_TRUE;
+
+  static void Pack(const VertexType& vertex,
+                   const VertexQuantization& quantization,
+                   uint8_t* out);
+  static void Unpack(const uint8_t* in,
+                     const VertexQuantization& quantization,
+                     VertexType& vertex);
+};
+
+/// @brief RGBA8.
+struct Color {
+  static constexpr GLuint kLocation = 2;
+  static constexpr size_t kSize = 4;
+  static constexpr GLint kComponents = 4;
+  static constexpr GLenum kType = GL_UNSIGNED_BYTE;
+  static constexpr GLboolean kNormalized = GL_TRUE;
+
+  static void Pack(const VertexType& vertex,
+                   const VertexQuantization& quantization,
+                   uint8_t* out);
+  static void Unpack(const uint8_t* in,
+                     const VertexQuantization& quantization,
+                     VertexType& vertex);
+};
+
+/// @brief Two half floats.
+struct TexCoords {
+  static constexpr GLuint kLocation = 3;
+  static constexpr size_t kSize = 4;
+  static constexpr GLint kComponents = 2;
+  static constexpr GLenum kType = GL_HALF_FLOAT;
+  static constexpr GLboolean kNormalized = GL_FALSE;
+
+  static void Pack(const VertexType& vertex,
+                   const VertexQuantization& quantization,
+                   uint8_t* out);
+  static void Unpack(const uint8_t* in,
+                     const VertexQuantization& quantization,
+                     VertexType& vertex);
+};
+
+struct Tangent {
+  static constexpr GLuint kLocation = 4;
+  static constexpr size_t kSize = 4;
+  static constexpr GLint kComponents = 4;
+  static constexpr GLenum kType = GL_INT_2_10_10_10_REV;
+  static constexpr GLboolean kNormalized = GL_TRUE;
+
+  static void Pack(const VertexType& vertex,
+                   const VertexQuantization& quantization,
+                   uint8_t* out);
+  static void Unpack(const uint8_t* in,
+                     const VertexQuantization& quantization,
+                     VertexType& vertex);
+};
+
+struct Bitangent {
+  static constexpr GLuint kLocation = 5;
+  static constexpr size_t kSize = 4;
+  static constexpr GLint kComponents = 4;
+  static constexpr GLenum kType = GL_INT_2_10_10_10_REV;
+  static constexpr GLboolean kNormalized = GL_TRUE;
+
+  static void Pack(const VertexType& vertex,
+                   const VertexQuantization& quantization,
+                   uint8_t* out);
+  static void Unpack(const uint8_t* in,
+                     const VertexQuantization& quantization,
+                     VertexType& vertex);
+};
+}  // namespace attributes
+
+/// @brief An interleaved vertex made of the given attributes, in order. The
+/// stride, the offsets and the attribute pointers all follow from the list.
+template <typename... Attributes>
+struct VertexLayout {
+  static constexpr size_t kStride = (Attributes::kSize + ...);
+
+  static std::vector<uint8_t> Pack(const VertexType* vertices,
+                                   size_t count,
+                                   const VertexQuantization& quantization) {
+    std::vector<uint8_t> packed(count * kStride);
+    for (size_t i = 0; i < count; i++) {
+      uint8_t* out = packed.data() + i * kStride;
+      ((Attributes::Pack(vertices[i], quantization, out),
+        out += Attributes::kSize),
+       ...);
+    }
+    return packed;
+  }
+
+  /// @brief Decode packed vertices, the fields outside the layout are zero.
+  static void Unpack(const uint8_t* packed,
+                     size_t count,
+                     const VertexQuantization& quantization,
+                     VertexType* vertices) {
+    for (size_t i = 0; i < count; i++) {
+      const uint8_t* in = packed + i * kStride;
+      vertices[i] = VertexType{};
+      ((Attributes::Unpack(in, quantization, vertices[i]),
+        in += Attributes::kSize),
+       ...);
+    }
+  }
+
+  /// @brief Point the attributes of the bound VAO at the bound VBO. Locations
+  /// outside the layout stay disabled and read their default value.
+  static void Bind() {
+    size_t offset = 0;
+    ((glEnableVertexAttribArray(Attributes::kLocation),
+      glVertexAttribPointer(Attributes::kLocation, Attributes::kComponents,
+                            Attributes::kType, Attributes::kNormalized,
+                            static_cast<GLsizei>(kStride),
+                            reinterpret_cast<void*>(offset)),
+      offset += Attributes::kSize),
+     ...);
+  }
+};
+
+using BasicVertexLayout =
+    VertexLayout<attributes::Position, attributes::Normal, attributes::Color>;
+using TexturedVertexLayout = VertexLayout<attributes::Position,
+                                          attributes::Normal,
+                                          attributes::Color,
+                                          attributes::TexCoords>;
+using TangentVertexLayout = VertexLayout<attributes::Position,
+                                         attributes::Normal,
+                                         attributes::Color,
+                                         attributes::Tangent,
+                                         attributes::Bitangent>;
+using TexturedTangentVertexLayout = VertexLayout<attributes::Position,
+                                                 attributes::Normal,
+                                                 attributes::Color,
+                                                 attributes::TexCoords,
+                                                 attributes::Tangent,
+                                                 attributes::Bitangent>;
+
+/// @brief Call a function with the smallest layout holding the attributes.
+/// @param attributes VertexAttributes flags.
+/// @param function Called with a default constructed layout.
+template <typename Function>
+void WithVertexLayout(unsigned int attributes, Function&& function) {
+  const bool texCoords = attributes & kVertexTexCoords;
+  const bool tangents = attributes & kVertexTangents;
+  if (texCoords && tangents) {
+    function(TexturedTangentVertexLayout{});
+  } else if (tangents) {
+    function(TangentVertexLayout{});
+  } else if (texCoords) {
+    function(TexturedVertexLayout{});
+  } else {
+    function(BasicVertexLayout{});
+  }
+}
+
+/// @brief Largest difference between the source vertices and their packed
+/// round trip, per attribute.
+struct VertexError {
+  float position = 0.0f;
+  float normal = 0.0f;
+  float color = 0.0f;
+  float texCoords = 0.0f;
+  float tangent = 0.0f;
+};
+
+/// @brief Pack and unpack the vertices with the layout picked for the
+/// attributes and measure what was lost.
+VertexError MeasureVertexError(const VertexType* vertices,
+                               size_t count,
+                               unsigned int attributes);
+
+/// @brief Headless check of the packed layouts: round trips synthetic meshes
+/// with huge, tiny and flat bounds, unit normals and tangents in every
+/// octant, texture coordinates far outside [0, 1] and colors across the
+/// range, and fails when an attribute comes back further off than its
+/// format allows:
+/// - positions half a unorm16 step of the mesh extent per axis, exact on a
+///   flat axis,
+/// - normals, tangents and bitangents half a snorm10 step per component,
+/// - texture coordinates half a half float step, 2^-11 of the value,
+/// - colors half a unorm8 step per channel.
+/// @return True when every check passed, failures are logged.
+bool CheckVertexFormat();
+}  // namespace models
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <Camera.hpp>
+#include <Culling.hpp>
+#include <Heightfield.hpp>
+#include <TerrainMesh.hpp>
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace jobs {
+class JobSystem;
+}
+
+namespace terrain {
+
+struct WaterSettings {
+  // fixed simulation steps per second, whatever the frame rate
+  float stepsPerSecond = 60.0f;
+  // steps one Advance runs at most, the rest of a long frame is dropped
+  int maxSteps = 4;
+  float gravity = 9.81f;
+  // fraction of the flux a pipe keeps from one step to the next
+  float fluxDamping = 0.995f;
+  // fraction of the depth lost per second
+  float evaporation = 0.01f;
+  // cells along each side of a tile, the unit of activity, threading and
+  // GPU updates
+  int tileSize = 32;
+  // shallower water is dry: it does not keep its tile active
+  float dryDepth = 1e-4f;
+  // a tile is uploaded again once a cell's depth moved further than this
+  // since its last upload
+  float redrawDepth = 1e-3f;
+};
+
+/// @brief A spring adding water around a cell every step.
+struct WaterSource {
+  float x = 0.0f;
+  float z = 0.0f;
+  // in cells
+  float radius = 4.0f;
+  // cubic world units per second
+  float rate = 20.0f;
+};
+
+/// @brief Shallow water over the terrain grid, after the virtual pipes
+/// model of Mei et al.: every cell keeps the outflow through a pipe to each
+/// of its four neighbours. A step accelerates the pipes by the difference
+/// in water surface, scales a cell's outflow down to the water it holds,
+/// then moves the water. Water depth and the four fluxes are stored as
+/// separate grids.
+///
+/// Only tiles holding water and their neighbours are stepped, everything
+/// else costs nothing. Both passes only write the cells of the tile being
+/// processed, so tiles run on the workers in any order with the same
+/// result. Rows are updated 8 cells at a time with AVX2 or 4 with SSE4.1.
+/// The scalar path performs the same operations in the same order.
+class ShallowWater {
+ private:
+  WaterSettings settings;
+  int width;
+  int depth;
+  float spacing;
+  double pending = 0.0;
+
+  // heights in world units
+  std::vector<float> ground;
+  std::vector<float> water;
+  // outflow towards -x, +x, -z and +z, in cubic units per second
+  std::vector<float> fluxLeft;
+  std::vector<float> fluxRight;
+  std::vector<float> fluxUp;
+  std::vector<float> fluxDown;
+  // depth of every cell when its tile was last taken as dirty
+  std::vector<float> uploaded;
+
+  int tilesX;
+  int tilesZ;
+  // per tile: holds water deeper than dryDepth, was stepped, moved further
+  // than redrawDepth or got wet or dry since the last TakeDirtyTiles
+  std::vector<uint8_t> wet;
+  std::vector<uint8_t> active;
+  std::vector<uint8_t> dirty;
+  std::vector<int> activeTiles;
+  size_t steps = 0;
+
+  std::vector<WaterSource> sources;
+
+  void UpdateActiveTiles();
+  void FluxTile(int tile, float dt, bool simd);
+  void DepthTile(int tile, float dt, bool simd);
+
+ public:
+  /// @param field Terrain heights, scaled by heightScale.
+  /// @param spacing World distance between neighbouring samples.
+  ShallowWater(const Heightfield& field,
+               float heightScale,
+               float spacing,
+               WaterSettings settings = WaterSettings());
+
+  const WaterSettings& Settings() const { return this->settings; }
+  int Width() const { return this->width; }
+  int Depth() const { return this->depth; }
+  int TileSize() const { return this->settings.tileSize; }
+  int TilesX() const { return this->tilesX; }
+  int TilesZ() const { return this->tilesZ; }
+
+  float Ground(int x, int z) const {
+    return this->ground[static_cast<size_t>(z) * width + x];
+  }
+  float WaterDepth(int x, int z) const {
+    return this->water[static_cast<size_t>(z) * width + x];
+  }
+  bool TileWet(int tile) const { return this->wet[tile] != 0; }
+
+  /// @brief Pour water into a disc at once.
+  /// @param volume Cubic world units.
+  void AddWater(float x, float z, float radius, float volume);
+
+  std::vector<WaterSource>& Sources() { return this->sources; }
+
+  /// @brief Run one fixed step of 1 / stepsPerSecond seconds.
+  /// @param jobs Spread tiles over these workers, nullptr runs them here.
+  /// @param simd False takes the scalar path.
+  void Step(jobs::JobSystem* jobs, bool simd = true);
+
+  /// @brief Run as many fixed steps as the elapsed time holds, carrying the
+  /// remainder to the next call.
+  /// @return The number of steps run.
+  int Advance(double seconds, jobs::JobSystem* jobs);
+
+  /// @brief Tiles whose water visibly changed since the last call, and
+  /// their neighbours, whose edges and normals read the changed cells. Then
+  /// forget them.
+  std::vector<int> TakeDirtyTiles();
+
+  /// @brief Tiles stepped by the last step.
+  size_t ActiveTiles() const { return this->activeTiles.size(); }
+  size_t Steps() const { return this->steps; }
+
+  /// @brief Total water, in cubic world units.
+  double Volume() const;
+
+  /// @brief The instruction set the cell updates were compiled for.
+  static const char* SimdPath();
+};
+
+/// @brief Draws the water surface one tile at a time. Each tile has its own
+/// vertex buffer, rewritten only when its water changed; dry tiles are not
+/// drawn.
+class WaterRenderer {
+ private:
+  struct Tile {
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    bool visible = false;
+    camera::Aabb bounds;
+  };
+
+  int tileSize;
+  int tilesX;
+  GLuint ibo = 0;
+  GLsizei indexCount = 0;
+  std::vector<Tile> tiles;
+  std::vector<TerrainVertex> vertices;
+  size_t uploads = 0;
+
+ public:
+  WaterRenderer(const ShallowWater& water);
+  ~WaterRenderer();
+
+  WaterRenderer(const WaterRenderer&) = delete;
+  WaterRenderer& operator=(const WaterRenderer&) = delete;
+
+  /// @brief Rewrite the tiles whose water changed. Must not run while the
+  /// simulation steps.
+  /// @param originX World x of column zero.
+  /// @param originZ World z of row zero.
+  void Upload(ShallowWater& water,
+              float originX,
+              float originZ,
+              float spacing);
+
+  /// @brief Draw the wet tiles. The program must already be in use with
+  /// blending enabled.
+  void Draw(const camera::Frustum* frustum) const;
+
+  /// @brief Tile buffers rewritten since the renderer was created.
+  size_t Uploads() const { return this->uploads; }
+};
+}  // namespace terrain
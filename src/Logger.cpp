@@ -1,32 +1,238 @@
-
 #include <Logger.hpp>
 
+#include <algorithm>
 #include <iostream>
+#include <stdexcept>
 
 using namespace logging;
 
 Logger Logger::globalInstance;
 
-void Logger::Log(LogLevel level, std::string msg) const {
-  if (!enabled.find(level)->second) {
+namespace {
+
+const char* const kLevelNames[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+constexpr char kBinaryMagic[8] = {'T', 'G', 'L', 'O', 'G', '\0', '\0', '\1'};
+
+// how long the sink sleeps when nobody asks for a flush
+constexpr auto kSinkInterval = std::chrono::milliseconds(10);
+
+struct BinaryRecord {
+  int64_t time;
+  uint32_t thread;
+  uint32_t level;
+  uint32_t length;
+  uint32_t reserved;
+};
+
+void AppendLine(std::string& text, LogLevel level, const std::string& msg) {
+  text += "[";
+  text += kLevelNames[level];
+  text += "] : ";
+  text += msg;
+  text += '\n';
+}
+
+// marks the buffer of an exiting thread, the sink frees it once drained
+struct BufferOwner {
+  std::shared_ptr<LogBuffer> buffer;
+
+  ~BufferOwner() {
+    if (buffer) {
+      buffer->retired.store(true, std::memory_order_release);
+    }
+  }
+};
+}  // namespace
+
+bool LogBuffer::Push(LogRecord&& record) {
+  const size_t position = head.load(std::memory_order_relaxed);
+  if (position - tail.load(std::memory_order_acquire) == kCapacity) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  records[position % kCapacity] = std::move(record);
+  head.store(position + 1, std::memory_order_release);
+  return true;
+}
+
+size_t LogBuffer::Drain(std::vector<LogRecord>& out) {
+  size_t position = tail.load(std::memory_order_relaxed);
+  const size_t end = head.load(std::memory_order_acquire);
+  const size_t count = end - position;
+  for (; position != end; position++) {
+    out.push_back(std::move(records[position % kCapacity]));
+  }
+  tail.store(end, std::memory_order_release);
+  return count;
+}
+
+bool LogBuffer::Empty() const {
+  return head.load(std::memory_order_acquire) ==
+         tail.load(std::memory_order_acquire);
+}
+
+Logger::Logger() : start{std::chrono::steady_clock::now()} {}
+
+Logger::~Logger() {
+  {
+    std::lock_guard<std::mutex> lock(sinkMutex);
+    shutdown = true;
+  }
+  wake.notify_all();
+  if (sink.joinable()) {
+    sink.join();
+  }
+  {
+    // anything logged from here on is written directly
+    std::lock_guard<std::mutex> lock(sinkMutex);
+    stopped = true;
+  }
+  flushed.notify_all();
+}
+
+LogBuffer& Logger::ThreadBuffer() {
+  thread_local BufferOwner owner;
+  if (!owner.buffer) {
+    owner.buffer = std::make_shared<LogBuffer>(nextThread++);
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    buffers.push_back(owner.buffer);
+  }
+  return *owner.buffer;
+}
+
+void Logger::StartSink() {
+  sink = std::thread([this]() { RunSink(); });
+  running = true;
+}
+
+void Logger::RunSink() {
+  std::vector<LogRecord> batch;
+  while (true) {
+    uint64_t requests;
+    bool stopping;
+    {
+      std::unique_lock<std::mutex> lock(sinkMutex);
+      wake.wait_for(lock, kSinkInterval, [this]() {
+        return flushRequests != flushesDone || shutdown;
+      });
+      requests = flushRequests;
+      stopping = shutdown;
+    }
+
+    batch.clear();
+    DrainAll(batch);
+    Write(batch);
+
+    {
+      std::lock_guard<std::mutex> lock(sinkMutex);
+      flushesDone = requests;
+    }
+    flushed.notify_all();
+
+    if (stopping) {
+      return;
+    }
+  }
+}
+
+void Logger::DrainAll(std::vector<LogRecord>& batch) {
+  std::lock_guard<std::mutex> lock(buffersMutex);
+  for (auto& buffer : buffers) {
+    buffer->Drain(batch);
+
+    const uint64_t dropped = buffer->dropped.exchange(0);
+    if (dropped) {
+      LogRecord record;
+      record.level = WRN;
+      record.thread = buffer->thread;
+      record.time = batch.empty() ? 0 : batch.back().time;
+      record.message = std::to_string(dropped) +
+                       " log messages dropped, the buffer of thread " +
+                       std::to_string(buffer->thread) + " was full";
+      batch.push_back(std::move(record));
+    }
+  }
+
+  buffers.erase(std::remove_if(buffers.begin(), buffers.end(),
+                               [](const std::shared_ptr<LogBuffer>& buffer) {
+                                 return buffer->retired && buffer->Empty();
+                               }),
+                buffers.end());
+
+  // each buffer is in order, interleave the threads by time
+  std::stable_sort(batch.begin(), batch.end(),
+                   [](const LogRecord& a, const LogRecord& b) {
+                     return a.time < b.time;
+                   });
+}
+
+void Logger::Write(const std::vector<LogRecord>& batch) {
+  if (batch.empty()) {
     return;
   }
 
-  std::cout << "[" << stringMapping.find(level)->second << "] : " << msg
-            << std::endl;
+  std::string text;
+  for (auto& record : batch) {
+    AppendLine(text, record.level, record.message);
+  }
+  std::cout.write(text.data(), text.size());
+  std::cout.flush();
+
+  std::lock_guard<std::mutex> lock(fileMutex);
+  if (!binaryLog.is_open()) {
+    return;
+  }
+  for (auto& record : batch) {
+    BinaryRecord header{record.time, record.thread,
+                        static_cast<uint32_t>(record.level),
+                        static_cast<uint32_t>(record.message.size()), 0};
+    binaryLog.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    binaryLog.write(record.message.data(), record.message.size());
+  }
+  binaryLog.flush();
+}
+
+void Logger::Log(LogLevel level, std::string msg) {
+  if (!IsEnabled(level)) {
+    return;
+  }
+
+  if (stopped.load(std::memory_order_acquire)) {
+    std::string text;
+    AppendLine(text, level, msg);
+    std::cout.write(text.data(), text.size());
+    std::cout.flush();
+    return;
+  }
+
+  if (!running.load(std::memory_order_acquire)) {
+    std::call_once(sinkStarted, [this]() { StartSink(); });
+  }
+
+  LogRecord record;
+  record.level = level;
+  record.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+  record.message = std::move(msg);
+
+  LogBuffer& buffer = ThreadBuffer();
+  record.thread = buffer.thread;
+  buffer.Push(std::move(record));
 }
 
 void Logger::LogDebug(std::string msg) {
-  GetInstance().Log(LogLevel::DBG, msg);
+  GetInstance().Log(LogLevel::DBG, std::move(msg));
 }
 void Logger::LogInfo(std::string msg) {
-  GetInstance().Log(LogLevel::INF, msg);
+  GetInstance().Log(LogLevel::INF, std::move(msg));
 }
 void Logger::LogWarn(std::string msg) {
-  GetInstance().Log(LogLevel::WRN, msg);
+  GetInstance().Log(LogLevel::WRN, std::move(msg));
 }
 void Logger::LogError(std::string msg) {
-  GetInstance().Log(LogLevel::ERR, msg);
+  GetInstance().Log(LogLevel::ERR, std::move(msg));
 }
 
 void Logger::SetEnabled(LogLevel level, bool value) {
@@ -34,5 +240,29 @@ void Logger::SetEnabled(LogLevel level, bool value) {
 }
 
 bool Logger::GetEnabled(LogLevel level) const {
-  return enabled.find(level)->second;
+  return IsEnabled(level);
+}
+
+void Logger::OpenBinaryLog(const std::string& path) {
+  std::lock_guard<std::mutex> lock(fileMutex);
+  binaryLog.close();
+  binaryLog.open(path, std::ios::binary | std::ios::trunc);
+  if (!binaryLog) {
+    throw std::runtime_error{"Could not create the binary log: " + path};
+  }
+  binaryLog.write(kBinaryMagic, sizeof(kBinaryMagic));
+}
+
+void Logger::Flush() {
+  if (!running.load(std::memory_order_acquire) ||
+      sink.get_id() == std::this_thread::get_id()) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(sinkMutex);
+  const uint64_t request = ++flushRequests;
+  wake.notify_all();
+  flushed.wait(lock, [this, request]() {
+    return flushesDone >= request || stopped;
+  });
 }
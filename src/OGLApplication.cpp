@@ -10,6 +10,7 @@
 
 #include <stdexcept>
 
+#include <JobSystem.hpp>
 #include <Logger.hpp>
 
 using namespace std;
@@ -17,6 +18,9 @@ using namespace std;
 int r_width = 1600;
 int r_height = 900;
 
+// Time per frame spent on GL work queued by the job system.
+const double mainThreadJobBudgetMs = 2.0;
+
 void APIENTRY glDebugOutput(GLenum source,
                             GLenum type,
                             unsigned int id,
@@ -40,7 +44,10 @@ OGLApplication::OGLApplication()
       title("Terrain Generator") {
   currentApplication = this;
 
-  logging::Logger::LogDebug("GLFW initialisation");
+  // The job system records the thread that creates it as the GL thread.
+  jobs::JobSystem::GetInstance();
+
+  LOG_DEBUG("GLFW initialisation");
 
   // initialize the GLFW library
   if (!glfwInit()) {
@@ -57,9 +64,8 @@ OGLApplication::OGLApplication()
   for (const auto& version : opengl_versions) {
     // test opengl versions from highest to lowest compatible to find one that
     // is supported on this platform
-    logging::Logger::LogDebug("Testing OpenGL " +
-                              std::to_string(version.major) + "." +
-                              std::to_string(version.minor));
+    LOG_DEBUG("Testing OpenGL " + std::to_string(version.major) + "." +
+              std::to_string(version.minor));
     ;
 
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version.major);
@@ -98,10 +104,8 @@ OGLApplication::OGLApplication()
   // get version info
   const GLubyte* renderer = glGetString(GL_RENDERER);
   const GLubyte* version = glGetString(GL_VERSION);
-  logging::Logger::LogInfo(
-      "Renderer: " + std::string{reinterpret_cast<const char*>(renderer)});
-  logging::Logger::LogInfo(
-      "Version: " + std::string{reinterpret_cast<const char*>(version)});
+  LOG_INFO("Renderer: " + std::string{reinterpret_cast<const char*>(renderer)});
+  LOG_INFO("Version: " + std::string{reinterpret_cast<const char*>(version)});
 
   // opengl configuration
   glEnable(GL_DEPTH_TEST);  // enable depth-testing
@@ -148,16 +152,17 @@ void OGLApplication::_enumerate_video_modes(GLFWmonitor* monitor) {
   // get resolution of monitor
   _video_modes = glfwGetVideoModes(monitor, &_video_mode_count);
 
-  logging::Logger::LogDebug("Start enumerating video modes");
+  LOG_DEBUG("Start enumerating video modes");
   for (int i = _video_mode_count - 1; i >= 0; --i) {
-    logging::Logger::LogDebug(
-        std::to_string(_video_modes[i].width) + " x " +
-        std::to_string(_video_modes[i].height) + ", " +
-        std::to_string(_video_modes[i].redBits + _video_modes[i].blueBits +
-                       _video_modes[i].greenBits) +
-        " bit color, " + std::to_string(_video_modes[i].refreshRate) + " hz");
+    LOG_DEBUG(std::to_string(_video_modes[i].width) + " x " +
+              std::to_string(_video_modes[i].height) + ", " +
+              std::to_string(_video_modes[i].redBits +
+                             _video_modes[i].blueBits +
+                             _video_modes[i].greenBits) +
+              " bit color, " + std::to_string(_video_modes[i].refreshRate) +
+              " hz");
   }
-  logging::Logger::LogDebug("End enumerating video modes");
+  LOG_DEBUG("End enumerating video modes");
 }
 
 GLFWwindow* OGLApplication::getWindow() const {
@@ -196,6 +201,9 @@ void OGLApplication::run() {
       _updateViewport = false;
     }
 
+    // GL work handed back from the job system, e.g. buffer uploads
+    jobs::JobSystem::GetInstance().RunMainThreadJobs(mainThreadJobBudgetMs);
+
     // execute the frame code
     render();
 
@@ -250,7 +258,7 @@ void OGLApplication::setFullScreen(bool fullscreen) {
 }
 
 void OGLApplication::render() {
-  logging::Logger::LogInfo("Render");
+  LOG_INFO("Render");
 }
 
 int OGLApplication::getWidth() {
@@ -266,8 +274,8 @@ float OGLApplication::getWindowRatio() {
 }
 
 void OGLApplication::mouseMoved(GLFWwindow* window, double x, double y) {
-  logging::Logger::LogInfo("Mouse moved to <" + std::to_string(x) + "," +
-                           std::to_string(y) + ">");
+  LOG_INFO("Mouse moved to <" + std::to_string(x) + "," + std::to_string(y) +
+           ">");
 }
 
 void OGLApplication::handleKeyboardEvent(GLFWwindow* window,
@@ -275,8 +283,7 @@ void OGLApplication::handleKeyboardEvent(GLFWwindow* window,
                                          int scancode,
                                          int action,
                                          int mods) {
-  logging::Logger::LogInfo("Keyboard event, key = " + std::to_string(key) +
-                           ", scancode = " + std::to_string(scancode) +
-                           ", action = " + std::to_string(action) +
-                           ", mods = " + std::to_string(mods));
+  LOG_INFO("Keyboard event, key = " + std::to_string(key) + ", scancode = " +
+           std::to_string(scancode) + ", action = " + std::to_string(action) +
+           ", mods = " + std::to_string(mods));
 }
\ No newline at end of file
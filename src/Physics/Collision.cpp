@@ -0,0 +1,410 @@
+#include <Physics.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace physics;
+
+namespace {
+
+// a pair of shapes so close their direction is unknown is pushed apart
+// along +y
+const glm::vec3 kFallbackNormal(0.0f, 1.0f, 0.0f);
+
+void Segment(const Collider& capsule, glm::vec3& p0, glm::vec3& p1) {
+  const glm::vec3 half = capsule.rotation[1] * capsule.shape.halfHeight;
+  p0 = capsule.position - half;
+  p1 = capsule.position + half;
+}
+
+glm::vec3 ClosestOnSegment(const glm::vec3& p0,
+                           const glm::vec3& p1,
+                           const glm::vec3& point) {
+  const glm::vec3 d = p1 - p0;
+  const float length2 = glm::dot(d, d);
+  if (length2 <= 1e-12f) {
+    return p0;
+  }
+  const float t = glm::clamp(glm::dot(point - p0, d) / length2, 0.0f, 1.0f);
+  return p0 + d * t;
+}
+
+// Closest points of two segments (Ericson, Real-Time Collision Detection
+// 5.1.9).
+void ClosestBetweenSegments(const glm::vec3& p0,
+                            const glm::vec3& p1,
+                            const glm::vec3& q0,
+                            const glm::vec3& q1,
+                            glm::vec3& onP,
+                            glm::vec3& onQ) {
+  const glm::vec3 d1 = p1 - p0;
+  const glm::vec3 d2 = q1 - q0;
+  const glm::vec3 r = p0 - q0;
+  const float a = glm::dot(d1, d1);
+  const float e = glm::dot(d2, d2);
+  const float f = glm::dot(d2, r);
+  float s = 0.0f;
+  float t = 0.0f;
+
+  if (a <= 1e-12f && e <= 1e-12f) {
+    onP = p0;
+    onQ = q0;
+    return;
+  }
+  if (a <= 1e-12f) {
+    t = glm::clamp(f / e, 0.0f, 1.0f);
+  } else {
+    const float c = glm::dot(d1, r);
+    if (e <= 1e-12f) {
+      s = glm::clamp(-c / a, 0.0f, 1.0f);
+    } else {
+      const float b = glm::dot(d1, d2);
+      const float denominator = a * e - b * b;
+      // parallel segments take any s, the clamp below fixes t
+      if (denominator > 1e-12f) {
+        s = glm::clamp((b * f - c * e) / denominator, 0.0f, 1.0f);
+      }
+      t = (b * s + f) / e;
+      if (t < 0.0f) {
+        t = 0.0f;
+        s = glm::clamp(-c / a, 0.0f, 1.0f);
+      } else if (t > 1.0f) {
+        t = 1.0f;
+        s = glm::clamp((b - c) / a, 0.0f, 1.0f);
+      }
+    }
+  }
+  onP = p0 + d1 * s;
+  onQ = q0 + d2 * t;
+}
+
+int Spheres(const glm::vec3& ca,
+            float ra,
+            const glm::vec3& cb,
+            float rb,
+            Contact* out) {
+  const glm::vec3 d = ca - cb;
+  const float distance2 = glm::dot(d, d);
+  const float reach = ra + rb;
+  if (distance2 >= reach * reach) {
+    return 0;
+  }
+  const float distance = std::sqrt(distance2);
+  const glm::vec3 normal = distance > 1e-6f ? d / distance : kFallbackNormal;
+  const float depth = reach - distance;
+  out->normal = normal;
+  out->depth = depth;
+  out->point = cb + normal * (rb - 0.5f * depth);
+  return 1;
+}
+
+// A sphere as the first collider against a box.
+int SphereBox(const glm::vec3& centre,
+              float radius,
+              const Collider& box,
+              Contact* out) {
+  const glm::vec3& e = box.shape.halfExtents;
+  const glm::vec3 local =
+      glm::transpose(box.rotation) * (centre - box.position);
+  const glm::vec3 clamped(glm::clamp(local.x, -e.x, e.x),
+                          glm::clamp(local.y, -e.y, e.y),
+                          glm::clamp(local.z, -e.z, e.z));
+
+  glm::vec3 normal;
+  float depth;
+  glm::vec3 surface = clamped;
+  if (clamped == local) {
+    // centre inside: out through the nearest face
+    int axis = 0;
+    float nearest = e.x - std::abs(local.x);
+    for (int i = 1; i < 3; i++) {
+      const float gap = e[i] - std::abs(local[i]);
+      if (gap < nearest) {
+        nearest = gap;
+        axis = i;
+      }
+    }
+    normal = glm::vec3(0.0f);
+    normal[axis] = local[axis] < 0.0f ? -1.0f : 1.0f;
+    surface[axis] = normal[axis] * e[axis];
+    depth = radius + nearest;
+  } else {
+    const glm::vec3 d = local - clamped;
+    const float distance2 = glm::dot(d, d);
+    if (distance2 >= radius * radius) {
+      return 0;
+    }
+    const float distance = std::sqrt(distance2);
+    normal = d / distance;
+    depth = radius - distance;
+  }
+
+  out->normal = box.rotation * normal;
+  out->depth = depth;
+  // the normal leaves the box, the middle of the overlap lies inside it
+  out->point = box.position + box.rotation * surface -
+               out->normal * (0.5f * depth);
+  return 1;
+}
+
+// A capsule as the first collider against a box: spheres at both caps and
+// at the point of the axis nearest the box. Good for capsules no longer
+// than the box faces they rest on.
+int CapsuleBox(const Collider& capsule, const Collider& box, Contact* out) {
+  glm::vec3 p0, p1;
+  Segment(capsule, p0, p1);
+
+  // two rounds of projecting onto the box and back onto the axis
+  glm::vec3 nearest = ClosestOnSegment(p0, p1, box.position);
+  const glm::mat3 inverse = glm::transpose(box.rotation);
+  const glm::vec3& e = box.shape.halfExtents;
+  for (int round = 0; round < 2; round++) {
+    const glm::vec3 local = inverse * (nearest - box.position);
+    const glm::vec3 clamped(glm::clamp(local.x, -e.x, e.x),
+                            glm::clamp(local.y, -e.y, e.y),
+                            glm::clamp(local.z, -e.z, e.z));
+    nearest = ClosestOnSegment(p0, p1, box.position + box.rotation * clamped);
+  }
+
+  const float radius = capsule.shape.radius;
+  int count = SphereBox(p0, radius, box, out);
+  count += SphereBox(p1, radius, box, out + count);
+  const float apart = 1e-3f + 0.1f * radius;
+  if (glm::distance(nearest, p0) > apart &&
+      glm::distance(nearest, p1) > apart) {
+    count += SphereBox(nearest, radius, box, out + count);
+  }
+  return count;
+}
+
+glm::vec3 Support(const Collider& box, const glm::vec3& direction) {
+  glm::vec3 point = box.position;
+  for (int i = 0; i < 3; i++) {
+    const float side =
+        glm::dot(box.rotation[i], direction) < 0.0f ? -1.0f : 1.0f;
+    point += box.rotation[i] * (side * box.shape.halfExtents[i]);
+  }
+  return point;
+}
+
+// Half the extent of a box along a unit axis.
+float Projection(const Collider& box, const glm::vec3& axis) {
+  return std::abs(glm::dot(box.rotation[0], axis)) * box.shape.halfExtents.x +
+         std::abs(glm::dot(box.rotation[1], axis)) * box.shape.halfExtents.y +
+         std::abs(glm::dot(box.rotation[2], axis)) * box.shape.halfExtents.z;
+}
+
+bool Inside(const Collider& box, const glm::vec3& point) {
+  const glm::vec3 local =
+      glm::transpose(box.rotation) * (point - box.position);
+  const float tolerance = 1e-3f;
+  return std::abs(local.x) <= box.shape.halfExtents.x + tolerance &&
+         std::abs(local.y) <= box.shape.halfExtents.y + tolerance &&
+         std::abs(local.z) <= box.shape.halfExtents.z + tolerance;
+}
+
+// Separating axis test over the 3 + 3 face normals and 9 edge directions.
+// The contacts are the corners of either box inside the other; edges
+// crossing without a corner inside get one point between the boxes.
+int Boxes(const Collider& a, const Collider& b, Contact* out) {
+  const glm::vec3 d = a.position - b.position;
+  glm::vec3 best(0.0f);
+  float overlap = 3.4e38f;
+
+  auto test = [&](glm::vec3 axis, bool edge) {
+    const float length2 = glm::dot(axis, axis);
+    if (length2 < 1e-8f) {
+      return true;
+    }
+    axis = axis / std::sqrt(length2);
+    const float distance = glm::dot(d, axis);
+    const float amount =
+        Projection(a, axis) + Projection(b, axis) - std::abs(distance);
+    if (amount < 0.0f) {
+      return false;
+    }
+    // edges must do clearly better than a face, faces give steadier
+    // contacts
+    if (edge ? amount < 0.95f * overlap - 0.01f : amount < overlap) {
+      overlap = amount;
+      best = distance < 0.0f ? -axis : axis;
+    }
+    return true;
+  };
+
+  for (int i = 0; i < 3; i++) {
+    if (!test(a.rotation[i], false) || !test(b.rotation[i], false)) {
+      return 0;
+    }
+  }
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      if (!test(glm::cross(a.rotation[i], b.rotation[j]), true)) {
+        return 0;
+      }
+    }
+  }
+
+  Contact found[16];
+  int count = 0;
+  const float faceA = glm::dot(a.position, best) - Projection(a, best);
+  const float faceB = glm::dot(b.position, best) + Projection(b, best);
+  for (int corner = 0; corner < 8; corner++) {
+    glm::vec3 offset(0.0f);
+    for (int i = 0; i < 3; i++) {
+      const float side = (corner >> i) & 1 ? 1.0f : -1.0f;
+      offset += a.rotation[i] * (side * a.shape.halfExtents[i]);
+    }
+    const glm::vec3 cornerA = a.position + offset;
+    if (Inside(b, cornerA)) {
+      const float depth = faceB - glm::dot(cornerA, best);
+      found[count++] = Contact{cornerA + best * (0.5f * depth), best, depth};
+    }
+
+    offset = glm::vec3(0.0f);
+    for (int i = 0; i < 3; i++) {
+      const float side = (corner >> i) & 1 ? 1.0f : -1.0f;
+      offset += b.rotation[i] * (side * b.shape.halfExtents[i]);
+    }
+    const glm::vec3 cornerB = b.position + offset;
+    if (Inside(a, cornerB)) {
+      const float depth = glm::dot(cornerB, best) - faceA;
+      found[count++] = Contact{cornerB - best * (0.5f * depth), best, depth};
+    }
+  }
+
+  if (count == 0) {
+    const glm::vec3 point = 0.5f * (Support(a, -best) + Support(b, best));
+    out[0] = Contact{point, best, overlap};
+    return 1;
+  }
+
+  // the deepest when corners of both sides are inside
+  std::stable_sort(found, found + count,
+                   [](const Contact& x, const Contact& y) {
+                     return x.depth > y.depth;
+                   });
+  count = std::min(count, kMaxContacts);
+  for (int i = 0; i < count; i++) {
+    out[i] = found[i];
+    out[i].depth = std::max(found[i].depth, 0.0f);
+  }
+  return count;
+}
+
+// Ordered so the first shape never comes after the second in ShapeType.
+int CollideOrdered(const Collider& a, const Collider& b, Contact* out) {
+  glm::vec3 p0, p1, q0, q1, onP, onQ;
+  switch (a.shape.type) {
+    case ShapeType::Sphere:
+      switch (b.shape.type) {
+        case ShapeType::Sphere:
+          return Spheres(a.position, a.shape.radius, b.position,
+                         b.shape.radius, out);
+        case ShapeType::Capsule:
+          Segment(b, q0, q1);
+          return Spheres(a.position, a.shape.radius,
+                         ClosestOnSegment(q0, q1, a.position),
+                         b.shape.radius, out);
+        case ShapeType::Box:
+          return SphereBox(a.position, a.shape.radius, b, out);
+      }
+      break;
+    case ShapeType::Capsule:
+      if (b.shape.type == ShapeType::Capsule) {
+        Segment(a, p0, p1);
+        Segment(b, q0, q1);
+        ClosestBetweenSegments(p0, p1, q0, q1, onP, onQ);
+        return Spheres(onP, a.shape.radius, onQ, b.shape.radius, out);
+      }
+      return CapsuleBox(a, b, out);
+    case ShapeType::Box:
+      return Boxes(a, b, out);
+  }
+  return 0;
+}
+
+// A point of a shape with the given radius against the terrain.
+int TerrainPoint(const glm::vec3& point,
+                 float radius,
+                 const terrain::HeightPyramid& ground,
+                 Contact* out) {
+  if (!ground.Contains(point.x, point.z)) {
+    return 0;
+  }
+  const float height = ground.Height(point.x, point.z);
+  if (point.y - radius > height) {
+    return 0;
+  }
+  // the surface as a plane through the sample under the point
+  const glm::vec3 normal = ground.Normal(point.x, point.z);
+  const float distance = (point.y - height) * normal.y - radius;
+  if (distance >= 0.0f) {
+    return 0;
+  }
+  const float depth = -distance;
+  out->normal = normal;
+  out->depth = depth;
+  out->point = point - normal * (radius - 0.5f * depth);
+  return 1;
+}
+}  // namespace
+
+Shape Shape::Sphere(float radius) {
+  Shape shape;
+  shape.type = ShapeType::Sphere;
+  shape.radius = radius;
+  return shape;
+}
+
+Shape Shape::Capsule(float radius, float halfHeight) {
+  Shape shape;
+  shape.type = ShapeType::Capsule;
+  shape.radius = radius;
+  shape.halfHeight = halfHeight;
+  return shape;
+}
+
+Shape Shape::Box(const glm::vec3& halfExtents) {
+  Shape shape;
+  shape.type = ShapeType::Box;
+  shape.halfExtents = halfExtents;
+  return shape;
+}
+
+int physics::Collide(const Collider& a, const Collider& b, Contact* contacts) {
+  if (a.shape.type <= b.shape.type) {
+    return CollideOrdered(a, b, contacts);
+  }
+  const int count = CollideOrdered(b, a, contacts);
+  for (int i = 0; i < count; i++) {
+    contacts[i].normal = -contacts[i].normal;
+  }
+  return count;
+}
+
+int physics::CollideTerrain(const Collider& a,
+                            const terrain::HeightPyramid& ground,
+                            Contact* contacts) {
+  glm::vec3 p0, p1;
+  int count = 0;
+  switch (a.shape.type) {
+    case ShapeType::Sphere:
+      return TerrainPoint(a.position, a.shape.radius, ground, contacts);
+    case ShapeType::Capsule:
+      Segment(a, p0, p1);
+      count = TerrainPoint(p0, a.shape.radius, ground, contacts);
+      return count + TerrainPoint(p1, a.shape.radius, ground, contacts + count);
+    case ShapeType::Box:
+      for (int corner = 0; corner < 8; corner++) {
+        glm::vec3 point = a.position;
+        for (int i = 0; i < 3; i++) {
+          const float side = (corner >> i) & 1 ? 1.0f : -1.0f;
+          point += a.rotation[i] * (side * a.shape.halfExtents[i]);
+        }
+        count += TerrainPoint(point, 0.0f, ground, contacts + count);
+      }
+      return count;
+  }
+  return 0;
+}
@@ -0,0 +1,629 @@
+#include <Physics.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <thread>
+
+#include <JobSystem.hpp>
+
+using namespace physics;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double Milliseconds(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+// Runs body(first, last) over ranges of grain items. The ranges are the
+// ones JobSystem::ParallelFor makes, so per range outputs joined in range
+// order do not depend on whether workers ran them.
+template <typename Body>
+void ForRanges(jobs::JobSystem* jobs, int count, int grain, const Body& body) {
+  if (jobs) {
+    jobs->ParallelFor(0, count, grain, body);
+    return;
+  }
+  for (int first = 0; first < count; first += grain) {
+    body(first, std::min(first + grain, count));
+  }
+}
+
+glm::vec3 InverseInertia(const Shape& shape, float mass) {
+  if (mass <= 0.0f) {
+    return glm::vec3(0.0f);
+  }
+  glm::vec3 inertia;
+  switch (shape.type) {
+    case ShapeType::Sphere:
+      inertia = glm::vec3(0.4f * mass * shape.radius * shape.radius);
+      break;
+    case ShapeType::Capsule: {
+      // as a cylinder as long as the whole capsule
+      const float r2 = shape.radius * shape.radius;
+      const float length = 2.0f * (shape.halfHeight + shape.radius);
+      const float across = mass * (3.0f * r2 + length * length) / 12.0f;
+      inertia = glm::vec3(across, 0.5f * mass * r2, across);
+      break;
+    }
+    case ShapeType::Box: {
+      const glm::vec3 e2 = shape.halfExtents * shape.halfExtents;
+      inertia = glm::vec3(e2.y + e2.z, e2.x + e2.z, e2.x + e2.y) *
+                (mass / 3.0f);
+      break;
+    }
+  }
+  return glm::vec3(1.0f) / inertia;
+}
+
+// Two unit vectors completing a right handed basis with the normal.
+void Tangents(const glm::vec3& normal, glm::vec3* tangents) {
+  const glm::vec3 helper = std::abs(normal.x) < 0.57f
+                               ? glm::vec3(1.0f, 0.0f, 0.0f)
+                               : glm::vec3(0.0f, 1.0f, 0.0f);
+  tangents[0] = glm::normalize(glm::cross(normal, helper));
+  tangents[1] = glm::cross(normal, tangents[0]);
+}
+
+glm::mat3 Diagonal(const glm::vec3& d) {
+  glm::mat3 m(0.0f);
+  m[0][0] = d.x;
+  m[1][1] = d.y;
+  m[2][2] = d.z;
+  return m;
+}
+}  // namespace
+
+PhysicsWorld::PhysicsWorld(PhysicsSettings settings) : settings{settings} {}
+
+void PhysicsWorld::SetGround(const terrain::HeightPyramid* ground) {
+  this->ground = ground;
+}
+
+uint32_t PhysicsWorld::AddBody(const BodyDesc& desc) {
+  const uint32_t body = static_cast<uint32_t>(positions.size());
+  const float mass = std::max(desc.mass, 0.0f);
+  shapes.push_back(desc.shape);
+  positions.push_back(desc.position);
+  orientations.push_back(glm::normalize(desc.orientation));
+  velocities.push_back(mass > 0.0f ? desc.velocity : glm::vec3(0.0f));
+  angularVelocities.push_back(mass > 0.0f ? desc.angularVelocity
+                                          : glm::vec3(0.0f));
+  inverseMasses.push_back(mass > 0.0f ? 1.0f / mass : 0.0f);
+  inverseInertias.push_back(InverseInertia(desc.shape, mass));
+  frictions.push_back(desc.friction);
+  restitutions.push_back(desc.restitution);
+  sweep.push_back(body);
+  sweepSorted = false;
+  return body;
+}
+
+void PhysicsWorld::Clear() {
+  shapes.clear();
+  positions.clear();
+  orientations.clear();
+  velocities.clear();
+  angularVelocities.clear();
+  inverseMasses.clear();
+  inverseInertias.clear();
+  frictions.clear();
+  restitutions.clear();
+  sweep.clear();
+  pairs.clear();
+  manifolds.clear();
+  contacts.clear();
+  points.clear();
+  pending = 0.0;
+}
+
+glm::mat4 PhysicsWorld::Transform(uint32_t body) const {
+  glm::mat4 transform = glm::mat4_cast(orientations[body]);
+  transform[3] = glm::vec4(positions[body], 1.0f);
+  return transform;
+}
+
+Collider PhysicsWorld::MakeCollider(uint32_t body) const {
+  return Collider{shapes[body], positions[body], rotations[body]};
+}
+
+// Gravity and damping, then everything the rest of the step reads about a
+// body in its current pose.
+void PhysicsWorld::UpdateBodies(jobs::JobSystem* jobs, float dt) {
+  const int count = static_cast<int>(positions.size());
+  rotations.resize(count);
+  worldInverseInertias.resize(count);
+  boundsMin.resize(count);
+  boundsMax.resize(count);
+
+  const float linear = 1.0f / (1.0f + dt * settings.linearDamping);
+  const float angular = 1.0f / (1.0f + dt * settings.angularDamping);
+  ForRanges(jobs, count, settings.grain, [&](int first, int last) {
+    for (int i = first; i < last; i++) {
+      if (inverseMasses[i] > 0.0f) {
+        velocities[i] = (velocities[i] + settings.gravity * dt) * linear;
+        angularVelocities[i] = angularVelocities[i] * angular;
+      }
+
+      const glm::mat3 rotation = glm::mat3_cast(orientations[i]);
+      rotations[i] = rotation;
+      worldInverseInertias[i] = rotation * Diagonal(inverseInertias[i]) *
+                                glm::transpose(rotation);
+
+      const Shape& shape = shapes[i];
+      glm::vec3 extent;
+      switch (shape.type) {
+        case ShapeType::Sphere:
+          extent = glm::vec3(shape.radius);
+          break;
+        case ShapeType::Capsule:
+          extent = glm::abs(rotation[1]) * shape.halfHeight +
+                   glm::vec3(shape.radius);
+          break;
+        case ShapeType::Box:
+          extent = glm::abs(rotation[0]) * shape.halfExtents.x +
+                   glm::abs(rotation[1]) * shape.halfExtents.y +
+                   glm::abs(rotation[2]) * shape.halfExtents.z;
+          break;
+      }
+      extent += glm::vec3(settings.margin);
+      boundsMin[i] = positions[i] - extent;
+      boundsMax[i] = positions[i] + extent;
+    }
+  });
+}
+
+// Sweep and prune along x. The order barely changes between steps, so
+// insertion sort is close to linear; only new bodies need a full sort. Each
+// body then scans forward until the bounds start past its own, ranges of
+// the sweep collecting their own pairs.
+void PhysicsWorld::FindPairs(jobs::JobSystem* jobs) {
+  auto lowX = [&](uint32_t body) { return boundsMin[body].x; };
+  if (!sweepSorted) {
+    std::sort(sweep.begin(), sweep.end(), [&](uint32_t a, uint32_t b) {
+      return lowX(a) < lowX(b) || (lowX(a) == lowX(b) && a < b);
+    });
+    sweepSorted = true;
+  } else {
+    for (size_t i = 1; i < sweep.size(); i++) {
+      const uint32_t body = sweep[i];
+      size_t j = i;
+      for (; j > 0 && (lowX(sweep[j - 1]) > lowX(body) ||
+                       (lowX(sweep[j - 1]) == lowX(body) &&
+                        sweep[j - 1] > body));
+           j--) {
+        sweep[j] = sweep[j - 1];
+      }
+      sweep[j] = body;
+    }
+  }
+
+  const int count = static_cast<int>(sweep.size());
+  const int grain = settings.grain;
+  rangePairs.resize((count + grain - 1) / grain);
+  ForRanges(jobs, count, grain, [&](int first, int last) {
+    std::vector<Pair>& found = rangePairs[first / grain];
+    found.clear();
+    for (int i = first; i < last; i++) {
+      const uint32_t a = sweep[i];
+      const float highX = boundsMax[a].x;
+      for (int j = i + 1; j < count && lowX(sweep[j]) <= highX; j++) {
+        const uint32_t b = sweep[j];
+        if (inverseMasses[a] == 0.0f && inverseMasses[b] == 0.0f) {
+          continue;
+        }
+        if (boundsMin[a].y <= boundsMax[b].y &&
+            boundsMin[b].y <= boundsMax[a].y &&
+            boundsMin[a].z <= boundsMax[b].z &&
+            boundsMin[b].z <= boundsMax[a].z) {
+          found.push_back(Pair{a, b});
+        }
+      }
+    }
+  });
+
+  pairs.clear();
+  for (auto& found : rangePairs) {
+    pairs.insert(pairs.end(), found.begin(), found.end());
+  }
+}
+
+// Terrain contacts of every moving body first, then the pairs.
+void PhysicsWorld::FindContacts(jobs::JobSystem* jobs) {
+  const int bodies = static_cast<int>(positions.size());
+  const int count = bodies + static_cast<int>(pairs.size());
+  const int grain = settings.grain;
+  const int ranges = (count + grain - 1) / grain;
+  rangeManifolds.resize(ranges);
+  rangeContacts.resize(ranges);
+
+  ForRanges(jobs, count, grain, [&](int first, int last) {
+    std::vector<Manifold>& found = rangeManifolds[first / grain];
+    std::vector<Contact>& foundContacts = rangeContacts[first / grain];
+    found.clear();
+    foundContacts.clear();
+    Contact buffer[kMaxContacts];
+    for (int i = first; i < last; i++) {
+      uint32_t a;
+      uint32_t b;
+      int n = 0;
+      if (i < bodies) {
+        a = static_cast<uint32_t>(i);
+        b = kGround;
+        if (ground && inverseMasses[a] > 0.0f &&
+            boundsMin[a].y <= ground->MaxHeight()) {
+          n = CollideTerrain(MakeCollider(a), *ground, buffer);
+        }
+      } else {
+        a = pairs[i - bodies].a;
+        b = pairs[i - bodies].b;
+        n = Collide(MakeCollider(a), MakeCollider(b), buffer);
+      }
+      if (n == 0) {
+        continue;
+      }
+
+      const float friction =
+          b == kGround ? frictions[a] : std::sqrt(frictions[a] * frictions[b]);
+      const float restitution =
+          b == kGround ? restitutions[a]
+                       : std::max(restitutions[a], restitutions[b]);
+      found.push_back(Manifold{a, b,
+                               static_cast<uint32_t>(foundContacts.size()),
+                               static_cast<uint32_t>(n), friction,
+                               restitution});
+      foundContacts.insert(foundContacts.end(), buffer, buffer + n);
+    }
+  });
+
+  manifolds.clear();
+  contacts.clear();
+  for (int r = 0; r < ranges; r++) {
+    const uint32_t offset = static_cast<uint32_t>(contacts.size());
+    for (Manifold manifold : rangeManifolds[r]) {
+      manifold.first += offset;
+      manifolds.push_back(manifold);
+    }
+    contacts.insert(contacts.end(), rangeContacts[r].begin(),
+                    rangeContacts[r].end());
+  }
+}
+
+// Greedy coloring in manifold order: each manifold takes the lowest color
+// neither of its moving bodies has yet. Static bodies and the ground are
+// never written by the solver and do not count.
+void PhysicsWorld::ColorManifolds() {
+  constexpr int kColors = 64;
+  std::vector<uint64_t> used(positions.size(), 0);
+  std::vector<uint8_t> colors(manifolds.size());
+  std::vector<uint32_t> sizes(kColors + 1, 0);
+
+  for (size_t m = 0; m < manifolds.size(); m++) {
+    const uint32_t a = manifolds[m].a;
+    const uint32_t b = manifolds[m].b;
+    const bool movesA = inverseMasses[a] > 0.0f;
+    const bool movesB = b != kGround && inverseMasses[b] > 0.0f;
+    const uint64_t taken = (movesA ? used[a] : 0) | (movesB ? used[b] : 0);
+
+    int color = kColors;
+    if (taken != ~uint64_t{0}) {
+      color = 0;
+      while (taken >> color & 1) {
+        color++;
+      }
+      const uint64_t bit = uint64_t{1} << color;
+      if (movesA) {
+        used[a] |= bit;
+      }
+      if (movesB) {
+        used[b] |= bit;
+      }
+    }
+    colors[m] = static_cast<uint8_t>(color);
+    sizes[color]++;
+  }
+
+  colorStarts.assign(kColors + 2, 0);
+  for (int c = 0; c <= kColors; c++) {
+    colorStarts[c + 1] = colorStarts[c] + sizes[c];
+  }
+  colorOrder.resize(manifolds.size());
+  std::vector<uint32_t> next(colorStarts.begin(), colorStarts.end() - 1);
+  for (size_t m = 0; m < manifolds.size(); m++) {
+    colorOrder[next[colors[m]]++] = static_cast<uint32_t>(m);
+  }
+}
+
+void PhysicsWorld::PrepareContacts(jobs::JobSystem* jobs, float dt) {
+  points.resize(contacts.size());
+  const glm::mat3 none(0.0f);
+  const int count = static_cast<int>(manifolds.size());
+  ForRanges(jobs, count, settings.grain, [&](int first, int last) {
+    for (int m = first; m < last; m++) {
+      const Manifold& manifold = manifolds[m];
+      const uint32_t a = manifold.a;
+      const uint32_t b = manifold.b;
+      const bool body = b != kGround;
+      const float massA = inverseMasses[a];
+      const float massB = body ? inverseMasses[b] : 0.0f;
+      const glm::mat3& inertiaA = worldInverseInertias[a];
+      const glm::mat3& inertiaB = body ? worldInverseInertias[b] : none;
+
+      for (uint32_t c = manifold.first; c < manifold.first + manifold.count;
+           c++) {
+        const Contact& contact = contacts[c];
+        ContactPoint& point = points[c];
+        const glm::vec3 ra = contact.point - positions[a];
+        const glm::vec3 rb =
+            body ? contact.point - positions[b] : glm::vec3(0.0f);
+        point.directions[0] = contact.normal;
+        Tangents(contact.normal, point.directions + 1);
+
+        for (int k = 0; k < 3; k++) {
+          point.armsA[k] = glm::cross(ra, point.directions[k]);
+          point.armsB[k] = glm::cross(rb, point.directions[k]);
+          point.spinsA[k] = inertiaA * point.armsA[k];
+          point.spinsB[k] = inertiaB * point.armsB[k];
+          // inverse of the mass felt along the direction at the contact
+          const float felt = massA + massB +
+                             glm::dot(point.armsA[k], point.spinsA[k]) +
+                             glm::dot(point.armsB[k], point.spinsB[k]);
+          point.masses[k] = felt > 0.0f ? 1.0f / felt : 0.0f;
+          point.impulses[k] = 0.0f;
+        }
+
+        // bounce off fast impacts, push out of deep ones
+        float approach = glm::dot(velocities[a], contact.normal) +
+                         glm::dot(angularVelocities[a], point.armsA[0]);
+        if (body) {
+          approach -= glm::dot(velocities[b], contact.normal) +
+                      glm::dot(angularVelocities[b], point.armsB[0]);
+        }
+        const float push = std::min(settings.baumgarte / dt *
+                                        std::max(contact.depth - settings.slop,
+                                                 0.0f),
+                                    settings.maxPushSpeed);
+        const float bounce =
+            approach < -1.0f ? -manifold.restitution * approach : 0.0f;
+        point.bias = std::max(push, bounce);
+      }
+    }
+  });
+}
+
+void PhysicsWorld::SolveManifold(const Manifold& manifold) {
+  const uint32_t a = manifold.a;
+  const uint32_t b = manifold.b;
+  const bool body = b != kGround;
+  const float massA = inverseMasses[a];
+  const float massB = body ? inverseMasses[b] : 0.0f;
+  // static bodies are shared by the manifolds of one color, they are read
+  // through copies so only moving bodies are ever written
+  const bool movesA = massA > 0.0f;
+  const bool movesB = massB > 0.0f;
+  glm::vec3 stillA = velocities[a];
+  glm::vec3 stillSpinA = angularVelocities[a];
+  glm::vec3 stillB = body ? velocities[b] : glm::vec3(0.0f);
+  glm::vec3 stillSpinB = body ? angularVelocities[b] : glm::vec3(0.0f);
+  glm::vec3& velocityA = movesA ? velocities[a] : stillA;
+  glm::vec3& spinA = movesA ? angularVelocities[a] : stillSpinA;
+  glm::vec3& velocityB = movesB ? velocities[b] : stillB;
+  glm::vec3& spinB = movesB ? angularVelocities[b] : stillSpinB;
+
+  // relative speed along direction k, and the change of impulse along it
+  auto speed = [&](const ContactPoint& point, int k) {
+    return glm::dot(velocityA - velocityB, point.directions[k]) +
+           glm::dot(spinA, point.armsA[k]) - glm::dot(spinB, point.armsB[k]);
+  };
+  auto apply = [&](const ContactPoint& point, int k, float impulse) {
+    if (movesA) {
+      velocityA += point.directions[k] * (impulse * massA);
+      spinA += point.spinsA[k] * impulse;
+    }
+    if (movesB) {
+      velocityB -= point.directions[k] * (impulse * massB);
+      spinB -= point.spinsB[k] * impulse;
+    }
+  };
+
+  for (uint32_t c = manifold.first; c < manifold.first + manifold.count; c++) {
+    ContactPoint& point = points[c];
+
+    // friction, bounded by the normal impulse of the previous pass
+    const float limit = manifold.friction * point.impulses[0];
+    for (int k = 1; k < 3; k++) {
+      const float previous = point.impulses[k];
+      point.impulses[k] = glm::clamp(
+          previous - speed(point, k) * point.masses[k], -limit, limit);
+      apply(point, k, point.impulses[k] - previous);
+    }
+
+    const float previous = point.impulses[0];
+    point.impulses[0] = std::max(
+        previous + (point.bias - speed(point, 0)) * point.masses[0], 0.0f);
+    apply(point, 0, point.impulses[0] - previous);
+  }
+}
+
+void PhysicsWorld::Solve(jobs::JobSystem* jobs) {
+  const int colors = static_cast<int>(colorStarts.size()) - 1;
+  // a few manifolds per job, they are cheap
+  const int grain = std::max(settings.grain / 4, 1);
+  for (int iteration = 0; iteration < settings.iterations; iteration++) {
+    for (int color = 0; color < colors; color++) {
+      const uint32_t start = colorStarts[color];
+      const int size = static_cast<int>(colorStarts[color + 1] - start);
+      if (size == 0) {
+        continue;
+      }
+      auto solve = [&](int first, int last) {
+        for (int i = first; i < last; i++) {
+          SolveManifold(manifolds[colorOrder[start + i]]);
+        }
+      };
+      // the overflow color shares bodies, it runs in order
+      if (color == colors - 1) {
+        solve(0, size);
+      } else {
+        ForRanges(jobs, size, grain, solve);
+      }
+    }
+  }
+}
+
+void PhysicsWorld::Integrate(jobs::JobSystem* jobs, float dt) {
+  const int count = static_cast<int>(positions.size());
+  ForRanges(jobs, count, settings.grain, [&](int first, int last) {
+    for (int i = first; i < last; i++) {
+      if (inverseMasses[i] == 0.0f) {
+        continue;
+      }
+      positions[i] += velocities[i] * dt;
+      const glm::vec3& w = angularVelocities[i];
+      const glm::quat spin(0.0f, w.x, w.y, w.z);
+      orientations[i] = glm::normalize(
+          orientations[i] + (spin * orientations[i]) * (0.5f * dt));
+    }
+  });
+}
+
+void PhysicsWorld::Step(jobs::JobSystem* jobs) {
+  const float dt = 1.0f / settings.stepsPerSecond;
+  const auto start = Clock::now();
+
+  UpdateBodies(jobs, dt);
+  auto phase = Clock::now();
+  FindPairs(jobs);
+  stats.broadphaseMilliseconds = Milliseconds(phase);
+
+  phase = Clock::now();
+  FindContacts(jobs);
+  stats.narrowphaseMilliseconds = Milliseconds(phase);
+
+  phase = Clock::now();
+  ColorManifolds();
+  PrepareContacts(jobs, dt);
+  Solve(jobs);
+  stats.solverMilliseconds = Milliseconds(phase);
+
+  Integrate(jobs, dt);
+  steps++;
+
+  stats.pairs = pairs.size();
+  stats.manifolds = manifolds.size();
+  stats.contacts = contacts.size();
+  stats.colors = 0;
+  for (size_t c = 0; c + 1 < colorStarts.size(); c++) {
+    stats.colors += colorStarts[c + 1] > colorStarts[c];
+  }
+  stats.stepMilliseconds = Milliseconds(start);
+}
+
+int PhysicsWorld::Advance(double seconds, jobs::JobSystem* jobs) {
+  pending += seconds;
+  const double dt = 1.0 / settings.stepsPerSecond;
+  int count = static_cast<int>(pending / dt);
+  if (count > settings.maxSteps) {
+    // falling behind, slow the simulation down rather than the frames
+    count = settings.maxSteps;
+    pending = 0.0;
+  } else {
+    pending -= count * dt;
+  }
+
+  for (int i = 0; i < count; i++) {
+    Step(jobs);
+  }
+  return count;
+}
+
+std::vector<PhysicsBenchmark> physics::BenchmarkPhysics(
+    const terrain::HeightPyramid& ground,
+    const std::vector<size_t>& bodyCounts,
+    int steps) {
+  const unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  // the calling thread helps while it waits, one worker fewer
+  jobs::JobSystem pool(std::max(threads, 2u) - 1);
+
+  auto fill = [&](PhysicsWorld& world, size_t count) {
+    std::mt19937 random(11);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    world.SetGround(&ground);
+
+    // layers of a square grid over the middle of the terrain, 1.5 apart
+    const int side = std::max(
+        1, std::min(static_cast<int>(std::sqrt(static_cast<double>(count))),
+                    static_cast<int>(0.5f * ground.Spacing() *
+                                     (ground.Width() - 1) / 1.5f)));
+    const float centreX =
+        ground.OriginX() + 0.5f * ground.Spacing() * (ground.Width() - 1);
+    const float centreZ =
+        ground.OriginZ() + 0.5f * ground.Spacing() * (ground.Depth() - 1);
+    const float top = ground.MaxHeight() + 2.0f;
+    for (size_t i = 0; i < count; i++) {
+      const int layer = static_cast<int>(i / (side * side));
+      const int cell = static_cast<int>(i % (side * side));
+      BodyDesc desc;
+      switch (i % 3) {
+        case 0:
+          desc.shape = Shape::Sphere(0.4f);
+          break;
+        case 1:
+          desc.shape = Shape::Capsule(0.3f, 0.3f);
+          break;
+        default:
+          desc.shape = Shape::Box(glm::vec3(0.4f, 0.3f, 0.35f));
+          break;
+      }
+      desc.position =
+          glm::vec3(centreX + 1.5f * (cell % side - 0.5f * side),
+                    top + 1.5f * layer,
+                    centreZ + 1.5f * (cell / side - 0.5f * side));
+      const glm::vec3 axis =
+          glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) +
+                         glm::vec3(0.0f, 0.0f, 1e-3f));
+      const float angle = 3.1415927f * unit(random);
+      const float s = std::sin(0.5f * angle);
+      desc.orientation =
+          glm::quat(std::cos(0.5f * angle), axis.x * s, axis.y * s, axis.z * s);
+      world.AddBody(desc);
+    }
+  };
+
+  std::vector<PhysicsBenchmark> results;
+  for (size_t count : bodyCounts) {
+    PhysicsBenchmark result;
+    result.bodies = count;
+    result.threads = pool.WorkerCount() + 1;
+
+    PhysicsWorld serial;
+    fill(serial, count);
+    auto start = Clock::now();
+    for (int s = 0; s < steps; s++) {
+      serial.Step(nullptr);
+    }
+    result.serialMilliseconds = Milliseconds(start) / std::max(steps, 1);
+
+    PhysicsWorld parallel;
+    fill(parallel, count);
+    start = Clock::now();
+    for (int s = 0; s < steps; s++) {
+      parallel.Step(&pool);
+    }
+    result.parallelMilliseconds = Milliseconds(start) / std::max(steps, 1);
+
+    result.pairs = parallel.Stats().pairs;
+    result.contacts = parallel.Stats().contacts;
+    result.matches = true;
+    for (uint32_t b = 0; b < count; b++) {
+      result.matches = result.matches &&
+                       serial.Position(b) == parallel.Position(b) &&
+                       serial.Orientation(b) == parallel.Orientation(b);
+    }
+    results.push_back(result);
+  }
+  return results;
+}
@@ -1 +1,35 @@
-#include <Camera.hpp>
\ No newline at end of file
+#include <Camera.hpp>
+
+using namespace camera;
+
+Frustum::Frustum(const glm::mat4& viewProjection) {
+  // Gribb/Hartmann, glm is column major so row i is m[0][i] .. m[3][i]
+  auto row = [&](int i) {
+    return glm::vec4(viewProjection[0][i], viewProjection[1][i],
+                     viewProjection[2][i], viewProjection[3][i]);
+  };
+
+  planes[0] = row(3) + row(0);  // left
+  planes[1] = row(3) - row(0);  // right
+  planes[2] = row(3) + row(1);  // bottom
+  planes[3] = row(3) - row(1);  // top
+  planes[4] = row(3) + row(2);  // near
+  planes[5] = row(3) - row(2);  // far
+
+  for (auto& plane : planes) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+}
+
+bool Frustum::IntersectsAabb(const glm::vec3& min, const glm::vec3& max) const {
+  for (auto& plane : planes) {
+    // the corner furthest along the plane normal
+    glm::vec3 corner{plane.x >= 0.0f ? max.x : min.x,
+                     plane.y >= 0.0f ? max.y : min.y,
+                     plane.z >= 0.0f ? max.z : min.z};
+    if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,454 @@
+#include <Culling.hpp>
+
+#include <Check.hpp>
+#include <Logger.hpp>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+using namespace camera;
+
+namespace {
+
+// a split halves a range, so no tree over 32 bit ids is deeper than this
+constexpr int kMaxDepth = 32;
+
+struct Range {
+  uint32_t begin;
+  uint32_t end;
+
+  uint32_t Size() const { return end - begin; }
+};
+
+// Bit i of outside is set when child i is entirely outside a plane, bit i of
+// inside when it is inside all of them. For each plane the corner furthest
+// along the normal (p) decides outside, the nearest one (n) inside. The sign
+// of the normal is the same for every lane, so the corners are picked per
+// plane rather than per lane. The arithmetic matches IntersectsAabb exactly,
+// so both agree on every box.
+template <typename Node>
+void TestNode(const Node& node,
+              const std::array<glm::vec4, 6>& planes,
+              unsigned int& outside,
+              unsigned int& inside) {
+#if defined(__AVX2__)
+  const __m256 zero = _mm256_setzero_ps();
+  __m256 out = zero;
+  __m256 in = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+  for (auto& plane : planes) {
+    const __m256 a = _mm256_set1_ps(plane.x);
+    const __m256 b = _mm256_set1_ps(plane.y);
+    const __m256 c = _mm256_set1_ps(plane.z);
+    const __m256 d = _mm256_set1_ps(plane.w);
+    const float* px = plane.x >= 0.0f ? node.maxX : node.minX;
+    const float* py = plane.y >= 0.0f ? node.maxY : node.minY;
+    const float* pz = plane.z >= 0.0f ? node.maxZ : node.minZ;
+    const float* nx = plane.x >= 0.0f ? node.minX : node.maxX;
+    const float* ny = plane.y >= 0.0f ? node.minY : node.maxY;
+    const float* nz = plane.z >= 0.0f ? node.minZ : node.maxZ;
+
+    __m256 p = _mm256_add_ps(_mm256_mul_ps(a, _mm256_load_ps(px)),
+                             _mm256_mul_ps(b, _mm256_load_ps(py)));
+    p = _mm256_add_ps(p, _mm256_mul_ps(c, _mm256_load_ps(pz)));
+    p = _mm256_add_ps(p, d);
+    __m256 n = _mm256_add_ps(_mm256_mul_ps(a, _mm256_load_ps(nx)),
+                             _mm256_mul_ps(b, _mm256_load_ps(ny)));
+    n = _mm256_add_ps(n, _mm256_mul_ps(c, _mm256_load_ps(nz)));
+    n = _mm256_add_ps(n, d);
+
+    out = _mm256_or_ps(out, _mm256_cmp_ps(p, zero, _CMP_LT_OQ));
+    in = _mm256_and_ps(in, _mm256_cmp_ps(n, zero, _CMP_GE_OQ));
+  }
+  outside = static_cast<unsigned int>(_mm256_movemask_ps(out));
+  inside = static_cast<unsigned int>(_mm256_movemask_ps(in)) & ~outside;
+#elif defined(__SSE4_1__)
+  outside = 0;
+  inside = 0;
+  const __m128 zero = _mm_setzero_ps();
+  for (int half = 0; half < BoundingVolumeHierarchy::kWidth; half += 4) {
+    __m128 out = zero;
+    __m128 in = _mm_cmpeq_ps(zero, zero);
+    for (auto& plane : planes) {
+      const __m128 a = _mm_set1_ps(plane.x);
+      const __m128 b = _mm_set1_ps(plane.y);
+      const __m128 c = _mm_set1_ps(plane.z);
+      const __m128 d = _mm_set1_ps(plane.w);
+      const float* px = (plane.x >= 0.0f ? node.maxX : node.minX) + half;
+      const float* py = (plane.y >= 0.0f ? node.maxY : node.minY) + half;
+      const float* pz = (plane.z >= 0.0f ? node.maxZ : node.minZ) + half;
+      const float* nx = (plane.x >= 0.0f ? node.minX : node.maxX) + half;
+      const float* ny = (plane.y >= 0.0f ? node.minY : node.maxY) + half;
+      const float* nz = (plane.z >= 0.0f ? node.minZ : node.maxZ) + half;
+
+      __m128 p = _mm_add_ps(_mm_mul_ps(a, _mm_load_ps(px)),
+                            _mm_mul_ps(b, _mm_load_ps(py)));
+      p = _mm_add_ps(p, _mm_mul_ps(c, _mm_load_ps(pz)));
+      p = _mm_add_ps(p, d);
+      __m128 n = _mm_add_ps(_mm_mul_ps(a, _mm_load_ps(nx)),
+                            _mm_mul_ps(b, _mm_load_ps(ny)));
+      n = _mm_add_ps(n, _mm_mul_ps(c, _mm_load_ps(nz)));
+      n = _mm_add_ps(n, d);
+
+      out = _mm_or_ps(out, _mm_cmplt_ps(p, zero));
+      in = _mm_and_ps(in, _mm_cmpge_ps(n, zero));
+    }
+    outside |= static_cast<unsigned int>(_mm_movemask_ps(out)) << half;
+    inside |= static_cast<unsigned int>(_mm_movemask_ps(in)) << half;
+  }
+  inside &= ~outside;
+#else
+  outside = 0;
+  inside = 0;
+  for (int lane = 0; lane < BoundingVolumeHierarchy::kWidth; lane++) {
+    bool in = true;
+    for (auto& plane : planes) {
+      const float* px = plane.x >= 0.0f ? node.maxX : node.minX;
+      const float* py = plane.y >= 0.0f ? node.maxY : node.minY;
+      const float* pz = plane.z >= 0.0f ? node.maxZ : node.minZ;
+      const float* nx = plane.x >= 0.0f ? node.minX : node.maxX;
+      const float* ny = plane.y >= 0.0f ? node.minY : node.maxY;
+      const float* nz = plane.z >= 0.0f ? node.minZ : node.maxZ;
+      const float p = plane.x * px[lane] + plane.y * py[lane] +
+                      plane.z * pz[lane] + plane.w;
+      const float n = plane.x * nx[lane] + plane.y * ny[lane] +
+                      plane.z * nz[lane] + plane.w;
+      if (p < 0.0f) {
+        outside |= 1u << lane;
+        in = false;
+        break;
+      }
+      in = in && n >= 0.0f;
+    }
+    if (in) {
+      inside |= 1u << lane;
+    }
+  }
+#endif
+}
+}  // namespace
+
+void Aabb::Expand(const glm::vec3& point) {
+  min = glm::min(min, point);
+  max = glm::max(max, point);
+}
+
+void Aabb::Expand(const Aabb& box) {
+  min = glm::min(min, box.min);
+  max = glm::max(max, box.max);
+}
+
+Aabb Aabb::Transformed(const glm::mat4& transform) const {
+  if (Empty()) {
+    return *this;
+  }
+
+  // each output axis takes the smaller and larger product per input axis
+  Aabb result;
+  result.min = result.max = glm::vec3(transform[3]);
+  for (int column = 0; column < 3; column++) {
+    for (int row = 0; row < 3; row++) {
+      const float a = transform[column][row] * min[column];
+      const float b = transform[column][row] * max[column];
+      result.min[row] += std::min(a, b);
+      result.max[row] += std::max(a, b);
+    }
+  }
+  return result;
+}
+
+int32_t BoundingVolumeHierarchy::BuildNode(
+    const std::vector<Aabb>& boxes,
+    const std::vector<glm::vec3>& centers,
+    uint32_t begin,
+    uint32_t end) {
+  const int32_t index = static_cast<int32_t>(nodes.size());
+  nodes.emplace_back();
+
+  // split the most populated range at its median along its longest axis
+  // until there is one range per child
+  Range ranges[kWidth] = {{begin, end}};
+  int rangeCount = 1;
+  while (rangeCount < kWidth) {
+    int largest = 0;
+    for (int i = 1; i < rangeCount; i++) {
+      if (ranges[i].Size() > ranges[largest].Size()) {
+        largest = i;
+      }
+    }
+    const Range range = ranges[largest];
+    if (range.Size() < 2) {
+      break;
+    }
+
+    Aabb bounds;
+    for (uint32_t i = range.begin; i < range.end; i++) {
+      bounds.Expand(centers[ids[i]]);
+    }
+    const glm::vec3 extent = bounds.max - bounds.min;
+    int axis = 0;
+    if (extent.y > extent[axis]) {
+      axis = 1;
+    }
+    if (extent.z > extent[axis]) {
+      axis = 2;
+    }
+
+    const uint32_t middle = range.begin + range.Size() / 2;
+    std::nth_element(ids.begin() + range.begin, ids.begin() + middle,
+                     ids.begin() + range.end, [&](uint32_t a, uint32_t b) {
+                       return centers[a][axis] < centers[b][axis];
+                     });
+    ranges[largest] = Range{range.begin, middle};
+    ranges[rangeCount++] = Range{middle, range.end};
+  }
+
+  Node node;
+  for (int lane = 0; lane < kWidth; lane++) {
+    Aabb bounds;
+    node.child[lane] = -1;
+    node.first[lane] = 0;
+    node.count[lane] = 0;
+    if (lane < rangeCount) {
+      const Range range = ranges[lane];
+      for (uint32_t i = range.begin; i < range.end; i++) {
+        bounds.Expand(boxes[ids[i]]);
+      }
+      node.first[lane] = range.begin;
+      node.count[lane] = range.Size();
+      if (range.Size() > 1) {
+        node.child[lane] = BuildNode(boxes, centers, range.begin, range.end);
+      }
+    }
+    node.minX[lane] = bounds.min.x;
+    node.minY[lane] = bounds.min.y;
+    node.minZ[lane] = bounds.min.z;
+    node.maxX[lane] = bounds.max.x;
+    node.maxY[lane] = bounds.max.y;
+    node.maxZ[lane] = bounds.max.z;
+  }
+
+  // the recursion may have moved the vector
+  nodes[index] = node;
+  return index;
+}
+
+void BoundingVolumeHierarchy::Build(const std::vector<Aabb>& boxes) {
+  nodes.clear();
+  ids.clear();
+
+  // empty boxes are never visible, and have no center to sort them by
+  std::vector<glm::vec3> centers(boxes.size());
+  for (uint32_t i = 0; i < boxes.size(); i++) {
+    if (!boxes[i].Empty()) {
+      ids.push_back(i);
+      centers[i] = boxes[i].Center();
+    }
+  }
+  if (ids.empty()) {
+    return;
+  }
+
+  // a node has at most kWidth children, so about n / (kWidth - 1) nodes
+  nodes.reserve(ids.size() / (kWidth - 1) + 1);
+  BuildNode(boxes, centers, 0, static_cast<uint32_t>(ids.size()));
+}
+
+void BoundingVolumeHierarchy::Cull(const Frustum& frustum,
+                                   std::vector<uint32_t>& visible) const {
+  visible.clear();
+  if (nodes.empty()) {
+    return;
+  }
+
+  const auto& planes = frustum.Planes();
+  int32_t stack[kMaxDepth * kWidth];
+  int size = 0;
+  stack[size++] = 0;
+
+  while (size > 0) {
+    const Node& node = nodes[stack[--size]];
+    unsigned int outside;
+    unsigned int inside;
+    TestNode(node, planes, outside, inside);
+
+    for (int lane = 0; lane < kWidth; lane++) {
+      if (node.count[lane] == 0 || (outside & (1u << lane))) {
+        continue;
+      }
+      if (node.child[lane] < 0 || (inside & (1u << lane))) {
+        // everything below is visible, no need to look further
+        const auto first = ids.begin() + node.first[lane];
+        visible.insert(visible.end(), first, first + node.count[lane]);
+      } else {
+        stack[size++] = node.child[lane];
+      }
+    }
+  }
+}
+
+const char* BoundingVolumeHierarchy::SimdPath() {
+#if defined(__AVX2__)
+  return "AVX2";
+#elif defined(__SSE4_1__)
+  return "SSE4.1";
+#else
+  return "scalar";
+#endif
+}
+
+void camera::CullBruteForce(const std::vector<Aabb>& boxes,
+                            const Frustum& frustum,
+                            std::vector<uint32_t>& visible) {
+  visible.clear();
+  for (uint32_t i = 0; i < boxes.size(); i++) {
+    if (frustum.IntersectsAabb(boxes[i].min, boxes[i].max)) {
+      visible.push_back(i);
+    }
+  }
+}
+
+CullingBenchmark camera::BenchmarkCulling(const std::vector<Aabb>& boxes,
+                                          const Frustum& frustum,
+                                          int repeats) {
+  using Clock = std::chrono::steady_clock;
+  using Milliseconds = std::chrono::duration<double, std::milli>;
+
+  CullingBenchmark result;
+  result.objects = boxes.size();
+
+  auto start = Clock::now();
+  BoundingVolumeHierarchy hierarchy;
+  hierarchy.Build(boxes);
+  result.buildMs = Milliseconds(Clock::now() - start).count();
+
+  std::vector<uint32_t> reference;
+  start = Clock::now();
+  for (int i = 0; i < repeats; i++) {
+    CullBruteForce(boxes, frustum, reference);
+  }
+  result.bruteForceMs = Milliseconds(Clock::now() - start).count() / repeats;
+
+  std::vector<uint32_t> visible;
+  start = Clock::now();
+  for (int i = 0; i < repeats; i++) {
+    hierarchy.Cull(frustum, visible);
+  }
+  result.hierarchyMs = Milliseconds(Clock::now() - start).count() / repeats;
+
+  std::sort(visible.begin(), visible.end());
+  result.visible = visible.size();
+  result.matches = visible == reference;
+  return result;
+}
+
+bool camera::ReportCullingBenchmark(const std::vector<Aabb>& boxes,
+                                    const Frustum& frustum) {
+  auto result = BenchmarkCulling(boxes, frustum);
+  LOG_INFO("Culling " + std::to_string(result.objects) + " boxes (" +
+           BoundingVolumeHierarchy::SimdPath() + "): " +
+           std::to_string(result.visible) + " visible, build " +
+           std::to_string(result.buildMs) + " ms, brute force " +
+           std::to_string(result.bruteForceMs) + " ms, hierarchy " +
+           std::to_string(result.hierarchyMs) + " ms per cull");
+  return result.matches;
+}
+
+namespace {
+
+// Boxes scattered over a 1000 unit cube. Most are small, some span many
+// others, some are flat along an axis and some are empty.
+std::vector<Aabb> ScatterBoxes(size_t count, std::mt19937& random) {
+  std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+  std::uniform_real_distribution<float> small(0.0f, 5.0f);
+  std::uniform_real_distribution<float> large(0.0f, 200.0f);
+  std::uniform_int_distribution<int> kind(0, 99);
+
+  std::vector<Aabb> boxes(count);
+  for (auto& box : boxes) {
+    const int k = kind(random);
+    if (k == 0) {
+      continue;
+    }
+    const glm::vec3 center(position(random), position(random),
+                           position(random));
+    auto& size = k < 5 ? large : small;
+    glm::vec3 half(size(random), size(random), size(random));
+    if (k < 10) {
+      half[k % 3] = 0.0f;
+    }
+    box.Expand(center - half);
+    box.Expand(center + half);
+  }
+  return boxes;
+}
+
+std::vector<Frustum> CheckViews() {
+  struct View {
+    glm::vec3 eye;
+    glm::vec3 target;
+    glm::vec3 up;
+    float fov;
+    float far;
+  };
+  const View views[] = {
+      // the whole cloud from outside
+      {{0, 0, 1500}, {0, 0, 0}, {0, 1, 0}, 60.0f, 5000.0f},
+      // from inside, the far plane cuts through it, also timed
+      {{0, 0, 0}, {1, 0, 0}, {0, 1, 0}, 45.0f, 300.0f},
+      // straight down, wide
+      {{0, 800, 0}, {0, 0, 0}, {0, 0, -1}, 100.0f, 1000.0f},
+      // oblique from a corner, narrow
+      {{600, 600, 600}, {-100, 0, 50}, {0, 1, 0}, 20.0f, 2000.0f},
+      // away from everything, nothing is visible
+      {{0, 0, 1500}, {0, 0, 3000}, {0, 1, 0}, 60.0f, 5000.0f},
+  };
+
+  std::vector<Frustum> frustums;
+  for (auto& view : views) {
+    const glm::mat4 projection =
+        glm::perspective(glm::radians(view.fov), 16.0f / 9.0f, 0.1f, view.far);
+    frustums.emplace_back(projection *
+                          glm::lookAt(view.eye, view.target, view.up));
+  }
+  return frustums;
+}
+}  // namespace
+
+bool camera::CheckCulling() {
+  checks::Checker check("Culling");
+  const auto views = CheckViews();
+  std::mt19937 random(11);
+
+  for (size_t count : {1000, 10000, 100000, 1000000}) {
+    const auto boxes = ScatterBoxes(count, random);
+    check.Expect(ReportCullingBenchmark(boxes, views[1]),
+                 "the benchmark disagrees on " + std::to_string(count) +
+                     " boxes");
+
+    BoundingVolumeHierarchy hierarchy;
+    hierarchy.Build(boxes);
+    std::vector<uint32_t> visible;
+    std::vector<uint32_t> reference;
+    for (size_t v = 0; v < views.size(); v++) {
+      hierarchy.Cull(views[v], visible);
+      std::sort(visible.begin(), visible.end());
+      CullBruteForce(boxes, views[v], reference);
+      check.Expect(visible == reference,
+                   "view " + std::to_string(v) + " finds " +
+                       std::to_string(visible.size()) + " of " +
+                       std::to_string(count) + " boxes, brute force " +
+                       std::to_string(reference.size()));
+    }
+  }
+  return check.Passed();
+}
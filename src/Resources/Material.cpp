@@ -0,0 +1,84 @@
+#include <Material.hpp>
+
+#include <map>
+#include <string>
+
+#include <Logger.hpp>
+
+using namespace models;
+
+namespace {
+
+const char* const kSamplerTypes[] = {"texture_diffuse", "texture_specular",
+                                     "texture_normal", "texture_height"};
+constexpr unsigned int kSamplerTypeCount =
+    sizeof(kSamplerTypes) / sizeof(kSamplerTypes[0]);
+}  // namespace
+
+Material::Material(uint32_t id,
+                   std::vector<TextureBinding> bindings,
+                   std::vector<std::shared_ptr<Texture>> textures)
+    : id{id}, bindings{std::move(bindings)}, textures{std::move(textures)} {}
+
+std::shared_ptr<const Material> Material::Get(
+    const std::vector<std::shared_ptr<Texture>>& textures) {
+  // keyed on the texture names in order, materials die with their meshes
+  static std::map<std::vector<GLuint>, std::weak_ptr<const Material>>
+      materials;
+  static uint32_t nextId = 0;
+
+  std::vector<GLuint> key;
+  for (auto& texture : textures) {
+    key.push_back(texture->Id());
+  }
+  if (auto existing = materials[key].lock()) {
+    return existing;
+  }
+
+  // the N in texture_diffuseN counts per type, in texture order
+  unsigned int used[kSamplerTypeCount] = {};
+  std::vector<TextureBinding> bindings;
+  for (auto& texture : textures) {
+    unsigned int type = 0;
+    while (type < kSamplerTypeCount && texture->Type() != kSamplerTypes[type]) {
+      type++;
+    }
+    if (type == kSamplerTypeCount || used[type] == kSamplersPerType) {
+      logging::Logger::LogWarn("Texture " + texture->Path() + " of type " +
+                               texture->Type() + " has no sampler, skipped");
+      continue;
+    }
+    bindings.push_back(
+        TextureBinding{type * kSamplersPerType + used[type]++, texture->Id()});
+  }
+
+  std::shared_ptr<const Material> material(
+      new Material(nextId++, std::move(bindings), textures));
+  materials[key] = material;
+  return material;
+}
+
+void Material::BindSamplerUnits(ShaderProgram& shader) {
+  shader.use();
+  for (unsigned int type = 0; type < kSamplerTypeCount; type++) {
+    for (unsigned int n = 0; n < kSamplersPerType; n++) {
+      const std::string name = kSamplerTypes[type] + std::to_string(n + 1);
+      const GLint location =
+          glGetUniformLocation(shader.getHandle(), name.c_str());
+      if (location >= 0) {
+        glUniform1i(location, static_cast<GLint>(type * kSamplersPerType + n));
+      }
+    }
+  }
+}
+
+void Material::Bind() const {
+  for (auto& texture : textures) {
+    texture->MarkUsed();
+  }
+  for (auto& binding : bindings) {
+    glActiveTexture(GL_TEXTURE0 + binding.unit);
+    glBindTexture(GL_TEXTURE_2D, binding.texture);
+  }
+  glActiveTexture(GL_TEXTURE0);
+}
@@ -5,15 +5,41 @@
 #include <assimp/scene.h>
 #include <assimp/Importer.hpp>
 
+#include <algorithm>
+
+#include <MeshOptimizer.hpp>
 #include <ResourceManager.hpp>
+#include <VertexFormat.hpp>
 
+#include <JobSystem.hpp>
 #include <Logger.hpp>
 
 using namespace models;
 
+namespace {
+
+constexpr UniformId kPositionOffset("positionOffset");
+constexpr UniformId kPositionScale("positionScale");
+constexpr UniformId kModel("model");
+}  // namespace
+
 void Mesh::Load(const aiScene* scene,
                 const aiMesh* mesh,
                 std::optional<std::string> relativePath) {
+  Import(scene, mesh, relativePath);
+
+  auto& manager = resources::ResourceManager::GetManager();
+  std::vector<std::shared_ptr<Texture>> loaded;
+  for (auto& reference : textureReferences) {
+    loaded.push_back(manager.LoadTexture(reference.path, reference.type));
+  }
+
+  Upload(std::move(loaded));
+}
+
+void Mesh::Import(const aiScene* scene,
+                  const aiMesh* mesh,
+                  std::optional<std::string> relativePath) {
   float scale = 2.0;
 
   const auto num_vertices = mesh->mNumVertices;
@@ -21,18 +47,15 @@ void Mesh::Load(const aiScene* scene,
   const auto has_normals = mesh->HasNormals();
   const auto has_tangents_and_bitangents = mesh->HasTangentsAndBitangents();
 
-  logging::Logger::LogDebug("Mesh has " + std::to_string(num_vertices) +
-                            " vertices.");
-
-  logging::Logger::LogDebug("Mesh contains " + std::to_string(color_channels) +
-                            " color channels.");
+  LOG_DEBUG("Mesh has " + std::to_string(num_vertices) + " vertices.");
 
-  logging::Logger::LogDebug("Mesh has normals: " + std::to_string(has_normals));
+  LOG_DEBUG("Mesh contains " + std::to_string(color_channels) +
+            " color channels.");
 
-  logging::Logger::LogDebug("Mesh has tangents and bitangets: " +
-                            std::to_string(has_tangents_and_bitangents));
+  LOG_DEBUG("Mesh has normals: " + std::to_string(has_normals));
 
-  int print = 0;
+  LOG_DEBUG("Mesh has tangents and bitangets: " +
+            std::to_string(has_tangents_and_bitangents));
 
   const aiMaterial* mtl = scene->mMaterials[mesh->mMaterialIndex];
 
@@ -42,206 +65,273 @@ void Mesh::Load(const aiScene* scene,
       mesh->HasVertexColors(0) && mesh->mColors[0]) {
     material_color = *mesh->mColors[0];
 
-    logging::Logger::LogDebug(
-        "Mesh does not have a diffuse color, using default: Red=" +
-        std::to_string(material_color.r) +
-        " Green=" + std::to_string(material_color.g) +
-        " Blue=" + std::to_string(material_color.b));
+    LOG_DEBUG("Mesh does not have a diffuse color, using default: Red=" +
+              std::to_string(material_color.r) +
+              " Green=" + std::to_string(material_color.g) +
+              " Blue=" + std::to_string(material_color.b));
   } else {
-    logging::Logger::LogDebug(
-        "Mesh has a diffuse color: Red=" + std::to_string(material_color.r) +
-        " Green=" + std::to_string(material_color.g) +
-        " Blue=" + std::to_string(material_color.b));
-  }
-  for (unsigned int i = 0; i < num_vertices; ++i) {
-    double per_done = (100 * i) / num_vertices;
-
-    if (per_done == print) {
-      logging::Logger::LogDebug(std::to_string(per_done) + "%");
-      print += 5;
-    }
-
-    VertexType vert;
-    vert.Position.x = mesh->mVertices[i].x / scale;
-    vert.Position.y = mesh->mVertices[i].y / scale;
-    vert.Position.z = mesh->mVertices[i].z / scale;
-
-    if (has_normals) {
-      vert.Normal.x = mesh->mNormals[i].x;
-      vert.Normal.y = mesh->mNormals[i].y;
-      vert.Normal.z = mesh->mNormals[i].z;
-    }
-
-    if (mesh->HasTextureCoords(0) && mesh->mTextureCoords[0]) {
-      // a vertex can contain up to 8 different texture coordinates. We thus
-      // make the assumption that we won't use models where a vertex can have
-      // multiple texture coordinates so we always take the first set (0).
-      vert.TexCoords.x = mesh->mTextureCoords[0][i].x;
-      vert.TexCoords.y = mesh->mTextureCoords[0][i].y;
-    } else {
-      vert.TexCoords.x = 0.0;
-      vert.TexCoords.y = 0.0;
-    }
-
-    if (has_tangents_and_bitangents) {
-      // tangent
-      vert.Tangent.x = mesh->mTangents[i].x;
-      vert.Tangent.y = mesh->mTangents[i].y;
-      vert.Tangent.z = mesh->mTangents[i].z;
-
-      // bitangent
-      vert.Bitangent.x = mesh->mBitangents[i].x;
-      vert.Bitangent.y = mesh->mBitangents[i].y;
-      vert.Bitangent.z = mesh->mBitangents[i].z;
-    }
-
-    vert.Color.r = material_color.r;
-    vert.Color.g = material_color.g;
-    vert.Color.b = material_color.b;
-    vert.Color.w = material_color.a;
-
-    vertices.push_back(vert);
+    LOG_DEBUG("Mesh has a diffuse color: Red=" +
+              std::to_string(material_color.r) +
+              " Green=" + std::to_string(material_color.g) +
+              " Blue=" + std::to_string(material_color.b));
   }
-
-  logging::Logger::LogDebug("Scene HasMaterials: " +
-                            std::to_string(scene->HasMaterials()));
+  color = glm::vec4(material_color.r, material_color.g, material_color.b,
+                    material_color.a);
+
+  // convert the vertices in parallel, each range writes its own slots
+  vertices.resize(num_vertices);
+  jobs::JobSystem::GetInstance().ParallelFor(
+      0, static_cast<int>(num_vertices), 4096, [&](int first, int last) {
+        for (int i = first; i < last; ++i) {
+          VertexType vert{};
+          vert.Position.x = mesh->mVertices[i].x / scale;
+          vert.Position.y = mesh->mVertices[i].y / scale;
+          vert.Position.z = mesh->mVertices[i].z / scale;
+
+          if (has_normals) {
+            vert.Normal.x = mesh->mNormals[i].x;
+            vert.Normal.y = mesh->mNormals[i].y;
+            vert.Normal.z = mesh->mNormals[i].z;
+          }
+
+          if (mesh->HasTextureCoords(0) && mesh->mTextureCoords[0]) {
+            // a vertex can contain up to 8 different texture coordinates. We
+            // thus make the assumption that we won't use models where a vertex
+            // can have multiple texture coordinates so we always take the
+            // first set (0).
+            vert.TexCoords.x = mesh->mTextureCoords[0][i].x;
+            vert.TexCoords.y = mesh->mTextureCoords[0][i].y;
+          } else {
+            vert.TexCoords.x = 0.0;
+            vert.TexCoords.y = 0.0;
+          }
+
+          if (has_tangents_and_bitangents) {
+            // tangent
+            vert.Tangent.x = mesh->mTangents[i].x;
+            vert.Tangent.y = mesh->mTangents[i].y;
+            vert.Tangent.z = mesh->mTangents[i].z;
+
+            // bitangent
+            vert.Bitangent.x = mesh->mBitangents[i].x;
+            vert.Bitangent.y = mesh->mBitangents[i].y;
+            vert.Bitangent.z = mesh->mBitangents[i].z;
+          }
+
+          vert.Color.r = material_color.r;
+          vert.Color.g = material_color.g;
+          vert.Color.b = material_color.b;
+          vert.Color.w = material_color.a;
+
+          vertices[i] = vert;
+        }
+      });
+
+  LOG_DEBUG("Scene HasMaterials: " + std::to_string(scene->HasMaterials()));
   if (scene->HasMaterials()) {
     // TODO: Handle n > 1
     auto material = scene->mMaterials[0];
 
-    auto manager = resources::ResourceManager::GetManager();
-
-    std::vector<std::shared_ptr<Texture>> diffuseMaps = manager.LoadTextures(
-        material, aiTextureType_DIFFUSE, "texture_diffuse", relativePath);
-    textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-
-    // 2. specular maps
-    std::vector<std::shared_ptr<Texture>> specularMaps = manager.LoadTextures(
-        material, aiTextureType_SPECULAR, "texture_specular", relativePath);
-    textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-
-    // 3. Normal maps
-    std::vector<std::shared_ptr<Texture>> normalMaps = manager.LoadTextures(
-        material, aiTextureType_HEIGHT, "texture_normal", relativePath);
-    textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-
-    // 4. height maps
-    std::vector<std::shared_ptr<Texture>> heightMaps = manager.LoadTextures(
-        material, aiTextureType_AMBIENT, "texture_height", relativePath);
-    textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+    // textures are only referenced here, they are loaded on the GL thread
+    const std::pair<aiTextureType, const char*> types[] = {
+        {aiTextureType_DIFFUSE, "texture_diffuse"},
+        {aiTextureType_SPECULAR, "texture_specular"},
+        {aiTextureType_HEIGHT, "texture_normal"},
+        {aiTextureType_AMBIENT, "texture_height"},
+    };
+    for (auto& type : types) {
+      for (auto& path : resources::ResourceManager::TexturePaths(
+               material, type.first, relativePath)) {
+        textureReferences.push_back(TextureReference{path, type.second});
+      }
+    }
   }
 
-  logging::Logger::LogDebug("Mesh has " + std::to_string(mesh->mNumFaces) +
-                            " faces");
+  LOG_DEBUG("Mesh has " + std::to_string(mesh->mNumFaces) + " faces");
 
+  indices.reserve(static_cast<size_t>(mesh->mNumFaces) * 3);
+  size_t skipped = 0;
   for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
     aiFace face = mesh->mFaces[i];
+    // the index buffer is a triangle list, a stray point or line would
+    // shift every triangle after it
+    if (face.mNumIndices != 3) {
+      skipped++;
+      continue;
+    }
     // retrieve all indices of the face and store them in the indices vector
     for (unsigned int j = 0; j < face.mNumIndices; j++)
       indices.push_back(face.mIndices[j]);
   }
+  if (skipped > 0) {
+    logging::Logger::LogWarn("Mesh skipped " + std::to_string(skipped) +
+                             " faces that are not triangles");
+  }
 
-  logging::Logger::LogDebug("Mesh has " + std::to_string(indices.size()) +
-                            " indices");
+  LOG_DEBUG("Mesh has " + std::to_string(indices.size()) + " indices");
+
+  auto report = OptimizeMesh(vertices, indices);
+  LOG_INFO("Mesh optimized: " + std::to_string(report.verticesBefore) + " -> " +
+           std::to_string(report.verticesAfter) + " vertices, ACMR " +
+           std::to_string(report.before.acmr) + " -> " +
+           std::to_string(report.after.acmr) + ", ATVR " +
+           std::to_string(report.before.atvr) + " -> " +
+           std::to_string(report.after.atvr));
+}
+
+void Mesh::Upload(std::vector<std::shared_ptr<models::Texture>> textures) {
+  this->textures = std::move(textures);
 
   // set up the buffers
-  Setup();
+  Setup(vertices.data(), vertices.size(), indices.data(), indices.size());
+}
+
+void Mesh::Load(const VertexType* vertices,
+                size_t vertexCount,
+                const unsigned int* indices,
+                size_t indexCount,
+                glm::vec4 color,
+                std::vector<std::shared_ptr<models::Texture>> textures) {
+  this->color = color;
+  this->textures = std::move(textures);
+
+  Setup(vertices, vertexCount, indices, indexCount);
 }
 
-void Mesh::Setup() {
+void Mesh::Setup(const VertexType* vertexData,
+                 size_t vertexCount,
+                 const unsigned int* indexData,
+                 size_t indexCount) {
+  this->indexCount = static_cast<GLsizei>(indexCount);
+  this->material = Material::Get(textures);
+
+  // keep only the attributes the mesh uses, in their smallest format
+  const auto quantization =
+      VertexQuantization::FromBounds(vertexData, vertexCount);
+  const unsigned int attributes =
+      DetectVertexAttributes(vertexData, vertexCount);
+  positionOffset = quantization.offset;
+  positionScale = quantization.scale;
+
+  bounds = camera::Aabb{};
+  for (size_t i = 0; i < vertexCount; i++) {
+    bounds.Expand(vertexData[i].Position);
+  }
+
   // create buffers/arrays
   glGenVertexArrays(1, &VAO);
   glGenBuffers(1, &VBO);
   glGenBuffers(1, &EBO);
+  buffersCreated += 2;
 
   glBindVertexArray(VAO);
 
-  // load data into vertex buffers
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  WithVertexLayout(attributes, [&](auto layout) {
+    using Layout = decltype(layout);
+    const auto packed = Layout::Pack(vertexData, vertexCount, quantization);
+    vertexBytes = packed.size();
 
-  // A great thing about structs is that their memory layout is sequential for
-  // all its items. The effect is that we can simply pass a pointer to the
-  // struct and it translates perfectly to a glm::vec3/2 array which again
-  // translates to 3/2 floats which translates to a byte array.
-  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(VertexType),
-               &vertices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(),
+                 GL_STATIC_DRAW);
+    Layout::Bind();
+  });
 
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
 
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
-               &indices[0], GL_STATIC_DRAW);
+  // halve the index buffer whenever every index fits in 16 bits
+  if (vertexCount < 65536) {
+    std::vector<uint16_t> shortIndices(indexData, indexData + indexCount);
+    indexType = GL_UNSIGNED_SHORT;
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(uint16_t),
+                 shortIndices.data(), GL_STATIC_DRAW);
+  } else {
+    indexType = GL_UNSIGNED_INT;
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int),
+                 indexData, GL_STATIC_DRAW);
+  }
 
-  int idx = 0;
+  glBindVertexArray(0);
 
-  // vertex Positions
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexType), (void*)0);
+  LOG_DEBUG("Mesh vertices packed to " +
+            std::to_string(vertexBytes / std::max<size_t>(vertexCount, 1)) +
+            " bytes from " + std::to_string(sizeof(VertexType)));
+  LOG_DEBUG([&] {
+    auto error = MeasureVertexError(vertexData, vertexCount, attributes);
+    return "Mesh packing error: position " + std::to_string(error.position) +
+           " normal " + std::to_string(error.normal) + " color " +
+           std::to_string(error.color) + " uv " +
+           std::to_string(error.texCoords) + " tangent " +
+           std::to_string(error.tangent);
+  }());
+}
 
-  // vertex normals
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertexType),
-                        (void*)offsetof(VertexType, Normal));
+void Mesh::Bind(ShaderProgram& shader) const {
+  material->Bind();
+  BindVertices(shader);
+}
 
-  // vertex color
-  glEnableVertexAttribArray(2);
-  glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(VertexType),
-                        (void*)offsetof(VertexType, Color));
+void Mesh::BindVertices(ShaderProgram& shader) const {
+  shader.setUniform(kPositionOffset, positionOffset);
+  shader.setUniform(kPositionScale, positionScale);
 
-  // vertex texture coords
-  glEnableVertexAttribArray(3);
-  glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(VertexType),
-                        (void*)offsetof(VertexType, TexCoords));
+  glBindVertexArray(VAO);
+}
 
-  // vertex tangent
-  glEnableVertexAttribArray(4);
-  glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(VertexType),
-                        (void*)offsetof(VertexType, Tangent));
+void Mesh::DrawElements() const {
+  glDrawElements(GL_TRIANGLES, indexCount, indexType, 0);
+}
 
-  // vertex bitangent
-  glEnableVertexAttribArray(5);
-  glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(VertexType),
-                        (void*)offsetof(VertexType, Bitangent));
+void Mesh::DrawElementsInstanced(GLuint instanceBuffer, GLsizei count) const {
+  // the transform takes four locations, one per column, then the tint
+  const GLuint transformLocation = 6;
+  const GLuint tintLocation = 10;
+
+  glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+  for (GLuint column = 0; column < 4; column++) {
+    glEnableVertexAttribArray(transformLocation + column);
+    glVertexAttribPointer(transformLocation + column, 4, GL_FLOAT, GL_FALSE,
+                          sizeof(MeshInstance),
+                          (void*)(offsetof(MeshInstance, transform) +
+                                  column * sizeof(glm::vec4)));
+    glVertexAttribDivisor(transformLocation + column, 1);
+  }
+  glEnableVertexAttribArray(tintLocation);
+  glVertexAttribPointer(tintLocation, 4, GL_FLOAT, GL_FALSE,
+                        sizeof(MeshInstance),
+                        (void*)offsetof(MeshInstance, tint));
+  glVertexAttribDivisor(tintLocation, 1);
+
+  glDrawElementsInstanced(GL_TRIANGLES, indexCount, indexType, 0, count);
+
+  // the VAO is shared with the per-object path, which has no instance data
+  for (GLuint location = transformLocation; location <= tintLocation;
+       location++) {
+    glDisableVertexAttribArray(location);
+  }
+}
 
+void Mesh::Draw(ShaderProgram& shader) const {
+  Bind(shader);
+  DrawElements();
   glBindVertexArray(0);
 }
 
-void Mesh::Draw(ShaderProgram& shader) const {
-  // bind appropriate textures
-  unsigned int diffuseNr = 1;
-  unsigned int specularNr = 1;
-  unsigned int normalNr = 1;
-  unsigned int heightNr = 1;
-
-  for (unsigned int i = 0; i < textures.size(); i++) {
-    glActiveTexture(GL_TEXTURE0 +
-                    i);  // active proper texture unit before binding
-    // retrieve texture number (the N in diffuse_textureN)
-    std::string number;
-    std::string name = textures[i]->Type();
-
-    if (name == "texture_diffuse")
-      number = std::to_string(diffuseNr++);
-    else if (name == "texture_specular")
-      number = std::to_string(specularNr++);  // transfer unsigned int to stream
-    else if (name == "texture_normal")
-      number = std::to_string(normalNr++);  // transfer unsigned int to stream
-    else if (name == "texture_height")
-      number = std::to_string(heightNr++);  // transfer unsigned int to stream
-
-    // now set the sampler to the correct texture unit
-    auto location =
-        glGetUniformLocation(shader.getHandle(), (name + number).c_str());
-
-    glUniform1i(location, i);
-    // and finally bind the texture
-    glBindTexture(GL_TEXTURE_2D, textures[i]->Id());
+void Mesh::Draw(ShaderProgram& shader,
+                const glm::mat4& transform,
+                const std::vector<glm::mat4>& instances) const {
+  Bind(shader);
+  for (auto& instance : instances) {
+    shader.setUniform(kModel, transform * instance);
+    DrawElements();
   }
-
-  // draw mesh
-  glBindVertexArray(VAO);
-  glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, 0);
   glBindVertexArray(0);
+}
 
-  // always good practice to set everything back to defaults once configured.
-  glActiveTexture(GL_TEXTURE0);
-}
\ No newline at end of file
+void Mesh::DrawInstanced(ShaderProgram& shader,
+                         GLuint instanceBuffer,
+                         GLsizei count) const {
+  Bind(shader);
+  DrawElementsInstanced(instanceBuffer, count);
+  glBindVertexArray(0);
+}
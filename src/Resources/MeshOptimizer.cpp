@@ -0,0 +1,235 @@
+#include <MeshOptimizer.hpp>
+
+#include <Hash.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+using namespace models;
+
+namespace {
+
+constexpr unsigned int kUnused = ~0u;
+
+// vertices compare bitwise, the struct has no padding
+static_assert(sizeof(VertexType) == 18 * sizeof(float),
+              "VertexType must not contain padding");
+
+struct VertexHash {
+  const std::vector<VertexType>* vertices;
+
+  size_t operator()(unsigned int index) const {
+    return static_cast<size_t>(
+        hashing::Fnv1a(&(*vertices)[index], sizeof(VertexType)));
+  }
+};
+
+struct VertexEqual {
+  const std::vector<VertexType>* vertices;
+
+  bool operator()(unsigned int a, unsigned int b) const {
+    return std::memcmp(&(*vertices)[a], &(*vertices)[b],
+                       sizeof(VertexType)) == 0;
+  }
+};
+
+// triangles around each vertex, compressed into one array
+struct Adjacency {
+  std::vector<unsigned int> offsets;
+  std::vector<unsigned int> triangles;
+
+  Adjacency(const std::vector<unsigned int>& indices, size_t vertexCount)
+      : offsets(vertexCount + 1, 0), triangles(indices.size()) {
+    for (unsigned int index : indices) {
+      offsets[index + 1]++;
+    }
+    for (size_t v = 0; v < vertexCount; v++) {
+      offsets[v + 1] += offsets[v];
+    }
+    std::vector<unsigned int> cursor(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) {
+      triangles[cursor[indices[i]]++] = static_cast<unsigned int>(i / 3);
+    }
+  }
+};
+}  // namespace
+
+VertexCacheStats models::AnalyzeVertexCache(
+    const std::vector<unsigned int>& indices,
+    size_t vertexCount,
+    size_t cacheSize) {
+  VertexCacheStats stats;
+  if (indices.empty()) {
+    return stats;
+  }
+
+  // a vertex is cached while fewer than cacheSize misses followed its own
+  std::vector<size_t> insertedAt(vertexCount, SIZE_MAX);
+  size_t misses = 0;
+  size_t unique = 0;
+  for (unsigned int index : indices) {
+    if (insertedAt[index] == SIZE_MAX) {
+      unique++;
+    }
+    if (insertedAt[index] == SIZE_MAX ||
+        misses - insertedAt[index] >= cacheSize) {
+      insertedAt[index] = misses++;
+    }
+  }
+
+  stats.acmr = static_cast<float>(misses) / (indices.size() / 3);
+  stats.atvr = static_cast<float>(misses) / unique;
+  return stats;
+}
+
+size_t models::WeldVertices(std::vector<VertexType>& vertices,
+                            std::vector<unsigned int>& indices) {
+  std::unordered_map<unsigned int, unsigned int, VertexHash, VertexEqual>
+      unique(vertices.size(), VertexHash{&vertices}, VertexEqual{&vertices});
+
+  // compact in place, the map only ever refers to already written slots
+  std::vector<unsigned int> remap(vertices.size());
+  unsigned int count = 0;
+  for (unsigned int i = 0; i < vertices.size(); i++) {
+    vertices[count] = vertices[i];
+    auto inserted = unique.emplace(count, count);
+    if (inserted.second) {
+      remap[i] = count++;
+    } else {
+      remap[i] = inserted.first->second;
+    }
+  }
+
+  for (auto& index : indices) {
+    index = remap[index];
+  }
+
+  const size_t removed = vertices.size() - count;
+  vertices.resize(count);
+  return removed;
+}
+
+void models::OptimizeVertexCache(std::vector<unsigned int>& indices,
+                                 size_t vertexCount,
+                                 size_t cacheSize) {
+  const size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0 || indices.size() % 3 != 0) {
+    return;
+  }
+
+  const Adjacency adjacency(indices, vertexCount);
+  std::vector<unsigned int> live(vertexCount);
+  for (size_t v = 0; v < vertexCount; v++) {
+    live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+  }
+
+  // time stamps start far enough in the past that nothing is cached
+  const size_t k = cacheSize;
+  std::vector<size_t> cacheTime(vertexCount, 0);
+  size_t time = k + 1;
+
+  std::vector<bool> emitted(triangleCount, false);
+  std::vector<unsigned int> deadEnd;
+  std::vector<unsigned int> candidates;
+  std::vector<unsigned int> result;
+  result.reserve(indices.size());
+
+  size_t cursor = 0;
+  unsigned int fan = indices[0];
+  while (fan != kUnused) {
+    // emit every remaining triangle around the fanning vertex
+    candidates.clear();
+    for (unsigned int a = adjacency.offsets[fan];
+         a < adjacency.offsets[fan + 1]; a++) {
+      const unsigned int triangle = adjacency.triangles[a];
+      if (emitted[triangle]) {
+        continue;
+      }
+      emitted[triangle] = true;
+      for (int corner = 0; corner < 3; corner++) {
+        const unsigned int v = indices[triangle * 3 + corner];
+        result.push_back(v);
+        deadEnd.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        if (time - cacheTime[v] > k) {
+          cacheTime[v] = time++;
+        }
+      }
+    }
+
+    // the next fan is the oldest candidate still in the cache after its
+    // remaining triangles are emitted
+    fan = kUnused;
+    size_t best = 0;
+    for (unsigned int v : candidates) {
+      if (live[v] == 0) {
+        continue;
+      }
+      size_t priority = 0;
+      if (time - cacheTime[v] + 2 * live[v] <= k) {
+        priority = time - cacheTime[v];
+      }
+      if (fan == kUnused || priority > best) {
+        fan = v;
+        best = priority;
+      }
+    }
+
+    // dead end: the most recent vertex with triangles left, then any
+    while (fan == kUnused && !deadEnd.empty()) {
+      const unsigned int v = deadEnd.back();
+      deadEnd.pop_back();
+      if (live[v] > 0) {
+        fan = v;
+      }
+    }
+    while (fan == kUnused && cursor < vertexCount) {
+      if (live[cursor] > 0) {
+        fan = static_cast<unsigned int>(cursor);
+      }
+      cursor++;
+    }
+  }
+
+  indices.swap(result);
+}
+
+void models::OptimizeVertexFetch(std::vector<VertexType>& vertices,
+                                 std::vector<unsigned int>& indices) {
+  std::vector<unsigned int> remap(vertices.size(), kUnused);
+  std::vector<VertexType> ordered;
+  ordered.reserve(vertices.size());
+
+  for (auto& index : indices) {
+    if (remap[index] == kUnused) {
+      remap[index] = static_cast<unsigned int>(ordered.size());
+      ordered.push_back(vertices[index]);
+    }
+    index = remap[index];
+  }
+
+  vertices.swap(ordered);
+}
+
+MeshOptimizationReport models::OptimizeMesh(
+    std::vector<VertexType>& vertices,
+    std::vector<unsigned int>& indices) {
+  MeshOptimizationReport report;
+  report.verticesBefore = vertices.size();
+  report.verticesAfter = vertices.size();
+  // not a triangle list, leave it as it is
+  if (indices.size() % 3 != 0) {
+    return report;
+  }
+  report.before = AnalyzeVertexCache(indices, vertices.size());
+
+  WeldVertices(vertices, indices);
+  OptimizeVertexCache(indices, vertices.size());
+  OptimizeVertexFetch(vertices, indices);
+
+  report.verticesAfter = vertices.size();
+  report.after = AnalyzeVertexCache(indices, vertices.size());
+  return report;
+}
@@ -1,50 +1,489 @@
-
 #include <Model.hpp>
 
+#include <chrono>
+#include <map>
+#include <set>
 #include <stdexcept>
+#include <utility>
+
+#include <GLFW/glfw3.h>
+#include <assimp/config.h>
 
+#include <Check.hpp>
 #include <Logger.hpp>
+#include <ResourceManager.hpp>
 
 using namespace models;
 
+namespace {
+
+// points and lines are split off into meshes of their own and dropped,
+// meshes are drawn and optimized as triangle lists only
+constexpr unsigned int kImportFlags =
+    aiProcess_Triangulate | aiProcess_SortByPType |
+    aiProcess_GenSmoothNormals | aiProcess_FlipUVs |
+    aiProcess_CalcTangentSpace;
+
+void PrepareImporter(Assimp::Importer& importer) {
+  importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE,
+                              aiPrimitiveType_POINT | aiPrimitiveType_LINE);
+}
+
+glm::mat4 ToMat4(const aiMatrix4x4& m) {
+  // assimp is row major, glm column major
+  const float rows[4][4] = {{m.a1, m.a2, m.a3, m.a4},
+                            {m.b1, m.b2, m.b3, m.b4},
+                            {m.c1, m.c2, m.c3, m.c4},
+                            {m.d1, m.d2, m.d3, m.d4}};
+  glm::mat4 result;
+  for (int row = 0; row < 4; row++) {
+    for (int column = 0; column < 4; column++) {
+      result[column][row] = rows[row][column];
+    }
+  }
+  return result;
+}
+
+// a grey unit cube drawn while a model is still loading
+const Mesh& Placeholder() {
+  static const Mesh placeholder = [] {
+    std::vector<VertexType> vertices;
+    std::vector<unsigned int> indices;
+    for (int axis = 0; axis < 3; axis++) {
+      for (float sign : {-1.0f, 1.0f}) {
+        glm::vec3 normal(0.0f);
+        normal[axis] = sign;
+        glm::vec3 u(0.0f);
+        u[(axis + 1) % 3] = 0.5f;
+        glm::vec3 v(0.0f);
+        v[(axis + 2) % 3] = 0.5f * sign;
+
+        unsigned int first = static_cast<unsigned int>(vertices.size());
+        for (int corner = 0; corner < 4; corner++) {
+          VertexType vertex{};
+          vertex.Position = normal * 0.5f + (corner & 1 ? u : -u) +
+                            (corner & 2 ? v : -v);
+          vertex.Normal = normal;
+          vertex.Color = glm::vec4(0.5f, 0.5f, 0.5f, 1.0f);
+          vertices.push_back(vertex);
+        }
+        for (unsigned int i : {0u, 1u, 3u, 0u, 3u, 2u}) {
+          indices.push_back(first + i);
+        }
+      }
+    }
+
+    Mesh mesh;
+    mesh.Load(vertices.data(), vertices.size(), indices.data(), indices.size(),
+              glm::vec4(0.5f, 0.5f, 0.5f, 1.0f), {});
+    return mesh;
+  }();
+  return placeholder;
+}
+}  // namespace
+
 void Model::Load(std::string fileName) {
-  auto constexpr flags = aiProcess_Triangulate | aiProcess_GenSmoothNormals |
-                         aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+  auto start = std::chrono::steady_clock::now();
+
+  ModelImport import;
+  Import(fileName, import);
+  Upload(import);
+
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  LOG_INFO("Model " + fileName + " loaded successfully in " +
+           std::to_string(elapsed.count()) + " ms");
+}
+
+jobs::JobHandle Model::LoadAsync(std::shared_ptr<Model> model,
+                                 std::string fileName) {
+  auto& jobSystem = jobs::JobSystem::GetInstance();
+  auto import = std::make_shared<ModelImport>();
+  auto start = std::chrono::steady_clock::now();
+
+  auto decode =
+      jobSystem.Submit([import, fileName]() { Import(fileName, *import); });
 
-  Assimp::Importer importer;
-  const aiScene* scene = importer.ReadFile(fileName, flags);
+  model->loadJob = jobSystem.SubmitMainThread(
+      [model, import, start]() {
+        try {
+          model->Upload(*import);
+        } catch (const std::exception& e) {
+          logging::Logger::LogError(e.what());
+          return;
+        }
 
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+        LOG_INFO("Model " + import->path + " ready after " +
+                 std::to_string(elapsed.count()) + " ms");
+      },
+      {decode});
+  return model->loadJob;
+}
+
+void Model::Import(std::string fileName, ModelImport& import) {
+  import.path = fileName;
+
+  // exceptions cannot leave a job, they are raised again on upload
+  try {
+    const uint64_t key = ModelCache::Key(fileName, kImportFlags);
+    import.cache = ModelCache::Open(key);
+
+    if (import.cache) {
+      LOG_DEBUG("Model " + fileName + " found in cache");
+      import.graph = import.cache->Graph();
+    } else {
+      Assimp::Importer importer;
+      PrepareImporter(importer);
+      const aiScene* scene = importer.ReadFile(fileName, kImportFlags);
+      ImportScene(scene, fileName, import);
+
+      // a missing cache entry only costs the next launch another import
+      try {
+        ModelCache::Write(key, import.meshes, import.graph);
+      } catch (const std::exception& e) {
+        logging::Logger::LogWarn(e.what());
+      }
+    }
+
+    DecodeTextures(import);
+  } catch (const std::exception& e) {
+    import.error = e.what();
+  }
+}
+
+void Model::ImportMemory(const std::string& data,
+                         const std::string& hint,
+                         ModelImport& import) {
+  import.path = "memory." + hint;
+
+  try {
+    Assimp::Importer importer;
+    PrepareImporter(importer);
+    const aiScene* scene = importer.ReadFileFromMemory(
+        data.data(), data.size(), kImportFlags, hint.c_str());
+    ImportScene(scene, std::nullopt, import);
+    DecodeTextures(import);
+  } catch (const std::exception& e) {
+    import.error = e.what();
+  }
+}
+
+void Model::ImportScene(const aiScene* scene,
+                        const std::optional<std::string>& fileName,
+                        ModelImport& import) {
   if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE ||
       !scene->mRootNode) {
-    throw std::runtime_error{"Could not read the model file: " + path};
+    throw std::runtime_error{"Could not read the model file: " + import.path};
   }
 
-  this->path = fileName;
+  LOG_DEBUG("Processing root node");
+  ProcessNode(scene->mRootNode, -1, import.graph);
+  import.graph.Update(scene->mNumMeshes);
+
+  // every mesh converts once, however many nodes use it
+  import.meshes.resize(scene->mNumMeshes);
+  jobs::JobSystem::GetInstance().ParallelFor(
+      0, static_cast<int>(scene->mNumMeshes), 1, [&](int first, int last) {
+        for (int i = first; i < last; i++) {
+          import.meshes[i].Import(scene, scene->mMeshes[i], fileName);
+        }
+      });
+}
 
-  logging::Logger::LogDebug("Processing root node");
-  ProcessNode(scene->mRootNode, scene);
+void Model::DecodeTextures(ModelImport& import) {
+  std::vector<TextureReference> references;
+  if (import.cache) {
+    for (auto& cached : import.cache->Meshes()) {
+      references.insert(references.end(), cached.textures.begin(),
+                        cached.textures.end());
+    }
+  } else {
+    for (auto& mesh : import.meshes) {
+      references.insert(references.end(), mesh.TextureReferences().begin(),
+                        mesh.TextureReferences().end());
+    }
+  }
+
+  // the type decides how a texture is filtered and compressed, the first
+  // reference to a path wins
+  std::map<std::string, std::string> unique;
+  for (auto& reference : references) {
+    unique.emplace(reference.path, reference.type);
+  }
+  std::vector<std::string> paths;
+  std::vector<std::string> types;
+  for (auto& [path, type] : unique) {
+    paths.push_back(path);
+    types.push_back(type);
+  }
+  std::vector<TextureImage> images(paths.size());
+  std::vector<std::string> errors(paths.size());
 
-  logging::Logger::LogInfo("Model " + fileName + " loaded successfully");
+  jobs::JobSystem::GetInstance().ParallelFor(
+      0, static_cast<int>(paths.size()), 1, [&](int first, int last) {
+        for (int i = first; i < last; i++) {
+          try {
+            images[i] = Texture::Decode(paths[i], types[i]);
+          } catch (const std::exception& e) {
+            errors[i] = e.what();
+          }
+        }
+      });
+
+  for (size_t i = 0; i < paths.size(); i++) {
+    if (!errors[i].empty()) {
+      throw std::runtime_error{errors[i]};
+    }
+    import.images[paths[i]] = std::move(images[i]);
+  }
 }
 
-void Model::Draw(ShaderProgram& shader) const {
-  // LogPainful
-  //  std::cout << "Rendering model " << this->path << std::endl;
+void Model::Upload(ModelImport& import) {
+  if (!import.error.empty()) {
+    throw std::runtime_error{import.error};
+  }
+
+  this->path = import.path;
+  auto& manager = resources::ResourceManager::GetManager();
+
+  auto load = [&](const std::vector<TextureReference>& references) {
+    std::vector<std::shared_ptr<Texture>> textures;
+    for (auto& reference : references) {
+      auto image = import.images.find(reference.path);
+      if (image != import.images.end()) {
+        textures.push_back(
+            manager.LoadTexture(reference.path, reference.type,
+                                std::move(image->second)));
+      } else {
+        textures.push_back(manager.LoadTexture(reference.path, reference.type));
+      }
+    }
+    return textures;
+  };
+
+  if (import.cache) {
+    for (auto& cached : import.cache->Meshes()) {
+      Mesh mesh;
+      mesh.Load(cached.vertices, cached.vertexCount, cached.indices,
+                cached.indexCount, cached.color, load(cached.textures));
+      this->meshes.push_back(mesh);
+    }
+  } else {
+    for (auto& mesh : import.meshes) {
+      mesh.Upload(load(mesh.TextureReferences()));
+      this->meshes.push_back(std::move(mesh));
+    }
+  }
+
+  this->graph = std::move(import.graph);
+  this->graph.Update(this->meshes.size());
+  for (unsigned int i = 0; i < this->meshes.size(); i++) {
+    for (auto& placement : this->graph.Instances(i)) {
+      this->bounds.Expand(this->meshes[i].Bounds().Transformed(placement));
+    }
+  }
+  LOG_INFO("Model " + this->path + " has " + std::to_string(MeshCount()) +
+           " meshes placed " + std::to_string(InstanceCount()) + " times");
+
+  // the mapping and the decoded pixels are no longer needed
+  import.cache.reset();
+  import.images.clear();
+
+  ready.store(true, std::memory_order_release);
+}
+
+void Model::Draw(ShaderProgram& shader, const glm::mat4& transform) const {
+  if (!IsReady()) {
+    shader.setUniform("model", transform);
+    Placeholder().Draw(shader);
+    return;
+  }
+
   for (unsigned int i = 0; i < meshes.size(); i++) {
-    meshes[i].Draw(shader);
+    meshes[i].Draw(shader, transform, graph.Instances(i));
   }
 }
 
-void Model::ProcessNode(aiNode* node, const aiScene* scene) {
-  for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
-    logging::Logger::LogDebug("Loading mesh " + std::to_string(i));
-    Mesh mesh;
-    mesh.Load(scene, scene->mMeshes[i], this->path);
-    this->meshes.push_back(mesh);
+void Model::Record(rendering::RenderQueue& queue,
+                   ShaderProgram& shader,
+                   const glm::mat4& transform) const {
+  if (!IsReady()) {
+    queue.Submit(shader, Placeholder(), transform);
+    return;
   }
 
+  for (unsigned int i = 0; i < meshes.size(); i++) {
+    for (auto& placement : graph.Instances(i)) {
+      queue.Submit(shader, meshes[i], transform * placement);
+    }
+  }
+}
+
+void Model::ProcessNode(const aiNode* node, int parent, SceneGraph& graph) {
+  std::vector<unsigned int> meshes(node->mMeshes,
+                                   node->mMeshes + node->mNumMeshes);
+  const int index =
+      graph.AddNode(parent, ToMat4(node->mTransformation), std::move(meshes));
+
   for (unsigned int i = 0; i < node->mNumChildren; i++) {
-    logging::Logger::LogDebug("Processing child node " + std::to_string(i));
-    ProcessNode(node->mChildren[i], scene);
+    LOG_DEBUG("Processing child node " + std::to_string(i));
+    ProcessNode(node->mChildren[i], index, graph);
+  }
+}
+
+namespace {
+
+// two geometries, the quad is placed by four nodes over two levels and the
+// triangle by one of them
+constexpr const char* kInstancedScene = R"(<?xml version="1.0"?>
+<COLLADA xmlns="http://www.collada.org/2005/11/COLLADASchema"
+         version="1.4.1">
+  <asset><unit meter="1"/><up_axis>Y_UP</up_axis></asset>
+  <library_geometries>
+    <geometry id="quad">
+      <mesh>
+        <source id="quad-positions">
+          <float_array id="quad-array" count="12">
+            0 0 0  1 0 0  1 1 0  0 1 0
+          </float_array>
+          <technique_common>
+            <accessor source="#quad-array" count="4" stride="3">
+              <param name="X" type="float"/>
+              <param name="Y" type="float"/>
+              <param name="Z" type="float"/>
+            </accessor>
+          </technique_common>
+        </source>
+        <vertices id="quad-vertices">
+          <input semantic="POSITION" source="#quad-positions"/>
+        </vertices>
+        <triangles count="2">
+          <input semantic="VERTEX" source="#quad-vertices" offset="0"/>
+          <p>0 1 2 0 2 3</p>
+        </triangles>
+      </mesh>
+    </geometry>
+    <geometry id="tri">
+      <mesh>
+        <source id="tri-positions">
+          <float_array id="tri-array" count="9">
+            0 0 0  0 0 1  1 0 0
+          </float_array>
+          <technique_common>
+            <accessor source="#tri-array" count="3" stride="3">
+              <param name="X" type="float"/>
+              <param name="Y" type="float"/>
+              <param name="Z" type="float"/>
+            </accessor>
+          </technique_common>
+        </source>
+        <vertices id="tri-vertices">
+          <input semantic="POSITION" source="#tri-positions"/>
+        </vertices>
+        <triangles count="1">
+          <input semantic="VERTEX" source="#tri-vertices" offset="0"/>
+          <p>0 1 2</p>
+        </triangles>
+      </mesh>
+    </geometry>
+  </library_geometries>
+  <library_visual_scenes>
+    <visual_scene id="scene">
+      <node id="a"><instance_geometry url="#quad"/></node>
+      <node id="b">
+        <translate>2 0 0</translate>
+        <instance_geometry url="#quad"/>
+        <node id="c">
+          <translate>0 2 0</translate>
+          <instance_geometry url="#quad"/>
+        </node>
+      </node>
+      <node id="d">
+        <translate>0 0 2</translate>
+        <instance_geometry url="#quad"/>
+        <instance_geometry url="#tri"/>
+      </node>
+    </visual_scene>
+  </library_visual_scenes>
+  <scene><instance_visual_scene url="#scene"/></scene>
+</COLLADA>
+)";
+constexpr size_t kSceneMeshes = 2;
+constexpr size_t kScenePlacements = 5;
+}  // namespace
+
+bool models::CheckModelInstancing() {
+  checks::Checker check("Model instancing");
+
+  // the job system records the thread that creates it as the GL thread
+  jobs::JobSystem::GetInstance();
+
+  ModelImport import;
+  Model::ImportMemory(kInstancedScene, "dae", import);
+  check.Expect(import.error.empty(), "import failed: " + import.error);
+  if (!import.error.empty()) {
+    return false;
   }
-}
\ No newline at end of file
+  check.Expect(import.meshes.size() == kSceneMeshes,
+               "imported " + std::to_string(import.meshes.size()) +
+                   " meshes, the scene has " + std::to_string(kSceneMeshes));
+  check.Expect(import.graph.InstanceCount() == kScenePlacements,
+               "the graph places " +
+                   std::to_string(import.graph.InstanceCount()) +
+                   " meshes, the scene places " +
+                   std::to_string(kScenePlacements));
+
+  // the buffers only exist on the GPU, a hidden window provides the context
+  if (!glfwInit()) {
+    check.Expect(false, "could not init GLFW");
+    return false;
+  }
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  GLFWwindow* window = glfwCreateWindow(1, 1, "check", nullptr, nullptr);
+  if (!window) {
+    glfwTerminate();
+    check.Expect(false, "could not create a GL context");
+    return false;
+  }
+  glfwMakeContextCurrent(window);
+
+  if (gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+    Model model;
+    const size_t before = Mesh::BuffersCreated();
+    model.Upload(import);
+    const size_t created = Mesh::BuffersCreated() - before;
+
+    check.Expect(model.MeshCount() == kSceneMeshes,
+                 "MeshCount() is " + std::to_string(model.MeshCount()) +
+                     ", the scene has " + std::to_string(kSceneMeshes));
+    check.Expect(created == 2 * model.MeshCount(),
+                 "the meshes created " + std::to_string(created) +
+                     " buffers for " + std::to_string(model.MeshCount()) +
+                     " meshes");
+    check.Expect(model.InstanceCount() == kScenePlacements,
+                 "InstanceCount() is " +
+                     std::to_string(model.InstanceCount()) + ", expected " +
+                     std::to_string(kScenePlacements));
+
+    // every mesh owns its own vertex array
+    std::set<GLuint> arrays;
+    for (auto& mesh : model.Meshes()) {
+      check.Expect(glIsVertexArray(mesh.Vao()) == GL_TRUE,
+                   "a mesh has no vertex array");
+      arrays.insert(mesh.Vao());
+    }
+    check.Expect(arrays.size() == model.MeshCount(),
+                 "meshes share a vertex array");
+  } else {
+    check.Expect(false, "could not initialize GLAD");
+  }
+
+  glfwDestroyWindow(window);
+  glfwTerminate();
+  return check.Passed();
+}
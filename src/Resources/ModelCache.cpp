@@ -0,0 +1,334 @@
+#include <ModelCache.hpp>
+
+#include <Asset.hpp>
+#include <Hash.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MODEL_CACHE_MMAP 1
+#endif
+
+using namespace models;
+
+namespace {
+
+constexpr char kMagic[8] = {'T', 'G', 'M', 'O', 'D', 'E', 'L', '\0'};
+
+// bump whenever Mesh::Load changes what it produces
+constexpr uint32_t kVersion = 4;
+
+constexpr size_t kAlignment = 16;
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t meshCount;
+  uint64_t key;
+  uint32_t vertexSize;
+  uint32_t nodeCount;
+};
+
+// followed by the texture block, the vertices and the indices, each padded
+// to kAlignment
+struct MeshHeader {
+  uint64_t vertexCount;
+  uint64_t indexCount;
+  float color[4];
+  uint32_t textureCount;
+  uint32_t textureBytes;
+};
+
+// the nodes follow the meshes, parents first, each followed by its mesh
+// indices padded to kAlignment
+struct NodeHeader {
+  int32_t parent;
+  uint32_t meshCount;
+  float transform[16];
+};
+
+size_t AlignUp(size_t value) {
+  return (value + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+void Pad(std::ofstream& out, size_t written) {
+  static const char zeros[kAlignment] = {};
+  out.write(zeros, AlignUp(written) - written);
+}
+}  // namespace
+
+ModelCache::~ModelCache() {
+#ifdef MODEL_CACHE_MMAP
+  if (mapping) {
+    munmap(mapping, mappingSize);
+  }
+#endif
+}
+
+uint64_t ModelCache::Key(const std::string& fileName, unsigned int flags) {
+  std::ifstream file(fileName, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error{"Could not read the model file: " + fileName};
+  }
+
+  uint64_t hash = hashing::kFnv1aBasis;
+  std::vector<char> chunk(1 << 20);
+  while (file) {
+    file.read(chunk.data(), chunk.size());
+    hash = hashing::Fnv1a(chunk.data(), static_cast<size_t>(file.gcount()),
+                          hash);
+  }
+
+  const uint32_t settings[3] = {flags, kVersion,
+                                static_cast<uint32_t>(sizeof(VertexType))};
+  return hashing::Fnv1a(settings, sizeof(settings), hash);
+}
+
+std::string ModelCache::PathFor(uint64_t key) {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.tgm",
+                static_cast<unsigned long long>(key));
+  return asset::Asset::CACHE_DIR + "/" + name;
+}
+
+std::unique_ptr<ModelCache> ModelCache::Open(uint64_t key) {
+  const std::string path = PathFor(key);
+  auto cache = std::make_unique<ModelCache>();
+
+#ifdef MODEL_CACHE_MMAP
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    close(fd);
+    return nullptr;
+  }
+
+  cache->mappingSize = static_cast<size_t>(info.st_size);
+  cache->mapping =
+      mmap(nullptr, cache->mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (cache->mapping == MAP_FAILED) {
+    cache->mapping = nullptr;
+    return nullptr;
+  }
+
+  const uint8_t* data = static_cast<const uint8_t*>(cache->mapping);
+  const size_t size = cache->mappingSize;
+#else
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return nullptr;
+  }
+  cache->buffer.assign(std::istreambuf_iterator<char>(file),
+                       std::istreambuf_iterator<char>());
+
+  const uint8_t* data = cache->buffer.data();
+  const size_t size = cache->buffer.size();
+#endif
+
+  if (!cache->Parse(data, size, key)) {
+    return nullptr;
+  }
+  return cache;
+}
+
+bool ModelCache::Parse(const uint8_t* data, size_t size, uint64_t key) {
+  FileHeader header;
+  if (size < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion || header.key != key ||
+      header.vertexSize != sizeof(VertexType)) {
+    return false;
+  }
+
+  size_t offset = AlignUp(sizeof(header));
+  for (uint32_t m = 0; m < header.meshCount; m++) {
+    MeshHeader mesh;
+    if (offset + sizeof(mesh) > size) {
+      return false;
+    }
+    std::memcpy(&mesh, data + offset, sizeof(mesh));
+    offset = AlignUp(offset + sizeof(mesh));
+
+    const size_t vertexBytes = mesh.vertexCount * sizeof(VertexType);
+    const size_t indexBytes = mesh.indexCount * sizeof(unsigned int);
+    if (offset + AlignUp(mesh.textureBytes) + AlignUp(vertexBytes) +
+            AlignUp(indexBytes) >
+        size) {
+      return false;
+    }
+
+    CachedMesh cached;
+    cached.color =
+        glm::vec4(mesh.color[0], mesh.color[1], mesh.color[2], mesh.color[3]);
+
+    // texture references: type length, path length, then both strings
+    size_t cursor = offset;
+    const size_t textureEnd = offset + mesh.textureBytes;
+    for (uint32_t t = 0; t < mesh.textureCount; t++) {
+      uint32_t lengths[2];
+      if (cursor + sizeof(lengths) > textureEnd) {
+        return false;
+      }
+      std::memcpy(lengths, data + cursor, sizeof(lengths));
+      cursor += sizeof(lengths);
+      if (cursor + lengths[0] + lengths[1] > textureEnd) {
+        return false;
+      }
+
+      TextureReference texture;
+      texture.type.assign(reinterpret_cast<const char*>(data + cursor),
+                          lengths[0]);
+      cursor += lengths[0];
+      texture.path.assign(reinterpret_cast<const char*>(data + cursor),
+                          lengths[1]);
+      cursor += lengths[1];
+      cached.textures.push_back(texture);
+    }
+    offset = AlignUp(textureEnd);
+
+    cached.vertices = reinterpret_cast<const VertexType*>(data + offset);
+    cached.vertexCount = mesh.vertexCount;
+    offset = AlignUp(offset + vertexBytes);
+
+    cached.indices = reinterpret_cast<const unsigned int*>(data + offset);
+    cached.indexCount = mesh.indexCount;
+    offset = AlignUp(offset + indexBytes);
+
+    meshes.push_back(std::move(cached));
+  }
+
+  for (uint32_t n = 0; n < header.nodeCount; n++) {
+    NodeHeader node;
+    if (offset + sizeof(node) > size) {
+      return false;
+    }
+    std::memcpy(&node, data + offset, sizeof(node));
+    offset = AlignUp(offset + sizeof(node));
+
+    const size_t meshBytes = node.meshCount * sizeof(uint32_t);
+    if (offset + AlignUp(meshBytes) > size ||
+        node.parent >= static_cast<int32_t>(n)) {
+      return false;
+    }
+    std::vector<unsigned int> nodeMeshes(node.meshCount);
+    std::memcpy(nodeMeshes.data(), data + offset, meshBytes);
+    offset = AlignUp(offset + meshBytes);
+
+    glm::mat4 transform;
+    for (int i = 0; i < 16; i++) {
+      transform[i / 4][i % 4] = node.transform[i];
+    }
+    graph.AddNode(node.parent, transform, std::move(nodeMeshes));
+  }
+
+  try {
+    graph.Update(meshes.size());
+  } catch (const std::exception&) {
+    return false;
+  }
+  return true;
+}
+
+void ModelCache::Write(uint64_t key,
+                       const std::vector<Mesh>& meshes,
+                       const SceneGraph& graph) {
+  const std::string path = PathFor(key);
+  const std::string temporary = path + ".tmp";
+  std::filesystem::create_directories(asset::Asset::CACHE_DIR);
+
+  {
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      throw std::runtime_error{"Could not write the model cache: " + path};
+    }
+
+    FileHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.meshCount = static_cast<uint32_t>(meshes.size());
+    header.key = key;
+    header.vertexSize = sizeof(VertexType);
+    header.nodeCount = static_cast<uint32_t>(graph.Nodes().size());
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    Pad(out, sizeof(header));
+
+    for (auto& mesh : meshes) {
+      std::string textureBlock;
+      for (auto& texture : mesh.TextureReferences()) {
+        const uint32_t lengths[2] = {
+            static_cast<uint32_t>(texture.type.size()),
+            static_cast<uint32_t>(texture.path.size())};
+        textureBlock.append(reinterpret_cast<const char*>(lengths),
+                            sizeof(lengths));
+        textureBlock += texture.type;
+        textureBlock += texture.path;
+      }
+
+      MeshHeader meshHeader{};
+      meshHeader.vertexCount = mesh.Vertices().size();
+      meshHeader.indexCount = mesh.Indices().size();
+      meshHeader.color[0] = mesh.Color().r;
+      meshHeader.color[1] = mesh.Color().g;
+      meshHeader.color[2] = mesh.Color().b;
+      meshHeader.color[3] = mesh.Color().a;
+      meshHeader.textureCount =
+          static_cast<uint32_t>(mesh.TextureReferences().size());
+      meshHeader.textureBytes = static_cast<uint32_t>(textureBlock.size());
+
+      out.write(reinterpret_cast<const char*>(&meshHeader), sizeof(meshHeader));
+      Pad(out, sizeof(meshHeader));
+
+      out.write(textureBlock.data(), textureBlock.size());
+      Pad(out, textureBlock.size());
+
+      const size_t vertexBytes = mesh.Vertices().size() * sizeof(VertexType);
+      out.write(reinterpret_cast<const char*>(mesh.Vertices().data()),
+                vertexBytes);
+      Pad(out, vertexBytes);
+
+      const size_t indexBytes = mesh.Indices().size() * sizeof(unsigned int);
+      out.write(reinterpret_cast<const char*>(mesh.Indices().data()),
+                indexBytes);
+      Pad(out, indexBytes);
+    }
+
+    for (auto& node : graph.Nodes()) {
+      NodeHeader nodeHeader{};
+      nodeHeader.parent = node.parent;
+      nodeHeader.meshCount = static_cast<uint32_t>(node.meshes.size());
+      for (int i = 0; i < 16; i++) {
+        nodeHeader.transform[i] = node.transform[i / 4][i % 4];
+      }
+      out.write(reinterpret_cast<const char*>(&nodeHeader), sizeof(nodeHeader));
+      Pad(out, sizeof(nodeHeader));
+
+      const std::vector<uint32_t> nodeMeshes(node.meshes.begin(),
+                                             node.meshes.end());
+      const size_t meshBytes = nodeMeshes.size() * sizeof(uint32_t);
+      out.write(reinterpret_cast<const char*>(nodeMeshes.data()), meshBytes);
+      Pad(out, meshBytes);
+    }
+
+    if (!out) {
+      throw std::runtime_error{"Could not write the model cache: " + path};
+    }
+  }
+
+  std::filesystem::rename(temporary, path);
+}
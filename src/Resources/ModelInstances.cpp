@@ -0,0 +1,163 @@
+#include <ModelInstances.hpp>
+
+#include <algorithm>
+
+using namespace models;
+
+ModelInstances::ModelInstances(std::shared_ptr<Model> model)
+    : model{std::move(model)} {}
+
+ModelInstances::~ModelInstances() {
+  if (!buffers.empty()) {
+    glDeleteBuffers(static_cast<GLsizei>(buffers.size()), buffers.data());
+  }
+}
+
+void ModelInstances::Set(std::vector<MeshInstance> instances) {
+  this->instances = std::move(instances);
+  dirty = true;
+  hierarchyDirty = true;
+}
+
+void ModelInstances::Add(const glm::mat4& transform, const glm::vec4& tint) {
+  instances.push_back(MeshInstance{transform, tint});
+  dirty = true;
+  hierarchyDirty = true;
+}
+
+void ModelInstances::Clear() {
+  instances.clear();
+  dirty = true;
+  hierarchyDirty = true;
+}
+
+void ModelInstances::Upload(const std::vector<uint32_t>* selection) {
+  const auto& meshes = model->Meshes();
+  if (buffers.size() != meshes.size()) {
+    if (!buffers.empty()) {
+      glDeleteBuffers(static_cast<GLsizei>(buffers.size()), buffers.data());
+    }
+    buffers.assign(meshes.size(), 0);
+    glGenBuffers(static_cast<GLsizei>(buffers.size()), buffers.data());
+  }
+  counts.assign(meshes.size(), 0);
+
+  const size_t count = selection ? selection->size() : instances.size();
+  std::vector<MeshInstance> data;
+  for (unsigned int mesh = 0; mesh < meshes.size(); mesh++) {
+    const auto& placements = model->Graph().Instances(mesh);
+    data.clear();
+    data.reserve(count * placements.size());
+    for (size_t i = 0; i < count; i++) {
+      const auto& instance = instances[selection ? (*selection)[i] : i];
+      for (auto& placement : placements) {
+        data.push_back(
+            MeshInstance{instance.transform * placement, instance.tint});
+      }
+    }
+
+    // a culled selection changes whenever the camera moves
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[mesh]);
+    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(MeshInstance),
+                 data.data(), selection ? GL_STREAM_DRAW : GL_STATIC_DRAW);
+    counts[mesh] = static_cast<GLsizei>(data.size());
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  uploadedAll = selection == nullptr;
+  uploaded = selection ? *selection : std::vector<uint32_t>{};
+  dirty = false;
+}
+
+void ModelInstances::Cull(const camera::Frustum& frustum) {
+  if (hierarchyDirty) {
+    std::vector<camera::Aabb> boxes;
+    boxes.reserve(instances.size());
+    for (auto& instance : instances) {
+      boxes.push_back(model->Bounds().Transformed(instance.transform));
+    }
+    hierarchy.Build(boxes);
+    hierarchyDirty = false;
+  }
+
+  hierarchy.Cull(frustum, visible);
+  // in instance order, so an unchanged selection compares equal
+  std::sort(visible.begin(), visible.end());
+}
+
+bool ModelInstances::Prepare(const camera::Frustum* frustum) {
+  if (!model->IsReady() || instances.empty()) {
+    return false;
+  }
+
+  if (frustum) {
+    Cull(*frustum);
+    if (dirty || uploadedAll || uploaded != visible) {
+      Upload(&visible);
+    }
+  } else if (dirty || !uploadedAll) {
+    Upload(nullptr);
+  }
+  return true;
+}
+
+void ModelInstances::Draw(ShaderProgram& shader,
+                          const camera::Frustum* frustum) {
+  if (!Prepare(frustum)) {
+    return;
+  }
+
+  const auto& meshes = model->Meshes();
+  for (size_t mesh = 0; mesh < meshes.size(); mesh++) {
+    if (counts[mesh] > 0) {
+      meshes[mesh].DrawInstanced(shader, buffers[mesh], counts[mesh]);
+    }
+  }
+}
+
+void ModelInstances::Record(rendering::RenderQueue& queue,
+                            ShaderProgram& shader,
+                            const camera::Frustum* frustum) {
+  if (!Prepare(frustum)) {
+    return;
+  }
+
+  const auto& meshes = model->Meshes();
+  for (size_t mesh = 0; mesh < meshes.size(); mesh++) {
+    if (counts[mesh] > 0) {
+      queue.SubmitInstanced(shader, meshes[mesh], buffers[mesh], counts[mesh]);
+    }
+  }
+}
+
+void ModelInstances::RecordEach(rendering::RenderQueue& queue,
+                                ShaderProgram& shader,
+                                const camera::Frustum* frustum) {
+  if (!frustum || !model->IsReady()) {
+    for (auto& instance : instances) {
+      model->Record(queue, shader, instance.transform);
+    }
+    return;
+  }
+
+  Cull(*frustum);
+  for (uint32_t i : visible) {
+    model->Record(queue, shader, instances[i].transform);
+  }
+}
+
+void ModelInstances::DrawEach(ShaderProgram& shader,
+                              const camera::Frustum* frustum) {
+  // the placeholder has no bounds, it is drawn everywhere
+  if (!frustum || !model->IsReady()) {
+    for (auto& instance : instances) {
+      model->Draw(shader, instance.transform);
+    }
+    return;
+  }
+
+  Cull(*frustum);
+  for (uint32_t i : visible) {
+    model->Draw(shader, instances[i].transform);
+  }
+}
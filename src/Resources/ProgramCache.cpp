@@ -0,0 +1,156 @@
+#include <ProgramCache.hpp>
+
+#include <Hash.hpp>
+#include <Logger.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <utility>
+#include <vector>
+
+using namespace rendering;
+
+namespace {
+
+constexpr char kMagic[8] = {'T', 'G', 'P', 'R', 'O', 'G', '\0', '\0'};
+
+constexpr uint32_t kVersion = 1;
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t format;
+  uint64_t key;
+  uint64_t length;
+};
+
+std::string GetString(GLenum name) {
+  const GLubyte* value = glGetString(name);
+  return value ? reinterpret_cast<const char*>(value) : "";
+}
+}  // namespace
+
+ProgramCache::ProgramCache(std::string directory)
+    : directory(std::move(directory)) {
+  driver = GetString(GL_VENDOR) + "\n" + GetString(GL_RENDERER) + "\n" +
+           GetString(GL_VERSION);
+
+  GLint formats = 0;
+  if (GLAD_GL_VERSION_4_1 || GLAD_GL_ARB_get_program_binary) {
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  }
+  enabled = formats > 0;
+  if (!enabled) {
+    logging::Logger::LogWarn(
+        "The driver has no program binary formats, shaders are compiled "
+        "every run");
+  }
+
+#ifdef GL_KHR_parallel_shader_compile
+  if (GLAD_GL_KHR_parallel_shader_compile) {
+    // as many threads as the driver wants
+    glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    LOG_DEBUG("Compiling shaders in parallel");
+  }
+#endif
+}
+
+uint64_t ProgramCache::Key(const std::vector<Shader>& shaders) const {
+  uint64_t hash = hashing::Fnv1a(driver.data(), driver.size());
+  for (auto& shader : shaders) {
+    // the lengths keep the boundaries between sources in the hash
+    const uint64_t header[2] = {shader.getType(), shader.getSource().size()};
+    hash = hashing::Fnv1a(header, sizeof(header), hash);
+    hash = hashing::Fnv1a(shader.getSource().data(), shader.getSource().size(),
+                          hash);
+  }
+  return hash;
+}
+
+std::string ProgramCache::PathFor(uint64_t key) const {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.tgp",
+                static_cast<unsigned long long>(key));
+  return directory + "/" + name;
+}
+
+bool ProgramCache::Load(uint64_t key, GLuint program) {
+  if (!enabled) {
+    misses++;
+    return false;
+  }
+
+  std::ifstream file(PathFor(key), std::ios::binary);
+  FileHeader header;
+  if (!file || !file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+      std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion || header.key != key) {
+    misses++;
+    return false;
+  }
+
+  std::vector<char> binary(static_cast<size_t>(header.length));
+  if (!file.read(binary.data(), binary.size())) {
+    misses++;
+    return false;
+  }
+
+  glProgramBinary(program, header.format, binary.data(),
+                  static_cast<GLsizei>(binary.size()));
+  GLint status = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  if (status != GL_TRUE) {
+    logging::Logger::LogWarn("The driver rejected the cached program " +
+                             PathFor(key));
+    misses++;
+    return false;
+  }
+
+  hits++;
+  return true;
+}
+
+void ProgramCache::Store(uint64_t key, GLuint program) {
+  if (!enabled) {
+    return;
+  }
+
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+
+  std::vector<char> binary(static_cast<size_t>(length));
+  GLenum format = 0;
+  glGetProgramBinary(program, length, &length, &format, binary.data());
+
+  FileHeader header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.format = format;
+  header.key = key;
+  header.length = static_cast<uint64_t>(length);
+
+  // written under a temporary name and renamed, a crash never leaves a
+  // truncated entry behind
+  const std::string path = PathFor(key);
+  const std::string temporary = path + ".tmp";
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+  {
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(binary.data(), length);
+    if (!out) {
+      logging::Logger::LogWarn("Could not write the program cache: " + path);
+      return;
+    }
+  }
+  std::filesystem::rename(temporary, path, error);
+  if (error) {
+    logging::Logger::LogWarn("Could not write the program cache: " + path);
+  }
+}
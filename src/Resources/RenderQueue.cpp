@@ -0,0 +1,187 @@
+#include <RenderQueue.hpp>
+
+#include <algorithm>
+#include <chrono>
+
+using namespace rendering;
+
+namespace {
+
+constexpr int kDepthBits = 20;
+constexpr int kVaoBits = 20;
+constexpr int kMaterialBits = 16;
+constexpr int kProgramBits = 8;
+
+constexpr int kVaoShift = kDepthBits;
+constexpr int kMaterialShift = kVaoShift + kVaoBits;
+constexpr int kProgramShift = kMaterialShift + kMaterialBits;
+static_assert(kProgramShift + kProgramBits == 64, "the key must fill 64 bits");
+
+constexpr UniformId kModelUniform("model");
+
+constexpr uint64_t Mask(int bits) {
+  return (uint64_t{1} << bits) - 1;
+}
+
+// counts the binds a sequence of commands needs, without issuing them
+struct StateTracker {
+  const ShaderProgram* program = nullptr;
+  const models::Material* material = nullptr;
+  const models::Mesh* mesh = nullptr;
+
+  void Apply(const DrawCommand& command, RenderQueueStats& stats) {
+    if (command.program != program) {
+      program = command.program;
+      stats.programChanges++;
+      // the position uniforms of the mesh belong to the program
+      mesh = nullptr;
+    }
+    if (&command.mesh->GetMaterial() != material) {
+      material = &command.mesh->GetMaterial();
+      stats.materialChanges++;
+    }
+    if (command.mesh != mesh) {
+      mesh = command.mesh;
+      stats.meshChanges++;
+    }
+  }
+};
+}  // namespace
+
+void rendering::RadixSort(std::vector<SortEntry>& entries,
+                          std::vector<SortEntry>& scratch) {
+  if (entries.size() < 2) {
+    return;
+  }
+
+  scratch.resize(entries.size());
+  for (int shift = 0; shift < 64; shift += 8) {
+    size_t offsets[256] = {};
+    for (auto& entry : entries) {
+      offsets[(entry.key >> shift) & 0xFF]++;
+    }
+    if (offsets[(entries.front().key >> shift) & 0xFF] == entries.size()) {
+      continue;
+    }
+
+    size_t offset = 0;
+    for (auto& count : offsets) {
+      const size_t bucket = count;
+      count = offset;
+      offset += bucket;
+    }
+    for (auto& entry : entries) {
+      scratch[offsets[(entry.key >> shift) & 0xFF]++] = entry;
+    }
+    entries.swap(scratch);
+  }
+}
+
+void RenderQueue::Begin(const glm::vec3& camera, float zfar) {
+  commands.clear();
+  entries.clear();
+  eye = camera;
+  farPlane = zfar;
+}
+
+uint64_t RenderQueue::Key(const ShaderProgram& program,
+                          const models::Mesh& mesh,
+                          float distance) {
+  auto slot = std::find(programs.begin(), programs.end(), &program);
+  if (slot == programs.end()) {
+    slot = programs.insert(programs.end(), &program);
+  }
+  const uint64_t programSlot =
+      static_cast<uint64_t>(slot - programs.begin()) & Mask(kProgramBits);
+
+  const float depth = std::clamp(distance / farPlane, 0.0f, 1.0f);
+  const uint64_t quantized = static_cast<uint64_t>(
+      depth * static_cast<float>(Mask(kDepthBits)));
+
+  return programSlot << kProgramShift |
+         (mesh.GetMaterial().Id() & Mask(kMaterialBits)) << kMaterialShift |
+         (mesh.Vao() & Mask(kVaoBits)) << kVaoShift |
+         (quantized & Mask(kDepthBits));
+}
+
+void RenderQueue::Record(const DrawCommand& command, float distance) {
+  entries.push_back(SortEntry{Key(*command.program, *command.mesh, distance),
+                              static_cast<uint32_t>(commands.size())});
+  commands.push_back(command);
+}
+
+void RenderQueue::Submit(ShaderProgram& program,
+                         const models::Mesh& mesh,
+                         const glm::mat4& transform) {
+  DrawCommand command;
+  command.program = &program;
+  command.mesh = &mesh;
+  command.transform = transform;
+  Record(command, glm::length(glm::vec3(transform[3]) - eye));
+}
+
+void RenderQueue::SubmitInstanced(ShaderProgram& program,
+                                  const models::Mesh& mesh,
+                                  GLuint instanceBuffer,
+                                  GLsizei count) {
+  DrawCommand command;
+  command.program = &program;
+  command.mesh = &mesh;
+  command.instanceBuffer = instanceBuffer;
+  command.instanceCount = count;
+  // spread over the whole view, it goes first among its vertex array
+  Record(command, 0.0f);
+}
+
+void RenderQueue::Flush() {
+  using Clock = std::chrono::steady_clock;
+  using Milliseconds = std::chrono::duration<double, std::milli>;
+
+  stats = RenderQueueStats{};
+  stats.commands = commands.size();
+
+  // what drawing in recording order would have cost
+  RenderQueueStats unsorted;
+  StateTracker recorded;
+  for (auto& command : commands) {
+    recorded.Apply(command, unsorted);
+  }
+  stats.unsortedChanges = unsorted.StateChanges();
+
+  auto start = Clock::now();
+  RadixSort(entries, scratch);
+  stats.sortMs = Milliseconds(Clock::now() - start).count();
+
+  start = Clock::now();
+  StateTracker state;
+  for (auto& entry : entries) {
+    const DrawCommand& command = commands[entry.index];
+    const ShaderProgram* program = state.program;
+    const models::Material* material = state.material;
+    const models::Mesh* mesh = state.mesh;
+    state.Apply(command, stats);
+
+    if (state.program != program) {
+      command.program->use();
+    }
+    if (state.material != material) {
+      state.material->Bind();
+    }
+    if (state.mesh != mesh) {
+      command.mesh->BindVertices(*command.program);
+    }
+
+    if (command.instanceCount > 0) {
+      command.mesh->DrawElementsInstanced(command.instanceBuffer,
+                                          command.instanceCount);
+    } else {
+      command.program->setUniform(kModelUniform, command.transform);
+      command.mesh->DrawElements();
+    }
+  }
+  glBindVertexArray(0);
+  stats.submitMs = Milliseconds(Clock::now() - start).count();
+
+  commands.clear();
+  entries.clear();
+}
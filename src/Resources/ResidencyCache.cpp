@@ -0,0 +1,113 @@
+#include <ResidencyCache.hpp>
+
+#include <Check.hpp>
+#include <Logger.hpp>
+
+using namespace resources;
+
+namespace {
+
+// Stands in for a texture: starts with its small levels resident and has
+// two steps left to upgrade, each worth kStepBytes.
+struct FakeResource {
+  static constexpr size_t kInitialBytes = 100;
+  static constexpr size_t kStepBytes = 200;
+
+  uint64_t lastUsed = 0;
+  int steps = 2;
+  size_t bytes = kInitialBytes;
+
+  size_t Bytes() const { return bytes; }
+  uint64_t LastUsedFrame() const { return lastUsed; }
+  bool CanUpgrade() const { return steps > 0; }
+  size_t UpgradeBytes() const { return kStepBytes; }
+  void Upgrade() {
+    steps--;
+    bytes += kStepBytes;
+  }
+};
+
+std::string Join(const std::vector<std::string>& keys) {
+  std::string result;
+  for (auto& key : keys) {
+    result += (result.empty() ? "" : " ") + key;
+  }
+  return result;
+}
+}  // namespace
+
+bool resources::CheckResidencyCache() {
+  checks::Checker check("Residency");
+  const size_t budget = 10 * FakeResource::kInitialBytes;
+  ResidencyCache<FakeResource> cache(budget);
+  std::vector<std::string> evicted;
+  cache.OnEvict([&](const std::string& key) { evicted.push_back(key); });
+
+  // twice the budget, used one per frame, with two of them held as if a mesh
+  // was drawing them
+  std::vector<std::shared_ptr<FakeResource>> held;
+  for (int i = 0; i < 20; i++) {
+    auto resource = std::make_shared<FakeResource>();
+    resource->lastUsed = static_cast<uint64_t>(i);
+    if (i == 3 || i == 7) {
+      held.push_back(resource);
+    }
+    cache.Add("t" + std::to_string(i), resource);
+    check.Expect(cache.Stats().residentBytes <= budget,
+                 "over budget after adding t" + std::to_string(i));
+  }
+
+  const std::vector<std::string> expected = {"t0", "t1", "t2",  "t4",  "t5",
+                                             "t6", "t8", "t9", "t10", "t11"};
+  check.Expect(evicted == expected, "eviction order was " + Join(evicted) +
+                                        ", expected " + Join(expected));
+  check.Expect(cache.Find("t3") && cache.Find("t7"),
+               "a referenced resource was evicted");
+  check.Expect(cache.Stats().peakBytes == budget,
+               "peak was " + std::to_string(cache.Stats().peakBytes) +
+                   " bytes, expected " + std::to_string(budget));
+
+  // using a resource moves it to the back of the queue
+  if (auto used = cache.Find("t12")) {
+    used->lastUsed = 100;
+  } else {
+    check.Expect(false, "t12 is missing");
+  }
+  evicted.clear();
+  cache.Add("t20", std::make_shared<FakeResource>());
+  check.Expect(evicted == std::vector<std::string>{"t13"},
+               "after using t12 evicted " + Join(evicted) + ", expected t13");
+
+  // upgrades go to the most recently used referenced resource first, within
+  // the upload allowance, and evict to stay in budget
+  held[1]->lastUsed = 101;
+  evicted.clear();
+  cache.Update(FakeResource::kStepBytes + FakeResource::kInitialBytes);
+  check.Expect(held[1]->bytes == FakeResource::kInitialBytes +
+                                     FakeResource::kStepBytes &&
+                   held[0]->bytes == FakeResource::kInitialBytes,
+               "upgrades did not follow recency or the upload allowance");
+  check.Expect(evicted.size() == 2, "an upgrade evicted " +
+                                        std::to_string(evicted.size()) +
+                                        " resources, expected 2");
+  check.Expect(cache.Stats().residentBytes <= budget &&
+                   cache.Stats().peakBytes == budget,
+               "upgrades went over budget");
+
+  // what is referenced stays, even over budget
+  cache.SetBudget(FakeResource::kInitialBytes);
+  cache.Update(0);
+  const ResidencyStats stats = cache.Stats();
+  check.Expect(stats.entries == 2 && cache.Find("t3") && cache.Find("t7"),
+               "shrinking the budget left " + std::to_string(stats.entries) +
+                   " resources, expected the 2 referenced ones");
+  check.Expect(stats.residentBytes == held[0]->bytes + held[1]->bytes,
+               "resident bytes do not add up");
+
+  if (check.Passed()) {
+    LOG_INFO("Residency check passed: " + std::to_string(stats.evictions) +
+             " evictions, peak " + std::to_string(stats.peakBytes) + " of " +
+             std::to_string(budget) + " bytes");
+  }
+  return check.Passed();
+}
@@ -13,15 +13,13 @@ ResourceManager& ResourceManager::GetManager() {
   return manager;
 }
 
-std::vector<std::shared_ptr<models::Texture>> ResourceManager::LoadTextures(
+std::vector<std::string> ResourceManager::TexturePaths(
     aiMaterial* mat,
     aiTextureType type,
-    std::string typeName,
     std::optional<std::string> relativePath) {
-  std::vector<std::shared_ptr<models::Texture>> result;
+  std::vector<std::string> result;
 
   for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
-    bool found = false;
     aiString str;
     mat->GetTexture(type, i, &str);
 
@@ -31,35 +29,113 @@ std::vector<std::shared_ptr<models::Texture>> ResourceManager::LoadTextures(
 
       path = rPath.parent_path().append(path).string();
     }
+    result.push_back(path);
+  }
 
-    auto ptr = this->textures_loaded.find(path);
-    if (ptr != this->textures_loaded.end()) {
-      result.push_back(ptr->second);
-    } else {
-      std::shared_ptr<models::Texture> texture =
-          std::make_shared<models::Texture>(path, typeName);
+  return result;
+}
 
-      this->textures_loaded[path] = texture;
-      result.push_back(texture);
-    }
+std::vector<std::shared_ptr<models::Texture>> ResourceManager::LoadTextures(
+    aiMaterial* mat,
+    aiTextureType type,
+    std::string typeName,
+    std::optional<std::string> relativePath) {
+  std::vector<std::shared_ptr<models::Texture>> result;
+
+  for (auto& path : TexturePaths(mat, type, relativePath)) {
+    result.push_back(LoadTexture(path, typeName));
   }
 
   return result;
 }
 
+std::shared_ptr<models::Texture> ResourceManager::LoadTexture(
+    std::string path,
+    std::string typeName) {
+  std::lock_guard<std::mutex> lock(texturesMutex);
+  if (auto texture = this->textures_loaded.Find(path)) {
+    texture->MarkUsed();
+    return texture;
+  }
+
+  auto texture = std::make_shared<models::Texture>(path, typeName);
+  texture->MarkUsed();
+  this->textures_loaded.Add(path, texture);
+  return texture;
+}
+
+std::shared_ptr<models::Texture> ResourceManager::LoadTexture(
+    std::string path,
+    std::string typeName,
+    models::TextureImage image) {
+  std::lock_guard<std::mutex> lock(texturesMutex);
+  if (auto texture = this->textures_loaded.Find(path)) {
+    texture->MarkUsed();
+    return texture;
+  }
+
+  auto texture =
+      std::make_shared<models::Texture>(path, typeName, std::move(image));
+  texture->MarkUsed();
+  this->textures_loaded.Add(path, texture);
+  return texture;
+}
+
+void ResourceManager::SetTextureBudget(size_t bytes) {
+  std::lock_guard<std::mutex> lock(texturesMutex);
+  this->textures_loaded.SetBudget(bytes);
+}
+
+void ResourceManager::BeginFrame() {
+  std::lock_guard<std::mutex> lock(texturesMutex);
+  models::Texture::AdvanceFrame();
+  this->textures_loaded.Update(kTextureUploadPerFrame);
+}
+
+ResidencyStats ResourceManager::TextureStats() const {
+  std::lock_guard<std::mutex> lock(texturesMutex);
+  return this->textures_loaded.Stats();
+}
+
 std::shared_ptr<models::Model> ResourceManager::LoadModel(std::string path) {
-  logging::Logger::LogDebug("Loading model from " + path);
-  auto ptr = this->models_loaded.find(path);
-  if (ptr != this->models_loaded.end()) {
-    logging::Logger::LogDebug(
-        "\tModel already loaded, returning cached value.");
-    return ptr->second;
+  LOG_DEBUG("Loading model from " + path);
+  bool loaded = false;
+  auto model = this->models_loaded.Load(path, [&]() {
+    LOG_DEBUG("\tModel not loaded, loading.");
+    loaded = true;
+    auto result = std::make_shared<models::Model>();
+    result->Load(path);
+    return result;
+  });
+
+  if (!loaded) {
+    LOG_DEBUG("\tModel already loaded, returning cached value.");
+    // still loading asynchronously, the wait runs the upload on this thread
+    if (!model->IsReady() && model->LoadJob()) {
+      jobs::JobSystem::GetInstance().Wait(model->LoadJob());
+    }
   }
+  return model;
+}
 
-  logging::Logger::LogDebug("\tModel not loaded, loading.");
-  std::shared_ptr<models::Model> result = std::make_shared<models::Model>();
-  result->Load(path);
-  this->models_loaded[path] = result;
+std::shared_ptr<models::Model> ResourceManager::LoadModelAsync(
+    std::string path) {
+  LOG_DEBUG("Loading model asynchronously from " + path);
+  return this->models_loaded.Load(path, [&]() {
+    auto result = std::make_shared<models::Model>();
+    models::Model::LoadAsync(result, path);
+    return result;
+  });
+}
 
-  return result;
+ModelHandle ResourceManager::FindModel(const std::string& path) {
+  return this->models_loaded.Find(path);
+}
+
+std::shared_ptr<models::Model> ResourceManager::GetModel(ModelHandle handle) {
+  return this->models_loaded.Get(handle);
+}
+
+bool ResourceManager::ReleaseModel(ModelHandle handle) {
+  return this->models_loaded.Release(handle);
 }
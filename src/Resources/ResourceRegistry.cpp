@@ -0,0 +1,171 @@
+#include <ResourceRegistry.hpp>
+
+#include <Check.hpp>
+#include <Logger.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
+
+using namespace resources;
+
+namespace {
+
+constexpr size_t kInternShards = 16;
+
+struct InternShard {
+  std::mutex mutex;
+  // node based, the strings never move once inserted
+  std::unordered_set<std::string> paths;
+};
+
+InternShard internShards[kInternShards];
+
+// what the stress test loads: remembers its path to catch mixed up slots
+struct FakeResource {
+  std::string path;
+};
+
+template <typename Work>
+void RunThreads(unsigned count, Work work) {
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < count; t++) {
+    threads.emplace_back(work, t);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+}  // namespace
+
+InternedPath resources::Intern(const std::string& path) {
+  const size_t hash = std::hash<std::string>{}(path);
+  InternShard& shard = internShards[hash % kInternShards];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  return InternedPath{&*shard.paths.insert(path).first, hash};
+}
+
+bool resources::CheckResourceRegistry() {
+  checks::Checker check("Registry");
+  const unsigned threads = std::max(8u, std::thread::hardware_concurrency());
+
+  // every thread loads the same paths in its own order: one load per path
+  // and everyone ends up with the same object
+  {
+    constexpr size_t kPaths = 64;
+    ResourceRegistry<FakeResource> registry;
+    std::vector<std::atomic<int>> loads(kPaths);
+    std::vector<std::vector<FakeResource*>> seen(
+        threads, std::vector<FakeResource*>(kPaths));
+
+    RunThreads(threads, [&](unsigned t) {
+      std::mt19937 random(t);
+      for (int round = 0; round < 20; round++) {
+        for (size_t i = 0; i < kPaths; i++) {
+          const size_t p = (i + random()) % kPaths;
+          const std::string path = "shared/" + std::to_string(p);
+          auto resource = registry.Load(path, [&]() {
+            loads[p]++;
+            std::this_thread::yield();
+            return std::make_shared<FakeResource>(FakeResource{path});
+          });
+          check.Expect(resource && resource->path == path,
+                       "loaded the wrong resource for " + path);
+          check.Expect(!seen[t][p] || seen[t][p] == resource.get(),
+                       "a second object for " + path);
+          seen[t][p] = resource.get();
+        }
+      }
+    });
+
+    for (size_t p = 0; p < kPaths; p++) {
+      check.Expect(loads[p] == 1, "shared/" + std::to_string(p) +
+                                      " loaded " + std::to_string(loads[p]) +
+                                      " times");
+      for (unsigned t = 1; t < threads; t++) {
+        check.Expect(seen[t][p] == seen[0][p],
+                     "threads disagree on shared/" + std::to_string(p));
+      }
+    }
+    check.Expect(registry.Size() == kPaths, "unexpected registry size");
+  }
+
+  // acquire and release a small set of paths from every thread: released
+  // handles go stale for good and each load is matched by a release or is
+  // still registered at the end
+  {
+    constexpr size_t kPaths = 16;
+    ResourceRegistry<FakeResource> registry;
+    std::atomic<size_t> loads{0};
+    std::atomic<size_t> releases{0};
+
+    RunThreads(threads, [&](unsigned t) {
+      std::mt19937 random(100 + t);
+      for (int i = 0; i < 5000; i++) {
+        const std::string path = "churn/" + std::to_string(random() % kPaths);
+        auto handle = registry.Acquire(path, [&]() {
+          loads++;
+          return std::make_shared<FakeResource>(FakeResource{path});
+        });
+        auto resource = registry.Get(handle);
+        check.Expect(!resource || resource->path == path,
+                     "a handle resolved to another path than " + path);
+        if (random() % 4 == 0 && registry.Release(handle)) {
+          releases++;
+          check.Expect(!registry.Get(handle),
+                       "a released handle still resolves for " + path);
+          check.Expect(registry.Find(path) != handle,
+                       "a released handle was handed out again");
+        }
+      }
+    });
+
+    check.Expect(loads == releases + registry.Size(),
+                 std::to_string(loads) + " loads but " +
+                     std::to_string(releases) + " releases and " +
+                     std::to_string(registry.Size()) + " left");
+  }
+
+  // a failed load reaches every waiter and leaves nothing behind
+  {
+    ResourceRegistry<FakeResource> registry;
+    bool threw = false;
+    try {
+      registry.Acquire("broken", []() -> std::shared_ptr<FakeResource> {
+        throw std::runtime_error{"broken"};
+      });
+    } catch (const std::runtime_error&) {
+      threw = true;
+    }
+    check.Expect(threw, "a failing loader did not throw");
+    check.Expect(!registry.Find("broken").Valid(),
+                 "a failed load stayed registered");
+    auto retry = registry.Load("broken", []() {
+      return std::make_shared<FakeResource>(FakeResource{"broken"});
+    });
+    check.Expect(retry && retry->path == "broken", "a retry did not load");
+
+    // the reload takes the freed slot, the old handle must not follow it
+    auto make = []() {
+      return std::make_shared<FakeResource>(FakeResource{"reused"});
+    };
+    auto first = registry.Acquire("reused", make);
+    registry.Release(first);
+    auto second = registry.Acquire("reused", make);
+    check.Expect(first.index == second.index && first != second &&
+                     !registry.Get(first) && registry.Get(second),
+                 "a stale handle resolved to the reloaded resource");
+  }
+
+  check.Expect(&Intern("a/b").Str() == &Intern(std::string("a/") + "b").Str(),
+               "equal paths were interned twice");
+
+  if (check.Passed()) {
+    LOG_INFO("Registry check passed on " + std::to_string(threads) +
+             " threads");
+  }
+  return check.Passed();
+}
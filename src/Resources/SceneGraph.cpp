@@ -0,0 +1,50 @@
+#include <SceneGraph.hpp>
+
+#include <stdexcept>
+#include <string>
+
+using namespace models;
+
+int SceneGraph::AddNode(int parent,
+                        const glm::mat4& transform,
+                        std::vector<unsigned int> meshes) {
+  if (parent >= static_cast<int>(nodes.size())) {
+    throw std::runtime_error{"Scene node parent " + std::to_string(parent) +
+                             " does not exist"};
+  }
+
+  SceneNode node;
+  node.parent = parent;
+  node.transform = transform;
+  node.meshes = std::move(meshes);
+  nodes.push_back(std::move(node));
+  return static_cast<int>(nodes.size()) - 1;
+}
+
+void SceneGraph::Update(size_t meshCount) {
+  instances.assign(meshCount, {});
+
+  // parents come first, their world transform is always ready
+  std::vector<glm::mat4> world(nodes.size());
+  for (size_t i = 0; i < nodes.size(); i++) {
+    const SceneNode& node = nodes[i];
+    world[i] = node.parent < 0 ? node.transform
+                               : world[node.parent] * node.transform;
+
+    for (unsigned int mesh : node.meshes) {
+      if (mesh >= meshCount) {
+        throw std::runtime_error{"Scene node refers to missing mesh " +
+                                 std::to_string(mesh)};
+      }
+      instances[mesh].push_back(world[i]);
+    }
+  }
+}
+
+size_t SceneGraph::InstanceCount() const {
+  size_t count = 0;
+  for (auto& placements : instances) {
+    count += placements.size();
+  }
+  return count;
+}
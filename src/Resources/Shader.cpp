@@ -8,6 +8,7 @@
 
 #include <Shader.hpp>
 
+#include <algorithm>
 #include <cstdlib>
 #include <fstream>
 #include <glm/gtc/type_ptr.hpp>
@@ -15,6 +16,7 @@
 #include <vector>
 
 #include <Logger.hpp>
+#include <ProgramCache.hpp>
 
 using namespace std;
 using namespace glm;
@@ -37,47 +39,79 @@ void getFileContents(const char* filename, vector<char>& buffer) {
   }
 }
 
-Shader::Shader(const std::string& filename, GLenum type) {
+Shader::Shader(const std::string& filename, GLenum type)
+    : state(std::make_shared<State>()) {
   // file loading
   vector<char> fileContent;
   getFileContents(filename.c_str(), fileContent);
 
+  state->filename = filename;
+  state->type = type;
+  state->source.assign(fileContent.data());
+}
+
+void Shader::compile() const {
+  if (state->handle != 0)
+    return;
+
   // creation
-  handle = glCreateShader(type);
-  if (handle == 0)
+  state->handle = glCreateShader(state->type);
+  if (state->handle == 0)
     throw std::runtime_error("[Error] Impossible to create a new Shader");
 
   // code source assignation
-  const char* shaderText(&fileContent[0]);
-  glShaderSource(handle, 1, (const GLchar**)&shaderText, NULL);
+  const char* shaderText(state->source.c_str());
+  glShaderSource(state->handle, 1, (const GLchar**)&shaderText, NULL);
+
+  // compilation, the status is queried later
+  glCompileShader(state->handle);
+}
 
-  // compilation
-  glCompileShader(handle);
+void Shader::checkCompile() const {
+  compile();
+  if (state->checked)
+    return;
+  state->checked = true;
 
   // compilation check
   GLint compile_status;
-  glGetShaderiv(handle, GL_COMPILE_STATUS, &compile_status);
+  glGetShaderiv(state->handle, GL_COMPILE_STATUS, &compile_status);
   if (compile_status != GL_TRUE) {
     GLsizei logsize = 0;
-    glGetShaderiv(handle, GL_INFO_LOG_LENGTH, &logsize);
+    glGetShaderiv(state->handle, GL_INFO_LOG_LENGTH, &logsize);
 
-    char* log = new char[logsize + 1];
-    glGetShaderInfoLog(handle, logsize, &logsize, log);
+    vector<char> log(logsize + 1, '\0');
+    glGetShaderInfoLog(state->handle, logsize, &logsize, log.data());
 
-    logging::Logger::LogError("Compilation error: " + filename);
+    logging::Logger::LogError("Compilation error: " + state->filename);
+    LOG_INFO(log.data());
 
     exit(EXIT_FAILURE);
   } else {
-    logging::Logger::LogInfo("Shader " + filename + " compiled successfully");
+    LOG_INFO("Shader " + state->filename + " compiled successfully");
   }
 }
 
 GLuint Shader::getHandle() const {
-  return handle;
+  return state->handle;
+}
+
+GLenum Shader::getType() const {
+  return state->type;
+}
+
+const std::string& Shader::getSource() const {
+  return state->source;
 }
 
 Shader::~Shader() {}
 
+Shader::State::~State() {
+  // programs keep their attached shaders alive until they are deleted
+  if (handle != 0)
+    glDeleteShader(handle);
+}
+
 ShaderProgram::ShaderProgram() {
   handle = glCreateProgram();
   if (!handle)
@@ -86,43 +120,166 @@ ShaderProgram::ShaderProgram() {
 
 ShaderProgram::ShaderProgram(std::initializer_list<Shader> shaderList)
     : ShaderProgram() {
-  for (auto& s : shaderList)
-    glAttachShader(handle, s.getHandle());
+  shaders.assign(shaderList.begin(), shaderList.end());
+  link();
+  finish();
+}
 
+ShaderProgram::ShaderProgram(std::initializer_list<Shader> shaderList,
+                             rendering::ProgramCache& cache)
+    : ShaderProgram() {
+  shaders.assign(shaderList.begin(), shaderList.end());
+  this->cache = &cache;
+  cacheKey = cache.Key(shaders);
+  if (cache.Load(cacheKey, handle)) {
+    cached = true;
+    shaders.clear();
+    reflect();
+    return;
+  }
+
+  if (cache.Enabled())
+    glProgramParameteri(handle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
   link();
 }
 
 void ShaderProgram::link() {
+  for (auto& s : shaders) {
+    s.compile();
+    glAttachShader(handle, s.getHandle());
+  }
+
   glLinkProgram(handle);
+  linking = true;
+}
+
+void ShaderProgram::finish() {
+  if (!linking)
+    return;
+  linking = false;
+
   GLint result;
   glGetProgramiv(handle, GL_LINK_STATUS, &result);
   if (result != GL_TRUE) {
+    // a shader that failed to compile is the usual cause, and exits
+    for (auto& s : shaders)
+      s.checkCompile();
+
     logging::Logger::LogError("Linkage error: ");
 
     GLsizei logsize = 0;
     glGetProgramiv(handle, GL_INFO_LOG_LENGTH, &logsize);
 
-    char* log = new char[logsize];
-    glGetProgramInfoLog(handle, logsize, &logsize, log);
+    vector<char> log(logsize + 1, '\0');
+    glGetProgramInfoLog(handle, logsize, &logsize, log.data());
 
-    logging::Logger::LogInfo(log);
+    LOG_INFO(log.data());
+    return;
   }
+
+  for (auto& s : shaders)
+    glDetachShader(handle, s.getHandle());
+  shaders.clear();
+
+  reflect();
+
+  if (cache)
+    cache->Store(cacheKey, handle);
 }
 
-GLint ShaderProgram::uniform(const std::string& name) {
-  auto it = uniforms.find(name);
-  if (it == uniforms.end()) {
-    // uniform that is not referenced
-    GLint r = glGetUniformLocation(handle, name.c_str());
-    if (r == GL_INVALID_OPERATION || r < 0)
-      logging::Logger::LogError("Uniform " + name +
-                                " does not exist in the program.");
-    // add it anyways
-    uniforms[name] = r;
+bool ShaderProgram::fromCache() const {
+  return cached;
+}
 
-    return r;
-  } else
-    return it->second;
+void ShaderProgram::reflect() {
+  uniforms.clear();
+  missingUniforms.clear();
+
+  GLint count = 0;
+  GLint maxLength = 0;
+  glGetProgramiv(handle, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(handle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+  vector<GLchar> buffer(std::max(maxLength, 1));
+
+  for (GLint i = 0; i < count; i++) {
+    GLsizei length = 0;
+    GLint size = 0;
+    GLenum type = 0;
+    glGetActiveUniform(handle, static_cast<GLuint>(i), maxLength, &length,
+                       &size, &type, buffer.data());
+    string name(buffer.data(), length);
+
+    // arrays are reported by their first element
+    if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+      name.resize(name.size() - 3);
+
+    // members of uniform blocks have no location
+    GLint location = glGetUniformLocation(handle, name.c_str());
+    if (location < 0)
+      continue;
+
+    uint32_t hash = UniformId(name).getHash();
+    uniforms.push_back(UniformInfo{hash, location, type, size, name});
+  }
+
+  sort(uniforms.begin(), uniforms.end(),
+       [](const UniformInfo& a, const UniformInfo& b) {
+         return a.hash < b.hash;
+       });
+  for (size_t i = 1; i < uniforms.size(); i++) {
+    if (uniforms[i].hash == uniforms[i - 1].hash)
+      logging::Logger::LogError("Uniforms " + uniforms[i - 1].name + " and " +
+                                uniforms[i].name + " have the same hash");
+  }
+
+  // shared blocks go to their fixed binding points
+  GLint blocks = 0;
+  GLint maxBlockLength = 0;
+  glGetProgramiv(handle, GL_ACTIVE_UNIFORM_BLOCKS, &blocks);
+  glGetProgramiv(handle, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH,
+                 &maxBlockLength);
+  buffer.assign(std::max(maxBlockLength, 1), '\0');
+  for (GLint i = 0; i < blocks; i++) {
+    GLsizei length = 0;
+    glGetActiveUniformBlockName(handle, static_cast<GLuint>(i), maxBlockLength,
+                                &length, buffer.data());
+    string name(buffer.data(), length);
+    if (name == "Frame")
+      glUniformBlockBinding(handle, static_cast<GLuint>(i), kFrameBlockBinding);
+    else
+      logging::Logger::LogWarn("Uniform block " + name +
+                               " has no binding point");
+  }
+
+  LOG_DEBUG("Program " + to_string(handle) + " has " +
+            to_string(uniforms.size()) + " uniforms and " + to_string(blocks) +
+            " uniform blocks");
+}
+
+GLint ShaderProgram::uniform(UniformId name) {
+  auto it = lower_bound(uniforms.begin(), uniforms.end(), name.getHash(),
+                        [](const UniformInfo& info, uint32_t hash) {
+                          return info.hash < hash;
+                        });
+  if (it != uniforms.end() && it->hash == name.getHash())
+    return it->location;
+
+  // uniform that is not referenced, setting location -1 is a no-op
+  if (find(missingUniforms.begin(), missingUniforms.end(), name.getHash()) ==
+      missingUniforms.end()) {
+    logging::Logger::LogError(string("Uniform ") + name.getName() +
+                              " does not exist in the program.");
+    missingUniforms.push_back(name.getHash());
+  }
+  return -1;
+}
+
+UniformHandle ShaderProgram::uniformHandle(UniformId name) {
+  return UniformHandle(uniform(name));
+}
+
+const std::vector<UniformInfo>& ShaderProgram::activeUniforms() const {
+  return uniforms;
 }
 
 GLint ShaderProgram::attribute(const std::string& name) {
@@ -169,49 +326,81 @@ void ShaderProgram::setAttribute(const std::string& name,
   setAttribute(name, size, stride, offset, false, GL_FLOAT);
 }
 
-void ShaderProgram::setUniform(const std::string& name,
+void ShaderProgram::setUniform(UniformId name,
                                float x,
                                float y,
                                float z) {
   glUniform3f(uniform(name), x, y, z);
 }
 
-void ShaderProgram::setUniform(const std::string& name, const vec3& v) {
+void ShaderProgram::setUniform(UniformId name, const vec2& v) {
+  glUniform2fv(uniform(name), 1, value_ptr(v));
+}
+
+void ShaderProgram::setUniform(UniformId name, const vec3& v) {
   glUniform3fv(uniform(name), 1, value_ptr(v));
 }
 
-void ShaderProgram::setUniform(const std::string& name, const dvec3& v) {
+void ShaderProgram::setUniform(UniformId name, const dvec3& v) {
   glUniform3dv(uniform(name), 1, value_ptr(v));
 }
 
-void ShaderProgram::setUniform(const std::string& name, const vec4& v) {
+void ShaderProgram::setUniform(UniformId name, const vec4& v) {
   glUniform4fv(uniform(name), 1, value_ptr(v));
 }
 
-void ShaderProgram::setUniform(const std::string& name, const dvec4& v) {
+void ShaderProgram::setUniform(UniformId name, const dvec4& v) {
   glUniform4dv(uniform(name), 1, value_ptr(v));
 }
 
-void ShaderProgram::setUniform(const std::string& name, const dmat4& m) {
+void ShaderProgram::setUniform(UniformId name, const dmat4& m) {
   glUniformMatrix4dv(uniform(name), 1, GL_FALSE, value_ptr(m));
 }
 
-void ShaderProgram::setUniform(const std::string& name, const mat4& m) {
+void ShaderProgram::setUniform(UniformId name, const mat4& m) {
   glUniformMatrix4fv(uniform(name), 1, GL_FALSE, value_ptr(m));
 }
 
-void ShaderProgram::setUniform(const std::string& name, const mat3& m) {
+void ShaderProgram::setUniform(UniformId name, const mat3& m) {
   glUniformMatrix3fv(uniform(name), 1, GL_FALSE, value_ptr(m));
 }
 
-void ShaderProgram::setUniform(const std::string& name, float val) {
+void ShaderProgram::setUniform(UniformId name, float val) {
   glUniform1f(uniform(name), val);
 }
 
-void ShaderProgram::setUniform(const std::string& name, int val) {
+void ShaderProgram::setUniform(UniformId name, int val) {
   glUniform1i(uniform(name), val);
 }
 
+void ShaderProgram::setUniform(UniformHandle handle, const vec2& v) {
+  glUniform2fv(static_cast<GLint>(handle), 1, value_ptr(v));
+}
+
+void ShaderProgram::setUniform(UniformHandle handle, const vec3& v) {
+  glUniform3fv(static_cast<GLint>(handle), 1, value_ptr(v));
+}
+
+void ShaderProgram::setUniform(UniformHandle handle, const vec4& v) {
+  glUniform4fv(static_cast<GLint>(handle), 1, value_ptr(v));
+}
+
+void ShaderProgram::setUniform(UniformHandle handle, const mat4& m) {
+  glUniformMatrix4fv(static_cast<GLint>(handle), 1, GL_FALSE, value_ptr(m));
+}
+
+void ShaderProgram::setUniform(UniformHandle handle, const mat3& m) {
+  glUniformMatrix3fv(static_cast<GLint>(handle), 1, GL_FALSE, value_ptr(m));
+}
+
+void ShaderProgram::setUniform(UniformHandle handle, float val) {
+  glUniform1f(static_cast<GLint>(handle), val);
+}
+
+void ShaderProgram::setUniform(UniformHandle handle, int val) {
+  glUniform1i(static_cast<GLint>(handle), val);
+}
+
 ShaderProgram::~ShaderProgram() {
   // glDeleteProgram(handle);
 }
@@ -1,70 +1,199 @@
-// This should expose stbi_load and stbi_image_free
+// This should expose stbi_load_from_memory and stbi_image_free
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_STATIC
 #include <stb_image.h>
 
 #include <ResourceManager.hpp>
 #include <Texture.hpp>
+#include <TextureCache.hpp>
 
 #include <glad/glad.h>
 #include <string>
 
+#include <algorithm>
+#include <chrono>
 #include <exception>
-#include <sstream>
+#include <fstream>
+#include <iterator>
 
 #include <Logger.hpp>
 
 using namespace models;
 
-unsigned int Load(std::string path) {
-  unsigned int textureID;
-  glGenTextures(1, &textureID);
+namespace {
 
-  int width, height, nrComponents;
-  unsigned char* data =
-      stbi_load(path.c_str(), &width, &height, &nrComponents, 0);
-  if (data) {
-    GLenum format;
-    if (nrComponents == 1)
-      format = GL_RED;
-    else if (nrComponents == 3)
-      format = GL_RGB;
-    else if (nrComponents == 4)
-      format = GL_RGBA;
-    else {
-      std::stringstream ss;
-      ss << "Unsupported format: " << nrComponents;
-      std::string message = ss.str();
-      throw std::runtime_error{message.c_str()};
-    }
+std::vector<uint8_t> ReadFile(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    std::string message = "Texture failed to load at path:" + path;
+    logging::Logger::LogError(message);
+    throw std::runtime_error{message};
+  }
+  return std::vector<uint8_t>((std::istreambuf_iterator<char>(file)),
+                              std::istreambuf_iterator<char>());
+}
+
+// The GL format of the blocks, 0 when the driver cannot sample them.
+GLenum CompressedFormat(TextureFormat format) {
+  switch (format) {
+    case TextureFormat::kBc1:
+      return GLAD_GL_EXT_texture_compression_s3tc
+                 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+                 : 0;
+    case TextureFormat::kBc3:
+      return GLAD_GL_EXT_texture_compression_s3tc
+                 ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+                 : 0;
+    case TextureFormat::kBc5:
+      return GL_COMPRESSED_RG_RGTC2;
+    case TextureFormat::kBc7:
+      return GLAD_GL_VERSION_4_2 || GLAD_GL_ARB_texture_compression_bptc
+                 ? GL_COMPRESSED_RGBA_BPTC_UNORM
+                 : 0;
+    case TextureFormat::kRgba8:
+      break;
+  }
+  return 0;
+}
+}  // namespace
+
+TextureImage Texture::Decode(const std::string& path,
+                             const std::string& typeName) {
+  const TextureUsage usage = TextureUsageFor(typeName);
+  const std::vector<uint8_t> file = ReadFile(path);
+  const uint64_t key = TextureCache::Key(file.data(), file.size(), usage);
+
+  TextureImage image;
+  if (TextureCache::Read(key, image)) {
+    LOG_DEBUG("Texture " + path + " found in cache");
+    return image;
+  }
+
+  // every image is expanded to RGBA, the encoders only read what they keep
+  int components = 0;
+  unsigned char* data = stbi_load_from_memory(
+      file.data(), static_cast<int>(file.size()), &image.width, &image.height,
+      &components, 4);
+  if (!data) {
+    std::string message = "Texture failed to load at path:" + path;
+    logging::Logger::LogError(message);
+    throw std::runtime_error{message};
+  }
+
+  TextureLevel base;
+  base.width = image.width;
+  base.height = image.height;
+  base.data.assign(data, data + static_cast<size_t>(image.width) *
+                                    image.height * 4);
+  stbi_image_free(data);
+
+  auto start = std::chrono::steady_clock::now();
+  image.format = ChooseTextureFormat(base, usage);
+  image.levels =
+      CompressLevels(BuildMipChain(std::move(base), usage), image.format);
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  LOG_DEBUG("Texture " + path + " compressed to " +
+            TextureFormatName(image.format) + " in " +
+            std::to_string(elapsed.count()) + " ms");
+
+  // a missing cache entry only costs the next launch another encode
+  try {
+    TextureCache::Write(key, image);
+  } catch (const std::exception& e) {
+    logging::Logger::LogWarn(e.what());
+  }
+  return image;
+}
+
+uint64_t Texture::currentFrame = 0;
 
-    glBindTexture(GL_TEXTURE_2D, textureID);
+void Texture::UploadLevel(int level, const TextureLevel& data) {
+  const GLenum compressed = CompressedFormat(format);
+  if (compressed != 0) {
+    glCompressedTexImage2D(GL_TEXTURE_2D, level, compressed, data.width,
+                           data.height, 0,
+                           static_cast<GLsizei>(data.data.size()),
+                           data.data.data());
+    bytes += data.data.size();
+  } else {
+    const TextureLevel rgba = DecompressLevels({data}, format)[0];
+    glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, rgba.width, rgba.height, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, rgba.data.data());
+    bytes += rgba.data.size();
+  }
+}
 
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format,
-                 GL_UNSIGNED_BYTE, data);
+void Texture::Upload(TextureImage image) {
+  format = image.format;
+  if (format != TextureFormat::kRgba8 && CompressedFormat(format) == 0) {
+    logging::Logger::LogWarn(std::string("The driver cannot sample ") +
+                             TextureFormatName(format) +
+                             ", uploading uncompressed");
+  }
 
-    glGenerateMipmap(GL_TEXTURE_2D);
+  glGenTextures(1, &id);
+  glBindTexture(GL_TEXTURE_2D, id);
+
+  // the small levels now, the larger ones when the residency cache has room
+  // for them. The chain is complete, the driver has nothing to generate
+  const int levelCount = static_cast<int>(image.levels.size());
+  baseLevel = 0;
+  while (baseLevel + 1 < levelCount &&
+         std::max(image.levels[baseLevel].width,
+                  image.levels[baseLevel].height) > kStreamingSize) {
+    baseLevel++;
+  }
+  for (int l = levelCount - 1; l >= baseLevel; l--) {
+    UploadLevel(l, image.levels[l]);
+  }
+  image.levels.resize(baseLevel);
+  pending = std::move(image.levels);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, baseLevel);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                    GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_LINEAR);
 
-    stbi_image_free(data);
-  } else {
-    stbi_image_free(data);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
 
-    std::string message = "Texture failed to load at path:" + path;
-    logging::Logger::LogError(message);
-    throw std::runtime_error{message};
+size_t Texture::UpgradeBytes() const {
+  if (pending.empty()) {
+    return 0;
   }
+  const TextureLevel& next = pending.back();
+  return CompressedFormat(format) != 0
+             ? next.data.size()
+             : static_cast<size_t>(next.width) * next.height * 4;
+}
 
-  return textureID;
+void Texture::Upgrade() {
+  if (pending.empty()) {
+    return;
+  }
+  glBindTexture(GL_TEXTURE_2D, id);
+  baseLevel--;
+  UploadLevel(baseLevel, pending.back());
+  pending.pop_back();
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, baseLevel);
 }
 
 Texture::Texture(std::string path, std::string type)
-    : path{path}, id{Load(path)}, type{type} {}
+    : type{type}, id{0}, path{path} {
+  Upload(Decode(path, type));
+}
+
+Texture::Texture(std::string path, std::string type, TextureImage image)
+    : type{type}, id{0}, path{path} {
+  Upload(std::move(image));
+}
+
+Texture::~Texture() {
+  glDeleteTextures(1, &id);
+}
@@ -0,0 +1,175 @@
+#include <TextureCache.hpp>
+
+#include <Asset.hpp>
+#include <Hash.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+using namespace models;
+
+namespace {
+
+// in the spirit of the KTX2 identifier: catches text mode transfers
+constexpr uint8_t kIdentifier[12] = {0xAB, 'T', 'G', 'T', 'E',  'X',
+                                     0xBB, '\r', '\n', 0x1A, '\n', '\0'};
+
+// bump whenever the mip filter or an encoder changes what it produces
+constexpr uint32_t kVersion = 1;
+
+constexpr size_t kAlignment = 16;
+
+struct FileHeader {
+  uint8_t identifier[12];
+  uint32_t version;
+  uint64_t key;
+  uint32_t format;
+  uint32_t width;
+  uint32_t height;
+  uint32_t levelCount;
+};
+
+// one per level, level 0 first, while the data is stored smallest first
+struct LevelIndex {
+  uint64_t byteOffset;
+  uint64_t byteLength;
+};
+
+size_t AlignUp(size_t value) {
+  return (value + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+bool KnownFormat(uint32_t format) {
+  switch (static_cast<TextureFormat>(format)) {
+    case TextureFormat::kRgba8:
+    case TextureFormat::kBc1:
+    case TextureFormat::kBc3:
+    case TextureFormat::kBc5:
+    case TextureFormat::kBc7:
+      return true;
+  }
+  return false;
+}
+
+int LevelDimension(uint32_t base, size_t level) {
+  return std::max(1, static_cast<int>(base >> level));
+}
+}  // namespace
+
+uint64_t TextureCache::Key(const uint8_t* file,
+                           size_t size,
+                           TextureUsage usage) {
+  const uint32_t settings[2] = {static_cast<uint32_t>(usage), kVersion};
+  return hashing::Fnv1a(settings, sizeof(settings),
+                        hashing::Fnv1a(file, size));
+}
+
+std::string TextureCache::PathFor(uint64_t key) {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.tgt",
+                static_cast<unsigned long long>(key));
+  return asset::Asset::CACHE_DIR + "/" + name;
+}
+
+bool TextureCache::Read(uint64_t key, TextureImage& image) {
+  std::ifstream file(PathFor(key), std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                            std::istreambuf_iterator<char>());
+
+  FileHeader header;
+  if (data.size() < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, data.data(), sizeof(header));
+  const auto format = static_cast<TextureFormat>(header.format);
+  if (std::memcmp(header.identifier, kIdentifier, sizeof(kIdentifier)) != 0 ||
+      header.version != kVersion || header.key != key ||
+      !KnownFormat(header.format) || header.width == 0 ||
+      header.height == 0 || header.levelCount == 0 || header.levelCount > 32) {
+    return false;
+  }
+
+  const size_t indexOffset = sizeof(header);
+  if (indexOffset + header.levelCount * sizeof(LevelIndex) > data.size()) {
+    return false;
+  }
+
+  image.width = static_cast<int>(header.width);
+  image.height = static_cast<int>(header.height);
+  image.format = format;
+  image.levels.resize(header.levelCount);
+  for (size_t l = 0; l < header.levelCount; l++) {
+    LevelIndex index;
+    std::memcpy(&index, data.data() + indexOffset + l * sizeof(index),
+                sizeof(index));
+
+    TextureLevel& level = image.levels[l];
+    level.width = LevelDimension(header.width, l);
+    level.height = LevelDimension(header.height, l);
+    if (index.byteLength !=
+            TextureLevelSize(format, level.width, level.height) ||
+        index.byteOffset > data.size() ||
+        index.byteLength > data.size() - index.byteOffset) {
+      return false;
+    }
+    level.data.assign(data.begin() + index.byteOffset,
+                      data.begin() + index.byteOffset + index.byteLength);
+  }
+  return true;
+}
+
+void TextureCache::Write(uint64_t key, const TextureImage& image) {
+  const std::string path = PathFor(key);
+  const std::string temporary = path + ".tmp";
+  std::filesystem::create_directories(asset::Asset::CACHE_DIR);
+
+  FileHeader header{};
+  std::memcpy(header.identifier, kIdentifier, sizeof(kIdentifier));
+  header.version = kVersion;
+  header.key = key;
+  header.format = static_cast<uint32_t>(image.format);
+  header.width = static_cast<uint32_t>(image.width);
+  header.height = static_cast<uint32_t>(image.height);
+  header.levelCount = static_cast<uint32_t>(image.levels.size());
+
+  // smallest level first, each aligned
+  std::vector<LevelIndex> index(image.levels.size());
+  size_t offset = AlignUp(sizeof(header) + index.size() * sizeof(LevelIndex));
+  for (size_t l = image.levels.size(); l-- > 0;) {
+    index[l].byteOffset = offset;
+    index[l].byteLength = image.levels[l].data.size();
+    offset = AlignUp(offset + image.levels[l].data.size());
+  }
+
+  {
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      throw std::runtime_error{"Could not write the texture cache: " + path};
+    }
+
+    std::vector<char> file(offset, '\0');
+    std::memcpy(file.data(), &header, sizeof(header));
+    std::memcpy(file.data() + sizeof(header), index.data(),
+                index.size() * sizeof(LevelIndex));
+    for (size_t l = 0; l < image.levels.size(); l++) {
+      std::memcpy(file.data() + index[l].byteOffset,
+                  image.levels[l].data.data(), index[l].byteLength);
+    }
+    out.write(file.data(), file.size());
+
+    if (!out) {
+      throw std::runtime_error{"Could not write the texture cache: " + path};
+    }
+  }
+
+  std::filesystem::rename(temporary, path);
+}
@@ -0,0 +1,899 @@
+#include <TextureCompression.hpp>
+
+#include <JobSystem.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using namespace models;
+
+namespace {
+
+using Pixels = uint8_t[16][4];
+
+// 4x4 blocks, edge blocks repeat the last row and column
+void FetchBlock(const TextureLevel& level, int bx, int by, Pixels out) {
+  for (int y = 0; y < 4; y++) {
+    const int sy = std::min(by * 4 + y, level.height - 1);
+    for (int x = 0; x < 4; x++) {
+      const int sx = std::min(bx * 4 + x, level.width - 1);
+      std::memcpy(out[y * 4 + x],
+                  &level.data[(static_cast<size_t>(sy) * level.width + sx) * 4],
+                  4);
+    }
+  }
+}
+
+void StoreBlock(TextureLevel& level, int bx, int by, const Pixels in) {
+  for (int y = 0; y < 4 && by * 4 + y < level.height; y++) {
+    for (int x = 0; x < 4 && bx * 4 + x < level.width; x++) {
+      const size_t offset =
+          (static_cast<size_t>(by * 4 + y) * level.width + bx * 4 + x) * 4;
+      std::memcpy(&level.data[offset], in[y * 4 + x], 4);
+    }
+  }
+}
+
+int BlocksAcross(int pixels) {
+  return (pixels + 3) / 4;
+}
+
+int Clamp(int value, int low, int high) {
+  return std::min(std::max(value, low), high);
+}
+
+// Mean and principal axis of the first channels of the pixels, by power
+// iteration on the covariance. The axis of a flat block is zero.
+void PrincipalAxis(const Pixels pixels,
+                   int channels,
+                   float mean[4],
+                   float axis[4]) {
+  for (int c = 0; c < channels; c++) {
+    mean[c] = 0.0f;
+    for (int i = 0; i < 16; i++) {
+      mean[c] += pixels[i][c];
+    }
+    mean[c] /= 16.0f;
+  }
+
+  float covariance[4][4] = {};
+  for (int i = 0; i < 16; i++) {
+    float d[4];
+    for (int c = 0; c < channels; c++) {
+      d[c] = pixels[i][c] - mean[c];
+    }
+    for (int a = 0; a < channels; a++) {
+      for (int b = 0; b < channels; b++) {
+        covariance[a][b] += d[a] * d[b];
+      }
+    }
+  }
+
+  // start from the column of the channel that varies most, a fixed start
+  // vector can be orthogonal to the axis
+  int widest = 0;
+  for (int c = 1; c < channels; c++) {
+    if (covariance[c][c] > covariance[widest][widest]) {
+      widest = c;
+    }
+  }
+  for (int c = 0; c < channels; c++) {
+    axis[c] = covariance[widest][c];
+  }
+  for (int iteration = 0; iteration < 8; iteration++) {
+    float next[4] = {};
+    float length = 0.0f;
+    for (int a = 0; a < channels; a++) {
+      for (int b = 0; b < channels; b++) {
+        next[a] += covariance[a][b] * axis[b];
+      }
+      length = std::max(length, std::fabs(next[a]));
+    }
+    if (length < 1e-6f) {
+      for (int c = 0; c < channels; c++) {
+        axis[c] = 0.0f;
+      }
+      return;
+    }
+    for (int c = 0; c < channels; c++) {
+      axis[c] = next[c] / length;
+    }
+  }
+
+  float length = 0.0f;
+  for (int c = 0; c < channels; c++) {
+    length += axis[c] * axis[c];
+  }
+  length = std::sqrt(length);
+  for (int c = 0; c < channels; c++) {
+    axis[c] /= length;
+  }
+}
+
+// The two ends of the pixels projected on the axis.
+void AxisEndpoints(const Pixels pixels,
+                   int channels,
+                   float low[4],
+                   float high[4]) {
+  float mean[4];
+  float axis[4];
+  PrincipalAxis(pixels, channels, mean, axis);
+
+  float minT = 0.0f;
+  float maxT = 0.0f;
+  for (int i = 0; i < 16; i++) {
+    float t = 0.0f;
+    for (int c = 0; c < channels; c++) {
+      t += (pixels[i][c] - mean[c]) * axis[c];
+    }
+    minT = std::min(minT, t);
+    maxT = std::max(maxT, t);
+  }
+  for (int c = 0; c < channels; c++) {
+    low[c] = mean[c] + axis[c] * minT;
+    high[c] = mean[c] + axis[c] * maxT;
+  }
+}
+
+// Endpoints a and b minimizing the squared error of (1 - t) a + t b against
+// the pixels, for fixed weights t. False when the weights are degenerate.
+bool LeastSquaresEndpoints(const Pixels pixels,
+                           const float weights[16],
+                           int channels,
+                           float a[4],
+                           float b[4]) {
+  float aa = 0.0f;
+  float bb = 0.0f;
+  float ab = 0.0f;
+  float ax[4] = {};
+  float bx[4] = {};
+  for (int i = 0; i < 16; i++) {
+    const float t = weights[i];
+    const float s = 1.0f - t;
+    aa += s * s;
+    bb += t * t;
+    ab += s * t;
+    for (int c = 0; c < channels; c++) {
+      ax[c] += s * pixels[i][c];
+      bx[c] += t * pixels[i][c];
+    }
+  }
+
+  const float determinant = aa * bb - ab * ab;
+  if (std::fabs(determinant) < 1e-6f) {
+    return false;
+  }
+  for (int c = 0; c < channels; c++) {
+    a[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+    b[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+  }
+  return true;
+}
+
+int SquaredDistance(const uint8_t* pixel, const int* color, int channels) {
+  int sum = 0;
+  for (int c = 0; c < channels; c++) {
+    const int d = pixel[c] - color[c];
+    sum += d * d;
+  }
+  return sum;
+}
+
+// BC1 color block
+
+int Quantize(float value, int maximum) {
+  return Clamp(static_cast<int>(std::lround(value * maximum / 255)), 0,
+               maximum);
+}
+
+uint16_t To565(const float color[3]) {
+  return static_cast<uint16_t>(Quantize(color[0], 31) << 11 |
+                               Quantize(color[1], 63) << 5 |
+                               Quantize(color[2], 31));
+}
+
+void From565(uint16_t value, int color[3]) {
+  const int r = value >> 11 & 31;
+  const int g = value >> 5 & 63;
+  const int b = value & 31;
+  color[0] = r << 3 | r >> 2;
+  color[1] = g << 2 | g >> 4;
+  color[2] = b << 3 | b >> 2;
+}
+
+void ColorPalette(uint16_t c0, uint16_t c1, bool opaque, int palette[4][3]) {
+  From565(c0, palette[0]);
+  From565(c1, palette[1]);
+  for (int c = 0; c < 3; c++) {
+    if (opaque || c0 > c1) {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    } else {
+      palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+      palette[3][c] = 0;
+    }
+  }
+}
+
+// Nearest palette entries in four color mode, returns the total error.
+int SelectColorIndices(const Pixels pixels,
+                       uint16_t c0,
+                       uint16_t c1,
+                       uint8_t indices[16]) {
+  int palette[4][3];
+  ColorPalette(c0, c1, true, palette);
+  int total = 0;
+  for (int i = 0; i < 16; i++) {
+    int best = std::numeric_limits<int>::max();
+    for (int p = 0; p < 4; p++) {
+      const int error = SquaredDistance(pixels[i], palette[p], 3);
+      if (error < best) {
+        best = error;
+        indices[i] = static_cast<uint8_t>(p);
+      }
+    }
+    total += best;
+  }
+  return total;
+}
+
+void EncodeColorBlock(const Pixels pixels, uint8_t out[8]) {
+  float low[4];
+  float high[4];
+  AxisEndpoints(pixels, 3, low, high);
+
+  uint16_t c0 = To565(high);
+  uint16_t c1 = To565(low);
+  uint8_t indices[16];
+  int error = SelectColorIndices(pixels, c0, c1, indices);
+
+  // one least squares pass on the chosen indices
+  static const float kWeights[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+  float weights[16];
+  for (int i = 0; i < 16; i++) {
+    weights[i] = kWeights[indices[i]];
+  }
+  float a[4];
+  float b[4];
+  if (LeastSquaresEndpoints(pixels, weights, 3, a, b)) {
+    const uint16_t r0 = To565(a);
+    const uint16_t r1 = To565(b);
+    uint8_t refined[16];
+    const int refinedError = SelectColorIndices(pixels, r0, r1, refined);
+    if (refinedError < error) {
+      c0 = r0;
+      c1 = r1;
+      error = refinedError;
+      std::memcpy(indices, refined, sizeof(refined));
+    }
+  }
+
+  // four color mode needs c0 > c1, equal endpoints use index 0 only
+  if (c0 < c1) {
+    std::swap(c0, c1);
+    for (auto& index : indices) {
+      index ^= 1;
+    }
+  }
+  if (c0 == c1) {
+    std::memset(indices, 0, sizeof(indices));
+  }
+
+  uint32_t bits = 0;
+  for (int i = 0; i < 16; i++) {
+    bits |= static_cast<uint32_t>(indices[i]) << (2 * i);
+  }
+  out[0] = static_cast<uint8_t>(c0);
+  out[1] = static_cast<uint8_t>(c0 >> 8);
+  out[2] = static_cast<uint8_t>(c1);
+  out[3] = static_cast<uint8_t>(c1 >> 8);
+  for (int i = 0; i < 4; i++) {
+    out[4 + i] = static_cast<uint8_t>(bits >> (8 * i));
+  }
+}
+
+// BC3 and BC5 always decode the color block in four color mode
+void DecodeColorBlock(const uint8_t in[8], bool opaque, Pixels pixels) {
+  const uint16_t c0 = static_cast<uint16_t>(in[0] | in[1] << 8);
+  const uint16_t c1 = static_cast<uint16_t>(in[2] | in[3] << 8);
+  int palette[4][3];
+  ColorPalette(c0, c1, opaque, palette);
+  const uint32_t bits = static_cast<uint32_t>(in[4]) | in[5] << 8 |
+                        in[6] << 16 | static_cast<uint32_t>(in[7]) << 24;
+  for (int i = 0; i < 16; i++) {
+    const int index = bits >> (2 * i) & 3;
+    for (int c = 0; c < 3; c++) {
+      pixels[i][c] = static_cast<uint8_t>(palette[index][c]);
+    }
+    pixels[i][3] = (!opaque && c0 <= c1 && index == 3) ? 0 : 255;
+  }
+}
+
+// BC4 single channel block, the alpha of BC3 and each channel of BC5
+
+void ChannelPalette(int a0, int a1, int palette[8]) {
+  palette[0] = a0;
+  palette[1] = a1;
+  if (a0 > a1) {
+    for (int i = 1; i < 7; i++) {
+      palette[i + 1] = ((7 - i) * a0 + i * a1 + 3) / 7;
+    }
+  } else {
+    for (int i = 1; i < 5; i++) {
+      palette[i + 1] = ((5 - i) * a0 + i * a1 + 2) / 5;
+    }
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+}
+
+void EncodeChannelBlock(const Pixels pixels, int channel, uint8_t out[8]) {
+  int a0 = 0;
+  int a1 = 255;
+  for (int i = 0; i < 16; i++) {
+    a0 = std::max(a0, static_cast<int>(pixels[i][channel]));
+    a1 = std::min(a1, static_cast<int>(pixels[i][channel]));
+  }
+
+  uint64_t bits = 0;
+  if (a0 > a1) {
+    int palette[8];
+    ChannelPalette(a0, a1, palette);
+    for (int i = 0; i < 16; i++) {
+      int best = 0;
+      for (int p = 1; p < 8; p++) {
+        if (std::abs(pixels[i][channel] - palette[p]) <
+            std::abs(pixels[i][channel] - palette[best])) {
+          best = p;
+        }
+      }
+      bits |= static_cast<uint64_t>(best) << (3 * i);
+    }
+  }
+
+  out[0] = static_cast<uint8_t>(a0);
+  out[1] = static_cast<uint8_t>(a1);
+  for (int i = 0; i < 6; i++) {
+    out[2 + i] = static_cast<uint8_t>(bits >> (8 * i));
+  }
+}
+
+void DecodeChannelBlock(const uint8_t in[8], int channel, Pixels pixels) {
+  int palette[8];
+  ChannelPalette(in[0], in[1], palette);
+  uint64_t bits = 0;
+  for (int i = 0; i < 6; i++) {
+    bits |= static_cast<uint64_t>(in[2 + i]) << (8 * i);
+  }
+  for (int i = 0; i < 16; i++) {
+    pixels[i][channel] = static_cast<uint8_t>(palette[bits >> (3 * i) & 7]);
+  }
+}
+
+// BC7 mode 6: one subset, RGBA endpoints of 7 bits plus a shared low bit
+// each, 4 bit indices
+
+constexpr int kBc7Weights[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                                 34, 38, 43, 47, 51, 55, 60, 64};
+
+struct Bc7Endpoint {
+  int value[4];
+  int pbit;
+};
+
+Bc7Endpoint QuantizeBc7(const float color[4]) {
+  Bc7Endpoint best{};
+  float bestError = std::numeric_limits<float>::max();
+  for (int p = 0; p < 2; p++) {
+    Bc7Endpoint candidate{};
+    candidate.pbit = p;
+    float error = 0.0f;
+    for (int c = 0; c < 4; c++) {
+      candidate.value[c] =
+          Clamp(static_cast<int>(std::lround((color[c] - p) / 2)), 0, 127);
+      const float d = (candidate.value[c] * 2 + p) - color[c];
+      error += d * d;
+    }
+    if (error < bestError) {
+      bestError = error;
+      best = candidate;
+    }
+  }
+  return best;
+}
+
+void Bc7Palette(const Bc7Endpoint& e0,
+                const Bc7Endpoint& e1,
+                int palette[16][4]) {
+  for (int i = 0; i < 16; i++) {
+    for (int c = 0; c < 4; c++) {
+      const int a = e0.value[c] << 1 | e0.pbit;
+      const int b = e1.value[c] << 1 | e1.pbit;
+      palette[i][c] =
+          ((64 - kBc7Weights[i]) * a + kBc7Weights[i] * b + 32) >> 6;
+    }
+  }
+}
+
+int SelectBc7Indices(const Pixels pixels,
+                     const Bc7Endpoint& e0,
+                     const Bc7Endpoint& e1,
+                     uint8_t indices[16]) {
+  int palette[16][4];
+  Bc7Palette(e0, e1, palette);
+  int total = 0;
+  for (int i = 0; i < 16; i++) {
+    int best = std::numeric_limits<int>::max();
+    for (int p = 0; p < 16; p++) {
+      const int error = SquaredDistance(pixels[i], palette[p], 4);
+      if (error < best) {
+        best = error;
+        indices[i] = static_cast<uint8_t>(p);
+      }
+    }
+    total += best;
+  }
+  return total;
+}
+
+class BitWriter {
+ private:
+  uint8_t* out;
+  int position = 0;
+
+ public:
+  explicit BitWriter(uint8_t* out) : out(out) {}
+
+  void Write(uint32_t value, int bits) {
+    for (int i = 0; i < bits; i++, position++) {
+      out[position >> 3] |= static_cast<uint8_t>((value >> i & 1)
+                                                 << (position & 7));
+    }
+  }
+};
+
+class BitReader {
+ private:
+  const uint8_t* in;
+  int position = 0;
+
+ public:
+  explicit BitReader(const uint8_t* in) : in(in) {}
+
+  uint32_t Read(int bits) {
+    uint32_t value = 0;
+    for (int i = 0; i < bits; i++, position++) {
+      value |= static_cast<uint32_t>(in[position >> 3] >> (position & 7) & 1)
+               << i;
+    }
+    return value;
+  }
+};
+
+void EncodeBc7Block(const Pixels pixels, uint8_t out[16]) {
+  float low[4];
+  float high[4];
+  AxisEndpoints(pixels, 4, low, high);
+
+  Bc7Endpoint e0 = QuantizeBc7(low);
+  Bc7Endpoint e1 = QuantizeBc7(high);
+  uint8_t indices[16];
+  int error = SelectBc7Indices(pixels, e0, e1, indices);
+
+  float weights[16];
+  for (int i = 0; i < 16; i++) {
+    weights[i] = kBc7Weights[indices[i]] / 64.0f;
+  }
+  float a[4];
+  float b[4];
+  if (LeastSquaresEndpoints(pixels, weights, 4, a, b)) {
+    const Bc7Endpoint r0 = QuantizeBc7(a);
+    const Bc7Endpoint r1 = QuantizeBc7(b);
+    uint8_t refined[16];
+    const int refinedError = SelectBc7Indices(pixels, r0, r1, refined);
+    if (refinedError < error) {
+      e0 = r0;
+      e1 = r1;
+      error = refinedError;
+      std::memcpy(indices, refined, sizeof(refined));
+    }
+  }
+
+  // the first index is stored without its top bit
+  if (indices[0] & 8) {
+    std::swap(e0, e1);
+    for (auto& index : indices) {
+      index = static_cast<uint8_t>(15 - index);
+    }
+  }
+
+  std::memset(out, 0, 16);
+  BitWriter writer(out);
+  writer.Write(1 << 6, 7);
+  for (int c = 0; c < 4; c++) {
+    writer.Write(e0.value[c], 7);
+    writer.Write(e1.value[c], 7);
+  }
+  writer.Write(e0.pbit, 1);
+  writer.Write(e1.pbit, 1);
+  writer.Write(indices[0], 3);
+  for (int i = 1; i < 16; i++) {
+    writer.Write(indices[i], 4);
+  }
+}
+
+// Other modes are never written and decode to transparent black.
+void DecodeBc7Block(const uint8_t in[16], Pixels pixels) {
+  std::memset(pixels, 0, sizeof(Pixels));
+  BitReader reader(in);
+  if (reader.Read(7) != 1 << 6) {
+    return;
+  }
+
+  Bc7Endpoint e0{};
+  Bc7Endpoint e1{};
+  for (int c = 0; c < 4; c++) {
+    e0.value[c] = static_cast<int>(reader.Read(7));
+    e1.value[c] = static_cast<int>(reader.Read(7));
+  }
+  e0.pbit = static_cast<int>(reader.Read(1));
+  e1.pbit = static_cast<int>(reader.Read(1));
+
+  int palette[16][4];
+  Bc7Palette(e0, e1, palette);
+  for (int i = 0; i < 16; i++) {
+    const int index = static_cast<int>(reader.Read(i == 0 ? 3 : 4));
+    for (int c = 0; c < 4; c++) {
+      pixels[i][c] = static_cast<uint8_t>(palette[index][c]);
+    }
+  }
+}
+
+void EncodeBlock(const Pixels pixels, TextureFormat format, uint8_t* out) {
+  switch (format) {
+    case TextureFormat::kBc1:
+      EncodeColorBlock(pixels, out);
+      break;
+    case TextureFormat::kBc3:
+      EncodeChannelBlock(pixels, 3, out);
+      EncodeColorBlock(pixels, out + 8);
+      break;
+    case TextureFormat::kBc5:
+      EncodeChannelBlock(pixels, 0, out);
+      EncodeChannelBlock(pixels, 1, out + 8);
+      break;
+    case TextureFormat::kBc7:
+      EncodeBc7Block(pixels, out);
+      break;
+    case TextureFormat::kRgba8:
+      break;
+  }
+}
+
+void DecodeBlock(const uint8_t* in, TextureFormat format, Pixels pixels) {
+  switch (format) {
+    case TextureFormat::kBc1:
+      DecodeColorBlock(in, false, pixels);
+      break;
+    case TextureFormat::kBc3:
+      DecodeColorBlock(in + 8, true, pixels);
+      DecodeChannelBlock(in, 3, pixels);
+      break;
+    case TextureFormat::kBc5:
+      DecodeChannelBlock(in, 0, pixels);
+      DecodeChannelBlock(in + 8, 1, pixels);
+      for (int i = 0; i < 16; i++) {
+        pixels[i][2] = 0;
+        pixels[i][3] = 255;
+      }
+      break;
+    case TextureFormat::kBc7:
+      DecodeBc7Block(in, pixels);
+      break;
+    case TextureFormat::kRgba8:
+      break;
+  }
+}
+
+// Run body(level, blockRow) over every block row of every level.
+template <typename Body>
+void ForEachBlockRow(const std::vector<TextureLevel>& levels,
+                     bool threaded,
+                     Body&& body) {
+  std::vector<std::pair<int, int>> rows;
+  for (size_t l = 0; l < levels.size(); l++) {
+    for (int row = 0; row < BlocksAcross(levels[l].height); row++) {
+      rows.emplace_back(static_cast<int>(l), row);
+    }
+  }
+
+  auto run = [&](int first, int last) {
+    for (int i = first; i < last; i++) {
+      body(rows[i].first, rows[i].second);
+    }
+  };
+  if (threaded) {
+    jobs::JobSystem::GetInstance().ParallelFor(0, static_cast<int>(rows.size()),
+                                               4, run);
+  } else {
+    run(0, static_cast<int>(rows.size()));
+  }
+}
+
+// sRGB transfer functions, decoding goes through a table
+float SrgbToLinear(uint8_t value) {
+  static const auto table = [] {
+    std::vector<float> result(256);
+    for (int i = 0; i < 256; i++) {
+      const float c = i / 255.0f;
+      result[i] = c <= 0.04045f ? c / 12.92f
+                                : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+    return result;
+  }();
+  return table[value];
+}
+
+uint8_t LinearToSrgb(float value) {
+  const float c = value <= 0.0031308f
+                      ? value * 12.92f
+                      : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+  return static_cast<uint8_t>(Clamp(static_cast<int>(c * 255.0f + 0.5f), 0,
+                                    255));
+}
+
+uint8_t ToUnorm8(float value) {
+  return static_cast<uint8_t>(
+      Clamp(static_cast<int>(value * 255.0f + 0.5f), 0, 255));
+}
+
+TextureLevel Downsample(const TextureLevel& source, TextureUsage usage) {
+  TextureLevel level;
+  level.width = std::max(1, source.width / 2);
+  level.height = std::max(1, source.height / 2);
+  level.data.resize(static_cast<size_t>(level.width) * level.height * 4);
+
+  for (int y = 0; y < level.height; y++) {
+    for (int x = 0; x < level.width; x++) {
+      float sum[4] = {};
+      for (int s = 0; s < 4; s++) {
+        const int sx = std::min(x * 2 + (s & 1), source.width - 1);
+        const int sy = std::min(y * 2 + (s >> 1), source.height - 1);
+        const uint8_t* pixel =
+            &source.data[(static_cast<size_t>(sy) * source.width + sx) * 4];
+        for (int c = 0; c < 4; c++) {
+          if (usage == TextureUsage::kColor && c < 3) {
+            sum[c] += SrgbToLinear(pixel[c]);
+          } else if (usage == TextureUsage::kNormal && c < 3) {
+            sum[c] += pixel[c] / 255.0f * 2.0f - 1.0f;
+          } else {
+            sum[c] += pixel[c] / 255.0f;
+          }
+        }
+      }
+
+      uint8_t* out =
+          &level.data[(static_cast<size_t>(y) * level.width + x) * 4];
+      if (usage == TextureUsage::kNormal) {
+        float length = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] +
+                                 sum[2] * sum[2]);
+        if (length < 1e-6f) {
+          sum[2] = length = 1.0f;
+        }
+        for (int c = 0; c < 3; c++) {
+          out[c] = ToUnorm8(sum[c] / length * 0.5f + 0.5f);
+        }
+      } else {
+        for (int c = 0; c < 3; c++) {
+          out[c] = usage == TextureUsage::kColor ? LinearToSrgb(sum[c] / 4)
+                                                 : ToUnorm8(sum[c] / 4);
+        }
+      }
+      out[3] = ToUnorm8(sum[3] / 4);
+    }
+  }
+  return level;
+}
+
+size_t ChainSize(const std::vector<TextureLevel>& levels) {
+  size_t size = 0;
+  for (auto& level : levels) {
+    size += level.data.size();
+  }
+  return size;
+}
+}  // namespace
+
+size_t models::TextureFormatBlockSize(TextureFormat format) {
+  switch (format) {
+    case TextureFormat::kBc1:
+      return 8;
+    case TextureFormat::kBc3:
+    case TextureFormat::kBc5:
+    case TextureFormat::kBc7:
+      return 16;
+    case TextureFormat::kRgba8:
+      break;
+  }
+  return 4;
+}
+
+size_t models::TextureLevelSize(TextureFormat format, int width, int height) {
+  if (format == TextureFormat::kRgba8) {
+    return static_cast<size_t>(width) * height * 4;
+  }
+  return static_cast<size_t>(BlocksAcross(width)) * BlocksAcross(height) *
+         TextureFormatBlockSize(format);
+}
+
+const char* models::TextureFormatName(TextureFormat format) {
+  switch (format) {
+    case TextureFormat::kBc1:
+      return "BC1";
+    case TextureFormat::kBc3:
+      return "BC3";
+    case TextureFormat::kBc5:
+      return "BC5";
+    case TextureFormat::kBc7:
+      return "BC7";
+    case TextureFormat::kRgba8:
+      break;
+  }
+  return "RGBA8";
+}
+
+TextureUsage models::TextureUsageFor(const std::string& typeName) {
+  if (typeName == "texture_normal") {
+    return TextureUsage::kNormal;
+  }
+  if (typeName == "texture_diffuse") {
+    return TextureUsage::kColor;
+  }
+  return TextureUsage::kData;
+}
+
+std::vector<TextureLevel> models::BuildMipChain(TextureLevel base,
+                                                TextureUsage usage) {
+  std::vector<TextureLevel> levels;
+  levels.push_back(std::move(base));
+  while (levels.back().width > 1 || levels.back().height > 1) {
+    levels.push_back(Downsample(levels.back(), usage));
+  }
+  return levels;
+}
+
+TextureFormat models::ChooseTextureFormat(const TextureLevel& base,
+                                          TextureUsage usage) {
+  if (usage == TextureUsage::kNormal) {
+    return TextureFormat::kBc5;
+  }
+  for (size_t i = 3; i < base.data.size(); i += 4) {
+    if (base.data[i] != 255) {
+      return TextureFormat::kBc7;
+    }
+  }
+  return TextureFormat::kBc1;
+}
+
+std::vector<TextureLevel> models::CompressLevels(
+    const std::vector<TextureLevel>& rgba,
+    TextureFormat format,
+    bool threaded) {
+  if (format == TextureFormat::kRgba8) {
+    return rgba;
+  }
+
+  const size_t blockSize = TextureFormatBlockSize(format);
+  std::vector<TextureLevel> blocks(rgba.size());
+  for (size_t l = 0; l < rgba.size(); l++) {
+    blocks[l].width = rgba[l].width;
+    blocks[l].height = rgba[l].height;
+    blocks[l].data.resize(
+        TextureLevelSize(format, rgba[l].width, rgba[l].height));
+  }
+
+  ForEachBlockRow(rgba, threaded, [&](int l, int row) {
+    const int across = BlocksAcross(rgba[l].width);
+    uint8_t* out = blocks[l].data.data() +
+                   static_cast<size_t>(row) * across * blockSize;
+    Pixels pixels;
+    for (int bx = 0; bx < across; bx++, out += blockSize) {
+      FetchBlock(rgba[l], bx, row, pixels);
+      EncodeBlock(pixels, format, out);
+    }
+  });
+  return blocks;
+}
+
+std::vector<TextureLevel> models::DecompressLevels(
+    const std::vector<TextureLevel>& blocks,
+    TextureFormat format) {
+  if (format == TextureFormat::kRgba8) {
+    return blocks;
+  }
+
+  const size_t blockSize = TextureFormatBlockSize(format);
+  std::vector<TextureLevel> rgba(blocks.size());
+  for (size_t l = 0; l < blocks.size(); l++) {
+    rgba[l].width = blocks[l].width;
+    rgba[l].height = blocks[l].height;
+    rgba[l].data.resize(static_cast<size_t>(blocks[l].width) *
+                        blocks[l].height * 4);
+  }
+
+  ForEachBlockRow(blocks, true, [&](int l, int row) {
+    const int across = BlocksAcross(blocks[l].width);
+    const uint8_t* in = blocks[l].data.data() +
+                        static_cast<size_t>(row) * across * blockSize;
+    Pixels pixels;
+    for (int bx = 0; bx < across; bx++, in += blockSize) {
+      DecodeBlock(in, format, pixels);
+      StoreBlock(rgba[l], bx, row, pixels);
+    }
+  });
+  return rgba;
+}
+
+double models::TexturePsnr(const TextureLevel& reference,
+                           const TextureLevel& decoded,
+                           TextureFormat format) {
+  int channels = 4;
+  if (format == TextureFormat::kBc1) {
+    channels = 3;
+  } else if (format == TextureFormat::kBc5) {
+    channels = 2;
+  }
+
+  double sum = 0.0;
+  const size_t pixels =
+      std::min(reference.data.size(), decoded.data.size()) / 4;
+  for (size_t i = 0; i < pixels; i++) {
+    for (int c = 0; c < channels; c++) {
+      const double d = reference.data[i * 4 + c] - decoded.data[i * 4 + c];
+      sum += d * d;
+    }
+  }
+  if (sum == 0.0) {
+    return std::numeric_limits<double>::infinity();
+  }
+  const double mse = sum / (static_cast<double>(pixels) * channels);
+  return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+std::vector<TextureEncoderBenchmark> models::BenchmarkTextureEncoders(
+    const TextureLevel& image) {
+  const auto levels = BuildMipChain(image, TextureUsage::kColor);
+  double pixels = 0.0;
+  for (auto& level : levels) {
+    pixels += static_cast<double>(level.width) * level.height;
+  }
+
+  std::vector<TextureEncoderBenchmark> results;
+  for (TextureFormat format : {TextureFormat::kBc1, TextureFormat::kBc3,
+                               TextureFormat::kBc5, TextureFormat::kBc7}) {
+    TextureEncoderBenchmark result;
+    result.format = format;
+
+    auto start = std::chrono::steady_clock::now();
+    CompressLevels(levels, format, false);
+    std::chrono::duration<double, std::milli> single =
+        std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    const auto blocks = CompressLevels(levels, format, true);
+    std::chrono::duration<double, std::milli> threaded =
+        std::chrono::steady_clock::now() - start;
+
+    result.singleThreadMs = single.count();
+    result.threadedMs = threaded.count();
+    result.megapixelsPerSecond = pixels / 1e3 / result.threadedMs;
+    result.psnr =
+        TexturePsnr(levels[0], DecompressLevels(blocks, format)[0], format);
+    result.ratio = static_cast<double>(ChainSize(levels)) / ChainSize(blocks);
+    results.push_back(result);
+  }
+  return results;
+}
@@ -0,0 +1,24 @@
+#include <UniformBuffer.hpp>
+
+using namespace rendering;
+
+UniformBuffer::UniformBuffer(GLuint binding, size_t size)
+    : binding{binding}, size{size} {
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+  glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+}
+
+UniformBuffer::~UniformBuffer() {
+  glDeleteBuffers(1, &buffer);
+}
+
+void UniformBuffer::Update(const void* data) {
+  glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+  // orphan the previous contents, a frame in flight may still read them
+  glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
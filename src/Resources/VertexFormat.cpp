@@ -0,0 +1,502 @@
+#include <VertexFormat.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <string>
+
+#include <Check.hpp>
+#include <Logger.hpp>
+
+using namespace models;
+
+namespace {
+
+glm::vec3 Max(glm::vec3 error, glm::vec3 a, glm::vec3 b) {
+  return glm::vec3(std::max(error.x, std::abs(a.x - b.x)),
+                   std::max(error.y, std::abs(a.y - b.y)),
+                   std::max(error.z, std::abs(a.z - b.z)));
+}
+
+float Largest(glm::vec3 value) {
+  return std::max(value.x, std::max(value.y, value.z));
+}
+
+void Store(uint8_t* out, const void* value, size_t size) {
+  std::memcpy(out, value, size);
+}
+
+void Load(const uint8_t* in, void* value, size_t size) {
+  std::memcpy(value, in, size);
+}
+}  // namespace
+
+VertexQuantization VertexQuantization::FromBounds(const VertexType* vertices,
+                                                  size_t count) {
+  VertexQuantization quantization;
+  if (count == 0) {
+    return quantization;
+  }
+
+  glm::vec3 low = vertices[0].Position;
+  glm::vec3 high = vertices[0].Position;
+  for (size_t i = 1; i < count; i++) {
+    for (int axis = 0; axis < 3; axis++) {
+      low[axis] = std::min(low[axis], vertices[i].Position[axis]);
+      high[axis] = std::max(high[axis], vertices[i].Position[axis]);
+    }
+  }
+
+  quantization.offset = low;
+  for (int axis = 0; axis < 3; axis++) {
+    const float extent = high[axis] - low[axis];
+    quantization.scale[axis] = extent > 0.0f ? extent : 1.0f;
+  }
+  return quantization;
+}
+
+unsigned int models::DetectVertexAttributes(const VertexType* vertices,
+                                            size_t count) {
+  unsigned int attributes = 0;
+  const glm::vec3 zero(0.0f);
+  for (size_t i = 0; i < count; i++) {
+    if (vertices[i].TexCoords.x != 0.0f || vertices[i].TexCoords.y != 0.0f) {
+      attributes |= kVertexTexCoords;
+    }
+    if (vertices[i].Tangent != zero || vertices[i].Bitangent != zero) {
+      attributes |= kVertexTangents;
+    }
+    if (attributes == (kVertexTexCoords | kVertexTangents)) {
+      break;
+    }
+  }
+  return attributes;
+}
+
+uint16_t packing::FloatToHalf(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+
+  const uint32_t sign = (bits >> 16) & 0x8000;
+  const int exponent = static_cast<int>((bits >> 23) & 0xFF);
+  uint32_t mantissa = bits & 0x7FFFFF;
+
+  // infinity and NaN
+  if (exponent == 0xFF) {
+    return static_cast<uint16_t>(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+  }
+
+  const int half = exponent - 127 + 15;
+  if (half >= 31) {
+    return static_cast<uint16_t>(sign | 0x7C00);
+  }
+
+  // too small for a normal half, shift the implicit bit into the mantissa
+  if (half <= 0) {
+    if (half < -10) {
+      return static_cast<uint16_t>(sign);
+    }
+    mantissa |= 0x800000;
+    const int shift = 14 - half;
+    uint32_t result = mantissa >> shift;
+    const uint32_t rest = mantissa & ((1u << shift) - 1);
+    const uint32_t halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (result & 1))) {
+      result++;
+    }
+    return static_cast<uint16_t>(sign | result);
+  }
+
+  // round to nearest even, a carry correctly bumps the exponent
+  uint32_t result = (static_cast<uint32_t>(half) << 10) | (mantissa >> 13);
+  const uint32_t rest = mantissa & 0x1FFF;
+  if (rest > 0x1000 || (rest == 0x1000 && (result & 1))) {
+    result++;
+  }
+  return static_cast<uint16_t>(sign | result);
+}
+
+float packing::HalfToFloat(uint16_t value) {
+  const uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+  const uint32_t exponent = (value >> 10) & 0x1F;
+  const uint32_t mantissa = value & 0x3FF;
+
+  if (exponent == 0) {
+    const float result = std::ldexp(static_cast<float>(mantissa), -24);
+    return sign ? -result : result;
+  }
+
+  uint32_t bits;
+  if (exponent == 31) {
+    bits = sign | 0x7F800000 | (mantissa << 13);
+  } else {
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  }
+  float result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+uint16_t packing::PackUnorm16(float value) {
+  return static_cast<uint16_t>(
+      std::lround(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+}
+
+float packing::UnpackUnorm16(uint16_t value) {
+  return value / 65535.0f;
+}
+
+uint32_t packing::PackSnorm1010102(glm::vec3 value) {
+  uint32_t result = 0;
+  for (int axis = 0; axis < 3; axis++) {
+    const long component = std::lround(std::clamp(value[axis], -1.0f, 1.0f) *
+                                       511.0f);
+    result |= (static_cast<uint32_t>(component) & 0x3FF) << (axis * 10);
+  }
+  return result;
+}
+
+glm::vec3 packing::UnpackSnorm1010102(uint32_t value) {
+  glm::vec3 result;
+  for (int axis = 0; axis < 3; axis++) {
+    // sign extend the 10 bit field
+    const int32_t component =
+        static_cast<int32_t>((value >> (axis * 10)) << 22) >> 22;
+    result[axis] = std::max(component / 511.0f, -1.0f);
+  }
+  return result;
+}
+
+uint32_t packing::PackUnorm4x8(glm::vec4 value) {
+  uint32_t result = 0;
+  for (int channel = 0; channel < 4; channel++) {
+    const long component =
+        std::lround(std::clamp(value[channel], 0.0f, 1.0f) * 255.0f);
+    result |= static_cast<uint32_t>(component) << (channel * 8);
+  }
+  return result;
+}
+
+glm::vec4 packing::UnpackUnorm4x8(uint32_t value) {
+  glm::vec4 result;
+  for (int channel = 0; channel < 4; channel++) {
+    result[channel] = ((value >> (channel * 8)) & 0xFF) / 255.0f;
+  }
+  return result;
+}
+
+void attributes::Position::Pack(const VertexType& vertex,
+                                const VertexQuantization& quantization,
+                                uint8_t* out) {
+  uint16_t packed[4] = {};
+  for (int axis = 0; axis < 3; axis++) {
+    packed[axis] = packing::PackUnorm16(
+        (vertex.Position[axis] - quantization.offset[axis]) /
+        quantization.scale[axis]);
+  }
+  Store(out, packed, sizeof(packed));
+}
+
+void attributes::Position::Unpack(const uint8_t* in,
+                                  const VertexQuantization& quantization,
+                                  VertexType& vertex) {
+  uint16_t packed[4];
+  Load(in, packed, sizeof(packed));
+  for (int axis = 0; axis < 3; axis++) {
+    vertex.Position[axis] =
+        quantization.offset[axis] +
+        packing::UnpackUnorm16(packed[axis]) * quantization.scale[axis];
+  }
+}
+
+void attributes::Normal::Pack(const VertexType& vertex,
+                              const VertexQuantization&,
+                              uint8_t* out) {
+  const uint32_t packed = packing::PackSnorm1010102(vertex.Normal);
+  Store(out, &packed, sizeof(packed));
+}
+
+void attributes::Normal::Unpack(const uint8_t* in,
+                                const VertexQuantization&,
+                                VertexType& vertex) {
+  uint32_t packed;
+  Load(in, &packed, sizeof(packed));
+  vertex.Normal = packing::UnpackSnorm1010102(packed);
+}
+
+void attributes::Color::Pack(const VertexType& vertex,
+                             const VertexQuantization&,
+                             uint8_t* out) {
+  const uint32_t packed = packing::PackUnorm4x8(vertex.Color);
+  Store(out, &packed, sizeof(packed));
+}
+
+void attributes::Color::Unpack(const uint8_t* in,
+                               const VertexQuantization&,
+                               VertexType& vertex) {
+  uint32_t packed;
+  Load(in, &packed, sizeof(packed));
+  vertex.Color = packing::UnpackUnorm4x8(packed);
+}
+
+void attributes::TexCoords::Pack(const VertexType& vertex,
+                                 const VertexQuantization&,
+                                 uint8_t* out) {
+  const uint16_t packed[2] = {packing::FloatToHalf(vertex.TexCoords.x),
+                              packing::FloatToHalf(vertex.TexCoords.y)};
+  Store(out, packed, sizeof(packed));
+}
+
+void attributes::TexCoords::Unpack(const uint8_t* in,
+                                   const VertexQuantization&,
+                                   VertexType& vertex) {
+  uint16_t packed[2];
+  Load(in, packed, sizeof(packed));
+  vertex.TexCoords = glm::vec2(packing::HalfToFloat(packed[0]),
+                               packing::HalfToFloat(packed[1]));
+}
+
+void attributes::Tangent::Pack(const VertexType& vertex,
+                               const VertexQuantization&,
+                               uint8_t* out) {
+  const uint32_t packed = packing::PackSnorm1010102(vertex.Tangent);
+  Store(out, &packed, sizeof(packed));
+}
+
+void attributes::Tangent::Unpack(const uint8_t* in,
+                                 const VertexQuantization&,
+                                 VertexType& vertex) {
+  uint32_t packed;
+  Load(in, &packed, sizeof(packed));
+  vertex.Tangent = packing::UnpackSnorm1010102(packed);
+}
+
+void attributes::Bitangent::Pack(const VertexType& vertex,
+                                 const VertexQuantization&,
+                                 uint8_t* out) {
+  const uint32_t packed = packing::PackSnorm1010102(vertex.Bitangent);
+  Store(out, &packed, sizeof(packed));
+}
+
+void attributes::Bitangent::Unpack(const uint8_t* in,
+                                   const VertexQuantization&,
+                                   VertexType& vertex) {
+  uint32_t packed;
+  Load(in, &packed, sizeof(packed));
+  vertex.Bitangent = packing::UnpackSnorm1010102(packed);
+}
+
+VertexError models::MeasureVertexError(const VertexType* vertices,
+                                       size_t count,
+                                       unsigned int attributes) {
+  VertexError error;
+  WithVertexLayout(attributes, [&](auto layout) {
+    using Layout = decltype(layout);
+    const auto quantization = VertexQuantization::FromBounds(vertices, count);
+    const auto packed = Layout::Pack(vertices, count, quantization);
+    std::vector<VertexType> decoded(count);
+    Layout::Unpack(packed.data(), count, quantization, decoded.data());
+
+    glm::vec3 position(0.0f), normal(0.0f), tangent(0.0f);
+    glm::vec3 color(0.0f), texCoords(0.0f);
+    for (size_t i = 0; i < count; i++) {
+      const VertexType& a = vertices[i];
+      const VertexType& b = decoded[i];
+      position = Max(position, a.Position, b.Position);
+      normal = Max(normal, a.Normal, b.Normal);
+      color = Max(color, glm::vec3(a.Color), glm::vec3(b.Color));
+      color.x = std::max(color.x, std::abs(a.Color.a - b.Color.a));
+      if (attributes & kVertexTexCoords) {
+        texCoords = Max(texCoords, glm::vec3(a.TexCoords, 0.0f),
+                        glm::vec3(b.TexCoords, 0.0f));
+      }
+      if (attributes & kVertexTangents) {
+        tangent = Max(tangent, a.Tangent, b.Tangent);
+        tangent = Max(tangent, a.Bitangent, b.Bitangent);
+      }
+    }
+
+    error.position = Largest(position);
+    error.normal = Largest(normal);
+    error.color = Largest(color);
+    error.texCoords = Largest(texCoords);
+    error.tangent = Largest(tangent);
+  });
+  return error;
+}
+
+namespace {
+
+// A mesh spread between low and high, with the axes where they are equal
+// flat. Normals, tangents and bitangents point into every octant and
+// along every axis, texture coordinates reach far outside [0, 1].
+std::vector<VertexType> CheckVertices(glm::vec3 low,
+                                      glm::vec3 high,
+                                      uint32_t seed) {
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  const float texCoords[] = {0.0f,   1.0f,    -1.0f,    0.5f,  -3.7f,
+                             12.25f, 1000.5f, -2049.0f, 1e-5f, 65504.0f};
+
+  std::vector<glm::vec3> directions;
+  for (int octant = 0; octant < 8; octant++) {
+    directions.push_back(glm::normalize(
+        glm::vec3(octant & 1 ? -1.0f : 1.0f, octant & 2 ? -1.0f : 1.0f,
+                  octant & 4 ? -1.0f : 1.0f) *
+        glm::vec3(0.2f + unit(random), 0.2f + unit(random),
+                  0.2f + unit(random))));
+  }
+  for (int axis = 0; axis < 3; axis++) {
+    glm::vec3 direction(0.0f);
+    direction[axis] = 1.0f;
+    directions.push_back(direction);
+    directions.push_back(-direction);
+  }
+
+  std::vector<VertexType> vertices;
+  for (size_t i = 0; i < 64; i++) {
+    VertexType vertex{};
+    // the corners first so the bounds are exactly low and high
+    for (int axis = 0; axis < 3; axis++) {
+      const float t =
+          i < 8 ? static_cast<float>((i >> axis) & 1) : unit(random);
+      vertex.Position[axis] = low[axis] + (high[axis] - low[axis]) * t;
+    }
+    vertex.Normal = directions[i % directions.size()];
+    vertex.Tangent = directions[(i + 3) % directions.size()];
+    vertex.Bitangent = directions[(i + 7) % directions.size()];
+    vertex.Color = glm::vec4(unit(random), unit(random), unit(random),
+                             i % 4 == 0 ? 1.0f : unit(random));
+    if (i % 5 == 0) {
+      vertex.Color = glm::vec4(static_cast<float>(i % 2));
+    }
+    vertex.TexCoords =
+        glm::vec2(texCoords[i % 10], texCoords[(i + 3) % 10] * unit(random));
+    vertices.push_back(vertex);
+  }
+  return vertices;
+}
+
+float Difference(glm::vec3 a, glm::vec3 b) {
+  return Largest(glm::abs(a - b));
+}
+}  // namespace
+
+bool models::CheckVertexFormat() {
+  checks::Checker check("Vertex format");
+
+  check.Expect(BasicVertexLayout::kStride == 16 &&
+                   TexturedVertexLayout::kStride == 20 &&
+                   TangentVertexLayout::kStride == 24 &&
+                   TexturedTangentVertexLayout::kStride == 28,
+               "unexpected layout strides");
+
+  struct Bounds {
+    const char* name;
+    glm::vec3 low;
+    glm::vec3 high;
+  };
+  const Bounds meshes[] = {
+      {"unit", glm::vec3(-0.5f), glm::vec3(0.5f)},
+      {"huge", glm::vec3(-1e5f, -3e4f, 2e5f), glm::vec3(1e5f, 5e4f, 2.5e5f)},
+      {"tiny", glm::vec3(100.0f, -100.0f, 7.0f),
+       glm::vec3(100.001f, -99.999f, 7.0005f)},
+      {"flat", glm::vec3(-20.0f, 3.25f, -20.0f),
+       glm::vec3(20.0f, 3.25f, 20.0f)},
+      {"line", glm::vec3(-1.0f, 0.0f, 5.0f), glm::vec3(1.0f, 0.0f, 5.0f)},
+  };
+
+  const float direction = 0.5f / 511.0f + 1e-6f;
+  const float color = 0.5f / 255.0f + 1e-6f;
+  uint32_t seed = 1;
+  for (const Bounds& mesh : meshes) {
+    const std::string name = mesh.name;
+    const auto vertices = CheckVertices(mesh.low, mesh.high, seed++);
+    const auto quantization =
+        VertexQuantization::FromBounds(vertices.data(), vertices.size());
+    const auto packed = TexturedTangentVertexLayout::Pack(
+        vertices.data(), vertices.size(), quantization);
+    std::vector<VertexType> decoded(vertices.size());
+    TexturedTangentVertexLayout::Unpack(packed.data(), vertices.size(),
+                                        quantization, decoded.data());
+
+    // half a step of the extent, plus the float rounding of the decode
+    glm::vec3 position;
+    for (int axis = 0; axis < 3; axis++) {
+      const float extent = mesh.high[axis] - mesh.low[axis];
+      const float magnitude =
+          std::max(std::abs(mesh.low[axis]), std::abs(mesh.high[axis]));
+      position[axis] =
+          extent > 0.0f ? 0.5f * extent / 65535.0f + 4e-7f * magnitude : 0.0f;
+    }
+
+    float worstPosition = 0.0f;
+    float worstDirection = 0.0f;
+    float worstTexCoords = 0.0f;
+    float worstColor = 0.0f;
+    for (size_t i = 0; i < vertices.size(); i++) {
+      const VertexType& a = vertices[i];
+      const VertexType& b = decoded[i];
+      for (int axis = 0; axis < 3; axis++) {
+        const float error = std::abs(a.Position[axis] - b.Position[axis]);
+        worstPosition = std::max(worstPosition, error);
+        check.Expect(error <= position[axis],
+                     name + " mesh: position axis " + std::to_string(axis) +
+                         " of vertex " + std::to_string(i) + " is " +
+                         std::to_string(error) + " off");
+      }
+
+      const float directionError =
+          std::max({Difference(a.Normal, b.Normal),
+                    Difference(a.Tangent, b.Tangent),
+                    Difference(a.Bitangent, b.Bitangent)});
+      worstDirection = std::max(worstDirection, directionError);
+      check.Expect(directionError <= direction,
+                   name + " mesh: normal or tangent of vertex " +
+                       std::to_string(i) + " is " +
+                       std::to_string(directionError) + " off");
+
+      for (int axis = 0; axis < 2; axis++) {
+        const float error = std::abs(a.TexCoords[axis] - b.TexCoords[axis]);
+        worstTexCoords = std::max(worstTexCoords, error);
+        check.Expect(error <= std::ldexp(std::abs(a.TexCoords[axis]), -11) +
+                                  std::ldexp(1.0f, -25),
+                     name + " mesh: texture coordinate " +
+                         std::to_string(a.TexCoords[axis]) + " came back as " +
+                         std::to_string(b.TexCoords[axis]));
+      }
+
+      const float colorError =
+          std::max(Difference(glm::vec3(a.Color), glm::vec3(b.Color)),
+                   std::abs(a.Color.a - b.Color.a));
+      worstColor = std::max(worstColor, colorError);
+      check.Expect(colorError <= color, name + " mesh: color of vertex " +
+                                            std::to_string(i) + " is " +
+                                            std::to_string(colorError) +
+                                            " off");
+    }
+
+    // the smaller layouts pack the same way and leave the rest zero
+    BasicVertexLayout::Unpack(
+        BasicVertexLayout::Pack(vertices.data(), 1, quantization).data(), 1,
+        quantization, decoded.data());
+    check.Expect(decoded[0].TexCoords == glm::vec2(0.0f) &&
+                     decoded[0].Tangent == glm::vec3(0.0f) &&
+                     decoded[0].Bitangent == glm::vec3(0.0f),
+                 name + " mesh: the basic layout decoded optional fields");
+
+    const VertexError measured = MeasureVertexError(
+        vertices.data(), vertices.size(), kVertexTexCoords | kVertexTangents);
+    check.Expect(measured.position == worstPosition &&
+                     measured.texCoords == worstTexCoords,
+                 name + " mesh: MeasureVertexError disagrees with the check");
+
+    LOG_INFO("Vertex format " + name + " mesh: position " +
+             std::to_string(worstPosition) + " normal " +
+             std::to_string(worstDirection) + " uv " +
+             std::to_string(worstTexCoords) + " color " +
+             std::to_string(worstColor));
+  }
+  return check.Passed();
+}
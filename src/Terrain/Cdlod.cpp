@@ -0,0 +1,398 @@
+
+#include <Cdlod.hpp>
+#include <Check.hpp>
+#include <Logger.hpp>
+#include <Noise.hpp>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <string>
+
+using namespace terrain;
+
+namespace {
+
+bool SphereIntersectsAabb(const glm::vec3& center,
+                          float radius,
+                          const glm::vec3& min,
+                          const glm::vec3& max) {
+  glm::vec3 closest = glm::min(glm::max(center, min), max);
+  glm::vec3 delta = closest - center;
+  return glm::dot(delta, delta) <= radius * radius;
+}
+
+int CountBits(uint8_t value) {
+  int count = 0;
+  for (; value; value >>= 1) {
+    count += value & 1;
+  }
+  return count;
+}
+
+// Level drawn over each cell of a cells x cells grid, -1 where nothing is
+// drawn. Returns the number of cells drawn more than once.
+size_t PaintLevels(const std::vector<CdlodSelectedNode>& selection,
+                   int cells,
+                   std::vector<int>& levels) {
+  levels.assign(static_cast<size_t>(cells) * cells, -1);
+
+  size_t overlaps = 0;
+  for (auto& node : selection) {
+    const int half = node.size / 2;
+    for (int i = 0; i < 4; i++) {
+      if (!(node.quadrants & (1 << i))) {
+        continue;
+      }
+      int x0 = node.x + (i & 1) * half;
+      int z0 = node.z + (i >> 1) * half;
+      for (int z = z0; z < std::min(z0 + half, cells); z++) {
+        for (int x = x0; x < std::min(x0 + half, cells); x++) {
+          int& level = levels[static_cast<size_t>(z) * cells + x];
+          overlaps += level != -1;
+          level = node.level;
+        }
+      }
+    }
+  }
+  return overlaps;
+}
+}  // namespace
+
+CdlodQuadtree::CdlodQuadtree(const Heightfield& field,
+                             float originX,
+                             float originZ,
+                             float spacing,
+                             float heightScale,
+                             CdlodSettings settings)
+    : settings{settings},
+      field{&field},
+      originX{originX},
+      originZ{originZ},
+      spacing{spacing},
+      heightScale{heightScale},
+      ranges(settings.lodCount, 0.0f) {
+  const int cells = std::max(field.Width(), field.Depth()) - 1;
+
+  for (int level = 0; level < settings.lodCount; level++) {
+    int size = settings.leafSize << level;
+    int count = (cells + size - 1) / size;
+    nodesPerSide.push_back(count);
+    bounds.emplace_back(static_cast<size_t>(count) * count,
+                        glm::vec2(std::numeric_limits<float>::max(),
+                                  std::numeric_limits<float>::lowest()));
+  }
+
+  // leaves straight from the samples, shared edges belong to both nodes
+  const int leaf = settings.leafSize;
+  for (int nz = 0; nz < nodesPerSide[0]; nz++) {
+    for (int nx = 0; nx < nodesPerSide[0]; nx++) {
+      glm::vec2& range = bounds[0][nz * nodesPerSide[0] + nx];
+      int lastZ = std::min((nz + 1) * leaf, field.Depth() - 1);
+      int lastX = std::min((nx + 1) * leaf, field.Width() - 1);
+      for (int z = std::min(nz * leaf, field.Depth() - 1); z <= lastZ; z++) {
+        for (int x = std::min(nx * leaf, field.Width() - 1); x <= lastX; x++) {
+          float height = field.At(x, z) * heightScale;
+          range.x = std::min(range.x, height);
+          range.y = std::max(range.y, height);
+        }
+      }
+    }
+  }
+
+  for (int level = 1; level < settings.lodCount; level++) {
+    const int count = nodesPerSide[level];
+    const int childCount = nodesPerSide[level - 1];
+    for (int nz = 0; nz < count; nz++) {
+      for (int nx = 0; nx < count; nx++) {
+        glm::vec2& range = bounds[level][nz * count + nx];
+        for (int i = 0; i < 4; i++) {
+          int cx = nx * 2 + (i & 1);
+          int cz = nz * 2 + (i >> 1);
+          if (cx >= childCount || cz >= childCount) {
+            continue;
+          }
+          const glm::vec2& child = bounds[level - 1][cz * childCount + cx];
+          range.x = std::min(range.x, child.x);
+          range.y = std::max(range.y, child.y);
+        }
+      }
+    }
+  }
+
+  UpdateRanges(glm::radians(45.0f), 900.0f, 150.0f);
+}
+
+void CdlodQuadtree::UpdateRanges(float fovRadians,
+                                 float viewportHeight,
+                                 float zfar) {
+  // pixels covered by one world unit at unit distance
+  const float projectionScale =
+      viewportHeight / (2.0f * std::tan(fovRadians * 0.5f));
+
+  float previous = 0.0f;
+  for (int level = 0; level < settings.lodCount; level++) {
+    float cellSize = spacing * static_cast<float>(1 << level);
+    float range = cellSize * projectionScale / settings.maxScreenSpaceError;
+
+    // each level must at least double the previous one so neighbouring nodes
+    // never differ by more than one level
+    ranges[level] = std::max(range, previous * 2.0f);
+    previous = ranges[level];
+  }
+  ranges.back() = std::max(ranges.back(), zfar);
+}
+
+void CdlodQuadtree::NodeBounds(int x,
+                               int z,
+                               int level,
+                               glm::vec3& min,
+                               glm::vec3& max) const {
+  const int size = settings.leafSize << level;
+  const int count = nodesPerSide[level];
+  const glm::vec2& range = bounds[level][(z / size) * count + (x / size)];
+
+  min = glm::vec3(originX + x * spacing, range.x, originZ + z * spacing);
+  max = glm::vec3(originX + (x + size) * spacing, range.y,
+                  originZ + (z + size) * spacing);
+}
+
+bool CdlodQuadtree::SelectNode(int x,
+                               int z,
+                               int level,
+                               const glm::vec3& cameraPos,
+                               const camera::Frustum& frustum,
+                               std::vector<CdlodSelectedNode>& selection) const {
+  glm::vec3 min, max;
+  NodeBounds(x, z, level, min, max);
+
+  // too far for this level, the parent covers the area instead
+  if (!SphereIntersectsAabb(cameraPos, ranges[level], min, max)) {
+    return false;
+  }
+
+  // handled, there is nothing to draw
+  if (!frustum.IntersectsAabb(min, max)) {
+    return true;
+  }
+
+  const int size = settings.leafSize << level;
+  if (level == 0 ||
+      !SphereIntersectsAabb(cameraPos, ranges[level - 1], min, max)) {
+    selection.push_back(CdlodSelectedNode{x, z, size, level, 0xF});
+    return true;
+  }
+
+  const int cells = std::max(field->Width(), field->Depth()) - 1;
+  const int half = size / 2;
+  uint8_t quadrants = 0;
+  for (int i = 0; i < 4; i++) {
+    int cx = x + (i & 1) * half;
+    int cz = z + (i >> 1) * half;
+    if (cx >= cells || cz >= cells) {
+      continue;
+    }
+    if (!SelectNode(cx, cz, level - 1, cameraPos, frustum, selection)) {
+      quadrants |= 1 << i;
+    }
+  }
+
+  if (quadrants) {
+    selection.push_back(CdlodSelectedNode{x, z, size, level, quadrants});
+  }
+  return true;
+}
+
+void CdlodQuadtree::Select(const glm::vec3& cameraPos,
+                           const camera::Frustum& frustum,
+                           std::vector<CdlodSelectedNode>& selection) const {
+  selection.clear();
+
+  const int top = settings.lodCount - 1;
+  const int size = settings.leafSize << top;
+  for (int nz = 0; nz < nodesPerSide[top]; nz++) {
+    for (int nx = 0; nx < nodesPerSide[top]; nx++) {
+      // nodes beyond the top range are beyond the far plane as well
+      SelectNode(nx * size, nz * size, top, cameraPos, frustum, selection);
+    }
+  }
+}
+
+size_t CdlodQuadtree::TriangleCount(
+    const std::vector<CdlodSelectedNode>& selection) const {
+  const size_t perQuadrant =
+      static_cast<size_t>(settings.leafSize) * settings.leafSize / 2;
+
+  size_t triangles = 0;
+  for (auto& node : selection) {
+    triangles += CountBits(node.quadrants) * perQuadrant;
+  }
+  return triangles;
+}
+
+std::vector<CdlodFrameReport> terrain::TraceCameraPath(
+    const CdlodQuadtree& tree,
+    const std::vector<glm::vec3>& positions,
+    const std::vector<glm::vec3>& fronts,
+    float fovRadians,
+    float aspect,
+    float znear,
+    float zfar) {
+  const glm::mat4 projection =
+      glm::perspective(fovRadians, aspect, znear, zfar);
+
+  std::vector<CdlodFrameReport> reports;
+  std::vector<CdlodSelectedNode> selection;
+  for (size_t i = 0; i < positions.size() && i < fronts.size(); i++) {
+    glm::mat4 view = glm::lookAt(positions[i], positions[i] + fronts[i],
+                                 glm::vec3(0.0f, 1.0f, 0.0f));
+    tree.Select(positions[i], camera::Frustum(projection * view), selection);
+    reports.push_back(
+        CdlodFrameReport{selection.size(), tree.TriangleCount(selection)});
+  }
+  return reports;
+}
+
+bool terrain::CheckLod() {
+  checks::Checker check("LOD");
+
+  // a power of two so no quadrant is cut by the edge of the field
+  const int cells = 512;
+  const float spacing = 0.25f;
+  const float heightScale = 40.0f;
+  const int first = -(cells / 2);
+  const float origin = spacing * first;
+  Heightfield field{cells + 1, cells + 1};
+  NoiseGenerator{GridParameters(NoiseParameters{}, spacing)}.Generate(
+      field, static_cast<float>(first), static_cast<float>(first), 1.0f);
+
+  const float fov = glm::radians(45.0f);
+  const float zfar = 150.0f;
+  const camera::Frustum everything{
+      glm::ortho(-1e4f, 1e4f, -1e4f, 1e4f, -1e4f, 1e4f)};
+
+  // the fly-over of ReportLodSelection, then one frame outside the field
+  const int frames = 60;
+  const float extent = 0.4f * spacing * cells;
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> fronts;
+  for (int i = 0; i < frames; i++) {
+    float t = static_cast<float>(i) / (frames - 1);
+    float along = -extent + 2.0f * extent * t;
+    positions.push_back(glm::vec3(along, heightScale * 0.5f, along));
+    fronts.push_back(glm::normalize(glm::vec3(1.0f, -0.2f, 1.0f)));
+  }
+  positions.push_back(glm::vec3(2.5f * extent, heightScale, 2.5f * extent));
+  fronts.push_back(glm::normalize(glm::vec3(-1.0f, -0.2f, -1.0f)));
+
+  const size_t full = static_cast<size_t>(cells) * cells * 2;
+  std::vector<CdlodSelectedNode> selection;
+  std::vector<int> levels;
+  for (int lodCount : {1, 3, 6}) {
+    CdlodSettings settings;
+    settings.lodCount = lodCount;
+    CdlodQuadtree tree{field, origin, origin, spacing, heightScale, settings};
+    tree.UpdateRanges(fov, 900.0f, zfar);
+
+    const size_t perQuadrant =
+        static_cast<size_t>(settings.leafSize) * settings.leafSize / 2;
+    std::vector<size_t> unculled;
+    for (size_t f = 0; f < positions.size(); f++) {
+      const std::string frame = std::to_string(lodCount) + " levels, frame " +
+                                std::to_string(f) + ": ";
+      tree.Select(positions[f], everything, selection);
+      unculled.push_back(tree.TriangleCount(selection));
+
+      check.Expect(PaintLevels(selection, cells, levels) == 0,
+                   frame + "quadrants overlap");
+
+      // only cells beyond the coarsest range may be left out, and
+      // neighbours more than one level apart would leave cracks
+      const float range = tree.Range(lodCount - 1);
+      size_t uncovered = 0;
+      bool restricted = true;
+      for (int z = 0; z < cells; z++) {
+        for (int x = 0; x < cells; x++) {
+          int level = levels[static_cast<size_t>(z) * cells + x];
+          if (level < 0) {
+            float low = std::min(
+                std::min(field.At(x, z), field.At(x + 1, z)),
+                std::min(field.At(x, z + 1), field.At(x + 1, z + 1)));
+            float high = std::max(
+                std::max(field.At(x, z), field.At(x + 1, z)),
+                std::max(field.At(x, z + 1), field.At(x + 1, z + 1)));
+            glm::vec3 min(origin + x * spacing, low * heightScale,
+                          origin + z * spacing);
+            glm::vec3 max(min.x + spacing, high * heightScale,
+                          min.z + spacing);
+            uncovered += SphereIntersectsAabb(positions[f], range, min, max);
+            continue;
+          }
+          if (x + 1 < cells && levels[z * cells + x + 1] >= 0) {
+            restricted &= std::abs(level - levels[z * cells + x + 1]) <= 1;
+          }
+          if (z + 1 < cells && levels[(z + 1) * cells + x] >= 0) {
+            restricted &= std::abs(level - levels[(z + 1) * cells + x]) <= 1;
+          }
+        }
+      }
+      check.Expect(uncovered == 0, frame + std::to_string(uncovered) +
+                                       " cells in range are left uncovered");
+      check.Expect(restricted, frame + "neighbours differ by two levels");
+
+      // a quadrant at level L spreads its triangles over 4^L times the area
+      // of a leaf quadrant
+      std::vector<size_t> triangles(lodCount, 0);
+      std::vector<size_t> area(lodCount, 0);
+      for (auto& node : selection) {
+        triangles[node.level] += CountBits(node.quadrants) * perQuadrant;
+      }
+      for (int level : levels) {
+        if (level >= 0) {
+          area[level]++;
+        }
+      }
+      for (int level = 0; level < lodCount; level++) {
+        check.Expect((triangles[level] << (2 * level)) == area[level] * 2,
+                     frame + "level " + std::to_string(level) + " draws " +
+                         std::to_string(triangles[level]) +
+                         " triangles over " + std::to_string(area[level]) +
+                         " cells");
+      }
+      check.Expect(unculled.back() <= full,
+                   frame + "more triangles than the full grid");
+
+      // the cell under the camera is always at full resolution
+      int cx = static_cast<int>((positions[f].x - origin) / spacing);
+      int cz = static_cast<int>((positions[f].z - origin) / spacing);
+      if (cx >= 0 && cx < cells && cz >= 0 && cz < cells) {
+        check.Expect(levels[static_cast<size_t>(cz) * cells + cx] == 0,
+                     frame + "the cell under the camera is not level 0");
+      }
+    }
+
+    // culling only ever drops nodes
+    auto reports = TraceCameraPath(tree, positions, fronts, fov, 16.0f / 9.0f,
+                                   0.1f, zfar);
+    size_t culled = 0;
+    for (size_t f = 0; f < reports.size(); f++) {
+      check.Expect(reports[f].triangles <= unculled[f],
+                   std::to_string(lodCount) + " levels, frame " +
+                       std::to_string(f) + ": culling adds triangles");
+      culled += reports[f].triangles;
+    }
+
+    size_t total = 0;
+    for (size_t triangles : unculled) {
+      total += triangles;
+    }
+    LOG_INFO("LOD: " + std::to_string(lodCount) + " levels average " +
+             std::to_string(total / unculled.size()) + " triangles, " +
+             std::to_string(culled / reports.size()) +
+             " after culling, full grid " + std::to_string(full));
+  }
+  return check.Passed();
+}
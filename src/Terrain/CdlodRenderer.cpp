@@ -0,0 +1,125 @@
+
+#include <Cdlod.hpp>
+
+using namespace terrain;
+
+CdlodRenderer::CdlodRenderer(const Heightfield& field, int gridSize)
+    : gridSize{gridSize} {
+  // unit grid, the vertex shader scales and offsets it per node
+  std::vector<glm::vec2> vertices;
+  for (int z = 0; z <= gridSize; z++) {
+    for (int x = 0; x <= gridSize; x++) {
+      vertices.push_back(glm::vec2(static_cast<float>(x) / gridSize,
+                                   static_cast<float>(z) / gridSize));
+    }
+  }
+
+  auto addCells = [&](std::vector<unsigned int>& indices, int x0, int z0,
+                      int count) {
+    const unsigned int row = gridSize + 1;
+    for (int z = z0; z < z0 + count; z++) {
+      for (int x = x0; x < x0 + count; x++) {
+        unsigned int i = z * row + x;
+        indices.push_back(i);
+        indices.push_back(i + row);
+        indices.push_back(i + 1);
+        indices.push_back(i + 1);
+        indices.push_back(i + row);
+        indices.push_back(i + row + 1);
+      }
+    }
+  };
+
+  // full node first, then the quadrants in selection bit order
+  std::vector<unsigned int> indices;
+  addCells(indices, 0, 0, gridSize);
+  fullCount = static_cast<GLsizei>(indices.size());
+
+  const int half = gridSize / 2;
+  for (int i = 0; i < 4; i++) {
+    addCells(indices, (i & 1) * half, (i >> 1) * half, half);
+  }
+  quadrantCount = (static_cast<GLsizei>(indices.size()) - fullCount) / 4;
+
+  glGenVertexArrays(1, &vao);
+  glGenBuffers(1, &vbo);
+  glGenBuffers(1, &ibo);
+
+  glBindVertexArray(vao);
+
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec2),
+               vertices.data(), GL_STATIC_DRAW);
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
+               indices.data(), GL_STATIC_DRAW);
+
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
+
+  glBindVertexArray(0);
+
+  // heights are fetched per vertex, no filtering
+  glGenTextures(1, &heightmap);
+  glBindTexture(GL_TEXTURE_2D, heightmap);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, field.Width(), field.Depth(), 0,
+               GL_RED, GL_FLOAT, field.Data());
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+CdlodRenderer::~CdlodRenderer() {
+  glDeleteTextures(1, &heightmap);
+  glDeleteBuffers(1, &ibo);
+  glDeleteBuffers(1, &vbo);
+  glDeleteVertexArrays(1, &vao);
+}
+
+void CdlodRenderer::Draw(ShaderProgram& shader,
+                         const CdlodQuadtree& tree,
+                         const std::vector<CdlodSelectedNode>& selection,
+                         float originX,
+                         float originZ,
+                         float spacing,
+                         float heightScale) const {
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, heightmap);
+
+  shader.setUniform("heightmap", 0);
+  shader.setUniform("gridDimension", static_cast<float>(gridSize));
+  shader.setUniform("terrainOrigin", glm::vec2(originX, originZ));
+  shader.setUniform("spacing", spacing);
+  shader.setUniform("heightScale", heightScale);
+
+  // set per node, resolved once per draw
+  const UniformHandle nodeOffset = shader.uniformHandle("nodeOffset");
+  const UniformHandle nodeSize = shader.uniformHandle("nodeSize");
+  const UniformHandle morphRange = shader.uniformHandle("morphRange");
+
+  glBindVertexArray(vao);
+  for (auto& node : selection) {
+    shader.setUniform(nodeOffset, glm::vec2(node.x, node.z));
+    shader.setUniform(nodeSize, static_cast<float>(node.size));
+    shader.setUniform(morphRange, glm::vec2(tree.MorphStart(node.level),
+                                            tree.Range(node.level)));
+
+    if (node.quadrants == 0xF) {
+      glDrawElements(GL_TRIANGLES, fullCount, GL_UNSIGNED_INT, 0);
+      continue;
+    }
+
+    for (int i = 0; i < 4; i++) {
+      if (node.quadrants & (1 << i)) {
+        size_t offset = (fullCount + i * quadrantCount) * sizeof(unsigned int);
+        glDrawElements(GL_TRIANGLES, quadrantCount, GL_UNSIGNED_INT,
+                       (void*)offset);
+      }
+    }
+  }
+  glBindVertexArray(0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
@@ -0,0 +1,384 @@
+
+#include <ChunkManager.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#include <Logger.hpp>
+
+using namespace terrain;
+
+namespace {
+
+int Distance(ChunkCoord a, ChunkCoord b) {
+  return std::max(std::abs(a.x - b.x), std::abs(a.z - b.z));
+}
+}  // namespace
+
+ChunkManager::ChunkManager(ChunkSettings settings,
+                           NoiseParameters parameters,
+                           std::shared_ptr<TileStore> store)
+    : settings{settings},
+      noise{GridParameters(parameters, settings.spacing)},
+      store{std::move(store)} {
+  if (this->store &&
+      this->store->Settings().resolution != settings.resolution + 2) {
+    throw std::runtime_error("Tile store resolution does not match chunks");
+  }
+
+  if (this->settings.maxResident == 0) {
+    size_t side = 2 * (this->settings.viewRadius + 1) + 1;
+    this->settings.maxResident = side * side;
+  }
+
+  auto indices = BuildGridIndices(this->settings.resolution);
+  indexCount = static_cast<GLsizei>(indices.size());
+
+  glGenBuffers(1, &ibo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
+               indices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+  if (this->settings.maxConcurrentBuilds == 0) {
+    this->settings.maxConcurrentBuilds =
+        jobs::JobSystem::GetInstance().WorkerCount();
+  }
+
+  LOG_INFO("Chunk streaming with " +
+           std::to_string(this->settings.maxConcurrentBuilds) +
+           " concurrent builds, " + std::to_string(this->settings.maxResident) +
+           " resident chunks");
+}
+
+ChunkManager::~ChunkManager() {
+  stopping = true;
+  for (auto& build : builds) {
+    try {
+      jobs::JobSystem::GetInstance().Wait(build);
+    } catch (const std::exception& e) {
+      logging::Logger::LogError(e.what());
+    }
+  }
+
+  for (auto& entry : resident) {
+    glDeleteVertexArrays(1, &entry.second.vao);
+    glDeleteBuffers(1, &entry.second.vbo);
+  }
+  glDeleteBuffers(1, &ibo);
+}
+
+float ChunkManager::ChunkSize() const {
+  return (settings.resolution - 1) * settings.spacing;
+}
+
+ChunkCoord ChunkManager::ChunkAt(const glm::vec3& position) const {
+  return ChunkCoord{static_cast<int>(std::floor(position.x / ChunkSize())),
+                    static_cast<int>(std::floor(position.z / ChunkSize()))};
+}
+
+void ChunkManager::BuildNext() {
+  if (stopping) {
+    return;
+  }
+
+  ChunkCoord coord;
+  {
+    std::lock_guard<std::mutex> lock(requestMutex);
+    if (requests.empty()) {
+      // cancelled after the job was submitted
+      return;
+    }
+
+    // closest to the camera first
+    auto next = std::min_element(
+        requests.begin(), requests.end(),
+        [this](const ChunkCoord& a, const ChunkCoord& b) {
+          return Distance(a, focus) < Distance(b, focus);
+        });
+    coord = *next;
+    *next = requests.back();
+    requests.pop_back();
+  }
+
+  auto build = Build(coord);
+
+  std::lock_guard<std::mutex> lock(completedMutex);
+  completed.push_back(std::move(build));
+}
+
+std::unique_ptr<ChunkManager::ChunkBuild> ChunkManager::Build(
+    ChunkCoord coord) const {
+  const int resolution = settings.resolution;
+  const int cells = resolution - 1;
+  const int firstX = coord.x * cells - 1;
+  const int firstZ = coord.z * cells - 1;
+
+  auto build = std::make_unique<ChunkBuild>();
+  build->coord = coord;
+
+  // a failing store only costs the regeneration, streaming carries on
+  if (store) {
+    try {
+      if (auto tile = store->Read(coord.x, coord.z)) {
+        BuildTerrainVertices(tile->Level(0), 1,
+                             static_cast<float>(firstX + 1),
+                             static_cast<float>(firstZ + 1), settings.spacing,
+                             settings.heightScale, build->vertices);
+        build->loaded = true;
+        return build;
+      }
+    } catch (const std::runtime_error& e) {
+      logging::Logger::LogError(e.what());
+    }
+  }
+
+  // one sample of apron on each side so normals are continuous across chunks
+  Heightfield field(resolution + 2, resolution + 2);
+  for (int z = 0; z < field.Depth(); z++) {
+    noise.FbmRow(static_cast<float>(firstX), static_cast<float>(firstZ + z),
+                 1.0f, field.Row(z), field.Width());
+  }
+
+  if (store) {
+    try {
+      store->Write(coord.x, coord.z, field);
+    } catch (const std::runtime_error& e) {
+      logging::Logger::LogError(e.what());
+    }
+  }
+
+  BuildTerrainVertices(field, 1, static_cast<float>(firstX + 1),
+                       static_cast<float>(firstZ + 1), settings.spacing,
+                       settings.heightScale, build->vertices);
+  return build;
+}
+
+void ChunkManager::Upload(ChunkBuild& build) {
+  Chunk chunk;
+  chunk.coord = build.coord;
+  chunk.lastUsedFrame = frame;
+
+  glGenVertexArrays(1, &chunk.vao);
+  glGenBuffers(1, &chunk.vbo);
+
+  glBindVertexArray(chunk.vao);
+  glBindBuffer(GL_ARRAY_BUFFER, chunk.vbo);
+  glBufferData(GL_ARRAY_BUFFER, build.vertices.size() * sizeof(TerrainVertex),
+               build.vertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+  SetupTerrainVertexAttributes();
+  glBindVertexArray(0);
+
+  for (auto& vertex : build.vertices) {
+    chunk.bounds.Expand(vertex.position);
+  }
+
+  resident[chunk.coord] = chunk;
+  hierarchyDirty = true;
+  if (build.loaded) {
+    stats.loaded++;
+  } else {
+    stats.generated++;
+  }
+}
+
+void ChunkManager::Update(const glm::vec3& cameraPos,
+                          const glm::vec3& cameraFront,
+                          float speed) {
+  frame++;
+  const ChunkCoord previous = center;
+  center = ChunkAt(cameraPos);
+  if (center != previous) {
+    hierarchyDirty = true;
+  }
+  const ChunkCoord ahead =
+      ChunkAt(cameraPos + cameraFront * (speed * settings.prefetchFrames));
+
+  auto wanted = [&](ChunkCoord coord) {
+    return Distance(coord, center) <= settings.viewRadius + 1 ||
+           Distance(coord, ahead) <= settings.prefetchRadius;
+  };
+
+  // upload a bounded number of finished chunks
+  std::vector<std::unique_ptr<ChunkBuild>> ready;
+  {
+    std::lock_guard<std::mutex> lock(completedMutex);
+    while (!completed.empty() &&
+           ready.size() < static_cast<size_t>(settings.maxUploadsPerFrame)) {
+      ready.push_back(std::move(completed.back()));
+      completed.pop_back();
+    }
+  }
+
+  for (auto& build : ready) {
+    if (wanted(build->coord) && resident.count(build->coord) == 0) {
+      Upload(*build);
+    } else {
+      stats.cancelled++;
+    }
+  }
+
+  // work out what is missing this frame
+  std::vector<ChunkCoord> missing;
+  for (int dz = -settings.viewRadius; dz <= settings.viewRadius; dz++) {
+    for (int dx = -settings.viewRadius; dx <= settings.viewRadius; dx++) {
+      ChunkCoord coord{center.x + dx, center.z + dz};
+      auto it = resident.find(coord);
+      if (it != resident.end()) {
+        it->second.lastUsedFrame = frame;
+        stats.hits++;
+      } else {
+        stats.misses++;
+        missing.push_back(coord);
+      }
+    }
+  }
+
+  std::vector<ChunkCoord> prefetch;
+  if (ahead != center) {
+    for (int dz = -settings.prefetchRadius; dz <= settings.prefetchRadius;
+         dz++) {
+      for (int dx = -settings.prefetchRadius; dx <= settings.prefetchRadius;
+           dx++) {
+        ChunkCoord coord{ahead.x + dx, ahead.z + dz};
+        auto it = resident.find(coord);
+        if (it != resident.end()) {
+          it->second.lastUsedFrame = frame;
+        } else if (Distance(coord, center) > settings.viewRadius) {
+          prefetch.push_back(coord);
+        }
+      }
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(requestMutex);
+    focus = center;
+
+    // drop requests the camera has moved away from
+    for (size_t i = 0; i < requests.size();) {
+      if (!wanted(requests[i])) {
+        inFlight.erase(requests[i]);
+        requests[i] = requests.back();
+        requests.pop_back();
+        stats.cancelled++;
+      } else {
+        i++;
+      }
+    }
+
+    for (auto& build : ready) {
+      inFlight.erase(build->coord);
+    }
+
+    for (auto& coord : missing) {
+      if (inFlight.insert(coord).second) {
+        requests.push_back(coord);
+      }
+    }
+    for (auto& coord : prefetch) {
+      if (inFlight.insert(coord).second) {
+        requests.push_back(coord);
+        stats.prefetches++;
+      }
+    }
+    stats.pending = inFlight.size();
+
+    // keep at most maxConcurrentBuilds jobs running, each builds one chunk
+    builds.erase(std::remove_if(builds.begin(), builds.end(),
+                                [](const jobs::JobHandle& job) {
+                                  return job->IsFinished();
+                                }),
+                 builds.end());
+    size_t jobCount = std::min<size_t>(
+        requests.size(), settings.maxConcurrentBuilds - builds.size());
+    for (size_t i = 0; i < jobCount; i++) {
+      builds.push_back(
+          jobs::JobSystem::GetInstance().Submit([this]() { BuildNext(); }));
+    }
+  }
+
+  Evict();
+}
+
+void ChunkManager::Evict() {
+  if (resident.size() <= settings.maxResident) {
+    return;
+  }
+
+  std::vector<const Chunk*> candidates;
+  for (auto& entry : resident) {
+    if (entry.second.lastUsedFrame != frame) {
+      candidates.push_back(&entry.second);
+    }
+  }
+
+  // least recently used first, furthest away breaking ties
+  std::sort(candidates.begin(), candidates.end(),
+            [this](const Chunk* a, const Chunk* b) {
+              if (a->lastUsedFrame != b->lastUsedFrame) {
+                return a->lastUsedFrame < b->lastUsedFrame;
+              }
+              return Distance(a->coord, center) > Distance(b->coord, center);
+            });
+
+  size_t excess = resident.size() - settings.maxResident;
+  std::vector<ChunkCoord> evicted;
+  for (size_t i = 0; i < candidates.size() && i < excess; i++) {
+    glDeleteVertexArrays(1, &candidates[i]->vao);
+    glDeleteBuffers(1, &candidates[i]->vbo);
+    evicted.push_back(candidates[i]->coord);
+  }
+
+  for (auto& coord : evicted) {
+    resident.erase(coord);
+    stats.evictions++;
+  }
+  if (!evicted.empty()) {
+    hierarchyDirty = true;
+  }
+}
+
+void ChunkManager::Draw(const camera::Frustum* frustum) {
+  if (hierarchyDirty) {
+    std::vector<camera::Aabb> boxes;
+    hierarchyCoords.clear();
+    for (auto& entry : resident) {
+      if (Distance(entry.first, center) <= settings.viewRadius) {
+        boxes.push_back(entry.second.bounds);
+        hierarchyCoords.push_back(entry.first);
+      }
+    }
+    hierarchy.Build(boxes);
+    hierarchyDirty = false;
+  }
+
+  if (frustum) {
+    hierarchy.Cull(*frustum, visible);
+  } else {
+    visible.resize(hierarchyCoords.size());
+    for (uint32_t i = 0; i < visible.size(); i++) {
+      visible[i] = i;
+    }
+  }
+
+  for (uint32_t i : visible) {
+    glBindVertexArray(resident.at(hierarchyCoords[i]).vao);
+    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+  }
+  glBindVertexArray(0);
+
+  stats.inRange = hierarchyCoords.size();
+  stats.visible = visible.size();
+}
+
+ChunkStats ChunkManager::Stats() {
+  ChunkStats result = stats;
+  result.resident = resident.size();
+  std::lock_guard<std::mutex> lock(requestMutex);
+  result.pending = inFlight.size();
+  return result;
+}
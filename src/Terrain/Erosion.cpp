@@ -0,0 +1,560 @@
+#include <Erosion.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#include <JobSystem.hpp>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+using namespace terrain;
+
+namespace {
+
+// Droplets simulated in lock step, fixed so every path runs them in the
+// same order.
+constexpr int Lanes = 8;
+
+inline uint64_t Mix(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ull;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+// uniform in [0, 1), 24 bits like a float mantissa
+inline float Unit(uint64_t bits) {
+  return static_cast<float>(bits >> 40) * (1.0f / 16777216.0f);
+}
+
+// Height and slope at lane positions. Positions must keep their four
+// neighbouring samples inside the grid.
+struct Samples {
+  float height[Lanes];
+  float gradientX[Lanes];
+  float gradientZ[Lanes];
+};
+
+void SampleScalar(const float* grid,
+                  int width,
+                  const float* xs,
+                  const float* zs,
+                  Samples& out) {
+  for (int l = 0; l < Lanes; l++) {
+    const float fx = std::floor(xs[l]);
+    const float fz = std::floor(zs[l]);
+    const size_t i =
+        static_cast<size_t>(fz) * width + static_cast<size_t>(fx);
+    const float h00 = grid[i];
+    const float h10 = grid[i + 1];
+    const float h01 = grid[i + width];
+    const float h11 = grid[i + width + 1];
+
+    const float u = xs[l] - fx;
+    const float v = zs[l] - fz;
+    const float iu = 1.0f - u;
+    const float iv = 1.0f - v;
+    out.gradientX[l] = (h10 - h00) * iv + (h11 - h01) * v;
+    out.gradientZ[l] = (h01 - h00) * iu + (h11 - h10) * u;
+    out.height[l] =
+        h00 * iu * iv + h10 * u * iv + h01 * iu * v + h11 * u * v;
+  }
+}
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+namespace simd {
+#if defined(__AVX2__)
+constexpr int Width = 8;
+using Float = __m256;
+
+inline Float Set(float v) { return _mm256_set1_ps(v); }
+inline Float Load(const float* p) { return _mm256_loadu_ps(p); }
+inline void Store(float* p, Float a) { _mm256_storeu_ps(p, a); }
+inline Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+inline Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+inline Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+inline Float Floor(Float a) { return _mm256_floor_ps(a); }
+
+// the four samples around each lane
+inline void Corners(const float* grid,
+                    int width,
+                    Float fx,
+                    Float fz,
+                    Float& h00,
+                    Float& h10,
+                    Float& h01,
+                    Float& h11) {
+  const __m256i index =
+      _mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvttps_epi32(fz),
+                                          _mm256_set1_epi32(width)),
+                       _mm256_cvttps_epi32(fx));
+  const __m256i right = _mm256_add_epi32(index, _mm256_set1_epi32(1));
+  const __m256i below = _mm256_add_epi32(index, _mm256_set1_epi32(width));
+  const __m256i diagonal = _mm256_add_epi32(below, _mm256_set1_epi32(1));
+  h00 = _mm256_i32gather_ps(grid, index, 4);
+  h10 = _mm256_i32gather_ps(grid, right, 4);
+  h01 = _mm256_i32gather_ps(grid, below, 4);
+  h11 = _mm256_i32gather_ps(grid, diagonal, 4);
+}
+#else
+constexpr int Width = 4;
+using Float = __m128;
+
+inline Float Set(float v) { return _mm_set1_ps(v); }
+inline Float Load(const float* p) { return _mm_loadu_ps(p); }
+inline void Store(float* p, Float a) { _mm_storeu_ps(p, a); }
+inline Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+inline Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+inline Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+inline Float Floor(Float a) { return _mm_floor_ps(a); }
+
+// no gather before AVX2, the corners are loaded one lane at a time
+inline void Corners(const float* grid,
+                    int width,
+                    Float fx,
+                    Float fz,
+                    Float& h00,
+                    Float& h10,
+                    Float& h01,
+                    Float& h11) {
+  alignas(16) int32_t index[4];
+  _mm_store_si128(reinterpret_cast<__m128i*>(index),
+                  _mm_add_epi32(_mm_mullo_epi32(_mm_cvttps_epi32(fz),
+                                                _mm_set1_epi32(width)),
+                                _mm_cvttps_epi32(fx)));
+  const float* p[4] = {grid + index[0], grid + index[1], grid + index[2],
+                       grid + index[3]};
+  h00 = _mm_setr_ps(p[0][0], p[1][0], p[2][0], p[3][0]);
+  h10 = _mm_setr_ps(p[0][1], p[1][1], p[2][1], p[3][1]);
+  h01 = _mm_setr_ps(p[0][width], p[1][width], p[2][width], p[3][width]);
+  h11 = _mm_setr_ps(p[0][width + 1], p[1][width + 1], p[2][width + 1],
+                    p[3][width + 1]);
+}
+#endif
+
+void Sample(const float* grid,
+            int width,
+            const float* xs,
+            const float* zs,
+            Samples& out) {
+  const Float one = Set(1.0f);
+  for (int l = 0; l < Lanes; l += Width) {
+    const Float x = Load(xs + l);
+    const Float z = Load(zs + l);
+    const Float fx = Floor(x);
+    const Float fz = Floor(z);
+    Float h00, h10, h01, h11;
+    Corners(grid, width, fx, fz, h00, h10, h01, h11);
+
+    const Float u = Sub(x, fx);
+    const Float v = Sub(z, fz);
+    const Float iu = Sub(one, u);
+    const Float iv = Sub(one, v);
+    Store(out.gradientX + l,
+          Add(Mul(Sub(h10, h00), iv), Mul(Sub(h11, h01), v)));
+    Store(out.gradientZ + l,
+          Add(Mul(Sub(h01, h00), iu), Mul(Sub(h11, h10), u)));
+    Store(out.height + l,
+          Add(Add(Add(Mul(Mul(h00, iu), iv), Mul(Mul(h10, u), iv)),
+                  Mul(Mul(h01, iu), v)),
+              Mul(Mul(h11, u), v)));
+  }
+}
+}  // namespace simd
+#endif
+
+void Sample(const float* grid,
+            int width,
+            const float* xs,
+            const float* zs,
+            Samples& out,
+            bool vectorised) {
+#if defined(__AVX2__) || defined(__SSE4_1__)
+  if (vectorised) {
+    simd::Sample(grid, width, xs, zs, out);
+    return;
+  }
+#endif
+  SampleScalar(grid, width, xs, zs, out);
+}
+
+// Weights of the tiles covering each sample along one axis. The ramps of
+// neighbouring tiles add up to one over their overlap, the outer edges of
+// the field are not ramped.
+struct AxisWeight {
+  int tile[2];
+  float weight[2];
+  int count = 0;
+};
+
+std::vector<AxisWeight> AxisWeights(int size, int tileSize, int overlap) {
+  const int tiles = (size + tileSize - 1) / tileSize;
+  std::vector<AxisWeight> result(size);
+  for (int x = 0; x < size; x++) {
+    AxisWeight& axis = result[x];
+    const int home = x / tileSize;
+    for (int t = std::max(0, home - 1); t <= std::min(tiles - 1, home + 1);
+         t++) {
+      const float centre = static_cast<float>(x) + 0.5f;
+      float rise = 1.0f;
+      if (t > 0) {
+        rise = (centre - static_cast<float>(t * tileSize - overlap)) /
+               static_cast<float>(2 * overlap);
+      }
+      float fall = 1.0f;
+      if (t < tiles - 1) {
+        fall = (static_cast<float>((t + 1) * tileSize + overlap) - centre) /
+               static_cast<float>(2 * overlap);
+      }
+      const float weight =
+          std::clamp(rise, 0.0f, 1.0f) * std::clamp(fall, 0.0f, 1.0f);
+      if (weight > 0.0f) {
+        axis.tile[axis.count] = t;
+        axis.weight[axis.count] = weight;
+        axis.count++;
+      }
+    }
+  }
+  return result;
+}
+
+struct Tile {
+  int x0, z0;
+  int width, depth;
+  std::vector<float> grid;
+};
+}  // namespace
+
+HydraulicErosion::HydraulicErosion(ErosionSettings settings)
+    : settings{settings} {
+  this->settings.tileSize = std::max(this->settings.tileSize, 8);
+  // wider overlaps would let three tiles share a sample
+  this->settings.tileOverlap = std::clamp(this->settings.tileOverlap, 1,
+                                          this->settings.tileSize / 2);
+  this->settings.radius = std::max(this->settings.radius, 0);
+
+  const int r = this->settings.radius;
+  float total = 0.0f;
+  for (int dz = -r; dz <= r; dz++) {
+    for (int dx = -r; dx <= r; dx++) {
+      const float distance = std::sqrt(static_cast<float>(dx * dx + dz * dz));
+      const float weight = static_cast<float>(r) + 1.0f - distance;
+      if (distance <= static_cast<float>(r) && weight > 0.0f) {
+        brush.push_back(BrushTap{dx, dz, weight});
+        total += weight;
+      }
+    }
+  }
+  for (auto& tap : brush) {
+    tap.weight /= total;
+  }
+}
+
+void HydraulicErosion::ErodeTile(std::vector<float>& grid,
+                                 int width,
+                                 int depth,
+                                 int droplets,
+                                 uint32_t tile,
+                                 bool simd) const {
+  // a droplet needs its four corners inside the tile
+  const float maxX = static_cast<float>(width - 1);
+  const float maxZ = static_cast<float>(depth - 1);
+  const uint64_t stream =
+      (static_cast<uint64_t>(settings.seed) << 32) ^ (uint64_t{tile} << 20);
+
+  float x[Lanes], z[Lanes], dirX[Lanes], dirZ[Lanes];
+  float speed[Lanes], water[Lanes], sediment[Lanes];
+  float oldX[Lanes], oldZ[Lanes];
+  int life[Lanes];
+  bool alive[Lanes];
+  Samples here, there;
+
+  int next = 0;
+  auto spawn = [&](int l) {
+    alive[l] = next < droplets;
+    if (alive[l]) {
+      const uint64_t key = stream + static_cast<uint64_t>(next++);
+      x[l] = Unit(Mix(key * 2)) * maxX;
+      z[l] = Unit(Mix(key * 2 + 1)) * maxZ;
+    } else {
+      // parked where sampling stays in bounds
+      x[l] = z[l] = 0.0f;
+    }
+    dirX[l] = dirZ[l] = 0.0f;
+    speed[l] = 1.0f;
+    water[l] = 1.0f;
+    sediment[l] = 0.0f;
+    life[l] = 0;
+  };
+  for (int l = 0; l < Lanes; l++) {
+    spawn(l);
+  }
+
+  float* heights = grid.data();
+  bool any = true;
+  while (any) {
+    Sample(heights, width, x, z, here, simd);
+
+    // follow the slope, keeping some of the previous direction
+    for (int l = 0; l < Lanes; l++) {
+      oldX[l] = x[l];
+      oldZ[l] = z[l];
+      if (!alive[l]) {
+        continue;
+      }
+      dirX[l] = dirX[l] * settings.inertia -
+                here.gradientX[l] * (1.0f - settings.inertia);
+      dirZ[l] = dirZ[l] * settings.inertia -
+                here.gradientZ[l] * (1.0f - settings.inertia);
+      const float length = std::sqrt(dirX[l] * dirX[l] + dirZ[l] * dirZ[l]);
+      if (length == 0.0f) {
+        alive[l] = false;
+        continue;
+      }
+      const float nx = x[l] + dirX[l] / length;
+      const float nz = z[l] + dirZ[l] / length;
+      if (!(nx >= 0.0f && nx < maxX && nz >= 0.0f && nz < maxZ)) {
+        // leaves the tile, its sediment leaves with it
+        alive[l] = false;
+        continue;
+      }
+      dirX[l] /= length;
+      dirZ[l] /= length;
+      x[l] = nx;
+      z[l] = nz;
+    }
+
+    Sample(heights, width, x, z, there, simd);
+
+    // each droplet changes the ground where it was, in lane order
+    for (int l = 0; l < Lanes; l++) {
+      if (!alive[l]) {
+        continue;
+      }
+      const int cx = static_cast<int>(oldX[l]);
+      const int cz = static_cast<int>(oldZ[l]);
+      const float u = oldX[l] - static_cast<float>(cx);
+      const float v = oldZ[l] - static_cast<float>(cz);
+      const size_t cell = static_cast<size_t>(cz) * width + cx;
+
+      const float delta = there.height[l] - here.height[l];
+      const float capacity =
+          std::max(-delta * speed[l] * water[l] * settings.capacity,
+                   settings.minCapacity);
+
+      if (sediment[l] > capacity || delta > 0.0f) {
+        // uphill it fills the pit behind it, otherwise it drops the excess
+        const float deposit =
+            delta > 0.0f ? std::min(delta, sediment[l])
+                         : (sediment[l] - capacity) * settings.depositSpeed;
+        sediment[l] -= deposit;
+        heights[cell] += deposit * (1.0f - u) * (1.0f - v);
+        heights[cell + 1] += deposit * u * (1.0f - v);
+        heights[cell + width] += deposit * (1.0f - u) * v;
+        heights[cell + width + 1] += deposit * u * v;
+      } else {
+        // never dig deeper than the drop in front of it
+        const float erode =
+            std::min((capacity - sediment[l]) * settings.erodeSpeed, -delta);
+        for (auto& tap : brush) {
+          const int tx = cx + tap.dx;
+          const int tz = cz + tap.dz;
+          if (tx < 0 || tx >= width || tz < 0 || tz >= depth) {
+            continue;
+          }
+          heights[static_cast<size_t>(tz) * width + tx] -= erode * tap.weight;
+          sediment[l] += erode * tap.weight;
+        }
+      }
+
+      speed[l] = std::sqrt(
+          std::max(speed[l] * speed[l] + delta * settings.gravity, 0.0f));
+      water[l] *= 1.0f - settings.evaporateSpeed;
+      if (++life[l] >= settings.maxLifetime) {
+        alive[l] = false;
+      }
+    }
+
+    any = false;
+    for (int l = 0; l < Lanes; l++) {
+      if (!alive[l]) {
+        spawn(l);
+      }
+      any = any || alive[l];
+    }
+  }
+}
+
+void HydraulicErosion::Run(Heightfield& field,
+                           jobs::JobSystem* jobs,
+                           bool simd) const {
+  const int width = field.Width();
+  const int depth = field.Depth();
+  if (width < 2 || depth < 2 || settings.droplets <= 0) {
+    return;
+  }
+
+  const int size = settings.tileSize;
+  const int overlap = settings.tileOverlap;
+  const int tilesX = (width + size - 1) / size;
+  const int tilesZ = (depth + size - 1) / size;
+  const double density = static_cast<double>(settings.droplets) /
+                         (static_cast<double>(width) * depth);
+
+  // every tile starts from the original heights, so none depends on another
+  std::vector<Tile> tiles(static_cast<size_t>(tilesX) * tilesZ);
+  auto erode = [&](int first, int last) {
+    for (int t = first; t < last; t++) {
+      Tile& tile = tiles[t];
+      const int tx = t % tilesX;
+      const int tz = t / tilesX;
+      tile.x0 = std::max(0, tx * size - overlap);
+      tile.z0 = std::max(0, tz * size - overlap);
+      tile.width = std::min(width, (tx + 1) * size + overlap) - tile.x0;
+      tile.depth = std::min(depth, (tz + 1) * size + overlap) - tile.z0;
+      if (tile.width < 2 || tile.depth < 2) {
+        continue;
+      }
+
+      tile.grid.resize(static_cast<size_t>(tile.width) * tile.depth);
+      for (int z = 0; z < tile.depth; z++) {
+        const float* row = field.Row(tile.z0 + z) + tile.x0;
+        float* out = &tile.grid[static_cast<size_t>(z) * tile.width];
+        for (int x = 0; x < tile.width; x++) {
+          out[x] = row[x] * settings.verticalScale;
+        }
+      }
+
+      const int droplets = static_cast<int>(
+          std::lround(density * tile.width * tile.depth));
+      ErodeTile(tile.grid, tile.width, tile.depth, droplets,
+                static_cast<uint32_t>(t), simd);
+    }
+  };
+
+  const std::vector<AxisWeight> weightsX = AxisWeights(width, size, overlap);
+  const std::vector<AxisWeight> weightsZ = AxisWeights(depth, size, overlap);
+  const float inverseScale = 1.0f / settings.verticalScale;
+  auto blend = [&](int first, int last) {
+    for (int z = first; z < last; z++) {
+      float* row = field.Row(z);
+      const AxisWeight& wz = weightsZ[z];
+      for (int x = 0; x < width; x++) {
+        const AxisWeight& wx = weightsX[x];
+        float sum = 0.0f;
+        for (int j = 0; j < wz.count; j++) {
+          for (int i = 0; i < wx.count; i++) {
+            const Tile& tile = tiles[wz.tile[j] * tilesX + wx.tile[i]];
+            sum += wz.weight[j] * wx.weight[i] *
+                   tile.grid[static_cast<size_t>(z - tile.z0) * tile.width +
+                             (x - tile.x0)];
+          }
+        }
+        row[x] = sum * inverseScale;
+      }
+    }
+  };
+
+  if (jobs) {
+    jobs->ParallelFor(0, static_cast<int>(tiles.size()), 1, erode);
+    jobs->ParallelFor(0, depth, 16, blend);
+  } else {
+    erode(0, static_cast<int>(tiles.size()));
+    blend(0, depth);
+  }
+}
+
+void HydraulicErosion::Erode(Heightfield& field, jobs::JobSystem& jobs) const {
+  Run(field, &jobs, true);
+}
+
+void HydraulicErosion::Erode(Heightfield& field) const {
+  Run(field, nullptr, true);
+}
+
+void HydraulicErosion::ErodeReference(Heightfield& field) const {
+  Run(field, nullptr, false);
+}
+
+size_t HydraulicErosion::DropletCount(int width, int depth) const {
+  const int size = settings.tileSize;
+  const int overlap = settings.tileOverlap;
+  const double density = static_cast<double>(settings.droplets) /
+                         (static_cast<double>(width) * depth);
+  size_t total = 0;
+  for (int tz = 0; tz * size < depth; tz++) {
+    for (int tx = 0; tx * size < width; tx++) {
+      const int w = std::min(width, (tx + 1) * size + overlap) -
+                    std::max(0, tx * size - overlap);
+      const int d = std::min(depth, (tz + 1) * size + overlap) -
+                    std::max(0, tz * size - overlap);
+      total += static_cast<size_t>(std::lround(density * w * d));
+    }
+  }
+  return total;
+}
+
+const char* HydraulicErosion::SimdPath() {
+#if defined(__AVX2__)
+  return "AVX2";
+#elif defined(__SSE4_1__)
+  return "SSE4.1";
+#else
+  return "scalar";
+#endif
+}
+
+std::vector<ErosionBenchmark> terrain::BenchmarkErosion(
+    const Heightfield& field,
+    const ErosionSettings& settings) {
+  using Clock = std::chrono::steady_clock;
+  const HydraulicErosion erosion{settings};
+  const double droplets = static_cast<double>(
+      erosion.DropletCount(field.Width(), field.Depth()));
+
+  Heightfield reference = field;
+  erosion.ErodeReference(reference);
+  auto same = [&](const Heightfield& eroded) {
+    return std::memcmp(eroded.Data(), reference.Data(),
+                       reference.Size() * sizeof(float)) == 0;
+  };
+
+  const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<ErosionBenchmark> results;
+  for (unsigned threads = 1;; threads = std::min(threads * 2, cores)) {
+    Heightfield eroded = field;
+    ErosionBenchmark result;
+    result.threads = threads;
+
+    if (threads == 1) {
+      auto start = Clock::now();
+      erosion.Erode(eroded);
+      result.milliseconds =
+          std::chrono::duration<double, std::milli>(Clock::now() - start)
+              .count();
+    } else {
+      // the calling thread helps while it waits, one worker fewer
+      jobs::JobSystem pool(threads - 1);
+      auto start = Clock::now();
+      erosion.Erode(eroded, pool);
+      result.milliseconds =
+          std::chrono::duration<double, std::milli>(Clock::now() - start)
+              .count();
+    }
+
+    result.dropletsPerSecond = droplets / (result.milliseconds / 1000.0);
+    result.matches = same(eroded);
+    results.push_back(result);
+    if (threads >= cores) {
+      break;
+    }
+  }
+  return results;
+}
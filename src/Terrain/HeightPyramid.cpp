@@ -0,0 +1,616 @@
+#include <HeightPyramid.hpp>
+#include <Logger.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+using namespace terrain;
+
+namespace {
+
+// Clips [enter, exit] to where origin + t * direction lies in [low, high]
+// along one axis.
+inline bool Clip(float origin,
+                 float direction,
+                 float inverse,
+                 float low,
+                 float high,
+                 float& enter,
+                 float& exit) {
+  if (direction == 0.0f) {
+    return origin >= low && origin <= high;
+  }
+  float near = (low - origin) * inverse;
+  float far = (high - origin) * inverse;
+  if (near > far) {
+    std::swap(near, far);
+  }
+  enter = std::max(enter, near);
+  exit = std::min(exit, far);
+  return enter <= exit;
+}
+
+// Bilinear height at grid coordinates. Coordinates are clamped to the grid
+// and the cell to the last full one, so u and v may reach 1 on the far
+// edges.
+inline float HeightScalar(const float* grid,
+                          int width,
+                          int depth,
+                          float gx,
+                          float gz) {
+  gx = std::min(std::max(gx, 0.0f), static_cast<float>(width - 1));
+  gz = std::min(std::max(gz, 0.0f), static_cast<float>(depth - 1));
+  const float fx = std::min(std::floor(gx), static_cast<float>(width - 2));
+  const float fz = std::min(std::floor(gz), static_cast<float>(depth - 2));
+  const size_t i = static_cast<size_t>(fz) * width + static_cast<size_t>(fx);
+  const float h00 = grid[i];
+  const float h10 = grid[i + 1];
+  const float h01 = grid[i + width];
+  const float h11 = grid[i + width + 1];
+
+  const float u = gx - fx;
+  const float v = gz - fz;
+  const float iu = 1.0f - u;
+  const float iv = 1.0f - v;
+  return h00 * iu * iv + h10 * u * iv + h01 * iu * v + h11 * u * v;
+}
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+namespace simd {
+#if defined(__AVX2__)
+constexpr int Width = 8;
+using Float = __m256;
+
+inline Float Set(float v) { return _mm256_set1_ps(v); }
+inline Float Load(const float* p) { return _mm256_loadu_ps(p); }
+inline void Store(float* p, Float a) { _mm256_storeu_ps(p, a); }
+inline Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+inline Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+inline Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+inline Float Min(Float a, Float b) { return _mm256_min_ps(a, b); }
+inline Float Max(Float a, Float b) { return _mm256_max_ps(a, b); }
+inline Float Floor(Float a) { return _mm256_floor_ps(a); }
+
+inline void Corners(const float* grid,
+                    int width,
+                    Float fx,
+                    Float fz,
+                    Float& h00,
+                    Float& h10,
+                    Float& h01,
+                    Float& h11) {
+  const __m256i index =
+      _mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvttps_epi32(fz),
+                                          _mm256_set1_epi32(width)),
+                       _mm256_cvttps_epi32(fx));
+  const __m256i right = _mm256_add_epi32(index, _mm256_set1_epi32(1));
+  const __m256i below = _mm256_add_epi32(index, _mm256_set1_epi32(width));
+  const __m256i diagonal = _mm256_add_epi32(below, _mm256_set1_epi32(1));
+  h00 = _mm256_i32gather_ps(grid, index, 4);
+  h10 = _mm256_i32gather_ps(grid, right, 4);
+  h01 = _mm256_i32gather_ps(grid, below, 4);
+  h11 = _mm256_i32gather_ps(grid, diagonal, 4);
+}
+#else
+constexpr int Width = 4;
+using Float = __m128;
+
+inline Float Set(float v) { return _mm_set1_ps(v); }
+inline Float Load(const float* p) { return _mm_loadu_ps(p); }
+inline void Store(float* p, Float a) { _mm_storeu_ps(p, a); }
+inline Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+inline Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+inline Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+inline Float Min(Float a, Float b) { return _mm_min_ps(a, b); }
+inline Float Max(Float a, Float b) { return _mm_max_ps(a, b); }
+inline Float Floor(Float a) { return _mm_floor_ps(a); }
+
+inline void Corners(const float* grid,
+                    int width,
+                    Float fx,
+                    Float fz,
+                    Float& h00,
+                    Float& h10,
+                    Float& h01,
+                    Float& h11) {
+  alignas(16) int32_t index[4];
+  _mm_store_si128(reinterpret_cast<__m128i*>(index),
+                  _mm_add_epi32(_mm_mullo_epi32(_mm_cvttps_epi32(fz),
+                                                _mm_set1_epi32(width)),
+                                _mm_cvttps_epi32(fx)));
+  const float* p[4] = {grid + index[0], grid + index[1], grid + index[2],
+                       grid + index[3]};
+  h00 = _mm_setr_ps(p[0][0], p[1][0], p[2][0], p[3][0]);
+  h10 = _mm_setr_ps(p[0][1], p[1][1], p[2][1], p[3][1]);
+  h01 = _mm_setr_ps(p[0][width], p[1][width], p[2][width], p[3][width]);
+  h11 = _mm_setr_ps(p[0][width + 1], p[1][width + 1], p[2][width + 1],
+                    p[3][width + 1]);
+}
+#endif
+
+// Whole vectors only, returns how many points were done.
+size_t Heights(const float* grid,
+               int width,
+               int depth,
+               float originX,
+               float originZ,
+               float inverseSpacing,
+               const float* xs,
+               const float* zs,
+               float* out,
+               size_t count) {
+  const Float zero = Set(0.0f);
+  const Float one = Set(1.0f);
+  const Float lastX = Set(static_cast<float>(width - 1));
+  const Float lastZ = Set(static_cast<float>(depth - 1));
+  const Float cellX = Set(static_cast<float>(width - 2));
+  const Float cellZ = Set(static_cast<float>(depth - 2));
+  const Float ox = Set(originX);
+  const Float oz = Set(originZ);
+  const Float scale = Set(inverseSpacing);
+
+  size_t i = 0;
+  for (; i + Width <= count; i += Width) {
+    const Float gx =
+        Min(Max(Mul(Sub(Load(xs + i), ox), scale), zero), lastX);
+    const Float gz =
+        Min(Max(Mul(Sub(Load(zs + i), oz), scale), zero), lastZ);
+    const Float fx = Min(Floor(gx), cellX);
+    const Float fz = Min(Floor(gz), cellZ);
+    Float h00, h10, h01, h11;
+    Corners(grid, width, fx, fz, h00, h10, h01, h11);
+
+    const Float u = Sub(gx, fx);
+    const Float v = Sub(gz, fz);
+    const Float iu = Sub(one, u);
+    const Float iv = Sub(one, v);
+    Store(out + i,
+          Add(Add(Add(Mul(Mul(h00, iu), iv), Mul(Mul(h10, u), iv)),
+                  Mul(Mul(h01, iu), v)),
+              Mul(Mul(h11, u), v)));
+  }
+  return i;
+}
+}  // namespace simd
+#endif
+}  // namespace
+
+HeightPyramid::HeightPyramid(const Heightfield& field,
+                             float heightScale,
+                             float spacing,
+                             float originX,
+                             float originZ)
+    : width{field.Width()},
+      depth{field.Depth()},
+      spacing{spacing},
+      originX{originX},
+      originZ{originZ},
+      heights(field.Size()) {
+  if (width < 2 || depth < 2) {
+    throw std::runtime_error{"A height pyramid needs at least 2x2 samples"};
+  }
+  for (size_t i = 0; i < heights.size(); i++) {
+    heights[i] = field.Data()[i] * heightScale;
+  }
+
+  // level 0: one node per cell, from its four corners
+  int levelWidth = width - 1;
+  int levelDepth = depth - 1;
+  std::vector<float> lows(static_cast<size_t>(levelWidth) * levelDepth);
+  std::vector<float> highs(lows.size());
+  for (int z = 0; z < levelDepth; z++) {
+    const float* row = &heights[static_cast<size_t>(z) * width];
+    for (int x = 0; x < levelWidth; x++) {
+      const float h00 = row[x];
+      const float h10 = row[x + 1];
+      const float h01 = row[x + width];
+      const float h11 = row[x + width + 1];
+      const size_t i = static_cast<size_t>(z) * levelWidth + x;
+      lows[i] = std::min(std::min(h00, h10), std::min(h01, h11));
+      highs[i] = std::max(std::max(h00, h10), std::max(h01, h11));
+    }
+  }
+  minHeights.push_back(std::move(lows));
+  maxHeights.push_back(std::move(highs));
+  levelWidths.push_back(levelWidth);
+  levelDepths.push_back(levelDepth);
+
+  // halve until one node is left, odd edges keep a node of one child
+  while (levelWidth > 1 || levelDepth > 1) {
+    const int childWidth = levelWidth;
+    const int childDepth = levelDepth;
+    levelWidth = (levelWidth + 1) / 2;
+    levelDepth = (levelDepth + 1) / 2;
+    const std::vector<float>& childLows = minHeights.back();
+    const std::vector<float>& childHighs = maxHeights.back();
+    lows.assign(static_cast<size_t>(levelWidth) * levelDepth, FLT_MAX);
+    highs.assign(lows.size(), -FLT_MAX);
+    for (int z = 0; z < childDepth; z++) {
+      for (int x = 0; x < childWidth; x++) {
+        const size_t child = static_cast<size_t>(z) * childWidth + x;
+        const size_t parent =
+            static_cast<size_t>(z / 2) * levelWidth + x / 2;
+        lows[parent] = std::min(lows[parent], childLows[child]);
+        highs[parent] = std::max(highs[parent], childHighs[child]);
+      }
+    }
+    minHeights.push_back(std::move(lows));
+    maxHeights.push_back(std::move(highs));
+    levelWidths.push_back(levelWidth);
+    levelDepths.push_back(levelDepth);
+  }
+}
+
+float HeightPyramid::Height(float x, float z) const {
+  const float scale = 1.0f / spacing;
+  return HeightScalar(heights.data(), width, depth, (x - originX) * scale,
+                      (z - originZ) * scale);
+}
+
+glm::vec3 HeightPyramid::Normal(float x, float z) const {
+  const float scale = 1.0f / spacing;
+  const float gx = std::min(std::max((x - originX) * scale, 0.0f),
+                            static_cast<float>(width - 1));
+  const float gz = std::min(std::max((z - originZ) * scale, 0.0f),
+                            static_cast<float>(depth - 1));
+  const float fx = std::min(std::floor(gx), static_cast<float>(width - 2));
+  const float fz = std::min(std::floor(gz), static_cast<float>(depth - 2));
+  const size_t i = static_cast<size_t>(fz) * width + static_cast<size_t>(fx);
+  const float h00 = heights[i];
+  const float h10 = heights[i + 1];
+  const float h01 = heights[i + width];
+  const float h11 = heights[i + width + 1];
+
+  const float u = gx - fx;
+  const float v = gz - fz;
+  const float slopeX = ((h10 - h00) * (1.0f - v) + (h11 - h01) * v) * scale;
+  const float slopeZ = ((h01 - h00) * (1.0f - u) + (h11 - h10) * u) * scale;
+  return glm::normalize(glm::vec3(-slopeX, 1.0f, -slopeZ));
+}
+
+void HeightPyramid::Heights(const float* xs,
+                            const float* zs,
+                            float* out,
+                            size_t count,
+                            bool simd) const {
+  const float scale = 1.0f / spacing;
+  size_t i = 0;
+#if defined(__AVX2__) || defined(__SSE4_1__)
+  if (simd) {
+    i = simd::Heights(heights.data(), width, depth, originX, originZ, scale,
+                      xs, zs, out, count);
+  }
+#endif
+  for (; i < count; i++) {
+    out[i] = HeightScalar(heights.data(), width, depth,
+                          (xs[i] - originX) * scale,
+                          (zs[i] - originZ) * scale);
+  }
+}
+
+// The ray is in grid space: x and z in cells from the corner of the grid, y
+// in world units, so t is still the world distance. The height along the
+// ray minus the bilinear surface is a quadratic in t; the first root inside
+// the cell is the hit.
+bool HeightPyramid::IntersectCell(int x,
+                                  int z,
+                                  const glm::vec3& origin,
+                                  const glm::vec3& direction,
+                                  float enter,
+                                  float exit,
+                                  float& distance) const {
+  const float* row = &heights[static_cast<size_t>(z) * width + x];
+  const float h00 = row[0];
+  const float b = row[1] - h00;
+  const float c = row[width] - h00;
+  const float e = h00 - row[1] - row[width] + row[width + 1];
+
+  // restart the ray where it enters the cell, keeps the terms small
+  const float u = origin.x + direction.x * enter - x;
+  const float v = origin.z + direction.z * enter - z;
+  const float y = origin.y + direction.y * enter;
+  const float qa = -e * direction.x * direction.z;
+  const float qb = direction.y - (b * direction.x + c * direction.z +
+                                  e * (u * direction.z + v * direction.x));
+  const float qc = y - (h00 + b * u + c * v + e * u * v);
+
+  // entered below the surface: it was crossed on the boundary
+  if (qc <= 0.0f) {
+    distance = enter;
+    return true;
+  }
+
+  float s = FLT_MAX;
+  if (std::abs(qa) < 1e-12f) {
+    if (qb < 0.0f) {
+      s = -qc / qb;
+    }
+  } else {
+    const float discriminant = qb * qb - 4.0f * qa * qc;
+    if (discriminant < 0.0f) {
+      return false;
+    }
+    // the stable pair of roots, q is not zero as qc is positive
+    const float q = -0.5f * (qb + std::copysign(std::sqrt(discriminant), qb));
+    for (float root : {q / qa, qc / q}) {
+      if (root >= 0.0f && root < s) {
+        s = root;
+      }
+    }
+  }
+  if (s > exit - enter) {
+    return false;
+  }
+  distance = enter + s;
+  return true;
+}
+
+bool HeightPyramid::Raycast(const glm::vec3& origin,
+                            const glm::vec3& direction,
+                            float maxDistance,
+                            RayHit& hit) const {
+  const float length = glm::length(direction);
+  if (length == 0.0f) {
+    return false;
+  }
+  const glm::vec3 unit = direction / length;
+  const glm::vec3 o((origin.x - originX) / spacing, origin.y,
+                    (origin.z - originZ) / spacing);
+  const glm::vec3 d(unit.x / spacing, unit.y, unit.z / spacing);
+  const glm::vec3 inverse(1.0f / d.x, 1.0f / d.y, 1.0f / d.z);
+
+  if (Contains(origin.x, origin.z) && o.y <= Height(origin.x, origin.z)) {
+    hit.distance = 0.0f;
+    hit.position = origin;
+    return true;
+  }
+
+  // children are pushed so the one the ray reaches first is popped first;
+  // visiting 2x2 children in index order flipped by the direction signs is
+  // front to back, so the first cell hit holds the nearest hit
+  struct Node {
+    int level;
+    int x;
+    int z;
+  };
+  Node stack[3 * 32 + 1];
+  int top = 0;
+  stack[top++] = Node{Levels() - 1, 0, 0};
+  const int flip = (d.x < 0.0f ? 1 : 0) | (d.z < 0.0f ? 2 : 0);
+  const float lastX = static_cast<float>(width - 1);
+  const float lastZ = static_cast<float>(depth - 1);
+
+  while (top > 0) {
+    const Node node = stack[--top];
+    const int levelWidth = levelWidths[node.level];
+    const size_t i = static_cast<size_t>(node.z) * levelWidth + node.x;
+    const float x0 = static_cast<float>(node.x << node.level);
+    const float z0 = static_cast<float>(node.z << node.level);
+    const float x1 = std::min(static_cast<float>((node.x + 1) << node.level),
+                              lastX);
+    const float z1 = std::min(static_cast<float>((node.z + 1) << node.level),
+                              lastZ);
+
+    float enter = 0.0f;
+    float exit = maxDistance;
+    if (!Clip(o.x, d.x, inverse.x, x0, x1, enter, exit) ||
+        !Clip(o.z, d.z, inverse.z, z0, z1, enter, exit) ||
+        !Clip(o.y, d.y, inverse.y, minHeights[node.level][i],
+              maxHeights[node.level][i], enter, exit)) {
+      continue;
+    }
+
+    if (node.level == 0) {
+      float distance;
+      if (IntersectCell(node.x, node.z, o, d, enter, exit, distance)) {
+        hit.distance = distance;
+        hit.position = origin + unit * distance;
+        return true;
+      }
+      continue;
+    }
+
+    const int childLevel = node.level - 1;
+    for (int k = 3; k >= 0; k--) {
+      const int child = k ^ flip;
+      const int cx = 2 * node.x + (child & 1);
+      const int cz = 2 * node.z + (child >> 1);
+      if (cx < levelWidths[childLevel] && cz < levelDepths[childLevel]) {
+        stack[top++] = Node{childLevel, cx, cz};
+      }
+    }
+  }
+  return false;
+}
+
+bool HeightPyramid::RaycastMarching(const glm::vec3& origin,
+                                    const glm::vec3& direction,
+                                    float maxDistance,
+                                    float step,
+                                    RayHit& hit) const {
+  const float length = glm::length(direction);
+  if (length == 0.0f || step <= 0.0f) {
+    return false;
+  }
+  const glm::vec3 unit = direction / length;
+  auto below = [&](float t) {
+    const glm::vec3 p = origin + unit * t;
+    return Contains(p.x, p.z) && p.y <= Height(p.x, p.z);
+  };
+
+  if (below(0.0f)) {
+    hit.distance = 0.0f;
+    hit.position = origin;
+    return true;
+  }
+  for (int n = 1;; n++) {
+    const float t = std::min(n * step, maxDistance);
+    if (below(t)) {
+      float above = std::max(t - step, 0.0f);
+      float under = t;
+      for (int i = 0; i < 16; i++) {
+        const float middle = 0.5f * (above + under);
+        (below(middle) ? under : above) = middle;
+      }
+      hit.distance = under;
+      hit.position = origin + unit * under;
+      return true;
+    }
+    if (t >= maxDistance) {
+      return false;
+    }
+  }
+}
+
+const char* HeightPyramid::SimdPath() {
+#if defined(__AVX2__)
+  return "AVX2";
+#elif defined(__SSE4_1__)
+  return "SSE4.1";
+#else
+  return "scalar";
+#endif
+}
+
+RaycastBenchmark terrain::BenchmarkRaycasts(const HeightPyramid& pyramid,
+                                            size_t rays,
+                                            uint32_t seed) {
+  using Clock = std::chrono::steady_clock;
+  auto perSecond = [](size_t count, Clock::time_point start) {
+    const double seconds =
+        std::chrono::duration<double>(Clock::now() - start).count();
+    return static_cast<double>(count) / std::max(seconds, 1e-9);
+  };
+
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  const float spacing = pyramid.Spacing();
+  const float extentX = spacing * (pyramid.Width() - 1);
+  const float extentZ = spacing * (pyramid.Depth() - 1);
+  const float maxDistance = 0.5f * std::min(extentX, extentZ);
+  const float step = 0.5f * spacing;
+
+  std::vector<glm::vec3> origins(rays);
+  std::vector<glm::vec3> directions(rays);
+  for (size_t r = 0; r < rays; r++) {
+    const float x = pyramid.OriginX() + extentX * unit(random);
+    const float z = pyramid.OriginZ() + extentZ * unit(random);
+    const float above = 1.0f + 20.0f * unit(random);
+    origins[r] = glm::vec3(x, pyramid.Height(x, z) + above, z);
+    const float angle = 6.2831853f * unit(random);
+    directions[r] = glm::vec3(std::cos(angle), 0.1f - 0.6f * unit(random),
+                              std::sin(angle));
+  }
+
+  RaycastBenchmark result;
+  result.rays = rays;
+  std::vector<RayHit> pyramidHits(rays);
+  std::vector<uint8_t> pyramidFound(rays);
+  auto start = Clock::now();
+  for (size_t r = 0; r < rays; r++) {
+    pyramidFound[r] = pyramid.Raycast(origins[r], directions[r], maxDistance,
+                                      pyramidHits[r]);
+  }
+  result.pyramidRaysPerSecond = perSecond(rays, start);
+
+  std::vector<RayHit> marchingHits(rays);
+  std::vector<uint8_t> marchingFound(rays);
+  start = Clock::now();
+  for (size_t r = 0; r < rays; r++) {
+    marchingFound[r] = pyramid.RaycastMarching(
+        origins[r], directions[r], maxDistance, step, marchingHits[r]);
+  }
+  result.marchingRaysPerSecond = perSecond(rays, start);
+
+  size_t agree = 0;
+  const float surfaceTolerance = 1e-3f * spacing;
+  for (size_t r = 0; r < rays; r++) {
+    result.hits += pyramidFound[r];
+    const RayHit& hit = pyramidHits[r];
+    if (marchingFound[r] &&
+        (!pyramidFound[r] ||
+         hit.distance > marchingHits[r].distance + step)) {
+      result.mismatches++;
+    } else if (pyramidFound[r] &&
+               std::abs(hit.position.y -
+                        pyramid.Height(hit.position.x, hit.position.z)) >
+                   surfaceTolerance) {
+      result.mismatches++;
+    }
+
+    if (pyramidFound[r] != marchingFound[r]) {
+      continue;
+    }
+    if (!pyramidFound[r] ||
+        std::abs(pyramidHits[r].distance - marchingHits[r].distance) <=
+            step) {
+      agree++;
+    }
+  }
+  result.agreement = rays ? static_cast<double>(agree) / rays : 1.0;
+
+  // points all over the grid, the gathers miss the cache like a real batch
+  result.queries = size_t{1} << 20;
+  std::vector<float> xs(result.queries);
+  std::vector<float> zs(result.queries);
+  for (size_t i = 0; i < result.queries; i++) {
+    xs[i] = pyramid.OriginX() + extentX * unit(random);
+    zs[i] = pyramid.OriginZ() + extentZ * unit(random);
+  }
+  std::vector<float> scalar(result.queries);
+  std::vector<float> vectorised(result.queries);
+  start = Clock::now();
+  pyramid.Heights(xs.data(), zs.data(), scalar.data(), result.queries, false);
+  result.scalarQueriesPerSecond = perSecond(result.queries, start);
+  start = Clock::now();
+  pyramid.Heights(xs.data(), zs.data(), vectorised.data(), result.queries);
+  result.simdQueriesPerSecond = perSecond(result.queries, start);
+  result.queriesMatch =
+      std::memcmp(scalar.data(), vectorised.data(),
+                  result.queries * sizeof(float)) == 0;
+  return result;
+}
+
+bool terrain::ReportRaycastBenchmark(const HeightPyramid& pyramid,
+                                     size_t rays,
+                                     uint32_t seed) {
+  const auto result = BenchmarkRaycasts(pyramid, rays, seed);
+  LOG_INFO(
+      "Raycasts: " + std::to_string(result.rays) + " rays, " +
+      std::to_string(result.hits) + " hits, pyramid " +
+      std::to_string(static_cast<size_t>(result.pyramidRaysPerSecond)) +
+      " rays/s, marching " +
+      std::to_string(static_cast<size_t>(result.marchingRaysPerSecond)) +
+      " rays/s, speedup " +
+      std::to_string(result.pyramidRaysPerSecond /
+                     result.marchingRaysPerSecond) +
+      ", agreement " + std::to_string(result.agreement));
+  LOG_INFO("Height queries (" + std::string(HeightPyramid::SimdPath()) + "): " +
+           std::to_string(static_cast<size_t>(result.simdQueriesPerSecond)) +
+           " queries/s, scalar " +
+           std::to_string(static_cast<size_t>(result.scalarQueriesPerSecond)) +
+           " queries/s");
+
+  if (result.mismatches) {
+    logging::Logger::LogError(
+        "Raycast mismatch: " + std::to_string(result.mismatches) +
+        " pyramid hits disagree with marching");
+  }
+  if (!result.queriesMatch) {
+    logging::Logger::LogError(
+        "Height query mismatch: the SIMD path disagrees with the scalar one");
+  }
+  return result.mismatches == 0 && result.queriesMatch;
+}
@@ -0,0 +1,375 @@
+
+#include <Noise.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+#include <Check.hpp>
+#include <JobSystem.hpp>
+#include <Logger.hpp>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+using namespace terrain;
+
+namespace {
+
+// Each octave gets its own lattice so the layers do not line up.
+constexpr uint32_t OctaveSeedStep = 0x9E3779B9u;
+constexpr uint32_t PrimeX = 0x27D4EB2Du;
+constexpr uint32_t PrimeZ = 0x165667B1u;
+constexpr uint32_t Mix = 0x2C1B3C6Du;
+
+// Number of rows per job in Generate.
+constexpr int RowsPerBlock = 8;
+
+inline uint32_t Hash(int32_t x, int32_t z, uint32_t seed) {
+  uint32_t h = seed ^ (static_cast<uint32_t>(x) * PrimeX) ^
+               (static_cast<uint32_t>(z) * PrimeZ);
+  h ^= h >> 15;
+  h *= Mix;
+  h ^= h >> 12;
+  return h;
+}
+
+// Picks one of eight gradients from the low hash bits and returns its dot
+// product with the offset (x, z).
+inline float Grad(uint32_t h, float x, float z) {
+  float u = (h & 4) ? z : x;
+  float v = (h & 4) ? x : z;
+  u = (h & 1) ? -u : u;
+  v = (h & 2) ? -v : v;
+  return u + v * 2.0f;
+}
+
+inline float Fade(float t) {
+  return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+inline float Lerp(float a, float b, float t) {
+  return a + t * (b - a);
+}
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+namespace simd {
+#if defined(__AVX2__)
+constexpr int Width = 8;
+using Float = __m256;
+using Int = __m256i;
+
+inline Float Set(float v) { return _mm256_set1_ps(v); }
+inline Int SetInt(int32_t v) { return _mm256_set1_epi32(v); }
+inline Float Lanes() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+inline Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+inline Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+inline Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+inline Float Floor(Float a) { return _mm256_floor_ps(a); }
+inline Float XorBits(Float a, Int b) {
+  return _mm256_xor_ps(a, _mm256_castsi256_ps(b));
+}
+inline Float Select(Int mask, Float a, Float b) {
+  return _mm256_blendv_ps(b, a, _mm256_castsi256_ps(mask));
+}
+inline Int ToInt(Float a) { return _mm256_cvttps_epi32(a); }
+inline Int AddInt(Int a, Int b) { return _mm256_add_epi32(a, b); }
+inline Int MulInt(Int a, Int b) { return _mm256_mullo_epi32(a, b); }
+inline Int XorInt(Int a, Int b) { return _mm256_xor_si256(a, b); }
+inline Int AndInt(Int a, Int b) { return _mm256_and_si256(a, b); }
+inline Int Equal(Int a, Int b) { return _mm256_cmpeq_epi32(a, b); }
+template <int N>
+inline Int ShiftRight(Int a) {
+  return _mm256_srli_epi32(a, N);
+}
+inline void Store(float* out, Float a) { _mm256_storeu_ps(out, a); }
+#else
+constexpr int Width = 4;
+using Float = __m128;
+using Int = __m128i;
+
+inline Float Set(float v) { return _mm_set1_ps(v); }
+inline Int SetInt(int32_t v) { return _mm_set1_epi32(v); }
+inline Float Lanes() { return _mm_setr_ps(0, 1, 2, 3); }
+inline Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+inline Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+inline Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+inline Float Floor(Float a) { return _mm_floor_ps(a); }
+inline Float XorBits(Float a, Int b) {
+  return _mm_xor_ps(a, _mm_castsi128_ps(b));
+}
+inline Float Select(Int mask, Float a, Float b) {
+  return _mm_blendv_ps(b, a, _mm_castsi128_ps(mask));
+}
+inline Int ToInt(Float a) { return _mm_cvttps_epi32(a); }
+inline Int AddInt(Int a, Int b) { return _mm_add_epi32(a, b); }
+inline Int MulInt(Int a, Int b) { return _mm_mullo_epi32(a, b); }
+inline Int XorInt(Int a, Int b) { return _mm_xor_si128(a, b); }
+inline Int AndInt(Int a, Int b) { return _mm_and_si128(a, b); }
+inline Int Equal(Int a, Int b) { return _mm_cmpeq_epi32(a, b); }
+template <int N>
+inline Int ShiftRight(Int a) {
+  return _mm_srli_epi32(a, N);
+}
+inline void Store(float* out, Float a) { _mm_storeu_ps(out, a); }
+#endif
+
+inline Int Hash(Int x, Int z, Int seed) {
+  Int h = XorInt(seed, XorInt(MulInt(x, SetInt(static_cast<int32_t>(PrimeX))),
+                              MulInt(z, SetInt(static_cast<int32_t>(PrimeZ)))));
+  h = XorInt(h, ShiftRight<15>(h));
+  h = MulInt(h, SetInt(static_cast<int32_t>(Mix)));
+  return XorInt(h, ShiftRight<12>(h));
+}
+
+inline Int HasBit(Int h, int32_t bit) {
+  Int b = SetInt(bit);
+  return Equal(AndInt(h, b), b);
+}
+
+inline Float Grad(Int h, Float x, Float z) {
+  const Int sign = SetInt(static_cast<int32_t>(0x80000000u));
+  Int swap = HasBit(h, 4);
+  Float u = Select(swap, z, x);
+  Float v = Select(swap, x, z);
+  u = XorBits(u, AndInt(HasBit(h, 1), sign));
+  v = XorBits(v, AndInt(HasBit(h, 2), sign));
+  return Add(u, Mul(v, Set(2.0f)));
+}
+
+inline Float Fade(Float t) {
+  Float inner = Add(Mul(t, Sub(Mul(t, Set(6.0f)), Set(15.0f))), Set(10.0f));
+  return Mul(Mul(Mul(t, t), t), inner);
+}
+
+inline Float Lerp(Float a, Float b, Float t) {
+  return Add(a, Mul(t, Sub(b, a)));
+}
+
+inline Float Gradient(Float x, Float z, uint32_t seed) {
+  Float x0 = Floor(x);
+  Float z0 = Floor(z);
+  Int xi = ToInt(x0);
+  Int zi = ToInt(z0);
+  Float xf = Sub(x, x0);
+  Float zf = Sub(z, z0);
+  Float u = Fade(xf);
+  Float w = Fade(zf);
+
+  const Int one = SetInt(1);
+  const Float onef = Set(1.0f);
+  Int s = SetInt(static_cast<int32_t>(seed));
+  Int xi1 = AddInt(xi, one);
+  Int zi1 = AddInt(zi, one);
+  Float xf1 = Sub(xf, onef);
+  Float zf1 = Sub(zf, onef);
+
+  Float g00 = Grad(Hash(xi, zi, s), xf, zf);
+  Float g10 = Grad(Hash(xi1, zi, s), xf1, zf);
+  Float g01 = Grad(Hash(xi, zi1, s), xf, zf1);
+  Float g11 = Grad(Hash(xi1, zi1, s), xf1, zf1);
+
+  return Mul(Lerp(Lerp(g00, g10, u), Lerp(g01, g11, u), w), Set(0.5f));
+}
+}  // namespace simd
+#endif
+}  // namespace
+
+NoiseGenerator::NoiseGenerator(NoiseParameters parameters)
+    : parameters{parameters} {
+  float amplitude = 1.0f;
+  float total = 0.0f;
+  for (int octave = 0; octave < parameters.octaves; octave++) {
+    total += amplitude;
+    amplitude *= parameters.gain;
+  }
+  normalization = total > 0.0f ? 1.0f / total : 0.0f;
+}
+
+float NoiseGenerator::Gradient(float x, float z, uint32_t seed) {
+  float x0 = std::floor(x);
+  float z0 = std::floor(z);
+  int32_t xi = static_cast<int32_t>(x0);
+  int32_t zi = static_cast<int32_t>(z0);
+  float xf = x - x0;
+  float zf = z - z0;
+  float u = Fade(xf);
+  float w = Fade(zf);
+
+  float g00 = Grad(Hash(xi, zi, seed), xf, zf);
+  float g10 = Grad(Hash(xi + 1, zi, seed), xf - 1.0f, zf);
+  float g01 = Grad(Hash(xi, zi + 1, seed), xf, zf - 1.0f);
+  float g11 = Grad(Hash(xi + 1, zi + 1, seed), xf - 1.0f, zf - 1.0f);
+
+  return Lerp(Lerp(g00, g10, u), Lerp(g01, g11, u), w) * 0.5f;
+}
+
+float NoiseGenerator::Fbm(float x, float z) const {
+  float sum = 0.0f;
+  float amplitude = 1.0f;
+  float frequency = parameters.frequency;
+  for (int octave = 0; octave < parameters.octaves; octave++) {
+    uint32_t seed = parameters.seed + octave * OctaveSeedStep;
+    sum += amplitude * Gradient(x * frequency, z * frequency, seed);
+    amplitude *= parameters.gain;
+    frequency *= parameters.lacunarity;
+  }
+  return sum * normalization;
+}
+
+void NoiseGenerator::FbmRow(float x0,
+                            float z,
+                            float step,
+                            float* out,
+                            int count) const {
+  int i = 0;
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+  const simd::Float lanes = simd::Lanes();
+  const simd::Float origin = simd::Set(x0);
+  const simd::Float stride = simd::Set(step);
+  const simd::Float zs = simd::Set(z);
+
+  for (; i + simd::Width <= count; i += simd::Width) {
+    simd::Float index = simd::Add(simd::Set(static_cast<float>(i)), lanes);
+    simd::Float xs = simd::Add(origin, simd::Mul(stride, index));
+
+    simd::Float sum = simd::Set(0.0f);
+    float amplitude = 1.0f;
+    float frequency = parameters.frequency;
+    for (int octave = 0; octave < parameters.octaves; octave++) {
+      uint32_t seed = parameters.seed + octave * OctaveSeedStep;
+      simd::Float f = simd::Set(frequency);
+      simd::Float n =
+          simd::Gradient(simd::Mul(xs, f), simd::Mul(zs, f), seed);
+      sum = simd::Add(sum, simd::Mul(simd::Set(amplitude), n));
+      amplitude *= parameters.gain;
+      frequency *= parameters.lacunarity;
+    }
+    simd::Store(out + i, simd::Mul(sum, simd::Set(normalization)));
+  }
+#endif
+
+  // Remaining samples, or the whole row without SIMD support.
+  for (; i < count; i++) {
+    out[i] = Fbm(x0 + step * static_cast<float>(i), z);
+  }
+}
+
+void NoiseGenerator::Generate(Heightfield& field,
+                              float originX,
+                              float originZ,
+                              float spacing) const {
+  const int width = field.Width();
+
+  jobs::JobSystem::GetInstance().ParallelFor(
+      0, field.Depth(), RowsPerBlock, [&](int first, int last) {
+        for (int z = first; z < last; z++) {
+          float worldZ = originZ + spacing * static_cast<float>(z);
+          FbmRow(originX, worldZ, spacing, field.Row(z), width);
+        }
+      });
+}
+
+void NoiseGenerator::GenerateReference(Heightfield& field,
+                                       float originX,
+                                       float originZ,
+                                       float spacing) const {
+  for (int z = 0; z < field.Depth(); z++) {
+    float worldZ = originZ + spacing * static_cast<float>(z);
+    float* row = field.Row(z);
+    for (int x = 0; x < field.Width(); x++) {
+      row[x] = Fbm(originX + spacing * static_cast<float>(x), worldZ);
+    }
+  }
+}
+
+NoiseParameters terrain::GridParameters(NoiseParameters parameters,
+                                        float spacing) {
+  parameters.frequency *= spacing;
+  return parameters;
+}
+
+const char* NoiseGenerator::SimdPath() {
+#if defined(__AVX2__)
+  return "AVX2";
+#elif defined(__SSE4_1__)
+  return "SSE4.1";
+#else
+  return "scalar";
+#endif
+}
+
+namespace {
+
+bool SameBits(const Heightfield& a, const Heightfield& b) {
+  return std::memcmp(a.Data(), b.Data(), a.Size() * sizeof(float)) == 0;
+}
+
+template <typename Fill>
+double Milliseconds(Fill fill) {
+  const auto start = std::chrono::steady_clock::now();
+  fill();
+  const std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+}  // namespace
+
+bool terrain::CheckNoise() {
+  checks::Checker check("Noise");
+
+  NoiseParameters detailed;
+  detailed.seed = 7;
+  detailed.octaves = 12;
+  detailed.frequency = 0.37f;
+  NoiseParameters single;
+  single.seed = 0xFFFFFFFFu;
+  single.octaves = 1;
+  single.lacunarity = 3.1f;
+  single.gain = 0.8f;
+  const NoiseParameters parameters[] = {NoiseParameters(), detailed, single};
+
+  // whole vectors, partial vectors and rows shorter than one vector
+  const int widths[] = {1, 3, 7, 8, 9, 15, 16, 17, 33, 100, 257};
+  for (const auto& p : parameters) {
+    const NoiseGenerator noise{p};
+    for (int width : widths) {
+      // negative and fractional origins cross lattice cells both ways
+      for (float origin : {0.0f, -37.3f, 1000.125f}) {
+        Heightfield generated(width, 19);
+        Heightfield reference(width, 19);
+        noise.Generate(generated, origin, -origin, 0.73f);
+        noise.GenerateReference(reference, origin, -origin, 0.73f);
+        check.Expect(SameBits(generated, reference),
+                     "Generate differs from the reference at width " +
+                         std::to_string(width) + ", origin " +
+                         std::to_string(origin) + ", seed " +
+                         std::to_string(p.seed));
+      }
+    }
+  }
+
+  // the size of the fixed terrain, on the chunk grid
+  const NoiseGenerator noise{GridParameters(NoiseParameters(), 0.25f)};
+  Heightfield generated(1024, 1024);
+  Heightfield reference(1024, 1024);
+  const double generateMs = Milliseconds(
+      [&] { noise.Generate(generated, -512.0f, -512.0f, 1.0f); });
+  const double referenceMs = Milliseconds(
+      [&] { noise.GenerateReference(reference, -512.0f, -512.0f, 1.0f); });
+  check.Expect(SameBits(generated, reference),
+               "Generate differs from the reference on the 1024x1024 grid");
+
+  LOG_INFO("Noise: 1024x1024 reference=" + std::to_string(referenceMs) + "ms " +
+           NoiseGenerator::SimdPath() + "=" + std::to_string(generateMs) +
+           "ms on " +
+           std::to_string(jobs::JobSystem::GetInstance().WorkerCount()) +
+           " workers");
+  return check.Passed();
+}
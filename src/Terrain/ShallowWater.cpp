@@ -0,0 +1,451 @@
+#include <Water.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#include <JobSystem.hpp>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+using namespace terrain;
+
+namespace {
+
+// keeps the outflow scale finite for cells with nothing flowing out
+constexpr float MinOutflow = 1e-20f;
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+namespace simd {
+#if defined(__AVX2__)
+constexpr int Width = 8;
+using Float = __m256;
+
+inline Float Set(float v) { return _mm256_set1_ps(v); }
+inline Float Load(const float* p) { return _mm256_loadu_ps(p); }
+inline void Store(float* p, Float a) { _mm256_storeu_ps(p, a); }
+inline Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+inline Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+inline Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+inline Float Div(Float a, Float b) { return _mm256_div_ps(a, b); }
+inline Float Max(Float a, Float b) { return _mm256_max_ps(a, b); }
+inline Float Min(Float a, Float b) { return _mm256_min_ps(a, b); }
+inline float HorizontalMax(Float a) {
+  __m128 m = _mm_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+  m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+  m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+  return _mm_cvtss_f32(m);
+}
+#else
+constexpr int Width = 4;
+using Float = __m128;
+
+inline Float Set(float v) { return _mm_set1_ps(v); }
+inline Float Load(const float* p) { return _mm_loadu_ps(p); }
+inline void Store(float* p, Float a) { _mm_storeu_ps(p, a); }
+inline Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+inline Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+inline Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+inline Float Div(Float a, Float b) { return _mm_div_ps(a, b); }
+inline Float Max(Float a, Float b) { return _mm_max_ps(a, b); }
+inline Float Min(Float a, Float b) { return _mm_min_ps(a, b); }
+inline float HorizontalMax(Float a) {
+  __m128 m = _mm_max_ps(a, _mm_movehl_ps(a, a));
+  m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+  return _mm_cvtss_f32(m);
+}
+#endif
+}  // namespace simd
+#endif
+}  // namespace
+
+ShallowWater::ShallowWater(const Heightfield& field,
+                           float heightScale,
+                           float spacing,
+                           WaterSettings settings)
+    : settings{settings},
+      width{field.Width()},
+      depth{field.Depth()},
+      spacing{spacing} {
+  this->settings.tileSize = std::max(this->settings.tileSize, 8);
+  const size_t cells = field.Size();
+  ground.resize(cells);
+  for (size_t i = 0; i < cells; i++) {
+    ground[i] = field.Data()[i] * heightScale;
+  }
+  water.assign(cells, 0.0f);
+  fluxLeft.assign(cells, 0.0f);
+  fluxRight.assign(cells, 0.0f);
+  fluxUp.assign(cells, 0.0f);
+  fluxDown.assign(cells, 0.0f);
+  uploaded.assign(cells, 0.0f);
+
+  const int size = this->settings.tileSize;
+  tilesX = (width + size - 1) / size;
+  tilesZ = (depth + size - 1) / size;
+  wet.assign(static_cast<size_t>(tilesX) * tilesZ, 0);
+  active.assign(wet.size(), 0);
+  dirty.assign(wet.size(), 0);
+}
+
+void ShallowWater::AddWater(float x, float z, float radius, float volume) {
+  const int x0 = std::max(0, static_cast<int>(std::floor(x - radius)));
+  const int x1 = std::min(width - 1, static_cast<int>(std::ceil(x + radius)));
+  const int z0 = std::max(0, static_cast<int>(std::floor(z - radius)));
+  const int z1 = std::min(depth - 1, static_cast<int>(std::ceil(z + radius)));
+
+  auto inside = [&](int cx, int cz) {
+    const float dx = static_cast<float>(cx) - x;
+    const float dz = static_cast<float>(cz) - z;
+    return dx * dx + dz * dz <= radius * radius;
+  };
+  int cells = 0;
+  for (int cz = z0; cz <= z1; cz++) {
+    for (int cx = x0; cx <= x1; cx++) {
+      cells += inside(cx, cz) ? 1 : 0;
+    }
+  }
+  if (cells == 0) {
+    return;
+  }
+
+  const float added = volume / (static_cast<float>(cells) * spacing * spacing);
+  const int size = settings.tileSize;
+  for (int cz = z0; cz <= z1; cz++) {
+    for (int cx = x0; cx <= x1; cx++) {
+      if (inside(cx, cz)) {
+        const size_t i = static_cast<size_t>(cz) * width + cx;
+        water[i] += added;
+        const int tile = (cz / size) * tilesX + cx / size;
+        const bool wasWet = wet[tile];
+        wet[tile] = wet[tile] || water[i] > settings.dryDepth;
+        dirty[tile] = dirty[tile] || wet[tile] != wasWet ||
+                      std::abs(water[i] - uploaded[i]) > settings.redrawDepth;
+      }
+    }
+  }
+}
+
+void ShallowWater::UpdateActiveTiles() {
+  std::vector<uint8_t> next(wet.size(), 0);
+  for (int tz = 0; tz < tilesZ; tz++) {
+    for (int tx = 0; tx < tilesX; tx++) {
+      if (!wet[tz * tilesX + tx]) {
+        continue;
+      }
+      // water only crosses into the four neighbouring tiles in a step
+      next[tz * tilesX + tx] = 1;
+      if (tx > 0) next[tz * tilesX + tx - 1] = 1;
+      if (tx < tilesX - 1) next[tz * tilesX + tx + 1] = 1;
+      if (tz > 0) next[(tz - 1) * tilesX + tx] = 1;
+      if (tz < tilesZ - 1) next[(tz + 1) * tilesX + tx] = 1;
+    }
+  }
+
+  const int size = settings.tileSize;
+  activeTiles.clear();
+  for (size_t t = 0; t < next.size(); t++) {
+    if (next[t]) {
+      activeTiles.push_back(static_cast<int>(t));
+    } else if (active[t]) {
+      // the leftover outflow of a tile going to sleep would keep feeding
+      // its neighbours
+      const int x0 = static_cast<int>(t % tilesX) * size;
+      const int z0 = static_cast<int>(t / tilesX) * size;
+      const int x1 = std::min(width, x0 + size);
+      for (int z = z0; z < std::min(depth, z0 + size); z++) {
+        const size_t row = static_cast<size_t>(z) * width;
+        std::fill(&fluxLeft[row + x0], &fluxLeft[row + x1], 0.0f);
+        std::fill(&fluxRight[row + x0], &fluxRight[row + x1], 0.0f);
+        std::fill(&fluxUp[row + x0], &fluxUp[row + x1], 0.0f);
+        std::fill(&fluxDown[row + x0], &fluxDown[row + x1], 0.0f);
+      }
+    }
+  }
+  active.swap(next);
+}
+
+void ShallowWater::FluxTile(int tile, float dt, bool simd) {
+  const int size = settings.tileSize;
+  const int x0 = (tile % tilesX) * size;
+  const int z0 = (tile / tilesX) * size;
+  const int x1 = std::min(width, x0 + size);
+  const int z1 = std::min(depth, z0 + size);
+
+  // pipes into a sleeping tile stay shut, its depth is not stepped and
+  // anything sent there would be lost
+  const int tx = tile % tilesX;
+  const int tz = tile / tilesX;
+  const bool openLeft = tx > 0 && active[tile - 1];
+  const bool openRight = tx < tilesX - 1 && active[tile + 1];
+  const bool openUp = tz > 0 && active[tile - tilesX];
+  const bool openDown = tz < tilesZ - 1 && active[tile + tilesX];
+
+  // pipes of cross section spacing squared and length spacing
+  const float k = dt * settings.gravity * spacing;
+  const float area = spacing * spacing;
+  const float damping = settings.fluxDamping;
+
+  for (int z = z0; z < z1; z++) {
+    auto cell = [&](int x) {
+      const size_t i = static_cast<size_t>(z) * width + x;
+      const float h = ground[i] + water[i];
+      auto pipe = [&](float flux, size_t neighbour) {
+        const float other = ground[neighbour] + water[neighbour];
+        return std::max(0.0f, flux * damping + k * (h - other));
+      };
+      const float l =
+          x > x0 || openLeft ? pipe(fluxLeft[i], i - 1) : 0.0f;
+      const float r =
+          x < x1 - 1 || openRight ? pipe(fluxRight[i], i + 1) : 0.0f;
+      const float u =
+          z > z0 || openUp ? pipe(fluxUp[i], i - width) : 0.0f;
+      const float d =
+          z < z1 - 1 || openDown ? pipe(fluxDown[i], i + width) : 0.0f;
+
+      // never let more flow out than the cell holds
+      const float out = l + r + u + d;
+      const float scale =
+          std::min(1.0f, water[i] * area / std::max(out * dt, MinOutflow));
+      fluxLeft[i] = l * scale;
+      fluxRight[i] = r * scale;
+      fluxUp[i] = u * scale;
+      fluxDown[i] = d * scale;
+    };
+    int x = x0;
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+    // whole vectors of cells with all four pipes open
+    if (simd && (z > z0 || openUp) && (z < z1 - 1 || openDown)) {
+      const simd::Float zero = simd::Set(0.0f);
+      const simd::Float vk = simd::Set(k);
+      const simd::Float vdamping = simd::Set(damping);
+      auto pipe = [&](const float* flux, size_t i, simd::Float h,
+                      size_t neighbour) {
+        const simd::Float other = simd::Add(simd::Load(&ground[neighbour]),
+                                            simd::Load(&water[neighbour]));
+        return simd::Max(
+            zero, simd::Add(simd::Mul(simd::Load(flux + i), vdamping),
+                            simd::Mul(vk, simd::Sub(h, other))));
+      };
+
+      if (!openLeft) {
+        cell(x++);
+      }
+      const int last = openRight ? x1 : x1 - 1;
+      for (; x + simd::Width <= last; x += simd::Width) {
+        const size_t i = static_cast<size_t>(z) * width + x;
+        const simd::Float h =
+            simd::Add(simd::Load(&ground[i]), simd::Load(&water[i]));
+        const simd::Float l = pipe(fluxLeft.data(), i, h, i - 1);
+        const simd::Float r = pipe(fluxRight.data(), i, h, i + 1);
+        const simd::Float u = pipe(fluxUp.data(), i, h, i - width);
+        const simd::Float d = pipe(fluxDown.data(), i, h, i + width);
+
+        const simd::Float out = simd::Add(simd::Add(simd::Add(l, r), u), d);
+        const simd::Float scale = simd::Min(
+            simd::Set(1.0f),
+            simd::Div(simd::Mul(simd::Load(&water[i]), simd::Set(area)),
+                      simd::Max(simd::Mul(out, simd::Set(dt)),
+                                simd::Set(MinOutflow))));
+        simd::Store(&fluxLeft[i], simd::Mul(l, scale));
+        simd::Store(&fluxRight[i], simd::Mul(r, scale));
+        simd::Store(&fluxUp[i], simd::Mul(u, scale));
+        simd::Store(&fluxDown[i], simd::Mul(d, scale));
+      }
+    }
+#endif
+
+    for (; x < x1; x++) {
+      cell(x);
+    }
+  }
+}
+
+void ShallowWater::DepthTile(int tile, float dt, bool simd) {
+  const int size = settings.tileSize;
+  const int x0 = (tile % tilesX) * size;
+  const int z0 = (tile / tilesX) * size;
+  const int x1 = std::min(width, x0 + size);
+  const int z1 = std::min(depth, z0 + size);
+
+  const float step = dt / (spacing * spacing);
+  const float keep = 1.0f - settings.evaporation * dt;
+  float deepest = 0.0f;
+  // furthest any cell moved from its uploaded depth
+  float moved = 0.0f;
+
+  for (int z = z0; z < z1; z++) {
+    auto cell = [&](int x) {
+      const size_t i = static_cast<size_t>(z) * width + x;
+      const float in = (x > 0 ? fluxRight[i - 1] : 0.0f) +
+                       (x < width - 1 ? fluxLeft[i + 1] : 0.0f) +
+                       (z > 0 ? fluxDown[i - width] : 0.0f) +
+                       (z < depth - 1 ? fluxUp[i + width] : 0.0f);
+      const float out = fluxLeft[i] + fluxRight[i] + fluxUp[i] + fluxDown[i];
+      const float level =
+          std::max(0.0f, water[i] + step * (in - out)) * keep;
+      water[i] = level;
+      deepest = std::max(deepest, level);
+      moved = std::max(moved, std::abs(level - uploaded[i]));
+    };
+    int x = x0;
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+    if (simd && z > 0 && z < depth - 1) {
+      const simd::Float zero = simd::Set(0.0f);
+      simd::Float rowDeepest = zero;
+      simd::Float rowMoved = zero;
+      if (x == 0) {
+        cell(x++);
+      }
+      for (; x + simd::Width <= std::min(x1, width - 1); x += simd::Width) {
+        const size_t i = static_cast<size_t>(z) * width + x;
+        const simd::Float in = simd::Add(
+            simd::Add(simd::Add(simd::Load(&fluxRight[i - 1]),
+                                simd::Load(&fluxLeft[i + 1])),
+                      simd::Load(&fluxDown[i - width])),
+            simd::Load(&fluxUp[i + width]));
+        const simd::Float out = simd::Add(
+            simd::Add(simd::Add(simd::Load(&fluxLeft[i]),
+                                simd::Load(&fluxRight[i])),
+                      simd::Load(&fluxUp[i])),
+            simd::Load(&fluxDown[i]));
+        const simd::Float change =
+            simd::Mul(simd::Set(step), simd::Sub(in, out));
+        const simd::Float level = simd::Mul(
+            simd::Max(zero, simd::Add(simd::Load(&water[i]), change)),
+            simd::Set(keep));
+        simd::Store(&water[i], level);
+        rowDeepest = simd::Max(rowDeepest, level);
+        const simd::Float before = simd::Load(&uploaded[i]);
+        rowMoved = simd::Max(rowMoved,
+                             simd::Max(simd::Sub(level, before),
+                                       simd::Sub(before, level)));
+      }
+      deepest = std::max(deepest, simd::HorizontalMax(rowDeepest));
+      moved = std::max(moved, simd::HorizontalMax(rowMoved));
+    }
+#endif
+
+    for (; x < x1; x++) {
+      cell(x);
+    }
+  }
+
+  // only a visible change is worth an upload
+  const bool nowWet = deepest > settings.dryDepth;
+  if (moved > settings.redrawDepth || nowWet != (wet[tile] != 0)) {
+    dirty[tile] = 1;
+  }
+  wet[tile] = nowWet;
+}
+
+void ShallowWater::Step(jobs::JobSystem* jobs, bool simd) {
+  const float dt = 1.0f / settings.stepsPerSecond;
+  for (auto& source : sources) {
+    AddWater(source.x, source.z, source.radius, source.rate * dt);
+  }
+
+  UpdateActiveTiles();
+  steps++;
+  if (activeTiles.empty()) {
+    return;
+  }
+
+  // every cell's outflow first, then every cell's depth, each pass only
+  // writes the tile it runs on
+  auto run = [&](auto pass) {
+    const int count = static_cast<int>(activeTiles.size());
+    if (jobs) {
+      jobs->ParallelFor(0, count, 4, [&](int first, int last) {
+        for (int t = first; t < last; t++) {
+          pass(activeTiles[t]);
+        }
+      });
+    } else {
+      for (int t = 0; t < count; t++) {
+        pass(activeTiles[t]);
+      }
+    }
+  };
+  run([&](int tile) { FluxTile(tile, dt, simd); });
+  run([&](int tile) { DepthTile(tile, dt, simd); });
+}
+
+int ShallowWater::Advance(double seconds, jobs::JobSystem* jobs) {
+  pending += seconds;
+  const double dt = 1.0 / settings.stepsPerSecond;
+  int count = static_cast<int>(pending / dt);
+  if (count > settings.maxSteps) {
+    // falling behind, slow the water down rather than the frames
+    count = settings.maxSteps;
+    pending = 0.0;
+  } else {
+    pending -= count * dt;
+  }
+
+  for (int i = 0; i < count; i++) {
+    Step(jobs);
+  }
+  return count;
+}
+
+std::vector<int> ShallowWater::TakeDirtyTiles() {
+  // the edge vertices and normals of a tile read one cell into each of its
+  // neighbours
+  std::vector<uint8_t> redraw(dirty.size(), 0);
+  for (int tz = 0; tz < tilesZ; tz++) {
+    for (int tx = 0; tx < tilesX; tx++) {
+      if (!dirty[tz * tilesX + tx]) {
+        continue;
+      }
+      for (int nz = std::max(0, tz - 1); nz <= std::min(tilesZ - 1, tz + 1);
+           nz++) {
+        for (int nx = std::max(0, tx - 1);
+             nx <= std::min(tilesX - 1, tx + 1); nx++) {
+          redraw[nz * tilesX + nx] = 1;
+        }
+      }
+    }
+  }
+  std::fill(dirty.begin(), dirty.end(), 0);
+
+  const int size = settings.tileSize;
+  std::vector<int> result;
+  for (size_t t = 0; t < redraw.size(); t++) {
+    if (!redraw[t]) {
+      continue;
+    }
+    result.push_back(static_cast<int>(t));
+    const int x0 = static_cast<int>(t % tilesX) * size;
+    const int z0 = static_cast<int>(t / tilesX) * size;
+    const int x1 = std::min(width, x0 + size);
+    for (int z = z0; z < std::min(depth, z0 + size); z++) {
+      const size_t row = static_cast<size_t>(z) * width;
+      std::copy(&water[row + x0], &water[row + x1], &uploaded[row + x0]);
+    }
+  }
+  return result;
+}
+
+double ShallowWater::Volume() const {
+  double total = 0.0;
+  for (float level : water) {
+    total += level;
+  }
+  return total * spacing * spacing;
+}
+
+const char* ShallowWater::SimdPath() {
+#if defined(__AVX2__)
+  return "AVX2";
+#elif defined(__SSE4_1__)
+  return "SSE4.1";
+#else
+  return "scalar";
+#endif
+}
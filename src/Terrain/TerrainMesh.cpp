@@ -0,0 +1,468 @@
+#include <TerrainMesh.hpp>
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include <Check.hpp>
+#include <Logger.hpp>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+using namespace terrain;
+
+namespace {
+const glm::vec4 LowColor{0.25f, 0.45f, 0.2f, 1.0f};
+const glm::vec4 HighColor{0.9f, 0.9f, 0.95f, 1.0f};
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+namespace simd {
+#if defined(__AVX2__)
+constexpr int Width = 8;
+using Float = __m256;
+
+inline Float Set(float v) { return _mm256_set1_ps(v); }
+inline Float Load(const float* p) { return _mm256_loadu_ps(p); }
+inline void Store(float* p, Float a) { _mm256_storeu_ps(p, a); }
+inline Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+inline Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+inline Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+inline Float Div(Float a, Float b) { return _mm256_div_ps(a, b); }
+inline Float Sqrt(Float a) { return _mm256_sqrt_ps(a); }
+inline Float Negate(Float a) { return _mm256_xor_ps(a, Set(-0.0f)); }
+#else
+constexpr int Width = 4;
+using Float = __m128;
+
+inline Float Set(float v) { return _mm_set1_ps(v); }
+inline Float Load(const float* p) { return _mm_loadu_ps(p); }
+inline void Store(float* p, Float a) { _mm_storeu_ps(p, a); }
+inline Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+inline Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+inline Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+inline Float Div(Float a, Float b) { return _mm_div_ps(a, b); }
+inline Float Sqrt(Float a) { return _mm_sqrt_ps(a); }
+inline Float Negate(Float a) { return _mm_xor_ps(a, Set(-0.0f)); }
+#endif
+}  // namespace simd
+#endif
+
+// Rows of a view as floats. Quantized rows are decoded into a ring of three
+// buffers, enough for a row and both its neighbours.
+class RowReader {
+ private:
+  const HeightfieldView& field;
+  std::vector<float> decoded[3];
+  int held[3] = {-1, -1, -1};
+
+ public:
+  explicit RowReader(const HeightfieldView& field) : field{field} {}
+
+  const float* Row(int z) {
+    const int width = field.Width();
+    if (const float* floats = field.Floats()) {
+      return floats + static_cast<size_t>(z) * width;
+    }
+    const int slot = z % 3;
+    if (held[slot] != z) {
+      decoded[slot].resize(width);
+      for (int x = 0; x < width; x++) {
+        decoded[slot][x] = field.At(x, z);
+      }
+      held[slot] = z;
+    }
+    return decoded[slot].data();
+  }
+};
+
+// Normal and tangent components of one row, indexed by column.
+struct RowFrames {
+  std::vector<float> normalX;
+  std::vector<float> normalY;
+  std::vector<float> normalZ;
+  std::vector<float> tangentX;
+  std::vector<float> tangentY;
+
+  explicit RowFrames(int width)
+      : normalX(width),
+        normalY(width),
+        normalZ(width),
+        tangentX(width),
+        tangentY(width) {}
+};
+
+// The normal is (-dx, 1, -dz) and the tangent (1, dx, 0), both normalised.
+void FrameSample(const float* above,
+                 const float* row,
+                 const float* below,
+                 int x,
+                 int width,
+                 float heightScale,
+                 float spacing,
+                 float stepZ,
+                 RowFrames& out) {
+  const int x0 = std::max(x - 1, 0);
+  const int x1 = std::min(x + 1, width - 1);
+  const float dx = (row[x1] - row[x0]) * heightScale / ((x1 - x0) * spacing);
+  const float dz = (below[x] - above[x]) * heightScale / stepZ;
+
+  const float across = dx * dx + 1.0f;
+  const float normal = 1.0f / std::sqrt(across + dz * dz);
+  const float tangent = 1.0f / std::sqrt(across);
+  out.normalX[x] = -dx * normal;
+  out.normalY[x] = normal;
+  out.normalZ[x] = -dz * normal;
+  out.tangentX[x] = tangent;
+  out.tangentY[x] = dx * tangent;
+}
+
+// Columns [first, last) of a row. The vector loop covers columns with a
+// neighbour on both sides, the edges and the remainder take FrameSample.
+void FrameRow(const float* above,
+              const float* row,
+              const float* below,
+              int width,
+              int first,
+              int last,
+              float heightScale,
+              float spacing,
+              float stepZ,
+              RowFrames& out,
+              bool simd) {
+  int x = first;
+#if defined(__AVX2__) || defined(__SSE4_1__)
+  if (simd) {
+    for (; x < last && x < 1; x++) {
+      FrameSample(above, row, below, x, width, heightScale, spacing, stepZ,
+                  out);
+    }
+
+    const simd::Float scale = simd::Set(heightScale);
+    const simd::Float acrossX = simd::Set(2.0f * spacing);
+    const simd::Float acrossZ = simd::Set(stepZ);
+    const simd::Float one = simd::Set(1.0f);
+    const int end = std::min(last, width - 1);
+    for (; x + simd::Width <= end; x += simd::Width) {
+      using namespace simd;
+      const Float dx = Div(
+          Mul(Sub(Load(row + x + 1), Load(row + x - 1)), scale), acrossX);
+      const Float dz =
+          Div(Mul(Sub(Load(below + x), Load(above + x)), scale), acrossZ);
+
+      const Float across = Add(Mul(dx, dx), one);
+      const Float normal = Div(one, Sqrt(Add(across, Mul(dz, dz))));
+      const Float tangent = Div(one, Sqrt(across));
+      Store(out.normalX.data() + x, Mul(Negate(dx), normal));
+      Store(out.normalY.data() + x, normal);
+      Store(out.normalZ.data() + x, Mul(Negate(dz), normal));
+      Store(out.tangentX.data() + x, tangent);
+      Store(out.tangentY.data() + x, Mul(dx, tangent));
+    }
+  }
+#endif
+  for (; x < last; x++) {
+    FrameSample(above, row, below, x, width, heightScale, spacing, stepZ,
+                out);
+  }
+}
+
+// Heights, colors, normals and tangents of the samples [x0, x1) by
+// [z0, z1), all inside the interior. With an origin the vertices are placed
+// in x and z as well, in the same pass.
+void RefreshVertices(const HeightfieldView& field,
+                     int border,
+                     float spacing,
+                     float heightScale,
+                     int x0,
+                     int z0,
+                     int x1,
+                     int z1,
+                     const glm::vec2* origin,
+                     std::vector<TerrainVertex>& vertices,
+                     bool simd) {
+  const int width = field.Width();
+  const int depth = field.Depth();
+  const size_t stride = static_cast<size_t>(width - 2 * border);
+
+  RowReader rows(field);
+  RowFrames frames(width);
+  for (int z = z0; z < z1; z++) {
+    const int above = std::max(z - 1, 0);
+    const int below = std::min(z + 1, depth - 1);
+    const float* heights = rows.Row(z);
+    FrameRow(rows.Row(above), heights, rows.Row(below), width, x0, x1,
+             heightScale, spacing, (below - above) * spacing, frames, simd);
+
+    TerrainVertex* vertex =
+        &vertices[(z - border) * stride + (x0 - border)];
+    for (int x = x0; x < x1; x++, vertex++) {
+      if (origin) {
+        vertex->position.x = (origin->x + (x - border)) * spacing;
+        vertex->position.z = (origin->y + (z - border)) * spacing;
+      }
+      vertex->position.y = heights[x] * heightScale;
+      vertex->normal = glm::vec3(frames.normalX[x], frames.normalY[x],
+                                 frames.normalZ[x]);
+      vertex->tangent = glm::vec3(frames.tangentX[x], frames.tangentY[x], 0.0f);
+      const float t = std::clamp(heights[x] + 0.5f, 0.0f, 1.0f);
+      vertex->color = glm::mix(LowColor, HighColor, t);
+    }
+  }
+}
+}  // namespace
+
+void terrain::BuildTerrainVertices(const HeightfieldView& field,
+                                   int border,
+                                   float originX,
+                                   float originZ,
+                                   float spacing,
+                                   float heightScale,
+                                   std::vector<TerrainVertex>& vertices,
+                                   bool simd) {
+  const int width = field.Width();
+  const int depth = field.Depth();
+
+  vertices.resize(static_cast<size_t>(width - 2 * border) *
+                  (depth - 2 * border));
+  const glm::vec2 origin(originX, originZ);
+  RefreshVertices(field, border, spacing, heightScale, border, border,
+                  width - border, depth - border, &origin, vertices, simd);
+}
+
+void terrain::UpdateTerrainVertices(const HeightfieldView& field,
+                                    int border,
+                                    float spacing,
+                                    float heightScale,
+                                    const SampleRect& changed,
+                                    std::vector<TerrainVertex>& vertices,
+                                    bool simd) {
+  const int width = field.Width();
+  const int depth = field.Depth();
+  if (vertices.size() != static_cast<size_t>(width - 2 * border) *
+                             (depth - 2 * border)) {
+    throw std::runtime_error(
+        "Terrain vertices were built from a different heightfield");
+  }
+
+  const int x0 = std::max(changed.x0 - 1, border);
+  const int z0 = std::max(changed.z0 - 1, border);
+  const int x1 = std::min(changed.x1 + 1, width - border);
+  const int z1 = std::min(changed.z1 + 1, depth - border);
+  if (x0 >= x1 || z0 >= z1) {
+    return;
+  }
+  RefreshVertices(field, border, spacing, heightScale, x0, z0, x1, z1,
+                  nullptr, vertices, simd);
+}
+
+std::vector<unsigned int> terrain::BuildGridIndices(int resolution) {
+  std::vector<unsigned int> indices;
+  indices.reserve(static_cast<size_t>(resolution - 1) * (resolution - 1) * 6);
+  for (int z = 0; z < resolution - 1; z++) {
+    for (int x = 0; x < resolution - 1; x++) {
+      unsigned int i = z * resolution + x;
+      indices.push_back(i);
+      indices.push_back(i + resolution);
+      indices.push_back(i + 1);
+      indices.push_back(i + 1);
+      indices.push_back(i + resolution);
+      indices.push_back(i + resolution + 1);
+    }
+  }
+  return indices;
+}
+
+void terrain::SetupTerrainVertexAttributes() {
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex),
+                        (void*)offsetof(TerrainVertex, position));
+
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex),
+                        (void*)offsetof(TerrainVertex, normal));
+
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex),
+                        (void*)offsetof(TerrainVertex, color));
+
+  // 3 is the texture coordinates of model meshes
+  glEnableVertexAttribArray(4);
+  glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex),
+                        (void*)offsetof(TerrainVertex, tangent));
+}
+
+const char* terrain::TerrainMeshSimdPath() {
+#if defined(__AVX2__)
+  return "AVX2";
+#elif defined(__SSE4_1__)
+  return "SSE4.1";
+#else
+  return "scalar";
+#endif
+}
+
+
+namespace {
+
+bool SameBits(const std::vector<TerrainVertex>& a,
+              const std::vector<TerrainVertex>& b) {
+  return a.size() == b.size() &&
+         std::memcmp(a.data(), b.data(), a.size() * sizeof(TerrainVertex)) ==
+             0;
+}
+
+// Rolling hills with noise on top and a flat patch, whose zero slopes
+// have to come out with the same signs on both paths.
+Heightfield CheckField(int width, int depth, uint32_t seed) {
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  Heightfield field(width, depth);
+  for (int z = 0; z < depth; z++) {
+    float* row = field.Row(z);
+    for (int x = 0; x < width; x++) {
+      row[x] = x < width / 4 && z < depth / 4
+                   ? 0.0f
+                   : 0.4f * std::sin(0.05f * x) * std::cos(0.07f * z) +
+                         0.05f * unit(random);
+    }
+  }
+  return field;
+}
+
+double BuildMilliseconds(const HeightfieldView& field,
+                         std::vector<TerrainVertex>& vertices,
+                         bool simd) {
+  double best = 0.0;
+  for (int run = 0; run < 3; run++) {
+    const auto start = std::chrono::steady_clock::now();
+    BuildTerrainVertices(field, 0, 0.0f, 0.0f, 0.25f, 40.0f, vertices, simd);
+    const std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    best = run == 0 ? elapsed.count() : std::min(best, elapsed.count());
+  }
+  return best;
+}
+}  // namespace
+
+bool terrain::CheckTerrainVertices() {
+  checks::Checker check("Terrain vertex");
+  const float spacing = 0.25f;
+  const float heightScale = 40.0f;
+
+  // odd sizes so every row ends in a partial vector
+  Heightfield field = CheckField(203, 157, 3);
+  std::vector<uint16_t> quantized(field.Size());
+  for (size_t i = 0; i < field.Size(); i++) {
+    quantized[i] = static_cast<uint16_t>(
+        std::lround((field.Data()[i] + 1.0f) * 0.5f * 65535.0f));
+  }
+  const HeightfieldView views[2] = {
+      HeightfieldView(field),
+      HeightfieldView(quantized.data(), field.Width(), field.Depth(), -1.0f,
+                      1.0f)};
+  const char* names[2] = {"float", "quantized"};
+
+  std::vector<TerrainVertex> vector;
+  std::vector<TerrainVertex> scalar;
+  for (int v = 0; v < 2; v++) {
+    const HeightfieldView& view = views[v];
+    for (int border = 0; border < 2; border++) {
+      const std::string what = std::string(names[v]) + " field with apron " +
+                               std::to_string(border);
+      BuildTerrainVertices(view, border, 3.0f, -5.0f, spacing, heightScale,
+                           vector, true);
+      BuildTerrainVertices(view, border, 3.0f, -5.0f, spacing, heightScale,
+                           scalar, false);
+      check.Expect(SameBits(vector, scalar),
+                   "vector and scalar paths differ on the " + what);
+
+      // against the plain per vertex formula
+      float normalError = 0.0f;
+      float tangentError = 0.0f;
+      const int width = view.Width();
+      const int depth = view.Depth();
+      for (int z = border; z < depth - border; z++) {
+        for (int x = border; x < width - border; x++) {
+          const int x0 = std::max(x - 1, 0), x1 = std::min(x + 1, width - 1);
+          const int z0 = std::max(z - 1, 0), z1 = std::min(z + 1, depth - 1);
+          const float dx = (view.At(x1, z) - view.At(x0, z)) * heightScale /
+                           ((x1 - x0) * spacing);
+          const float dz = (view.At(x, z1) - view.At(x, z0)) * heightScale /
+                           ((z1 - z0) * spacing);
+          const TerrainVertex& vertex =
+              vector[static_cast<size_t>(z - border) * (width - 2 * border) +
+                     (x - border)];
+          const glm::vec3 expected =
+              glm::normalize(glm::vec3(-dx, 1.0f, -dz));
+          normalError =
+              std::max(normalError, glm::length(vertex.normal - expected));
+          tangentError = std::max(
+              {tangentError, std::abs(glm::dot(vertex.tangent, vertex.normal)),
+               std::abs(glm::length(vertex.tangent) - 1.0f)});
+        }
+      }
+      check.Expect(normalError < 1e-5f,
+                   "normals are " + std::to_string(normalError) +
+                       " off the reference on the " + what);
+      check.Expect(tangentError < 1e-5f,
+                   "tangents are " + std::to_string(tangentError) +
+                       " off unit and perpendicular on the " + what);
+    }
+  }
+
+  // edits inside, across the apron and over a corner, each refreshed in
+  // place and compared with building again from scratch
+  const SampleRect edits[3] = {
+      {40, 60, 72, 75}, {0, 20, 9, 30}, {190, 150, 260, 200}};
+  for (int border = 0; border < 2; border++) {
+    Heightfield edited = field;
+    std::vector<TerrainVertex> updated;
+    BuildTerrainVertices(edited, border, 0.0f, 0.0f, spacing, heightScale,
+                         updated);
+    for (const SampleRect& edit : edits) {
+      for (int z = std::max(edit.z0, 0);
+           z < std::min(edit.z1, edited.Depth()); z++) {
+        for (int x = std::max(edit.x0, 0);
+             x < std::min(edit.x1, edited.Width()); x++) {
+          edited.Row(z)[x] += 0.01f * (x - z);
+        }
+      }
+      UpdateTerrainVertices(edited, border, spacing, heightScale, edit,
+                            updated);
+    }
+    BuildTerrainVertices(edited, border, 0.0f, 0.0f, spacing, heightScale,
+                         vector);
+    check.Expect(SameBits(updated, vector),
+                 "updating edits differs from a rebuild with apron " +
+                     std::to_string(border));
+  }
+
+  // a grid the size of the fixed terrain
+  Heightfield large = CheckField(1024, 1024, 5);
+  const double scalarMs = BuildMilliseconds(large, scalar, false);
+  const double vectorMs = BuildMilliseconds(large, vector, true);
+  check.Expect(SameBits(vector, scalar),
+               "vector and scalar paths differ on the 1024x1024 grid");
+
+  const SampleRect brush{500, 500, 532, 532};
+  const auto start = std::chrono::steady_clock::now();
+  UpdateTerrainVertices(large, 0, 0.25f, 40.0f, brush, vector);
+  const std::chrono::duration<double, std::milli> updateMs =
+      std::chrono::steady_clock::now() - start;
+
+  LOG_INFO("Terrain vertices: 1024x1024 scalar=" + std::to_string(scalarMs) +
+           "ms " + TerrainMeshSimdPath() + "=" + std::to_string(vectorMs) +
+           "ms, 32x32 update=" + std::to_string(updateMs.count()) + "ms");
+  return check.Passed();
+}
@@ -0,0 +1,419 @@
+
+#include <TileStore.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define TILE_STORE_MMAP 1
+#endif
+
+using namespace terrain;
+
+namespace {
+
+constexpr char kMagic[8] = {'T', 'G', 'T', 'I', 'L', 'E', 'S', '\0'};
+constexpr uint32_t kVersion = 1;
+
+// the index starts on the second page, tiles and mip levels are aligned so
+// every tile starts on a page boundary of common page sizes
+constexpr size_t kIndexOffset = 4096;
+constexpr size_t kTileAlignment = 4096;
+constexpr size_t kLevelAlignment = 16;
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t format;
+  uint32_t resolution;
+  uint32_t mipCount;
+  uint32_t capacity;
+  uint32_t reserved;
+  float minHeight;
+  float maxHeight;
+  uint64_t key;
+  uint64_t tileCount;
+  // end of the last tile, the next tile is appended here
+  uint64_t end;
+};
+
+// offset 0 marks an empty slot, no tile can start inside the header
+struct IndexEntry {
+  int32_t x;
+  int32_t z;
+  uint64_t offset;
+};
+
+static_assert(sizeof(FileHeader) <= kIndexOffset, "header overlaps index");
+
+size_t AlignUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+int LevelResolution(int resolution, int level) {
+  for (int i = 0; i < level; i++) {
+    resolution = (resolution + 1) / 2;
+  }
+  return resolution;
+}
+
+size_t SampleBytes(TileFormat format) {
+  return format == TileFormat::Unorm16 ? sizeof(uint16_t) : sizeof(float);
+}
+
+size_t LevelOffset(const TileStoreSettings& settings, int level) {
+  size_t offset = 0;
+  for (int i = 0; i < level; i++) {
+    size_t side = LevelResolution(settings.resolution, i);
+    offset += AlignUp(side * side * SampleBytes(settings.format),
+                      kLevelAlignment);
+  }
+  return offset;
+}
+
+uint32_t Slot(int x, int z, uint32_t capacity) {
+  uint32_t hash = static_cast<uint32_t>(x) * 0x9E3779B1u ^
+                  static_cast<uint32_t>(z) * 0x85EBCA77u;
+  hash ^= hash >> 15;
+  return hash & (capacity - 1);
+}
+
+// 2x2 box filter, the last row and column are reused on odd sizes
+Heightfield Downsample(const Heightfield& source) {
+  Heightfield result((source.Width() + 1) / 2, (source.Depth() + 1) / 2);
+  for (int z = 0; z < result.Depth(); z++) {
+    int z0 = 2 * z;
+    int z1 = std::min(z0 + 1, source.Depth() - 1);
+    for (int x = 0; x < result.Width(); x++) {
+      int x0 = 2 * x;
+      int x1 = std::min(x0 + 1, source.Width() - 1);
+      result.Set(x, z,
+                 0.25f * (source.At(x0, z0) + source.At(x1, z0) +
+                          source.At(x0, z1) + source.At(x1, z1)));
+    }
+  }
+  return result;
+}
+
+void Encode(const Heightfield& level,
+            const TileStoreSettings& settings,
+            uint8_t* out) {
+  if (settings.format == TileFormat::Float32) {
+    std::memcpy(out, level.Data(), level.Size() * sizeof(float));
+    return;
+  }
+
+  const float scale = 65535.0f / (settings.maxHeight - settings.minHeight);
+  uint16_t* samples = reinterpret_cast<uint16_t*>(out);
+  for (size_t i = 0; i < level.Size(); i++) {
+    float value = (level.Data()[i] - settings.minHeight) * scale;
+    samples[i] =
+        static_cast<uint16_t>(std::lround(std::clamp(value, 0.0f, 65535.0f)));
+  }
+}
+}  // namespace
+
+TileView::TileView(void* mapping,
+                   size_t mappingSize,
+                   const uint8_t* data,
+                   const TileStoreSettings& settings)
+    : mapping{mapping},
+      mappingSize{mappingSize},
+      data{data},
+      settings{settings} {}
+
+TileView::~TileView() {
+#ifdef TILE_STORE_MMAP
+  munmap(mapping, mappingSize);
+#endif
+}
+
+HeightfieldView TileView::Level(int level) const {
+  const int side = LevelResolution(settings.resolution, level);
+  const uint8_t* samples = data + LevelOffset(settings, level);
+  if (settings.format == TileFormat::Unorm16) {
+    return HeightfieldView(reinterpret_cast<const uint16_t*>(samples), side,
+                           side, settings.minHeight, settings.maxHeight);
+  }
+  return HeightfieldView(reinterpret_cast<const float*>(samples), side, side);
+}
+
+#ifdef TILE_STORE_MMAP
+
+TileStore::TileStore(std::string path, TileStoreSettings settings)
+    : path{std::move(path)}, settings{settings} {
+  if (settings.capacity == 0 ||
+      (settings.capacity & (settings.capacity - 1)) != 0) {
+    throw std::runtime_error("Tile store capacity must be a power of two");
+  }
+
+  headerSize = AlignUp(kIndexOffset + settings.capacity * sizeof(IndexEntry),
+                       kTileAlignment);
+  tileBytes = LevelOffset(settings, settings.mipCount);
+
+  fd = open(this->path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    throw std::runtime_error("Could not open tile store: " + this->path);
+  }
+
+  if (!OpenExisting()) {
+    Create();
+  }
+
+  header = mmap(nullptr, headerSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (header == MAP_FAILED) {
+    close(fd);
+    throw std::runtime_error("Could not map tile store index: " + this->path);
+  }
+}
+
+TileStore::~TileStore() {
+  msync(header, headerSize, MS_SYNC);
+  munmap(header, headerSize);
+  close(fd);
+}
+
+bool TileStore::OpenExisting() {
+  FileHeader existing{};
+  if (pread(fd, &existing, sizeof(existing), 0) !=
+      static_cast<ssize_t>(sizeof(existing))) {
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    return false;
+  }
+
+  return std::memcmp(existing.magic, kMagic, sizeof(kMagic)) == 0 &&
+         existing.version == kVersion &&
+         existing.format == static_cast<uint32_t>(settings.format) &&
+         existing.resolution == static_cast<uint32_t>(settings.resolution) &&
+         existing.mipCount == static_cast<uint32_t>(settings.mipCount) &&
+         existing.capacity == settings.capacity &&
+         existing.minHeight == settings.minHeight &&
+         existing.maxHeight == settings.maxHeight &&
+         existing.key == settings.key &&
+         existing.end <= static_cast<uint64_t>(info.st_size);
+}
+
+void TileStore::Create() {
+  // zero filled, so every index slot starts empty
+  if (ftruncate(fd, 0) != 0 ||
+      ftruncate(fd, static_cast<off_t>(headerSize)) != 0) {
+    close(fd);
+    throw std::runtime_error("Could not size tile store: " + path);
+  }
+
+  FileHeader fresh{};
+  std::memcpy(fresh.magic, kMagic, sizeof(kMagic));
+  fresh.version = kVersion;
+  fresh.format = static_cast<uint32_t>(settings.format);
+  fresh.resolution = settings.resolution;
+  fresh.mipCount = settings.mipCount;
+  fresh.capacity = settings.capacity;
+  fresh.minHeight = settings.minHeight;
+  fresh.maxHeight = settings.maxHeight;
+  fresh.key = settings.key;
+  fresh.end = headerSize;
+
+  if (pwrite(fd, &fresh, sizeof(fresh), 0) !=
+      static_cast<ssize_t>(sizeof(fresh))) {
+    close(fd);
+    throw std::runtime_error("Could not write tile store header: " + path);
+  }
+}
+
+int64_t TileStore::Find(int x, int z) const {
+  const IndexEntry* index = reinterpret_cast<const IndexEntry*>(
+      static_cast<const uint8_t*>(header) + kIndexOffset);
+  for (uint32_t i = Slot(x, z, settings.capacity);;
+       i = (i + 1) & (settings.capacity - 1)) {
+    const IndexEntry& entry = index[i];
+    if (entry.offset == 0) {
+      return -1;
+    }
+    if (entry.x == x && entry.z == z) {
+      return static_cast<int64_t>(entry.offset);
+    }
+  }
+}
+
+std::unique_ptr<TileView> TileStore::Read(int x, int z) {
+  int64_t offset;
+  {
+    std::shared_lock<std::shared_mutex> lock(indexMutex);
+    offset = Find(x, z);
+  }
+  if (offset < 0) {
+    misses++;
+    return nullptr;
+  }
+
+  // mappings must start on a page boundary
+  static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  const size_t start = static_cast<size_t>(offset) / pageSize * pageSize;
+  const size_t lead = static_cast<size_t>(offset) - start;
+
+  void* mapping = mmap(nullptr, lead + tileBytes, PROT_READ, MAP_SHARED, fd,
+                       static_cast<off_t>(start));
+  if (mapping == MAP_FAILED) {
+    throw std::runtime_error("Could not map tile from " + path);
+  }
+
+  hits++;
+  mappedBytes += tileBytes;
+  return std::make_unique<TileView>(
+      mapping, lead + tileBytes, static_cast<const uint8_t*>(mapping) + lead,
+      settings);
+}
+
+bool TileStore::Write(int x, int z, const Heightfield& field) {
+  if (field.Width() != settings.resolution ||
+      field.Depth() != settings.resolution) {
+    throw std::runtime_error("Tile does not match the store resolution");
+  }
+
+  {
+    std::shared_lock<std::shared_mutex> lock(indexMutex);
+    if (Find(x, z) >= 0) {
+      return true;
+    }
+  }
+
+  // encode outside the locks, writers only serialise on the append itself
+  // padded so the file always ends on a tile boundary
+  std::vector<uint8_t> tile(AlignUp(tileBytes, kTileAlignment), 0);
+  Encode(field, settings, tile.data());
+  Heightfield level = field;
+  for (int i = 1; i < settings.mipCount; i++) {
+    level = Downsample(level);
+    Encode(level, settings, tile.data() + LevelOffset(settings, i));
+  }
+
+  std::lock_guard<std::mutex> append(appendMutex);
+  FileHeader* fileHeader = static_cast<FileHeader*>(header);
+  {
+    std::shared_lock<std::shared_mutex> lock(indexMutex);
+    if (Find(x, z) >= 0) {
+      return true;
+    }
+    if (fileHeader->tileCount + 1 > settings.capacity / 4 * 3) {
+      return false;
+    }
+  }
+
+  // the data lands before the index entry, so a crash never leaves an entry
+  // pointing past the end of the file
+  const uint64_t offset = fileHeader->end;
+  size_t done = 0;
+  while (done < tile.size()) {
+    ssize_t count = pwrite(fd, tile.data() + done, tile.size() - done,
+                           static_cast<off_t>(offset + done));
+    if (count <= 0) {
+      throw std::runtime_error("Could not write tile to " + path);
+    }
+    done += static_cast<size_t>(count);
+  }
+
+  std::unique_lock<std::shared_mutex> lock(indexMutex);
+  IndexEntry* index = reinterpret_cast<IndexEntry*>(
+      static_cast<uint8_t*>(header) + kIndexOffset);
+  uint32_t i = Slot(x, z, settings.capacity);
+  while (index[i].offset != 0) {
+    i = (i + 1) & (settings.capacity - 1);
+  }
+  index[i] = IndexEntry{x, z, offset};
+  fileHeader->tileCount++;
+  fileHeader->end = offset + tile.size();
+
+  written++;
+  return true;
+}
+
+TileStoreStats TileStore::Stats() {
+  TileStoreStats result;
+  result.hits = hits;
+  result.misses = misses;
+  result.written = written;
+  result.mappedBytes = mappedBytes;
+
+  std::shared_lock<std::shared_mutex> lock(indexMutex);
+  const FileHeader* fileHeader = static_cast<const FileHeader*>(header);
+  result.tiles = fileHeader->tileCount;
+  result.fileBytes = fileHeader->end;
+  return result;
+}
+
+MemoryUsage TileStore::ProcessMemory() {
+  MemoryUsage usage;
+
+  struct rusage counters;
+  if (getrusage(RUSAGE_SELF, &counters) == 0) {
+    usage.minorFaults = static_cast<uint64_t>(counters.ru_minflt);
+    usage.majorFaults = static_cast<uint64_t>(counters.ru_majflt);
+#if defined(__APPLE__)
+    usage.peakResidentBytes = static_cast<uint64_t>(counters.ru_maxrss);
+#else
+    usage.peakResidentBytes = static_cast<uint64_t>(counters.ru_maxrss) * 1024;
+#endif
+  }
+
+  // statm reports pages: total size, then resident
+  std::ifstream statm("/proc/self/statm");
+  uint64_t totalPages = 0;
+  uint64_t residentPages = 0;
+  if (statm >> totalPages >> residentPages) {
+    usage.residentBytes =
+        residentPages * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+  } else {
+    usage.residentBytes = usage.peakResidentBytes;
+  }
+  return usage;
+}
+
+#else
+
+TileStore::TileStore(std::string path, TileStoreSettings settings)
+    : path{std::move(path)}, settings{settings} {
+  throw std::runtime_error("The tile store needs mmap support");
+}
+
+TileStore::~TileStore() {}
+
+bool TileStore::OpenExisting() {
+  return false;
+}
+
+void TileStore::Create() {}
+
+int64_t TileStore::Find(int x, int z) const {
+  return -1;
+}
+
+std::unique_ptr<TileView> TileStore::Read(int x, int z) {
+  return nullptr;
+}
+
+bool TileStore::Write(int x, int z, const Heightfield& field) {
+  return false;
+}
+
+TileStoreStats TileStore::Stats() {
+  return TileStoreStats{};
+}
+
+MemoryUsage TileStore::ProcessMemory() {
+  return MemoryUsage{};
+}
+
+#endif
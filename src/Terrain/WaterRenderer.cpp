@@ -0,0 +1,122 @@
+#include <Water.hpp>
+
+#include <algorithm>
+#include <cstddef>
+
+using namespace terrain;
+
+namespace {
+const glm::vec3 ShallowColor{0.25f, 0.55f, 0.7f};
+const glm::vec3 DeepColor{0.05f, 0.2f, 0.45f};
+
+// dry vertices sink below the ground so the shoreline ends under it
+constexpr float DryOffset = 0.05f;
+}  // namespace
+
+WaterRenderer::WaterRenderer(const ShallowWater& water)
+    : tileSize{water.TileSize()}, tilesX{water.TilesX()} {
+  tiles.resize(static_cast<size_t>(water.TilesX()) * water.TilesZ());
+
+  // every tile has the same vertex grid, edge tiles repeat the last sample
+  std::vector<unsigned int> indices = BuildGridIndices(tileSize + 1);
+  indexCount = static_cast<GLsizei>(indices.size());
+  glGenBuffers(1, &ibo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
+               indices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+WaterRenderer::~WaterRenderer() {
+  for (auto& tile : tiles) {
+    if (tile.vao) {
+      glDeleteVertexArrays(1, &tile.vao);
+      glDeleteBuffers(1, &tile.vbo);
+    }
+  }
+  glDeleteBuffers(1, &ibo);
+}
+
+void WaterRenderer::Upload(ShallowWater& water,
+                           float originX,
+                           float originZ,
+                           float spacing) {
+  const int width = water.Width();
+  const int depth = water.Depth();
+  const float dry = water.Settings().dryDepth;
+  const int row = tileSize + 1;
+
+  auto surface = [&](int x, int z) {
+    x = std::clamp(x, 0, width - 1);
+    z = std::clamp(z, 0, depth - 1);
+    return water.Ground(x, z) + water.WaterDepth(x, z);
+  };
+
+  for (int t : water.TakeDirtyTiles()) {
+    Tile& tile = tiles[t];
+    tile.visible = water.TileWet(t);
+    if (!tile.visible) {
+      continue;
+    }
+
+    const int x0 = (t % tilesX) * tileSize;
+    const int z0 = (t / tilesX) * tileSize;
+    vertices.resize(static_cast<size_t>(row) * row);
+    tile.bounds = camera::Aabb();
+    for (int vz = 0; vz < row; vz++) {
+      for (int vx = 0; vx < row; vx++) {
+        const int x = std::min(x0 + vx, width - 1);
+        const int z = std::min(z0 + vz, depth - 1);
+        const float level = water.WaterDepth(x, z);
+
+        const float dx = (surface(x + 1, z) - surface(x - 1, z)) / 2.0f;
+        const float dz = (surface(x, z + 1) - surface(x, z - 1)) / 2.0f;
+
+        TerrainVertex& vertex = vertices[static_cast<size_t>(vz) * row + vx];
+        vertex.position = glm::vec3(
+            originX + x * spacing,
+            level > dry ? surface(x, z) : water.Ground(x, z) - DryOffset,
+            originZ + z * spacing);
+        vertex.normal = glm::normalize(glm::vec3(-dx, spacing, -dz));
+        vertex.tangent = glm::normalize(glm::vec3(spacing, dx, 0.0f));
+        const float deep = std::clamp(level / 2.0f, 0.0f, 1.0f);
+        vertex.color = glm::vec4(glm::mix(ShallowColor, DeepColor, deep),
+                                 0.45f + 0.4f * deep);
+        tile.bounds.Expand(vertex.position);
+      }
+    }
+
+    if (!tile.vao) {
+      glGenVertexArrays(1, &tile.vao);
+      glGenBuffers(1, &tile.vbo);
+      glBindVertexArray(tile.vao);
+      glBindBuffer(GL_ARRAY_BUFFER, tile.vbo);
+      glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(TerrainVertex),
+                   nullptr, GL_DYNAMIC_DRAW);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+      SetupTerrainVertexAttributes();
+      // the alpha carries the opacity
+      glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex),
+                            (void*)offsetof(TerrainVertex, color));
+    } else {
+      glBindBuffer(GL_ARRAY_BUFFER, tile.vbo);
+    }
+    glBufferSubData(GL_ARRAY_BUFFER, 0,
+                    vertices.size() * sizeof(TerrainVertex), vertices.data());
+    uploads++;
+  }
+  glBindVertexArray(0);
+}
+
+void WaterRenderer::Draw(const camera::Frustum* frustum) const {
+  for (auto& tile : tiles) {
+    if (!tile.visible ||
+        (frustum && !frustum->IntersectsAabb(tile.bounds.min,
+                                             tile.bounds.max))) {
+      continue;
+    }
+    glBindVertexArray(tile.vao);
+    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+  }
+  glBindVertexArray(0);
+}
@@ -12,6 +12,10 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/matrix_operation.hpp>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <random>
 #include <vector>
 
 #include <assimp/postprocess.h>
@@ -24,62 +28,778 @@
 
 #include <Logger.hpp>
 #include <Asset.hpp>
+#include <Hash.hpp>
+#include <JobSystem.hpp>
+#include <ProgramCache.hpp>
+#include <TerrainMesh.hpp>
 
-struct VertexType {
-  glm::vec3 position;
-  glm::vec3 normal;
-  glm::vec4 color;
+namespace {
+
+const char* const kTerrainKeys[] = {
+    "terrainSeed",
+    "terrainOctaves",
+    "terrainFrequency",
+    "terrainHeightScale",
+    "terrainErosionDroplets",
+    "waterSimulation",
+    "waterStepsPerSecond",
+    "terrainStreaming",
+    "terrainViewRadius",
+    "terrainResidentChunks",
+    "terrainTileStore",
+    "terrainTileFormat",
+    "terrainLod",
+    "terrainLodError",
+    "lodSelectionReport",
 };
+}  // namespace
 
 TerrainGenerator::TerrainGenerator(config::ConfigReader& configReader)
     : OGLApplication(),
-      modelPath(asset::Asset::MODELS_DIR + "/tree.DAE"),
+      configReader(configReader),
+      terrainTilePath(asset::getExecutablePath() + "/terrain.tiles"),
+      modelPaths{asset::Asset::MODELS_DIR + "/tree.DAE"},
       vertexShaderPath(asset::Asset::SHADERS_DIR + "/shader.vert"),
-      fragmentShaderPath(asset::Asset::SHADERS_DIR + "/shader.frag") {
-  if (configReader.ContainsKey("model")) {
-    std::string modelName = configReader.ReadString("model");
-    modelPath = asset::Asset::MODELS_DIR + "/" + modelName;
-    logging::Logger::LogInfo("Overriding default model vale: " + modelPath);
+      fragmentShaderPath(asset::Asset::SHADERS_DIR + "/shader.frag"),
+      terrainVertexShaderPath(asset::Asset::SHADERS_DIR + "/terrain.vert"),
+      instancedVertexShaderPath(asset::Asset::SHADERS_DIR +
+                                "/instanced.vert"),
+      waterVertexShaderPath(asset::Asset::SHADERS_DIR + "/water.vert") {
+  // one snapshot so every key comes from the same version of the file
+  auto config = configReader.Snapshot();
+
+  if (config->ContainsKey("model")) {
+    std::string modelName = config->ReadString("model");
+    modelPaths = {asset::Asset::MODELS_DIR + "/" + modelName};
+    LOG_INFO("Overriding default model vale: " + modelPaths.front());
+  }
+
+  if (config->ContainsKey("models")) {
+    modelPaths.clear();
+    for (auto& modelName : config->ReadStringList("models")) {
+      modelPaths.push_back(asset::Asset::MODELS_DIR + "/" + modelName);
+      LOG_INFO("Adding model: " + modelPaths.back());
+    }
   }
 
-  if (configReader.ContainsKey("vertexShader")) {
-    std::string vertexShaderName = configReader.ReadString("vertexShader");
+  if (config->ContainsKey("vertexShader")) {
+    std::string vertexShaderName = config->ReadString("vertexShader");
     vertexShaderPath = asset::Asset::SHADERS_DIR + "/" + vertexShaderName;
-    logging::Logger::LogInfo("Overriding default vertex value: " +
-                             vertexShaderPath);
+    LOG_INFO("Overriding default vertex value: " + vertexShaderPath);
   }
 
-  if (configReader.ContainsKey("fragmentShader")) {
-    std::string fragmentShaderName = configReader.ReadString("fragmentShader");
+  if (config->ContainsKey("fragmentShader")) {
+    std::string fragmentShaderName = config->ReadString("fragmentShader");
     fragmentShaderPath = asset::Asset::SHADERS_DIR + "/" + fragmentShaderName;
-    logging::Logger::LogInfo("Overriding default fragment value: " +
-                             fragmentShaderPath);
+    LOG_INFO("Overriding default fragment value: " + fragmentShaderPath);
+  }
+
+  if (config->ContainsKey("modelInstances")) {
+    modelInstanceCount = config->ReadInt("modelInstances");
+    LOG_INFO("Overriding default model instances: " +
+             std::to_string(modelInstanceCount));
+  }
+
+  if (config->ContainsKey("instancedRendering")) {
+    instancedRendering = config->ReadBool("instancedRendering");
+    LOG_INFO("Overriding default instanced rendering: " +
+             std::to_string(instancedRendering));
+  }
+
+  if (config->ContainsKey("cameraFollowTerrain")) {
+    cameraFollowTerrain = config->ReadBool("cameraFollowTerrain");
+    LOG_INFO("Overriding default camera follow terrain: " +
+             std::to_string(cameraFollowTerrain));
+  }
+
+  if (config->ContainsKey("cameraEyeHeight")) {
+    cameraEyeHeight = static_cast<float>(config->ReadReal("cameraEyeHeight"));
+    LOG_INFO("Overriding default camera eye height: " +
+             std::to_string(cameraEyeHeight));
+  }
+
+  if (config->ContainsKey("physicsStepsPerSecond")) {
+    physicsSettings.stepsPerSecond =
+        static_cast<float>(config->ReadReal("physicsStepsPerSecond"));
+    LOG_INFO("Overriding default physics steps per second: " +
+             std::to_string(physicsSettings.stepsPerSecond));
+  }
+
+  if (config->ContainsKey("frustumCulling")) {
+    frustumCulling = config->ReadBool("frustumCulling");
+    LOG_INFO("Overriding default frustum culling: " +
+             std::to_string(frustumCulling));
   }
 
+  if (config->ContainsKey("textureBudgetMB")) {
+    const int budget = config->ReadInt("textureBudgetMB");
+    resources::ResourceManager::GetManager().SetTextureBudget(
+        static_cast<size_t>(std::max(budget, 0)) << 20);
+    LOG_INFO("Overriding default texture budget: " + std::to_string(budget) +
+             " MB");
+  }
+
+  ReadTerrainConfig(*config);
+
   Init();
+
+  // terrain keys apply without a restart, the regeneration runs between
+  // frames on the GL thread
+  configSubscription = configReader.Subscribe(
+      [this](std::shared_ptr<const config::ConfigSnapshot> previous,
+             std::shared_ptr<const config::ConfigSnapshot> current) {
+        bool changed = false;
+        for (auto key : kTerrainKeys) {
+          changed = changed || current->Changed(*previous, key);
+        }
+        if (!changed) {
+          return;
+        }
+
+        jobs::JobSystem::GetInstance().SubmitMainThread([this, current]() {
+          LOG_INFO("Terrain config changed, regenerating");
+          ReadTerrainConfig(*current);
+          RegenerateTerrain();
+        });
+      });
+}
+
+TerrainGenerator::~TerrainGenerator() {
+  configReader.Unsubscribe(configSubscription);
+  StopWater();
+  StopPhysics();
+}
+
+// Keys that are removed from the file keep their last value.
+void TerrainGenerator::ReadTerrainConfig(const config::ConfigSnapshot& config) {
+  if (config.ContainsKey("terrainSeed")) {
+    noiseParameters.seed =
+        static_cast<uint32_t>(config.ReadInt("terrainSeed"));
+    LOG_INFO("Overriding default terrain seed: " +
+             std::to_string(noiseParameters.seed));
+  }
+
+  if (config.ContainsKey("terrainOctaves")) {
+    noiseParameters.octaves = config.ReadInt("terrainOctaves");
+    LOG_INFO("Overriding default terrain octaves: " +
+             std::to_string(noiseParameters.octaves));
+  }
+
+  if (config.ContainsKey("terrainFrequency")) {
+    noiseParameters.frequency =
+        static_cast<float>(config.ReadReal("terrainFrequency"));
+    LOG_INFO("Overriding default terrain frequency: " +
+             std::to_string(noiseParameters.frequency));
+  }
+
+  if (config.ContainsKey("terrainHeightScale")) {
+    terrainHeightScale =
+        static_cast<float>(config.ReadReal("terrainHeightScale"));
+    LOG_INFO("Overriding default terrain height scale: " +
+             std::to_string(terrainHeightScale));
+  }
+
+  if (config.ContainsKey("terrainErosionDroplets")) {
+    erosionSettings.droplets = config.ReadInt("terrainErosionDroplets");
+    LOG_INFO("Overriding default erosion droplets: " +
+             std::to_string(erosionSettings.droplets));
+  }
+
+  if (config.ContainsKey("waterSimulation")) {
+    waterSimulation = config.ReadBool("waterSimulation");
+    LOG_INFO("Overriding default water simulation: " +
+             std::to_string(waterSimulation));
+  }
+
+  if (config.ContainsKey("waterStepsPerSecond")) {
+    waterSettings.stepsPerSecond =
+        static_cast<float>(config.ReadReal("waterStepsPerSecond"));
+    LOG_INFO("Overriding default water steps per second: " +
+             std::to_string(waterSettings.stepsPerSecond));
+  }
+
+  if (config.ContainsKey("terrainStreaming")) {
+    terrainStreaming = config.ReadBool("terrainStreaming");
+    LOG_INFO("Overriding default terrain streaming: " +
+             std::to_string(terrainStreaming));
+  }
+
+  if (config.ContainsKey("terrainViewRadius")) {
+    chunkSettings.viewRadius = config.ReadInt("terrainViewRadius");
+    LOG_INFO("Overriding default terrain view radius: " +
+             std::to_string(chunkSettings.viewRadius));
+  }
+
+  if (config.ContainsKey("terrainResidentChunks")) {
+    chunkSettings.maxResident = config.ReadInt("terrainResidentChunks");
+    LOG_INFO("Overriding default resident chunks: " +
+             std::to_string(chunkSettings.maxResident));
+  }
+
+  if (config.ContainsKey("terrainTileStore")) {
+    terrainTilePath = config.ReadString("terrainTileStore");
+    LOG_INFO("Overriding default terrain tile store: " + terrainTilePath);
+  }
+
+  if (config.ContainsKey("terrainTileFormat")) {
+    std::string format = config.ReadString("terrainTileFormat");
+    terrainTileFormat = format == "unorm16" ? terrain::TileFormat::Unorm16
+                                            : terrain::TileFormat::Float32;
+    LOG_INFO("Overriding default terrain tile format: " + format);
+  }
+
+  if (config.ContainsKey("terrainLod")) {
+    terrainLod = config.ReadBool("terrainLod");
+    LOG_INFO("Overriding default terrain LOD: " + std::to_string(terrainLod));
+  }
+
+  if (config.ContainsKey("terrainLodError")) {
+    cdlodSettings.maxScreenSpaceError =
+        static_cast<float>(config.ReadReal("terrainLodError"));
+    LOG_INFO("Overriding default terrain LOD error: " +
+             std::to_string(cdlodSettings.maxScreenSpaceError));
+  }
+
+  if (config.ContainsKey("lodSelectionReport")) {
+    lodSelectionReport = config.ReadBool("lodSelectionReport");
+  }
+
+  chunkSettings.spacing = terrainSpacing;
+  chunkSettings.heightScale = terrainHeightScale;
+  erosionSettings.seed = noiseParameters.seed;
+  erosionSettings.verticalScale = terrainHeightScale / terrainSpacing;
 }
 
 void TerrainGenerator::Init() {
-  auto manager = resources::ResourceManager::GetManager();
+  auto& manager = resources::ResourceManager::GetManager();
+
+  // Create shaders. Every program starts building before the first one is
+  // waited on, so the driver can compile and link them side by side
+  auto shaderStart = std::chrono::steady_clock::now();
+  rendering::ProgramCache programCache(asset::Asset::CACHE_DIR + "/programs");
 
-  // Create shaders
   auto vertexShader = Shader(vertexShaderPath, GL_VERTEX_SHADER);
   auto fragmentShader = Shader(fragmentShaderPath, GL_FRAGMENT_SHADER);
   shaderProgram = std::make_unique<ShaderProgram>(
-      std::initializer_list<Shader>{vertexShader, fragmentShader});
+      std::initializer_list<Shader>{vertexShader, fragmentShader},
+      programCache);
+
+  auto terrainVertexShader = Shader(terrainVertexShaderPath, GL_VERTEX_SHADER);
+  terrainShaderProgram = std::make_unique<ShaderProgram>(
+      std::initializer_list<Shader>{terrainVertexShader, fragmentShader},
+      programCache);
+
+  auto instancedVertexShader =
+      Shader(instancedVertexShaderPath, GL_VERTEX_SHADER);
+  instancedShaderProgram = std::make_unique<ShaderProgram>(
+      std::initializer_list<Shader>{instancedVertexShader, fragmentShader},
+      programCache);
+
+  auto waterVertexShader = Shader(waterVertexShaderPath, GL_VERTEX_SHADER);
+  waterShaderProgram = std::make_unique<ShaderProgram>(
+      std::initializer_list<Shader>{waterVertexShader, fragmentShader},
+      programCache);
+
+  shaderProgram->finish();
+  terrainShaderProgram->finish();
+  instancedShaderProgram->finish();
+  waterShaderProgram->finish();
+
+  std::chrono::duration<double, std::milli> shaderTime =
+      std::chrono::steady_clock::now() - shaderStart;
+  LOG_INFO("Shader programs ready in " + std::to_string(shaderTime.count()) +
+           " ms, " + std::to_string(programCache.Hits()) + " from the cache, " +
+           std::to_string(programCache.Misses()) + " compiled");
 
-  auto model = manager.LoadModel(modelPath);
+  frameUniforms = std::make_unique<rendering::UniformBuffer>(
+      kFrameBlockBinding, sizeof(rendering::FrameUniforms));
 
-  models.push_back(model);
+  // materials bind textures to fixed units, the samplers are set up once
+  models::Material::BindSamplerUnits(*shaderProgram);
+  models::Material::BindSamplerUnits(*instancedShaderProgram);
 
-  // setup the camera
-  cameraPos = glm::vec3(0.0, 0.0, 50.0);
+  // models import and decode on the workers, each draws a placeholder until
+  // its upload ran between frames
+  for (auto& modelPath : modelPaths) {
+    models.push_back(manager.LoadModelAsync(modelPath));
+  }
+
+  GenerateTerrain();
+
+  if (modelInstanceCount > 0 && !models.empty()) {
+    scatteredModels = std::make_unique<models::ModelInstances>(models.front());
+    scatteredModels->Set(ScatterInstances(modelInstanceCount, 1));
+  }
+
+  // setup the camera, starting just above the terrain surface
+  const float groundHeight = heightPyramid->Height(0.0f, 50.0f);
+  cameraPos =
+      glm::vec3(0.0, std::max(groundHeight, 0.0f) + cameraEyeHeight, 50.0);
   cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
   cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
   cameraTarget = glm::vec3(0.0f, 0.0f, 0.0f);
   cameraDirection = glm::normalize(cameraPos - cameraTarget);
 }
 
+void TerrainGenerator::GenerateTerrain() {
+  heightfield = std::make_unique<terrain::Heightfield>(size, size);
+  terrain::NoiseGenerator noise{
+      terrain::GridParameters(noiseParameters, terrainSpacing)};
+
+  // sampled exactly where the streamed chunks sample
+  const float first = static_cast<float>(GridFirst());
+  const float origin = GridOrigin();
+
+  auto start = std::chrono::steady_clock::now();
+  noise.Generate(*heightfield, first, first, 1.0f);
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  LOG_INFO("Generated " + std::to_string(size) + "x" + std::to_string(size) +
+           " heightfield with " + std::to_string(noiseParameters.octaves) +
+           " octaves (" + terrain::NoiseGenerator::SimdPath() + ") in " +
+           std::to_string(elapsed.count()) + " ms");
+
+  // streamed chunks come straight from the noise, the camera and the
+  // scattered models must agree with them
+  if (!terrainStreaming && erosionSettings.droplets > 0) {
+    const terrain::HydraulicErosion erosion{erosionSettings};
+    start = std::chrono::steady_clock::now();
+    erosion.Erode(*heightfield, jobs::JobSystem::GetInstance());
+    elapsed = std::chrono::steady_clock::now() - start;
+
+    const size_t droplets = erosion.DropletCount(size, size);
+    LOG_INFO(
+        "Eroded the heightfield with " + std::to_string(droplets) +
+        " droplets (" + terrain::HydraulicErosion::SimdPath() + ") in " +
+        std::to_string(elapsed.count()) + " ms, " +
+        std::to_string(static_cast<size_t>(droplets /
+                                           (elapsed.count() / 1000.0))) +
+        " droplets/s");
+  }
+
+  start = std::chrono::steady_clock::now();
+  heightPyramid = std::make_unique<terrain::HeightPyramid>(
+      *heightfield, terrainHeightScale, terrainSpacing, origin, origin);
+  elapsed = std::chrono::steady_clock::now() - start;
+  LOG_INFO("Built a " + std::to_string(heightPyramid->Levels()) +
+           " level height pyramid in " + std::to_string(elapsed.count()) +
+           " ms");
+
+  physicsWorld = std::make_unique<physics::PhysicsWorld>(physicsSettings);
+  physicsWorld->SetGround(heightPyramid.get());
+  physicsClock = std::chrono::steady_clock::now();
+
+  LogMemoryUsage("After heightfield generation");
+
+  // streamed chunks sample the same grid as the heightfield, so water runs
+  // in every mode but only over the extent of the heightfield
+  if (waterSimulation) {
+    water = std::make_unique<terrain::ShallowWater>(
+        *heightfield, terrainHeightScale, terrainSpacing, waterSettings);
+    waterRenderer = std::make_unique<terrain::WaterRenderer>(*water);
+    waterClock = std::chrono::steady_clock::now();
+  }
+
+  if (terrainStreaming) {
+    if (!terrainTilePath.empty()) {
+      terrain::TileStoreSettings tileSettings;
+      tileSettings.resolution = chunkSettings.resolution + 2;
+      tileSettings.format = terrainTileFormat;
+
+      // tiles from other noise parameters or spacing are never reused; the
+      // key covers their exact bits and is the same in every build
+      static_assert(sizeof(terrain::NoiseParameters) == 5 * sizeof(float),
+                    "NoiseParameters must not contain padding");
+      tileSettings.key = hashing::Fnv1a(
+          &chunkSettings.spacing, sizeof(chunkSettings.spacing),
+          hashing::Fnv1a(&noiseParameters, sizeof(noiseParameters)));
+
+      try {
+        tileStore =
+            std::make_shared<terrain::TileStore>(terrainTilePath, tileSettings);
+        LOG_INFO("Terrain tile store " + terrainTilePath + " with " +
+                 std::to_string(tileStore->Stats().tiles) + " tiles");
+      } catch (const std::runtime_error& e) {
+        logging::Logger::LogError(e.what());
+      }
+    }
+
+    chunkManager = std::make_unique<terrain::ChunkManager>(
+        chunkSettings, noiseParameters, tileStore);
+    return;
+  }
+
+  if (terrainLod) {
+    cdlodTree = std::make_unique<terrain::CdlodQuadtree>(
+        *heightfield, origin, origin, terrainSpacing, terrainHeightScale,
+        cdlodSettings);
+    cdlodRenderer = std::make_unique<terrain::CdlodRenderer>(
+        *heightfield, cdlodSettings.leafSize);
+
+    if (lodSelectionReport) {
+      ReportLodSelection();
+    }
+    return;
+  }
+
+  std::vector<terrain::TerrainVertex> vertices;
+  terrain::BuildTerrainVertices(*heightfield, 0,
+                                static_cast<float>(GridFirst()),
+                                static_cast<float>(GridFirst()),
+                                terrainSpacing, terrainHeightScale, vertices);
+  std::vector<unsigned int> indices = terrain::BuildGridIndices(size);
+
+  num_vertices = vertices.size();
+  num_indexes = indices.size();
+
+  glGenVertexArrays(1, &vao);
+  glGenBuffers(1, &vbo);
+  glGenBuffers(1, &ibo);
+
+  glBindVertexArray(vao);
+
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER,
+               vertices.size() * sizeof(terrain::TerrainVertex),
+               vertices.data(), GL_STATIC_DRAW);
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
+               indices.data(), GL_STATIC_DRAW);
+
+  terrain::SetupTerrainVertexAttributes();
+
+  glBindVertexArray(0);
+}
+
+void TerrainGenerator::RegenerateTerrain() {
+  StopWater();
+  StopPhysics();
+  // the tile store file must be closed before a new key can reset it
+  chunkManager.reset();
+  tileStore.reset();
+  cdlodRenderer.reset();
+  cdlodTree.reset();
+  cdlodSelection.clear();
+
+  if (vao) {
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vbo);
+    glDeleteBuffers(1, &ibo);
+    vao = vbo = ibo = 0;
+  }
+
+  GenerateTerrain();
+
+  // keep the scattered models on the new surface
+  if (scatteredModels) {
+    scatteredModels->Set(ScatterInstances(scatteredModels->Size(), 1));
+  }
+}
+
+std::vector<models::MeshInstance> TerrainGenerator::ScatterInstances(
+    size_t count,
+    uint32_t seed) const {
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+  // anywhere over the grid, the heights come in one batch
+  const float origin = GridOrigin();
+  const float extent = terrainSpacing * (size - 1);
+  std::vector<float> xs(count);
+  std::vector<float> zs(count);
+  std::vector<float> heights(count);
+  for (size_t i = 0; i < count; i++) {
+    xs[i] = origin + extent * unit(random);
+    zs[i] = origin + extent * unit(random);
+  }
+  heightPyramid->Heights(xs.data(), zs.data(), heights.data(), count);
+
+  std::vector<models::MeshInstance> instances;
+  instances.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    const glm::vec3 position(xs[i], heights[i], zs[i]);
+
+    glm::mat4 transform = glm::translate(glm::mat4(1.0f), position);
+    transform = glm::rotate(transform, unit(random) * 6.2831853f,
+                            glm::vec3(0.0f, 1.0f, 0.0f));
+    transform = glm::scale(transform, glm::vec3(0.75f + 0.5f * unit(random)));
+
+    const float shade = 0.8f + 0.2f * unit(random);
+    instances.push_back(models::MeshInstance{
+        transform, glm::vec4(shade, 0.9f + 0.1f * unit(random), shade, 1.0f)});
+  }
+  return instances;
+}
+
+// Compares the CPU time of submitting one frame of scattered models through
+// both paths. The GPU is drained between frames so queued work from one
+// path does not bill the other.
+bool TerrainGenerator::BenchmarkInstancing() {
+  if (models.empty() || !models.front()->IsReady()) {
+    logging::Logger::LogWarn("Instancing benchmark needs a loaded model");
+    return false;
+  }
+
+  const int frames = 5;
+  for (size_t count : {1000, 10000, 100000}) {
+    models::ModelInstances instances(models.front());
+    instances.Set(ScatterInstances(count, 7));
+
+    auto time = [&](ShaderProgram& shader, bool instanced) {
+      shader.use();
+
+      double total = 0.0;
+      for (int frame = 0; frame <= frames; frame++) {
+        glFinish();
+        auto start = std::chrono::steady_clock::now();
+        if (instanced) {
+          instances.Draw(shader);
+        } else {
+          instances.DrawEach(shader);
+        }
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+        // the first frame uploads the instance buffers
+        if (frame > 0) {
+          total += elapsed.count();
+        }
+      }
+      glFinish();
+      return total / frames;
+    };
+
+    const double perObject = time(*shaderProgram, false);
+    const double instanced = time(*instancedShaderProgram, true);
+    LOG_INFO("Instancing " + std::to_string(count) + " models: per-object " +
+             std::to_string(perObject) + " ms, instanced " +
+             std::to_string(instanced) + " ms per frame, " +
+             std::to_string(count * models.front()->InstanceCount()) +
+             " draw calls against " +
+             std::to_string(models.front()->MeshCount()));
+  }
+  return true;
+}
+
+// Times setting the model matrix of the model shader through each lookup:
+// the string keyed map the programs used before, a name hashed at run time,
+// a name hashed at compile time and a handle resolved up front. The GL call
+// is the same in all four, the differences are the lookup.
+bool TerrainGenerator::BenchmarkUniforms() {
+  const int calls = 100000;
+  shaderProgram->use();
+
+  std::map<std::string, GLint> names;
+  for (auto& info : shaderProgram->activeUniforms()) {
+    names[info.name] = info.location;
+  }
+  const std::string runtimeName = "model";
+  constexpr UniformId compiledName("model");
+  const UniformHandle handle = shaderProgram->uniformHandle(compiledName);
+  if (static_cast<GLint>(handle) < 0) {
+    logging::Logger::LogWarn(
+        "Uniform benchmark needs a model uniform in the model shader");
+    return false;
+  }
+
+  auto time = [&](auto&& set) {
+    glFinish();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < calls; i++) {
+      set();
+    }
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    glFinish();
+    return elapsed.count() / calls;
+  };
+
+  const double map = time([&] {
+    shaderProgram->setUniform(UniformHandle(names[std::string("model")]),
+                              model);
+  });
+  const double hashed =
+      time([&] { shaderProgram->setUniform(runtimeName, model); });
+  const double compiled =
+      time([&] { shaderProgram->setUniform(compiledName, model); });
+  const double direct = time([&] { shaderProgram->setUniform(handle, model); });
+
+  LOG_INFO("Uniform mat4 per call: string map " + std::to_string(map) +
+           " ns, runtime hash " + std::to_string(hashed) +
+           " ns, compile-time " + "hash " + std::to_string(compiled) +
+           " ns, handle " + std::to_string(direct) + " ns");
+  return true;
+}
+
+// Erodes copies of freshly generated noise with growing thread counts, each
+// run on its own job system, and reports throughput and scaling. Every run
+// must match the single threaded scalar reference bit for bit.
+void TerrainGenerator::BenchmarkErosion() {
+  terrain::Heightfield field(size, size);
+  const float first = static_cast<float>(GridFirst());
+  terrain::NoiseGenerator{
+      terrain::GridParameters(noiseParameters, terrainSpacing)}
+      .Generate(field, first, first, 1.0f);
+
+  double single = 0.0;
+  for (auto& result : terrain::BenchmarkErosion(field, erosionSettings)) {
+    if (result.threads == 1) {
+      single = result.milliseconds;
+    }
+    LOG_INFO("Erosion on " + std::to_string(result.threads) + " threads (" +
+             terrain::HydraulicErosion::SimdPath() + "): " +
+             std::to_string(result.milliseconds) + " ms, " +
+             std::to_string(static_cast<size_t>(result.dropletsPerSecond)) +
+             " droplets/s, speedup " +
+             std::to_string(single / result.milliseconds));
+    if (!result.matches) {
+      logging::Logger::LogError(
+          "Erosion mismatch: " + std::to_string(result.threads) +
+          " threads disagree with the scalar reference");
+    }
+  }
+}
+
+// Rays start a little above the current surface, so the eroded heightfield
+// is what gets measured when erosion ran.
+void TerrainGenerator::BenchmarkRaycasts() {
+  terrain::ReportRaycastBenchmark(*heightPyramid, 100000, 7);
+}
+
+// The image is fractal noise through a terrain-like color ramp, with a second
+// octave set as alpha, so it has both smooth gradients and fine detail.
+void TerrainGenerator::BenchmarkTextureCompression(
+    const terrain::NoiseParameters& noiseParameters) {
+  const int size = 1024;
+  terrain::NoiseGenerator color{noiseParameters};
+  terrain::NoiseParameters alphaParameters = noiseParameters;
+  alphaParameters.seed += 1;
+  alphaParameters.frequency *= 4.0f;
+  terrain::NoiseGenerator alpha{alphaParameters};
+
+  models::TextureLevel image;
+  image.width = size;
+  image.height = size;
+  image.data.resize(static_cast<size_t>(size) * size * 4);
+  std::vector<float> heights(size);
+  std::vector<float> alphas(size);
+  for (int y = 0; y < size; y++) {
+    color.FbmRow(0.0f, static_cast<float>(y), 1.0f, heights.data(), size);
+    alpha.FbmRow(0.0f, static_cast<float>(y), 1.0f, alphas.data(), size);
+    for (int x = 0; x < size; x++) {
+      const float h = glm::clamp(heights[x] * 0.5f + 0.5f, 0.0f, 1.0f);
+      const glm::vec3 rgb =
+          glm::mix(glm::vec3(0.2f, 0.5f, 0.1f), glm::vec3(0.6f, 0.5f, 0.4f), h);
+      uint8_t* pixel = &image.data[(static_cast<size_t>(y) * size + x) * 4];
+      pixel[0] = static_cast<uint8_t>(rgb.r * 255.0f);
+      pixel[1] = static_cast<uint8_t>(rgb.g * 255.0f);
+      pixel[2] = static_cast<uint8_t>(rgb.b * 255.0f);
+      pixel[3] = static_cast<uint8_t>(
+          glm::clamp(alphas[x] * 0.5f + 0.5f, 0.0f, 1.0f) * 255.0f);
+    }
+  }
+
+  for (auto& result : models::BenchmarkTextureEncoders(image)) {
+    LOG_INFO(std::string(models::TextureFormatName(result.format)) + ": " +
+             std::to_string(result.singleThreadMs) + " ms on one thread, " +
+             std::to_string(result.threadedMs) + " ms on " +
+             std::to_string(jobs::JobSystem::GetInstance().WorkerCount()) +
+             " workers (" + std::to_string(result.megapixelsPerSecond) +
+             " MP/s), PSNR " + std::to_string(result.psnr) + " dB, " +
+             std::to_string(result.ratio) + "x smaller than RGBA8");
+  }
+}
+
+bool TerrainGenerator::RunBenchmark(const std::string& name) {
+  if (name == "instancing") {
+    // the first model loads on the workers, the wait runs its upload here
+    if (!models.empty() && !models.front()->IsReady() &&
+        models.front()->LoadJob()) {
+      jobs::JobSystem::GetInstance().Wait(models.front()->LoadJob());
+    }
+    return BenchmarkInstancing();
+  }
+  if (name == "uniforms") {
+    return BenchmarkUniforms();
+  }
+  logging::Logger::LogError("Unknown benchmark " + name);
+  return false;
+}
+
+void TerrainGenerator::ReportLodSelection() {
+  // a fixed diagonal fly-over so runs can be compared
+  const int frames = 240;
+  const float extent = 0.4f * terrainSpacing * size;
+
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> fronts;
+  for (int i = 0; i < frames; i++) {
+    float t = static_cast<float>(i) / (frames - 1);
+    float along = -extent + 2.0f * extent * t;
+    positions.push_back(glm::vec3(along, terrainHeightScale * 0.5f, along));
+    fronts.push_back(glm::normalize(glm::vec3(1.0f, -0.2f, 1.0f)));
+  }
+
+  cdlodTree->UpdateRanges(glm::radians(fov), static_cast<float>(getHeight()),
+                          zfar);
+  auto reports =
+      terrain::TraceCameraPath(*cdlodTree, positions, fronts, glm::radians(fov),
+                               getWindowRatio(), znear, zfar);
+
+  size_t total = 0;
+  size_t peak = 0;
+  for (size_t i = 0; i < reports.size(); i++) {
+    LOG_INFO("LOD frame " + std::to_string(i) + ": " +
+             std::to_string(reports[i].nodes) + " nodes, " +
+             std::to_string(reports[i].triangles) + " triangles");
+    total += reports[i].triangles;
+    peak = std::max(peak, reports[i].triangles);
+  }
+
+  const size_t full = static_cast<size_t>(size - 1) * (size - 1) * 2;
+  LOG_INFO("LOD selection: average " + std::to_string(total / reports.size()) +
+           " triangles, peak " + std::to_string(peak) + ", full grid " +
+           std::to_string(full));
+}
+
+void TerrainGenerator::LogChunkStats() {
+  if (!chunkManager) {
+    return;
+  }
+
+  auto stats = chunkManager->Stats();
+  LOG_INFO("Chunks: resident=" + std::to_string(stats.resident) + " pending=" +
+           std::to_string(stats.pending) + " hits=" +
+           std::to_string(stats.hits) + " misses=" +
+           std::to_string(stats.misses) + " prefetches=" +
+           std::to_string(stats.prefetches) + " evictions=" +
+           std::to_string(stats.evictions) + " generated=" +
+           std::to_string(stats.generated) + " loaded=" +
+           std::to_string(stats.loaded) + " cancelled=" +
+           std::to_string(stats.cancelled) + " visible=" +
+           std::to_string(stats.visible) + "/" + std::to_string(stats.inRange));
+
+  if (tileStore) {
+    auto tiles = tileStore->Stats();
+    LOG_INFO("Tile store: tiles=" + std::to_string(tiles.tiles) + " hits=" +
+             std::to_string(tiles.hits) + " misses=" +
+             std::to_string(tiles.misses) + " written=" +
+             std::to_string(tiles.written) + " file=" +
+             std::to_string(tiles.fileBytes >> 20) + "MB" + " mapped=" +
+             std::to_string(tiles.mappedBytes >> 20) + "MB");
+  }
+  LogMemoryUsage("Chunk streaming");
+}
+
+void TerrainGenerator::LogMemoryUsage(const std::string& context) {
+  auto usage = terrain::TileStore::ProcessMemory();
+  LOG_INFO(context + ": rss=" + std::to_string(usage.residentBytes >> 20) +
+           "MB" + " peak=" + std::to_string(usage.peakResidentBytes >> 20) +
+           "MB" + " minorFaults=" + std::to_string(usage.minorFaults) +
+           " majorFaults=" + std::to_string(usage.majorFaults));
+}
+
 void TerrainGenerator::render() {
   // exit on window close button pressed
   if (glfwWindowShouldClose(getWindow()))
@@ -87,6 +807,8 @@ void TerrainGenerator::render() {
 
   processInput(getWindow());
 
+  resources::ResourceManager::GetManager().BeginFrame();
+
   // set matrix : projection + view
   projection =
       glm::perspective(glm::radians(fov), getWindowRatio(), znear, zfar);
@@ -94,21 +816,322 @@ void TerrainGenerator::render() {
   // glm::lookAt(eye, center, up)
   view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
 
+  frameUniforms->Update(
+      rendering::FrameUniforms{projection, view, glm::vec4(cameraPos, 1.0f)});
+
   // clear
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+  const camera::Frustum frustum(projection * view);
+  const camera::Frustum* culling = frustumCulling ? &frustum : nullptr;
+
+  if (cdlodTree) {
+    cdlodTree->UpdateRanges(glm::radians(fov),
+                            static_cast<float>(getHeight()), zfar);
+    cdlodTree->Select(cameraPos, frustum, cdlodSelection);
+
+    const float origin = GridOrigin();
+    terrainShaderProgram->use();
+    cdlodRenderer->Draw(*terrainShaderProgram, *cdlodTree, cdlodSelection,
+                        origin, origin, terrainSpacing, terrainHeightScale);
+  }
+
   shaderProgram->use();
 
-  // send uniforms
-  shaderProgram->setUniform("camera", cameraPos);
+  // send uniforms, the frame block holds the camera
   shaderProgram->setUniform("model", model);
-  shaderProgram->setUniform("projection", projection);
-  shaderProgram->setUniform("view", view);
 
-  for (size_t i = 0; i < this->models.size(); i++) {
-    this->models[i]->Draw(*shaderProgram);
+  // terrain vertices are plain floats, meshes set their own bounds
+  shaderProgram->setUniform("positionOffset", glm::vec3(0.0f));
+  shaderProgram->setUniform("positionScale", glm::vec3(1.0f));
+
+  if (chunkManager) {
+    chunkManager->Update(cameraPos, cameraFront, speed);
+    chunkManager->Draw(culling);
+  } else if (!cdlodTree) {
+    glBindVertexArray(vao);
+    glDrawElements(GL_TRIANGLES, (GLsizei)num_indexes, GL_UNSIGNED_INT, 0);
+    glBindVertexArray(0);
+  }
+
+  renderQueue.Begin(cameraPos, zfar);
+  RecordModels(culling);
+
+  if (scatteredModels) {
+    if (instancedRendering) {
+      scatteredModels->Record(renderQueue, *instancedShaderProgram, culling);
+    } else {
+      scatteredModels->RecordEach(renderQueue, *shaderProgram, culling);
+    }
+  }
+
+  if (physicsWorld) {
+    UpdatePhysics();
+  }
+  if (droppedModels) {
+    droppedModels->Record(renderQueue, *instancedShaderProgram, culling);
+  }
+
+  renderQueue.Flush();
+
+  // transparent, after everything opaque
+  if (water) {
+    UpdateWater(culling);
+  }
+}
+
+void TerrainGenerator::UpdateWater(const camera::Frustum* frustum) {
+  auto& jobSystem = jobs::JobSystem::GetInstance();
+
+  // the previous batch still runs: draw what was uploaded before it
+  if (!waterJob || waterJob->IsFinished()) {
+    const float origin = GridOrigin();
+    waterRenderer->Upload(*water, origin, origin, terrainSpacing);
+
+    water->Sources().clear();
+    if (waterSpring) {
+      water->Sources().push_back(waterSource);
+    }
+
+    // the batch covers the time since the previous one started, however
+    // many frames that was
+    const auto now = std::chrono::steady_clock::now();
+    const double elapsed =
+        std::chrono::duration<double>(now - waterClock).count();
+    waterClock = now;
+    waterJob = jobSystem.Submit([this, elapsed, &jobSystem]() {
+      water->Advance(elapsed, &jobSystem);
+    });
+  }
+
+  waterShaderProgram->use();
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glDepthMask(GL_FALSE);
+  waterRenderer->Draw(frustum);
+  glDepthMask(GL_TRUE);
+  glDisable(GL_BLEND);
+}
+
+void TerrainGenerator::StopWater() {
+  if (waterJob) {
+    try {
+      jobs::JobSystem::GetInstance().Wait(waterJob);
+    } catch (const std::exception& e) {
+      logging::Logger::LogError(e.what());
+    }
+    waterJob.reset();
+  }
+  waterRenderer.reset();
+  water.reset();
+}
+
+void TerrainGenerator::UpdatePhysics() {
+  // the previous batch still runs: draw the poses from before it
+  if (physicsJob && !physicsJob->IsFinished()) {
+    return;
+  }
+
+  const auto now = std::chrono::steady_clock::now();
+  const double elapsed =
+      std::chrono::duration<double>(now - physicsClock).count();
+  physicsClock = now;
+  const size_t bodies = physicsWorld->BodyCount();
+  if (bodies == 0 || !droppedModels) {
+    return;
+  }
+
+  std::vector<models::MeshInstance> instances;
+  instances.reserve(bodies);
+  for (uint32_t body = 0; body < bodies; body++) {
+    instances.push_back(models::MeshInstance{
+        physicsWorld->Transform(body) * droppedModelOffset, glm::vec4(1.0f)});
+  }
+  droppedModels->Set(std::move(instances));
+
+  auto& jobSystem = jobs::JobSystem::GetInstance();
+  physicsJob = jobSystem.Submit([this, elapsed, &jobSystem]() {
+    physicsWorld->Advance(elapsed, &jobSystem);
+  });
+}
+
+void TerrainGenerator::StopPhysics() {
+  if (physicsJob) {
+    try {
+      jobs::JobSystem::GetInstance().Wait(physicsJob);
+    } catch (const std::exception& e) {
+      logging::Logger::LogError(e.what());
+    }
+    physicsJob.reset();
+  }
+  droppedModels.reset();
+  physicsWorld.reset();
+}
+
+// Drops a 10x10 grid of boxes shaped like the first model above the point
+// the camera looks at.
+void TerrainGenerator::DropBodies() {
+  if (!physicsWorld || models.empty() || !models.front()->IsReady()) {
+    logging::Logger::LogWarn("Dropping bodies needs a loaded model");
+    return;
+  }
+  // bodies can only be added between batches
+  if (physicsJob) {
+    jobs::JobSystem::GetInstance().Wait(physicsJob);
+    physicsJob.reset();
+  }
+
+  const camera::Aabb& bounds = models.front()->Bounds();
+  const glm::vec3 extent = glm::max(bounds.max - bounds.min, glm::vec3(1e-3f));
+  const float fit = 1.0f / std::max({extent.x, extent.y, extent.z});
+  if (!droppedModels) {
+    droppedModels = std::make_unique<models::ModelInstances>(models.front());
+    droppedModelOffset =
+        glm::translate(glm::scale(glm::mat4(1.0f), glm::vec3(fit)),
+                       -0.5f * (bounds.min + bounds.max));
+  }
+
+  terrain::RayHit hit;
+  hit.position = cameraPos;
+  heightPyramid->Raycast(cameraPos, cameraFront, zfar, hit);
+
+  std::mt19937 random(static_cast<uint32_t>(physicsWorld->BodyCount()));
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  physics::BodyDesc desc;
+  desc.shape = physics::Shape::Box(0.5f * fit * extent);
+  for (int i = 0; i < 100; i++) {
+    desc.position = hit.position + glm::vec3(1.5f * (i % 10 - 4.5f),
+                                             4.0f + unit(random),
+                                             1.5f * (i / 10 - 4.5f));
+    desc.orientation = glm::angleAxis(
+        3.1415927f * unit(random),
+        glm::normalize(glm::vec3(unit(random), 2.0f, unit(random))));
+    physicsWorld->AddBody(desc);
+  }
+  physicsClock = std::chrono::steady_clock::now();
+  LOG_INFO("Dropped 100 bodies, " + std::to_string(physicsWorld->BodyCount()) +
+           " in the world");
+}
+
+void TerrainGenerator::RecordModels(const camera::Frustum* frustum) {
+  size_t ready = 0;
+  for (auto& entry : models) {
+    if (entry->IsReady()) {
+      ready++;
+    } else {
+      entry->Record(renderQueue, *shaderProgram, model);
+    }
+  }
+
+  // models finish loading in any order, place them all again when one does
+  if (ready != placedModels) {
+    placements.clear();
+    std::vector<camera::Aabb> boxes;
+    for (size_t i = 0; i < models.size(); i++) {
+      if (!models[i]->IsReady()) {
+        continue;
+      }
+      const auto& meshes = models[i]->Meshes();
+      for (unsigned int mesh = 0; mesh < meshes.size(); mesh++) {
+        for (auto& placement : models[i]->Graph().Instances(mesh)) {
+          placements.push_back(MeshPlacement{i, mesh, model * placement});
+          boxes.push_back(
+              meshes[mesh].Bounds().Transformed(placements.back().transform));
+        }
+      }
+    }
+    placementHierarchy.Build(boxes);
+    placedModels = ready;
+  }
+
+  if (frustum) {
+    placementHierarchy.Cull(*frustum, visiblePlacements);
+  } else {
+    visiblePlacements.resize(placements.size());
+    for (uint32_t i = 0; i < visiblePlacements.size(); i++) {
+      visiblePlacements[i] = i;
+    }
+  }
+
+  for (uint32_t i : visiblePlacements) {
+    const MeshPlacement& placement = placements[i];
+    renderQueue.Submit(*shaderProgram,
+                       models[placement.model]->Meshes()[placement.mesh],
+                       placement.transform);
+  }
+}
+
+void TerrainGenerator::LogRenderStats() {
+  auto& stats = renderQueue.Stats();
+  LOG_INFO("Render queue: draws=" + std::to_string(stats.commands) +
+           " programs=" + std::to_string(stats.programChanges) + " materials=" +
+           std::to_string(stats.materialChanges) + " meshes=" +
+           std::to_string(stats.meshChanges) + " state changes=" +
+           std::to_string(stats.StateChanges()) + " unsorted=" +
+           std::to_string(stats.unsortedChanges) + " saved=" +
+           std::to_string(stats.Saved()) + " sort=" +
+           std::to_string(stats.sortMs) + "ms" + " submit=" +
+           std::to_string(stats.submitMs) + "ms");
+
+  auto textures = resources::ResourceManager::GetManager().TextureStats();
+  LOG_INFO("Textures: resident=" + std::to_string(textures.entries) +
+           " bytes=" + std::to_string(textures.residentBytes >> 20) + "/" +
+           std::to_string(textures.budgetBytes >> 20) + "MB peak=" +
+           std::to_string(textures.peakBytes >> 20) + "MB evictions=" +
+           std::to_string(textures.evictions) + " upgrades=" +
+           std::to_string(textures.upgrades) + " streaming=" +
+           std::to_string(textures.pendingUpgrades));
+
+  // the counters belong to the worker while a batch runs
+  if (water && (!waterJob || waterJob->IsFinished())) {
+    LOG_INFO("Water: steps=" + std::to_string(water->Steps()) +
+             " activeTiles=" + std::to_string(water->ActiveTiles()) + "/" +
+             std::to_string(water->TilesX() * water->TilesZ()) + " volume=" +
+             std::to_string(water->Volume()) + " uploads=" +
+             std::to_string(waterRenderer->Uploads()) + " path=" +
+             terrain::ShallowWater::SimdPath());
+  }
+
+  if (physicsWorld && (!physicsJob || physicsJob->IsFinished())) {
+    auto& physics = physicsWorld->Stats();
+    LOG_INFO("Physics: bodies=" + std::to_string(physicsWorld->BodyCount()) +
+             " steps=" + std::to_string(physicsWorld->Steps()) + " pairs=" +
+             std::to_string(physics.pairs) + " contacts=" +
+             std::to_string(physics.contacts) + " colors=" +
+             std::to_string(physics.colors) + " broadphase=" +
+             std::to_string(physics.broadphaseMilliseconds) +
+             "ms narrowphase=" +
+             std::to_string(physics.narrowphaseMilliseconds) + "ms solver=" +
+             std::to_string(physics.solverMilliseconds) + "ms step=" +
+             std::to_string(physics.stepMilliseconds) + "ms");
+  }
+}
+
+// Times culling copies of the first model scattered over the terrain against
+// the current view, through the hierarchy and one box at a time, and checks
+// both find the same copies. CPU only, nothing is drawn.
+void TerrainGenerator::BenchmarkCulling() {
+  camera::Aabb bounds{glm::vec3(-0.5f), glm::vec3(0.5f)};
+  if (!models.empty() && models.front()->IsReady()) {
+    bounds = models.front()->Bounds();
+  }
+
+  const camera::Frustum frustum(projection * view);
+  for (size_t count : {1000, 10000, 100000, 1000000}) {
+    std::vector<camera::Aabb> boxes;
+    boxes.reserve(count);
+    for (auto& instance : ScatterInstances(count, 11)) {
+      boxes.push_back(bounds.Transformed(instance.transform));
+    }
+
+    if (!camera::ReportCullingBenchmark(boxes, frustum)) {
+      logging::Logger::LogError(
+          "Culling mismatch: the hierarchy and the brute force reference "
+          "disagree on " +
+          std::to_string(count) + " boxes");
+    }
   }
 }
 
@@ -165,14 +1188,68 @@ void TerrainGenerator::handleKeyboardEvent(GLFWwindow* window,
     polygonMode = (polygonMode + 1) % 2;
     glPolygonMode(GL_FRONT_AND_BACK, polygonModes[polygonMode]);
   }
+  if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+    BenchmarkInstancing();
+  }
+  if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+    BenchmarkCulling();
+  }
+  if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+    BenchmarkTextureCompression(noiseParameters);
+  }
+  if (key == GLFW_KEY_U && action == GLFW_PRESS) {
+    BenchmarkUniforms();
+  }
+  if (key == GLFW_KEY_E && action == GLFW_PRESS) {
+    BenchmarkErosion();
+  }
+  if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+    BenchmarkRaycasts();
+  }
+  if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+    cameraFollowTerrain = !cameraFollowTerrain;
+    LOG_INFO("Camera follows terrain: " + std::to_string(cameraFollowTerrain));
+  }
+  if (key == GLFW_KEY_R && action == GLFW_PRESS && water) {
+    // a spring where the camera looks, or under it when the view misses
+    // the ground; pressed again it dries up
+    const float origin = GridOrigin();
+    terrain::RayHit hit;
+    hit.position = cameraPos;
+    heightPyramid->Raycast(cameraPos, cameraFront, zfar, hit);
+    waterSpring = !waterSpring;
+    waterSource.x = (hit.position.x - origin) / terrainSpacing;
+    waterSource.z = (hit.position.z - origin) / terrainSpacing;
+    LOG_INFO(std::string("Water spring ") + (waterSpring ? "on" : "off"));
+  }
+  if (key == GLFW_KEY_K && action == GLFW_PRESS) {
+    DropBodies();
+  }
+  if (key == GLFW_KEY_I && action == GLFW_PRESS && scatteredModels) {
+    instancedRendering = !instancedRendering;
+    LOG_INFO("Instanced rendering: " + std::to_string(instancedRendering));
+  }
+  if (key == GLFW_KEY_L && action == GLFW_PRESS) {
+    LogChunkStats();
+    LogRenderStats();
+    jobs::JobSystem::GetInstance().LogStats();
+  }
 }
 
 void TerrainGenerator::processInput(GLFWwindow* window) {
+  // walking moves level whatever the pitch, the ground sets the height
+  const bool walking = cameraFollowTerrain &&
+                       heightPyramid->Contains(cameraPos.x, cameraPos.z);
+  glm::vec3 forward = cameraFront;
+  if (walking && (forward.x != 0.0f || forward.z != 0.0f)) {
+    forward = glm::normalize(glm::vec3(forward.x, 0.0f, forward.z));
+  }
+
   if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-    cameraPos += cameraFront * speed;
+    cameraPos += forward * speed;
   }
   if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-    cameraPos -= cameraFront * speed;
+    cameraPos -= forward * speed;
   }
   if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
     cameraPos -= glm::normalize(glm::cross(cameraFront, cameraUp)) * speed;
@@ -180,4 +1257,12 @@ void TerrainGenerator::processInput(GLFWwindow* window) {
   if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
     cameraPos += glm::normalize(glm::cross(cameraFront, cameraUp)) * speed;
   }
+
+  // outside the heightfield there is no ground to stand on, streamed
+  // chunks beyond it are flown over
+  if (cameraFollowTerrain &&
+      heightPyramid->Contains(cameraPos.x, cameraPos.z)) {
+    cameraPos.y =
+        heightPyramid->Height(cameraPos.x, cameraPos.z) + cameraEyeHeight;
+  }
 }
\ No newline at end of file
@@ -0,0 +1,346 @@
+
+#include <JobSystem.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+#include <Logger.hpp>
+
+using namespace jobs;
+
+namespace {
+// Identifies the scheduler and deque owned by the current worker thread.
+thread_local JobSystem* currentSystem = nullptr;
+thread_local size_t currentWorker = 0;
+
+using Clock = std::chrono::steady_clock;
+}  // namespace
+
+void JobSystem::WorkQueue::Push(JobHandle job) {
+  std::lock_guard<std::mutex> lock(mutex);
+  jobs.push_back(std::move(job));
+}
+
+JobHandle JobSystem::WorkQueue::Pop() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (jobs.empty()) {
+    return nullptr;
+  }
+  JobHandle job = std::move(jobs.back());
+  jobs.pop_back();
+  return job;
+}
+
+JobHandle JobSystem::WorkQueue::Steal() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (jobs.empty()) {
+    return nullptr;
+  }
+  JobHandle job = std::move(jobs.front());
+  jobs.pop_front();
+  return job;
+}
+
+JobSystem::JobSystem(unsigned int workerCount)
+    : mainThread{std::this_thread::get_id()}, statsStart{Clock::now()} {
+  if (workerCount == 0) {
+    unsigned int cores = std::thread::hardware_concurrency();
+    workerCount = cores > 1 ? cores - 1 : 1;
+  }
+
+  for (unsigned int i = 0; i <= workerCount; i++) {
+    queues.push_back(std::make_unique<WorkQueue>());
+  }
+  for (unsigned int i = 0; i < workerCount; i++) {
+    counters.push_back(std::make_unique<WorkerCounters>());
+  }
+  for (unsigned int i = 0; i < workerCount; i++) {
+    threads.emplace_back(&JobSystem::WorkerLoop, this, i);
+  }
+
+  LOG_INFO("Job system started with " + std::to_string(workerCount) +
+           " workers");
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+JobSystem& JobSystem::GetInstance() {
+  static JobSystem instance;
+  return instance;
+}
+
+size_t JobSystem::CurrentQueue() const {
+  return currentSystem == this ? currentWorker : InjectionQueue();
+}
+
+void JobSystem::WorkerLoop(size_t index) {
+  currentSystem = this;
+  currentWorker = index;
+
+  while (!stopping) {
+    if (JobHandle job = Find(index)) {
+      Execute(job, index);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    wake.wait(lock, [this] { return stopping || queued.load() > 0; });
+  }
+}
+
+JobHandle JobSystem::Find(size_t index) {
+  // own work first, newest first while it is still warm in cache
+  JobHandle job = index == InjectionQueue() ? nullptr : queues[index]->Pop();
+
+  // then steal the oldest work from everyone else, injection queue included
+  for (size_t i = 1; !job && i <= queues.size(); i++) {
+    size_t victim = (index + i) % queues.size();
+    job = queues[victim]->Steal();
+    if (job && index < counters.size()) {
+      counters[index]->steals++;
+    }
+  }
+
+  if (job) {
+    queued--;
+  }
+  return job;
+}
+
+void JobSystem::Execute(const JobHandle& job, size_t index) {
+  auto start = Clock::now();
+  // a job whose dependency failed is skipped, the error passes through it
+  if (!job->error) {
+    try {
+      job->work();
+    } catch (...) {
+      job->error = std::current_exception();
+    }
+  }
+  job->work = nullptr;
+
+  if (index < counters.size()) {
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - start);
+    counters[index]->busyNanoseconds += elapsed.count();
+    counters[index]->jobs++;
+  }
+
+  std::vector<JobHandle> ready;
+  {
+    std::lock_guard<std::mutex> lock(job->continuationMutex);
+    job->finished.store(true, std::memory_order_release);
+    ready.swap(job->continuations);
+  }
+
+  for (auto& continuation : ready) {
+    if (job->error) {
+      std::lock_guard<std::mutex> lock(continuation->continuationMutex);
+      if (!continuation->error) {
+        continuation->error = job->error;
+      }
+    }
+    if (continuation->unfinishedDependencies.fetch_sub(1) == 1) {
+      Schedule(continuation);
+    }
+  }
+}
+
+void JobSystem::Schedule(const JobHandle& job) {
+  if (job->mainThread) {
+    std::lock_guard<std::mutex> lock(mainMutex);
+    mainJobs.push_back(job);
+    return;
+  }
+
+  // counted before it is visible so the counter never underflows
+  queued++;
+  queues[CurrentQueue()]->Push(job);
+
+  { std::lock_guard<std::mutex> lock(sleepMutex); }
+  wake.notify_one();
+}
+
+JobHandle JobSystem::Create(std::function<void()> work,
+                            const std::vector<JobHandle>& dependencies,
+                            bool mainThread) {
+  auto job = std::make_shared<Job>();
+  job->work = std::move(work);
+  job->mainThread = mainThread;
+
+  for (auto& dependency : dependencies) {
+    if (!dependency) {
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(dependency->continuationMutex);
+    if (!dependency->IsFinished()) {
+      job->unfinishedDependencies++;
+      dependency->continuations.push_back(job);
+    } else if (dependency->error) {
+      // an earlier dependency may be failing the job at the same time
+      std::lock_guard<std::mutex> jobLock(job->continuationMutex);
+      if (!job->error) {
+        job->error = dependency->error;
+      }
+    }
+  }
+
+  // drop the creation guard, schedules the job if nothing is outstanding
+  if (job->unfinishedDependencies.fetch_sub(1) == 1) {
+    Schedule(job);
+  }
+  return job;
+}
+
+JobHandle JobSystem::Submit(std::function<void()> work,
+                            const std::vector<JobHandle>& dependencies) {
+  return Create(std::move(work), dependencies, false);
+}
+
+JobHandle JobSystem::SubmitMainThread(
+    std::function<void()> work,
+    const std::vector<JobHandle>& dependencies) {
+  return Create(std::move(work), dependencies, true);
+}
+
+bool JobSystem::RunMainThreadJob() {
+  JobHandle job;
+  {
+    std::lock_guard<std::mutex> lock(mainMutex);
+    if (mainJobs.empty()) {
+      return false;
+    }
+    job = std::move(mainJobs.front());
+    mainJobs.pop_front();
+  }
+  Execute(job, InjectionQueue());
+  return true;
+}
+
+bool JobSystem::RunMainThreadJob(const JobHandle& job) {
+  {
+    std::lock_guard<std::mutex> lock(mainMutex);
+    auto queued = std::find(mainJobs.begin(), mainJobs.end(), job);
+    if (queued == mainJobs.end()) {
+      return false;
+    }
+    mainJobs.erase(queued);
+  }
+  Execute(job, InjectionQueue());
+  return true;
+}
+
+void JobSystem::Wait(const JobHandle& job) {
+  const size_t index = CurrentQueue();
+  // other main thread jobs wait for RunMainThreadJobs, running them here
+  // would re-enter whatever GL thread code is waiting
+  const bool runsHere =
+      job->mainThread && std::this_thread::get_id() == mainThread;
+
+  while (!job->IsFinished()) {
+    if (runsHere && RunMainThreadJob(job)) {
+      continue;
+    }
+    if (JobHandle other = Find(index)) {
+      Execute(other, index);
+      continue;
+    }
+    std::this_thread::yield();
+  }
+
+  if (job->error) {
+    std::rethrow_exception(job->error);
+  }
+}
+
+JobHandle JobSystem::ParallelForAsync(
+    int begin,
+    int end,
+    int grain,
+    std::function<void(int, int)> body,
+    const std::vector<JobHandle>& dependencies) {
+  grain = std::max(grain, 1);
+  auto shared = std::make_shared<std::function<void(int, int)>>(std::move(body));
+
+  std::vector<JobHandle> ranges;
+  for (int first = begin; first < end; first += std::min(grain, end - first)) {
+    int last = first + std::min(grain, end - first);
+    ranges.push_back(
+        Submit([shared, first, last]() { (*shared)(first, last); },
+               dependencies));
+  }
+
+  if (ranges.empty()) {
+    return Submit([]() {}, dependencies);
+  }
+  return Submit([]() {}, ranges);
+}
+
+void JobSystem::ParallelFor(int begin,
+                            int end,
+                            int grain,
+                            std::function<void(int, int)> body) {
+  Wait(ParallelForAsync(begin, end, grain, std::move(body)));
+}
+
+size_t JobSystem::RunMainThreadJobs(double budgetMilliseconds) {
+  auto start = Clock::now();
+  size_t count = 0;
+  while (RunMainThreadJob()) {
+    count++;
+    std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+    if (elapsed.count() >= budgetMilliseconds) {
+      break;
+    }
+  }
+  return count;
+}
+
+std::vector<WorkerStats> JobSystem::Stats() const {
+  std::chrono::duration<double> elapsed = Clock::now() - statsStart;
+
+  std::vector<WorkerStats> result;
+  for (auto& counter : counters) {
+    WorkerStats stats;
+    stats.jobs = counter->jobs;
+    stats.steals = counter->steals;
+    stats.busySeconds = counter->busyNanoseconds * 1e-9;
+    stats.utilization =
+        elapsed.count() > 0.0 ? stats.busySeconds / elapsed.count() : 0.0;
+    result.push_back(stats);
+  }
+  return result;
+}
+
+void JobSystem::ResetStats() {
+  for (auto& counter : counters) {
+    counter->jobs = 0;
+    counter->steals = 0;
+    counter->busyNanoseconds = 0;
+  }
+  statsStart = Clock::now();
+}
+
+void JobSystem::LogStats() {
+  auto stats = Stats();
+  for (size_t i = 0; i < stats.size(); i++) {
+    char utilization[16];
+    std::snprintf(utilization, sizeof(utilization), "%.1f%%",
+                  stats[i].utilization * 100.0);
+    LOG_INFO("Worker " + std::to_string(i) + ": " +
+             std::to_string(stats[i].jobs) + " jobs, " +
+             std::to_string(stats[i].steals) + " steals, " + utilization +
+             " busy");
+  }
+  ResetStats();
+}
@@ -10,34 +10,212 @@
 
 #include <Logger.hpp>
 #include <Asset.hpp>
+#include <Cdlod.hpp>
+#include <Erosion.hpp>
+#include <HeightPyramid.hpp>
+#include <Model.hpp>
+#include <Noise.hpp>
+#include <Physics.hpp>
+#include <TerrainMesh.hpp>
+#include <VertexFormat.hpp>
+#include <ResidencyCache.hpp>
+#include <ResourceRegistry.hpp>
+
+namespace {
+
+// Drops bodies onto a default noise terrain and logs the step time for each
+// body count. Fails when the threaded steps drift from the serial ones.
+bool BenchmarkPhysics() {
+  const int size = 512;
+  const float spacing = 0.25f;
+  const float origin = -0.5f * spacing * (size - 1);
+  terrain::Heightfield field{size, size};
+  terrain::NoiseGenerator{terrain::NoiseParameters{}}.Generate(
+      field, origin, origin, spacing);
+  const terrain::HeightPyramid ground{field, 40.0f, spacing, origin, origin};
+
+  bool passed = true;
+  for (auto& result :
+       physics::BenchmarkPhysics(ground, {1000, 2000, 4000, 8000}, 180)) {
+    LOG_INFO("Physics: bodies=" + std::to_string(result.bodies) + " threads=" +
+             std::to_string(result.threads) + " serial=" +
+             std::to_string(result.serialMilliseconds) + "ms" + " parallel=" +
+             std::to_string(result.parallelMilliseconds) + "ms" + " pairs=" +
+             std::to_string(result.pairs) + " contacts=" +
+             std::to_string(result.contacts));
+    if (!result.matches) {
+      logging::Logger::LogError("Physics: threaded steps differ from serial");
+      passed = false;
+    }
+  }
+  return passed;
+}
+
+// Casts rays over a default noise terrain through the height pyramid and by
+// marching. Fails when a pyramid hit disagrees with the marching one.
+bool BenchmarkRaycasts() {
+  const int size = 512;
+  const float spacing = 0.25f;
+  const float first = static_cast<float>(-(size / 2));
+  terrain::Heightfield field{size, size};
+  terrain::NoiseGenerator{
+      terrain::GridParameters(terrain::NoiseParameters{}, spacing)}
+      .Generate(field, first, first, 1.0f);
+  const terrain::HeightPyramid pyramid{field, 40.0f, spacing, first * spacing,
+                                       first * spacing};
+  return terrain::ReportRaycastBenchmark(pyramid, 100000, 7);
+}
+
+// Erodes a default noise terrain with a fixed seed on 1, 2, 4... threads and
+// logs the droplet rate of each. Fails when any thread count gives different
+// heights from the scalar reference.
+bool BenchmarkErosion() {
+  const int size = 512;
+  const float spacing = 0.25f;
+  const float first = static_cast<float>(-(size / 2));
+  terrain::Heightfield field{size, size};
+  terrain::NoiseGenerator{
+      terrain::GridParameters(terrain::NoiseParameters{}, spacing)}
+      .Generate(field, first, first, 1.0f);
+
+  terrain::ErosionSettings settings;
+  settings.seed = 1337;
+  settings.verticalScale = 40.0f / spacing;
+
+  bool passed = true;
+  double single = 0.0;
+  for (auto& result : terrain::BenchmarkErosion(field, settings)) {
+    if (result.threads == 1) {
+      single = result.milliseconds;
+    }
+    LOG_INFO("Erosion: threads=" + std::to_string(result.threads) + " simd=" +
+             terrain::HydraulicErosion::SimdPath() + " time=" +
+             std::to_string(result.milliseconds) + "ms" + " droplets/s=" +
+             std::to_string(static_cast<size_t>(result.dropletsPerSecond)) +
+             " speedup=" + std::to_string(single / result.milliseconds));
+    if (!result.matches) {
+      logging::Logger::LogError("Erosion: " + std::to_string(result.threads) +
+                                " threads differ from the reference");
+      passed = false;
+    }
+  }
+  return passed;
+}
+}  // namespace
 
 int main(int argc, const char* argv[]) {
+  // headless checks, they run without a window or a GL context
+  if (argc == 2 && std::string(argv[1]) == "--check-noise") {
+    const bool passed = terrain::CheckNoise();
+    logging::Logger::GetInstance().Flush();
+    return passed ? 0 : 1;
+  }
+  if (argc == 2 && std::string(argv[1]) == "--check-residency") {
+    const bool passed = resources::CheckResidencyCache();
+    logging::Logger::GetInstance().Flush();
+    return passed ? 0 : 1;
+  }
+  if (argc == 2 && std::string(argv[1]) == "--check-registry") {
+    const bool passed = resources::CheckResourceRegistry();
+    logging::Logger::GetInstance().Flush();
+    return passed ? 0 : 1;
+  }
+  if (argc == 2 && std::string(argv[1]) == "--check-vertex-format") {
+    const bool passed = models::CheckVertexFormat();
+    logging::Logger::GetInstance().Flush();
+    return passed ? 0 : 1;
+  }
+  if (argc == 2 && std::string(argv[1]) == "--check-culling") {
+    const bool passed = camera::CheckCulling();
+    logging::Logger::GetInstance().Flush();
+    return passed ? 0 : 1;
+  }
+  if (argc == 2 && std::string(argv[1]) == "--check-lod") {
+    const bool passed = terrain::CheckLod();
+    logging::Logger::GetInstance().Flush();
+    return passed ? 0 : 1;
+  }
+  if (argc == 2 && std::string(argv[1]) == "--check-terrain-vertices") {
+    const bool passed = terrain::CheckTerrainVertices();
+    logging::Logger::GetInstance().Flush();
+    return passed ? 0 : 1;
+  }
+  // needs a GL context, it opens a hidden window of its own
+  if (argc == 2 && std::string(argv[1]) == "--check-model-instancing") {
+    const bool passed = models::CheckModelInstancing();
+    logging::Logger::GetInstance().Flush();
+    return passed ? 0 : 1;
+  }
+  if (argc == 2 && std::string(argv[1]) == "--benchmark-physics") {
+    const bool passed = BenchmarkPhysics();
+    logging::Logger::GetInstance().Flush();
+    return passed ? 0 : 1;
+  }
+  if (argc == 2 && std::string(argv[1]) == "--benchmark-raycast") {
+    const bool passed = BenchmarkRaycasts();
+    logging::Logger::GetInstance().Flush();
+    return passed ? 0 : 1;
+  }
+  if (argc == 2 && std::string(argv[1]) == "--benchmark-erosion") {
+    const bool passed = BenchmarkErosion();
+    logging::Logger::GetInstance().Flush();
+    return passed ? 0 : 1;
+  }
+  if (argc == 2 &&
+      std::string(argv[1]) == "--benchmark-texture-compression") {
+    TerrainGenerator::BenchmarkTextureCompression(terrain::NoiseParameters{});
+    logging::Logger::GetInstance().Flush();
+    return 0;
+  }
+  // these need the shaders and models of the application, they open its
+  // window with the default config but never enter the frame loop
+  if (argc == 2 && (std::string(argv[1]) == "--benchmark-instancing" ||
+                    std::string(argv[1]) == "--benchmark-uniforms")) {
+    config::ConfigReader configReader{asset::Asset::CONFIG_PATH};
+    TerrainGenerator app{configReader};
+    const bool passed =
+        app.RunBenchmark(std::string(argv[1]) == "--benchmark-instancing"
+                             ? "instancing"
+                             : "uniforms");
+    logging::Logger::GetInstance().Flush();
+    return passed ? 0 : 1;
+  }
+
   std::string configPath = asset::Asset::CONFIG_PATH;
   if (argc == 2) {
     configPath = argv[1];
   }
 
   config::ConfigReader configReader{configPath};
+  auto config = configReader.Snapshot();
 
   // Check this setting first before logging configuration being loadded.
-  if (configReader.ContainsKey("infoLoggingEnabled")) {
+  if (config->ContainsKey("infoLoggingEnabled")) {
     logging::Logger::GetInstance().SetEnabled(
-        logging::INF, configReader.ReadBool("infoLoggingEnabled"));
+        logging::INF, config->ReadBool("infoLoggingEnabled"));
   }
 
-  logging::Logger::LogInfo("Config loaded from " + configPath);
+  LOG_INFO("Config loaded from " + configPath);
 
-  if (configReader.ContainsKey("debugLoggingEnabled")) {
-    auto value = configReader.ReadBool("debugLoggingEnabled");
-    logging::Logger::GetInstance().SetEnabled(
-        logging::DBG, configReader.ReadBool("debugLoggingEnabled"));
-    logging::Logger::LogInfo(
-        "Overriding default debug logging enabled value: " +
-        std::to_string(value));
+  if (config->ContainsKey("debugLoggingEnabled")) {
+    auto value = config->ReadBool("debugLoggingEnabled");
+    logging::Logger::GetInstance().SetEnabled(logging::DBG, value);
+    LOG_INFO("Overriding default debug logging enabled value: " +
+             std::to_string(value));
   }
 
+  if (config->ContainsKey("binaryLogPath")) {
+    auto path = config->ReadString("binaryLogPath");
+    logging::Logger::GetInstance().OpenBinaryLog(path);
+    LOG_INFO("Writing a binary log to " + path);
+  }
+
+  // edits to the file are picked up while running
+  configReader.StartWatching();
+
   TerrainGenerator app{configReader};
   app.run();
 
+  logging::Logger::GetInstance().Flush();
   return 0;
 }